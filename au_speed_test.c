@@ -0,0 +1,228 @@
+#include <assert.h>
+#include <errno.h>
+#include <linux/fs.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "au_speed_test.h"
+#include "buffer_pool.h"
+#include "device.h"
+#include "io_watchdog.h"
+#include "messages.h"
+#include "mfst.h"
+#include "ncurses.h"
+#include "rng.h"
+#include "util.h"
+
+/**
+ * Displays a dialog to the user indicating that the AU speed test encountered
+ * an I/O error, and logs the error.  This function blocks until the user
+ * dismisses the dialog.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param errnum                  The error number of the error that occurred.
+ */
+static void io_error_during_au_speed_test(device_testing_context_type *device_testing_context, int errnum) {
+    log_log(device_testing_context, "probe_au_write_speeds", SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR, strerror(errnum));
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_AU_SPEED_TEST_ABORTING_DEVICE_ERROR);
+
+    message_window(device_testing_context, stdscr, WARNING_TITLE,
+                   "We ran into an error during the AU speed test.  It could "
+                   "be that the device was removed, experienced an error and "
+                   "disconnected itself, or set itself to read-only.  The "
+                   "speed class results will be based on the other speed "
+                   "tests instead -- but if the device really has been "
+                   "removed or set to read-only, the remainder of the tests "
+                   "are going to fail pretty quickly.", 1);
+}
+
+/**
+ * Writes a single AU, one recording unit at a time, and measures how long it
+ * took.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param buf                     A buffer holding AU_SPEED_TEST_LARGE_RU_SIZE
+ *                                bytes of data to write.  The same data is
+ *                                written to each AU_SPEED_TEST_LARGE_RU_SIZE
+ *                                bytes of the AU.
+ * @param position                The byte offset of the AU.
+ * @param au_size                 The size of the AU, in bytes.
+ * @param ru_size                 The size of the recording units, in bytes.
+ * @param elapsed                 A pointer to a variable that receives the
+ *                                time it took to write the AU, in
+ *                                microseconds.
+ *
+ * @returns 0 if the AU was written successfully, or -1 if it was not.  On
+ *          error, errno is set to the underlying error.
+ */
+static int timed_au_write(device_testing_context_type *device_testing_context, char *buf, uint64_t position, uint64_t au_size, uint64_t ru_size, time_t *elapsed) {
+    struct timeval start_time, end_time;
+    uint64_t ru, bytes_left;
+    int64_t ret;
+
+    assert(!gettimeofday(&start_time, NULL));
+
+    for(ru = 0; ru < au_size; ru += ru_size) {
+        for(bytes_left = ru_size; bytes_left; bytes_left -= ret) {
+            ret = io_watchdog_write(device_testing_context, buf + ((ru + (ru_size - bytes_left)) % AU_SPEED_TEST_LARGE_RU_SIZE), bytes_left, position + ru + (ru_size - bytes_left));
+            if(ret == -1) {
+                return -1;
+            } else if(!ret) {
+                errno = EIO;
+                return -1;
+            }
+        }
+    }
+
+    assert(!gettimeofday(&end_time, NULL));
+    *elapsed = timediff(start_time, end_time);
+
+    return 0;
+}
+
+int probe_au_write_speeds(device_testing_context_type *device_testing_context) {
+    struct timeval cur_time;
+    char *buf;
+    char rate[15], avg_rate[15];
+    const char *au_size_source;
+    uint64_t au_size, num_device_aus, position, range[2];
+    time_t elapsed;
+    double speed;
+    int i, total_aus, prev_percent, cur_percent, local_errno, discard_failed;
+    au_speed_test_info_type *info = &device_testing_context->au_speed_test_info;
+    au_speed_test_result_type *result;
+    WINDOW *window;
+
+    if(program_options.au_size) {
+        au_size = program_options.au_size;
+        au_size_source = "given on the command line";
+    } else if((au_size = get_device_au_size(device_testing_context->device_info.device_num))) {
+        au_size_source = "reported by the card";
+    } else {
+        au_size = device_testing_context->device_info.logical_size <= (32ULL * 1073741824ULL) ? AU_SPEED_TEST_DEFAULT_SDHC_AU_SIZE : AU_SPEED_TEST_DEFAULT_SDXC_AU_SIZE;
+        au_size_source = "assumed";
+    }
+
+    // Every AU has to hold a whole number of the larger recording units
+    au_size = (au_size / AU_SPEED_TEST_LARGE_RU_SIZE) * AU_SPEED_TEST_LARGE_RU_SIZE;
+    if(!au_size) {
+        au_size = AU_SPEED_TEST_LARGE_RU_SIZE;
+    }
+
+    num_device_aus = (device_testing_context->device_info.num_physical_sectors * device_testing_context->device_info.sector_size) / au_size;
+    if(num_device_aus < 2) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_AU_SPEED_TEST_DEVICE_TOO_SMALL);
+        errno = ENOSPC;
+        return -1;
+    }
+
+    total_aus = num_device_aus < (AU_SPEED_TEST_NUM_AUS * 2) ? num_device_aus : (AU_SPEED_TEST_NUM_AUS * 2);
+
+    if(!(buf = buffer_pool_get(device_testing_context, AU_SPEED_TEST_LARGE_RU_SIZE))) {
+        local_errno = errno;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, (uint64_t) AU_SPEED_TEST_LARGE_RU_SIZE, strerror(local_errno));
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_AU_SPEED_TEST_ABORTING_MEM_ALLOC_ERROR);
+
+        message_window(device_testing_context, stdscr, WARNING_TITLE,
+                       "We ran into an error while trying to allocate memory "
+                       "for the AU speed test.  This could mean your system is "
+                       "low on memory.  The speed class results will be based "
+                       "on the other speed tests instead.", 1);
+
+        errno = local_errno;
+        return -1;
+    }
+
+    memset(info, 0, sizeof(au_speed_test_info_type));
+    info->au_size = au_size;
+    info->small_ru.ru_size = AU_SPEED_TEST_SMALL_RU_SIZE;
+    info->large_ru.ru_size = AU_SPEED_TEST_LARGE_RU_SIZE;
+
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_AU_SPEED_TEST_STARTING, au_size, au_size_source, total_aus / 2);
+    window = message_window(device_testing_context, stdscr, "Measuring AU write speeds",
+        "\n                                        ", // Make room for the progress bar
+    0);
+
+    assert(!gettimeofday(&cur_time, NULL));
+    rng_init(device_testing_context, cur_time.tv_sec + cur_time.tv_usec);
+
+    discard_failed = 0;
+    prev_percent = 0;
+
+    // Alternate between the two recording unit sizes so that both sets of AUs
+    // are spread out across the whole device
+    for(i = 0; i < total_aus; i++) {
+        handle_key_inputs(device_testing_context, window);
+
+        result = (i % 2) ? &info->large_ru : &info->small_ru;
+        position = ((i * num_device_aus) / total_aus) * au_size;
+
+        // The performance model assumes the AU is free before it's written
+        range[0] = position;
+        range[1] = au_size;
+        if(ioctl(device_testing_context->device_info.fd, BLKDISCARD, &range) && !discard_failed) {
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_AU_SPEED_TEST_DISCARD_ERROR, strerror(errno));
+            discard_failed = 1;
+        }
+
+        rng_fill_buffer(device_testing_context, buf, AU_SPEED_TEST_LARGE_RU_SIZE);
+
+        if(timed_au_write(device_testing_context, buf, position, au_size, result->ru_size, &elapsed)) {
+            local_errno = errno;
+            buffer_pool_put(device_testing_context, buf);
+            erase_and_delete_window(window);
+
+            io_error_during_au_speed_test(device_testing_context, local_errno);
+
+            errno = local_errno;
+            return -1;
+        }
+
+        speed = ((double) au_size) / (((double) (elapsed ? elapsed : 1)) / 1000000.0);
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_AU_SPEED_TEST_AU_RESULT, position, result->ru_size, format_rate(speed, rate, sizeof(rate)));
+
+        if(!result->num_aus || speed < result->min_write_speed) {
+            result->min_write_speed = speed;
+            result->slowest_au = position;
+        }
+
+        // Keep a running total for now; it gets turned into an average below
+        result->avg_write_speed += speed;
+        result->num_aus++;
+
+        cur_percent = ((i + 1) * 40) / total_aus;
+        if(cur_percent != prev_percent) {
+            // Advance the graph
+            if(!program_options.no_curses) {
+                wattron(window, COLOR_PAIR(BLACK_ON_GREEN));
+                mvwprintw(window, 2, 2, "%*s", cur_percent, "");
+                wattroff(window, COLOR_PAIR(BLACK_ON_GREEN));
+                touchwin(stdscr);
+                wrefresh(window);
+            }
+
+            prev_percent = cur_percent;
+        }
+    }
+
+    buffer_pool_put(device_testing_context, buf);
+    erase_and_delete_window(window);
+
+    for(i = 0; i < 2; i++) {
+        result = i ? &info->large_ru : &info->small_ru;
+        result->avg_write_speed /= result->num_aus;
+
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_AU_SPEED_TEST_RESULT, result->ru_size, format_rate(result->min_write_speed, rate, sizeof(rate)), result->slowest_au,
+                format_rate(result->avg_write_speed, avg_rate, sizeof(avg_rate)));
+    }
+
+    info->test_performed = 1;
+
+    return 0;
+}
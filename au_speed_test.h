@@ -0,0 +1,43 @@
+#if !defined(AU_SPEED_TEST_H)
+#define AU_SPEED_TEST_H
+
+#include <inttypes.h>
+
+#include "device_testing_context.h"
+
+// Number of AUs written with each recording unit size
+#define AU_SPEED_TEST_NUM_AUS 16
+
+// AU sizes to assume if none was given on the command line and the card didn't
+// report one.  These are typical of SDHC (32GB and under) and SDXC cards.
+#define AU_SPEED_TEST_DEFAULT_SDHC_AU_SIZE (4 * 1048576)
+#define AU_SPEED_TEST_DEFAULT_SDXC_AU_SIZE (16 * 1048576)
+
+/**
+ * Measures the device's write speed the way the SD Association's performance
+ * model does: by writing whole allocation units (AUs), one recording unit (RU)
+ * at a time, and judging the device by its slowest AU.
+ *
+ * The AU size comes from --au-size if it was given, or from the card itself if
+ * the kernel exposes it (see get_device_au_size()).  Otherwise,
+ * AU_SPEED_TEST_DEFAULT_SDHC_AU_SIZE or AU_SPEED_TEST_DEFAULT_SDXC_AU_SIZE is
+ * assumed, depending on the size of the device.
+ *
+ * AU_SPEED_TEST_NUM_AUS AUs spread across the device are written with
+ * AU_SPEED_TEST_SMALL_RU_SIZE recording units, and another
+ * AU_SPEED_TEST_NUM_AUS with AU_SPEED_TEST_LARGE_RU_SIZE recording units.  Each
+ * AU is discarded first (if the device supports it) so that it starts out
+ * free, as the model expects.  The model's allowances for file system updates
+ * aren't simulated, so the results are a little stricter than the model's.
+ *
+ * The caller is expected to hold the lockfile.
+ *
+ * @param device_testing_context  The device to be tested.
+ *
+ * @returns 0 if the test was successful, or -1 if the test failed.  On success,
+ *          the results are placed in
+ *          device_testing_context->au_speed_test_info.
+ */
+int probe_au_write_speeds(device_testing_context_type *device_testing_context);
+
+#endif // !defined(AU_SPEED_TEST_H)
@@ -8,6 +8,8 @@
 #include <unistd.h>
 
 #include "block_size_test.h"
+#include "buffer_pool.h"
+#include "io_watchdog.h"
 #include "lockfile.h"
 #include "messages.h"
 #include "mfst.h"
@@ -96,9 +98,10 @@ int probe_for_optimal_block_size(device_testing_context_type *device_testing_con
         "\n                                        ", // Make room for the progress bar
     0);
 
-    if(local_errno = posix_memalign((void **) &buf, sysconf(_SC_PAGESIZE), buf_size)) {
+    if(!(buf = buffer_pool_get(device_testing_context, buf_size))) {
+        local_errno = errno;
         unlock_lockfile(device_testing_context);
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_POSIX_MEMALIGN_ERROR, strerror(local_errno));
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, (uint64_t) buf_size, strerror(local_errno));
         log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_OPTIMAL_BLOCK_SIZE_TEST_ABORTING_MEM_ALLOC_ERROR);
 
         erase_and_delete_window(window);
@@ -142,11 +145,11 @@ int probe_for_optimal_block_size(device_testing_context_type *device_testing_con
         for(total_bytes_written = 0; total_bytes_written < buf_size; total_bytes_written += cur_block_size) {
             cur_block_bytes_left = cur_block_size;
             while(cur_block_bytes_left) {
-                ret = write(device_testing_context->device_info.fd, buf + total_bytes_written + (cur_block_size - cur_block_bytes_left), cur_block_bytes_left);
+                ret = io_watchdog_write(device_testing_context, buf + total_bytes_written + (cur_block_size - cur_block_bytes_left), cur_block_bytes_left, total_bytes_written + (cur_block_size - cur_block_bytes_left));
                 if(ret == -1) {
                     log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR, strerror(errno));
 
-                    free(buf);
+                    buffer_pool_put(device_testing_context, buf);
                     unlock_lockfile(device_testing_context);
 
                     log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_OPTIMAL_BLOCK_SIZE_TEST_ABORTING_DEVICE_ERROR);
@@ -203,30 +206,6 @@ int probe_for_optimal_block_size(device_testing_context_type *device_testing_con
 
         assert(!gettimeofday(&end_time, NULL));
 
-        if(lseek(device_testing_context->device_info.fd, 0, SEEK_SET) == -1) {
-            local_errno = errno;
-            unlock_lockfile(device_testing_context);
-            free(buf);
-
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(local_errno));
-            log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_OPTIMAL_BLOCK_SIZE_TEST_ABORTING_DEVICE_ERROR);
-
-            erase_and_delete_window(window);
-
-            snprintf(msg_buffer, sizeof(msg_buffer),
-                     "We encountered an error while trying to probe for the "
-                     "optimal write block size.  It could be that the device "
-                     "was disconnected, or experienced an error and "
-                     "disconnected itself.  For now, we'll use other means to "
-                     "determine the optimal write block size -- but if the "
-                     "device really has been removed, the remainder of the "
-                     "tests are going to fail pretty quickly.\n\nThe error we "
-                     "got was: %s", strerror(local_errno));
-
-            message_window(device_testing_context, stdscr, WARNING_TITLE, msg_buffer, 1);
-            return -1;
-        }
-
         rates[cur_pow] = buf_size / (((double) timediff(start_time, end_time)) / 1000000);
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_OPTIMAL_BLOCK_SIZE_TEST_INDIVIDUAL_RESULT, labels[cur_pow], format_rate(rates[cur_pow], rate_buffer, sizeof(rate_buffer)));
 
@@ -241,7 +220,7 @@ int probe_for_optimal_block_size(device_testing_context_type *device_testing_con
 
     unlock_lockfile(device_testing_context);
 
-    free(buf);
+    buffer_pool_put(device_testing_context, buf);
     erase_and_delete_window(window);
 
     log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_OPTIMAL_BLOCK_SIZE_TEST_COMPLETE, 1 << (highest_rate_pow + 9));
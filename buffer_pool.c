@@ -0,0 +1,211 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "buffer_pool.h"
+#include "device_testing_context.h"
+#include "messages.h"
+#include "mfst.h"
+
+// Size of a huge page on the platforms we care about
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Buffers bigger than this (such as the scratch buffer used by the optimal
+// block size test) are only needed once, so they're unmapped as soon as
+// they're returned rather than staying locked in memory for the whole test
+#define BUFFER_POOL_MAX_RETAINED_SIZE (64 * 1024 * 1024)
+
+// Protects the pool's slots.  The queue depth sweep, workload jobs, and
+// surface scan all run worker threads alongside the main thread, so the pool
+// can't assume that only one thread is looking at it.
+static pthread_mutex_t buffer_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t round_up(size_t size, size_t multiple) {
+    return ((size + multiple - 1) / multiple) * multiple;
+}
+
+/**
+ * Maps a new buffer for the buffer pool.  Explicit huge pages are tried first;
+ * if none are available, the buffer is mapped with regular pages and the
+ * kernel is asked to back it with transparent huge pages instead.  The buffer
+ * is pre-faulted and locked into memory.
+ *
+ * @param device_testing_context  The device whose buffer pool the buffer is
+ *                                being created for.
+ * @param size                    The minimum size of the buffer, in bytes.
+ * @param mapped_size             A pointer to a variable which will receive
+ *                                the actual size of the buffer.
+ *
+ * @returns A pointer to the new buffer, or NULL if an error occurred.  On
+ *          error, errno is set to the error returned by mmap().
+ */
+static void *buffer_pool_map(device_testing_context_type *device_testing_context, size_t size, size_t *mapped_size) {
+    void *buffer = MAP_FAILED;
+
+    if(size >= HUGE_PAGE_SIZE) {
+        *mapped_size = round_up(size, HUGE_PAGE_SIZE);
+        buffer = mmap(NULL, *mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    }
+
+    if(buffer == MAP_FAILED) {
+        *mapped_size = round_up(size, sysconf(_SC_PAGESIZE));
+        buffer = mmap(NULL, *mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(buffer == MAP_FAILED) {
+            return NULL;
+        }
+
+        // It doesn't matter if this fails -- we'll just get regular pages
+        if(*mapped_size >= HUGE_PAGE_SIZE) {
+            madvise(buffer, *mapped_size, MADV_HUGEPAGE);
+        }
+
+        // Fault the pages in now rather than in the middle of the test
+        memset(buffer, 0, *mapped_size);
+    }
+
+    // Also not fatal (RLIMIT_MEMLOCK might just be too low), but only complain
+    // about it once
+    if(mlock(buffer, *mapped_size) && !device_testing_context->buffer_pool.mlock_failed) {
+        device_testing_context->buffer_pool.mlock_failed = 1;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_MLOCK_ERROR, strerror(errno));
+    }
+
+    return buffer;
+}
+
+void *buffer_pool_get(device_testing_context_type *device_testing_context, size_t size) {
+    buffer_pool_entry_type *entry, *best = NULL, *empty = NULL, *idle = NULL;
+    void *buffer = NULL;
+    int i, local_errno = 0;
+
+    pthread_mutex_lock(&buffer_pool_mutex);
+
+    for(i = 0; i < BUFFER_POOL_MAX_BUFFERS; i++) {
+        entry = &device_testing_context->buffer_pool.entries[i];
+
+        if(!entry->buffer) {
+            if(!empty) {
+                empty = entry;
+            }
+        } else if(!entry->in_use) {
+            if(entry->size >= size) {
+                if(!best || entry->size < best->size) {
+                    best = entry;
+                }
+            } else {
+                idle = entry;
+            }
+        }
+    }
+
+    if(best) {
+        best->in_use = 1;
+        buffer = best->buffer;
+    } else if(!empty && !idle) {
+        local_errno = ENOMEM;
+    } else {
+        // Nothing big enough is free, so either use an empty slot or replace
+        // an idle buffer that's too small
+        if(!empty) {
+            munmap(idle->buffer, idle->size);
+            idle->buffer = NULL;
+            idle->size = 0;
+            empty = idle;
+        }
+
+        if(!(empty->buffer = buffer_pool_map(device_testing_context, size, &empty->size))) {
+            local_errno = errno;
+            empty->size = 0;
+        } else {
+            empty->in_use = 1;
+            buffer = empty->buffer;
+        }
+    }
+
+    pthread_mutex_unlock(&buffer_pool_mutex);
+
+    if(!buffer) {
+        errno = local_errno;
+    }
+
+    return buffer;
+}
+
+int buffer_pool_reserve(device_testing_context_type *device_testing_context, const size_t *sizes, int num_sizes) {
+    void *buffers[BUFFER_POOL_MAX_BUFFERS];
+    int i, num_buffers, local_errno = 0;
+
+    for(i = 0, num_buffers = 0; i < num_sizes && num_buffers < BUFFER_POOL_MAX_BUFFERS; i++) {
+        if(sizes[i] > BUFFER_POOL_MAX_RETAINED_SIZE) {
+            continue;
+        }
+
+        if(!(buffers[num_buffers] = buffer_pool_get(device_testing_context, sizes[i]))) {
+            local_errno = errno;
+            break;
+        }
+
+        num_buffers++;
+    }
+
+    for(i = 0; i < num_buffers; i++) {
+        buffer_pool_put(device_testing_context, buffers[i]);
+    }
+
+    if(local_errno) {
+        errno = local_errno;
+        return -1;
+    }
+
+    return 0;
+}
+
+void buffer_pool_put(device_testing_context_type *device_testing_context, void *buffer) {
+    buffer_pool_entry_type *entry;
+    int i;
+
+    if(!buffer) {
+        return;
+    }
+
+    pthread_mutex_lock(&buffer_pool_mutex);
+
+    for(i = 0; i < BUFFER_POOL_MAX_BUFFERS; i++) {
+        entry = &device_testing_context->buffer_pool.entries[i];
+        if(entry->buffer == buffer) {
+            if(entry->size > BUFFER_POOL_MAX_RETAINED_SIZE) {
+                munmap(entry->buffer, entry->size);
+                entry->buffer = NULL;
+                entry->size = 0;
+            }
+
+            entry->in_use = 0;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&buffer_pool_mutex);
+}
+
+void buffer_pool_release(device_testing_context_type *device_testing_context) {
+    buffer_pool_entry_type *entry;
+    int i;
+
+    pthread_mutex_lock(&buffer_pool_mutex);
+
+    for(i = 0; i < BUFFER_POOL_MAX_BUFFERS; i++) {
+        entry = &device_testing_context->buffer_pool.entries[i];
+        if(entry->buffer) {
+            munmap(entry->buffer, entry->size);
+            entry->buffer = NULL;
+            entry->size = 0;
+            entry->in_use = 0;
+        }
+    }
+
+    pthread_mutex_unlock(&buffer_pool_mutex);
+}
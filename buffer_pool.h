@@ -0,0 +1,71 @@
+#if !defined(BUFFER_POOL_H)
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+#include "device_testing_context.h"
+
+/**
+ * Borrows a buffer of at least `size` bytes from the device's buffer pool.
+ * Buffers are page-aligned (and backed by huge pages where the system allows
+ * it), so they are suitable for use with O_DIRECT.  Newly created buffers are
+ * pre-faulted and locked into memory; buffers that are returned to the pool
+ * are handed out again on later calls instead of being freed.
+ *
+ * The contents of the buffer are undefined.
+ *
+ * The pool is protected by a mutex, so buffers can be borrowed and returned
+ * from any thread.
+ *
+ * @param device_testing_context  The device whose buffer pool the buffer
+ *                                should be borrowed from.
+ * @param size                    The minimum size of the buffer, in bytes.
+ *
+ * @returns A pointer to the buffer, or NULL if an error occurred.  On error,
+ *          errno is set to the underlying error.  If every slot in the pool is
+ *          already in use, errno is set to ENOMEM.
+ */
+void *buffer_pool_get(device_testing_context_type *device_testing_context, size_t size);
+
+/**
+ * Allocates buffers of the given sizes ahead of time, so that the I/O tests
+ * don't have to wait for them to be mapped and faulted in later.  Each buffer
+ * is borrowed and then returned right away, so that later calls to
+ * buffer_pool_get() for the same sizes are handed these buffers.  Sizes larger
+ * than the pool keeps hold of between uses are skipped.
+ *
+ * @param device_testing_context  The device whose buffer pool the buffers
+ *                                should be allocated in.
+ * @param sizes                   The sizes of the buffers, in bytes.  If the
+ *                                same size is needed at the same time more
+ *                                than once, it should be listed more than
+ *                                once.
+ * @param num_sizes               The number of entries in `sizes`.
+ *
+ * @returns 0 if all of the buffers were allocated, or -1 if an error occurred.
+ *          On error, errno is set to the underlying error; any buffers that
+ *          were allocated are still kept in the pool.
+ */
+int buffer_pool_reserve(device_testing_context_type *device_testing_context, const size_t *sizes, int num_sizes);
+
+/**
+ * Returns a buffer that was borrowed with buffer_pool_get() to the pool.
+ * Unusually large buffers are given back to the system instead of being kept
+ * in the pool.  Does nothing if `buffer` is NULL.
+ *
+ * @param device_testing_context  The device whose buffer pool the buffer was
+ *                                borrowed from.
+ * @param buffer                  The buffer to return.
+ */
+void buffer_pool_put(device_testing_context_type *device_testing_context, void *buffer);
+
+/**
+ * Frees every buffer in the device's buffer pool, whether or not it has been
+ * returned.  Any pointers previously returned by buffer_pool_get() are invalid
+ * after this call.
+ *
+ * @param device_testing_context  The device whose buffer pool should be freed.
+ */
+void buffer_pool_release(device_testing_context_type *device_testing_context);
+
+#endif // !defined(BUFFER_POOL_H)
@@ -0,0 +1,282 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer_pool.h"
+#include "cache_size_test.h"
+#include "io_watchdog.h"
+#include "lockfile.h"
+#include "messages.h"
+#include "mfst.h"
+#include "ncurses.h"
+#include "rng.h"
+#include "util.h"
+
+// Number of chunks whose write times make up the baseline at the start of the
+// test, and number of recent chunks that are compared against it
+#define CACHE_SIZE_TEST_WINDOW_CHUNKS 8
+
+static char msg_buffer[512];
+
+/**
+ * Displays a dialog to the user indicating that the write cache size test
+ * encountered an I/O error, and logs the error.  This function blocks until
+ * the user dismisses the dialog.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param write                   Non-zero if the error occurred during a write,
+ *                                or zero if it occurred during a read.
+ * @param errnum                  The error number of the error that occurred.
+ */
+static void io_error_during_cache_size_test(device_testing_context_type *device_testing_context, char write, int errnum) {
+    log_log(device_testing_context, "probe_for_write_cache_size", SEVERITY_LEVEL_DEBUG, write ? MSG_WRITE_ERROR : MSG_READ_ERROR, strerror(errnum));
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_CACHE_SIZE_TEST_ABORTING_DEVICE_ERROR);
+
+    message_window(device_testing_context, stdscr, WARNING_TITLE,
+                   "We ran into an error while trying to probe for the size "
+                   "of the device's write cache.  It could be that the device "
+                   "was removed, experienced an error and disconnected "
+                   "itself, or set itself to read-only.  For now, we'll "
+                   "assume the device has a 16MB write cache -- but if the "
+                   "device really has been removed or set to read-only, the "
+                   "remainder of the tests are going to fail pretty quickly.", 1);
+}
+
+/**
+ * Reads or writes a chunk of data for the write cache size test and measures
+ * how long it took.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param buf                     The buffer to read into or write from.
+ * @param position                The position on the device to read from or
+ *                                write to.
+ * @param write                   Non-zero to write the chunk, or zero to read
+ *                                it.
+ * @param elapsed                 A pointer to a variable that receives the
+ *                                time the operation took, in microseconds.
+ *
+ * @returns 0 if the operation completed successfully, or -1 if it did not.  On
+ *          error, errno is set to the underlying error.
+ */
+static int timed_chunk_io(device_testing_context_type *device_testing_context, char *buf, off_t position, char write, time_t *elapsed) {
+    struct timeval start_time, end_time;
+    uint64_t bytes_left;
+    int64_t ret;
+
+    assert(!gettimeofday(&start_time, NULL));
+
+    for(bytes_left = CACHE_SIZE_TEST_CHUNK_SIZE; bytes_left; bytes_left -= ret) {
+        if(write) {
+            ret = io_watchdog_write(device_testing_context, buf + (CACHE_SIZE_TEST_CHUNK_SIZE - bytes_left), bytes_left, position + (CACHE_SIZE_TEST_CHUNK_SIZE - bytes_left));
+        } else {
+            ret = io_watchdog_read(device_testing_context, buf + (CACHE_SIZE_TEST_CHUNK_SIZE - bytes_left), bytes_left, position + (CACHE_SIZE_TEST_CHUNK_SIZE - bytes_left));
+        }
+
+        if(ret == -1) {
+            return -1;
+        } else if(!ret) {
+            errno = EIO;
+            return -1;
+        }
+    }
+
+    assert(!gettimeofday(&end_time, NULL));
+    *elapsed = timediff(start_time, end_time);
+
+    return 0;
+}
+
+int probe_for_write_cache_size(device_testing_context_type *device_testing_context) {
+    struct timeval cur_time;
+    char *buf, *oldest_buf, *read_buf;
+    uint64_t max_span, span, bytes_written, num_chunks;
+    uint64_t write_inflection, read_inflection, stale_span, estimate;
+    time_t latency, first_read_latency, baseline_latency, fastest_latency, recent_latencies[CACHE_SIZE_TEST_WINDOW_CHUNKS];
+    int i, prev_percent, cur_percent, local_errno;
+    WINDOW *window;
+
+    if(lock_lockfile(device_testing_context)) {
+        local_errno = errno;
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_CACHE_SIZE_TEST_ABORTING_LOCKFILE_ERROR);
+
+        snprintf(msg_buffer, sizeof(msg_buffer),
+                 "Unable to obtain a lock on the lockfile.  For now, we'll "
+                 "skip the write cache size test and assume the device has a "
+                 "16MB write cache.  However, if this happens again, other "
+                 "tests may fail or lock up.\n\nThe error we got was: %s",
+                 strerror(local_errno));
+
+        message_window(device_testing_context, stdscr, ERROR_TITLE, msg_buffer, 1);
+        return -1;
+    }
+
+    // Don't write over more than a quarter of the device, in case it's fake
+    // flash
+    max_span = ((device_testing_context->device_info.logical_size / 4) / CACHE_SIZE_TEST_CHUNK_SIZE) * CACHE_SIZE_TEST_CHUNK_SIZE;
+    if(max_span > CACHE_SIZE_TEST_MAX_SPAN) {
+        max_span = CACHE_SIZE_TEST_MAX_SPAN;
+    }
+
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_CACHE_SIZE_TEST_STARTING);
+    window = message_window(device_testing_context, stdscr, "Probing for write cache size",
+        "\n                                        ", // Make room for the progress bar
+    0);
+
+    if(!(buf = buffer_pool_get(device_testing_context, CACHE_SIZE_TEST_CHUNK_SIZE * 3))) {
+        local_errno = errno;
+        unlock_lockfile(device_testing_context);
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, (uint64_t) (CACHE_SIZE_TEST_CHUNK_SIZE * 3), strerror(local_errno));
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_CACHE_SIZE_TEST_ABORTING_MEM_ALLOC_ERROR);
+
+        erase_and_delete_window(window);
+        message_window(device_testing_context, stdscr, WARNING_TITLE,
+                       "We ran into an error while trying to allocate memory "
+                       "for the write cache size test.  This could mean your "
+                       "system is low on memory.  For now, we'll assume the "
+                       "device has a 16MB write cache.", 1);
+
+        return -1;
+    }
+
+    oldest_buf = buf + CACHE_SIZE_TEST_CHUNK_SIZE;
+    read_buf = buf + (CACHE_SIZE_TEST_CHUNK_SIZE * 2);
+
+    assert(!gettimeofday(&cur_time, NULL));
+    rng_init(device_testing_context, cur_time.tv_sec);
+
+    write_inflection = read_inflection = stale_span = 0;
+    first_read_latency = baseline_latency = 0;
+    prev_percent = 0;
+
+    for(bytes_written = 0, num_chunks = 0, span = CACHE_SIZE_TEST_MIN_SPAN; bytes_written < max_span; num_chunks++) {
+        handle_key_inputs(device_testing_context, window);
+
+        rng_fill_buffer(device_testing_context, buf, CACHE_SIZE_TEST_CHUNK_SIZE);
+        if(!bytes_written) {
+            memcpy(oldest_buf, buf, CACHE_SIZE_TEST_CHUNK_SIZE);
+        }
+
+        if(timed_chunk_io(device_testing_context, buf, bytes_written, 1, &latency)) {
+            local_errno = errno;
+            buffer_pool_put(device_testing_context, buf);
+            unlock_lockfile(device_testing_context);
+            erase_and_delete_window(window);
+
+            io_error_during_cache_size_test(device_testing_context, 1, local_errno);
+            return -1;
+        }
+
+        bytes_written += CACHE_SIZE_TEST_CHUNK_SIZE;
+
+        recent_latencies[num_chunks % CACHE_SIZE_TEST_WINDOW_CHUNKS] = latency;
+
+        // The first few chunks set the baseline.  After that, the cache is
+        // considered full once even the fastest of the last few chunks is
+        // slower than the baseline by a wide margin -- a single slow chunk
+        // could just be the device doing some housekeeping.
+        if(num_chunks < CACHE_SIZE_TEST_WINDOW_CHUNKS) {
+            baseline_latency += latency;
+            if(num_chunks == (CACHE_SIZE_TEST_WINDOW_CHUNKS - 1)) {
+                baseline_latency /= CACHE_SIZE_TEST_WINDOW_CHUNKS;
+            }
+        } else if(!write_inflection && num_chunks >= ((CACHE_SIZE_TEST_WINDOW_CHUNKS * 2) - 1)) {
+            for(i = 0, fastest_latency = recent_latencies[0]; i < CACHE_SIZE_TEST_WINDOW_CHUNKS; i++) {
+                if(recent_latencies[i] < fastest_latency) {
+                    fastest_latency = recent_latencies[i];
+                }
+            }
+
+            if(fastest_latency > (baseline_latency * CACHE_SIZE_TEST_LATENCY_FACTOR)) {
+                write_inflection = bytes_written - (CACHE_SIZE_TEST_CHUNK_SIZE * CACHE_SIZE_TEST_WINDOW_CHUNKS);
+            }
+        }
+
+        cur_percent = (bytes_written * 40) / max_span;
+        if(cur_percent != prev_percent) {
+            // Advance the graph
+            if(!program_options.no_curses) {
+                wattron(window, COLOR_PAIR(BLACK_ON_GREEN));
+                mvwprintw(window, 2, 2, "%*s", cur_percent, "");
+                wattroff(window, COLOR_PAIR(BLACK_ON_GREEN));
+                touchwin(stdscr);
+                wrefresh(window);
+            }
+
+            prev_percent = cur_percent;
+        }
+
+        if(bytes_written < span && bytes_written < max_span) {
+            continue;
+        }
+
+        // Go back and check on the oldest data
+        if(timed_chunk_io(device_testing_context, read_buf, 0, 0, &latency)) {
+            local_errno = errno;
+            buffer_pool_put(device_testing_context, buf);
+            unlock_lockfile(device_testing_context);
+            erase_and_delete_window(window);
+
+            io_error_during_cache_size_test(device_testing_context, 0, local_errno);
+            return -1;
+        }
+
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_CACHE_SIZE_TEST_SPAN_RESULT, bytes_written, (uint64_t) latency, (uint64_t) recent_latencies[num_chunks % CACHE_SIZE_TEST_WINDOW_CHUNKS]);
+
+        if(memcmp(read_buf, oldest_buf, CACHE_SIZE_TEST_CHUNK_SIZE)) {
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_CACHE_SIZE_TEST_STALE_READ, bytes_written);
+            stale_span = bytes_written;
+            break;
+        }
+
+        if(!first_read_latency) {
+            first_read_latency = latency ? latency : 1;
+        } else if(latency > (first_read_latency * CACHE_SIZE_TEST_LATENCY_FACTOR)) {
+            read_inflection = bytes_written;
+        }
+
+        if(write_inflection || read_inflection) {
+            break;
+        }
+
+        span *= 2;
+    }
+
+    buffer_pool_put(device_testing_context, buf);
+    unlock_lockfile(device_testing_context);
+    erase_and_delete_window(window);
+
+    // Go with whichever sign showed up first
+    estimate = write_inflection;
+    if(read_inflection && (!estimate || read_inflection < estimate)) {
+        estimate = read_inflection;
+    }
+
+    if(stale_span && (!estimate || stale_span < estimate)) {
+        estimate = stale_span;
+    }
+
+    if(estimate) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_CACHE_SIZE_TEST_COMPLETE, estimate);
+    } else {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_CACHE_SIZE_TEST_INCONCLUSIVE, (uint64_t) DEFAULT_WRITE_CACHE_SIZE);
+    }
+
+    device_testing_context->write_cache_size_test_info.test_performed = 1;
+    device_testing_context->write_cache_size_test_info.write_cache_size = estimate;
+
+    return 0;
+}
+
+uint64_t get_cache_defeat_size(device_testing_context_type *device_testing_context) {
+    if(device_testing_context->device_info.write_cache_size) {
+        return device_testing_context->device_info.write_cache_size + CACHE_DEFEAT_MARGIN;
+    }
+
+    return DEFAULT_WRITE_CACHE_SIZE + CACHE_DEFEAT_MARGIN;
+}
@@ -0,0 +1,67 @@
+#if !defined(CACHE_SIZE_TEST_H)
+#define CACHE_SIZE_TEST_H
+
+#include <inttypes.h>
+
+#include "device_testing_context.h"
+
+// Amount of data written at a time during the write cache size test
+#define CACHE_SIZE_TEST_CHUNK_SIZE 1048576
+
+// The smallest and largest spans of data that the write cache size test will
+// write before going back to check on the oldest data
+#define CACHE_SIZE_TEST_MIN_SPAN (4 * 1048576)
+#define CACHE_SIZE_TEST_MAX_SPAN (1024 * 1048576)
+
+// How many times slower an operation has to get before we decide that the
+// device's write cache has filled up
+#define CACHE_SIZE_TEST_LATENCY_FACTOR 2
+
+// Write cache size to assume if the write cache size test wasn't run or
+// couldn't come up with an answer
+#define DEFAULT_WRITE_CACHE_SIZE (16 * 1048576)
+
+// Extra data to write on top of the write cache size when trying to push data
+// out of the write cache
+#define CACHE_DEFEAT_MARGIN (4 * 1048576)
+
+/**
+ * Probe the device to estimate the size of its write cache.
+ *
+ * The test writes random data sequentially from the start of the device, 1MB
+ * at a time, timing each write.  Each time the amount written doubles (from 4MB
+ * up to 1GB, or a quarter of the device, whichever is smaller), the oldest 1MB
+ * of data is read back, timed, and compared to what was written.  The write
+ * cache is considered full at the first of:
+ *
+ * * the point where writes consistently get CACHE_SIZE_TEST_LATENCY_FACTOR
+ *   times slower than they were at the start of the test;
+ * * the point where reading back the oldest data gets
+ *   CACHE_SIZE_TEST_LATENCY_FACTOR times slower than it was the first time; or
+ * * the point where the oldest data no longer reads back correctly.
+ *
+ * @param device_testing_context  The device to be tested.
+ *
+ * @returns 0 if the test was successful, or -1 if the test failed.  On success,
+ *          device_testing_context->write_cache_size_test_info.test_performed
+ *          is set to 1, and
+ *          device_testing_context->write_cache_size_test_info.write_cache_size
+ *          is set to the estimated write cache size, in bytes (or 0 if none of
+ *          the above happened).
+ */
+int probe_for_write_cache_size(device_testing_context_type *device_testing_context);
+
+/**
+ * Returns the amount of data that needs to be written to the device after a
+ * piece of data to be reasonably sure that piece of data has been pushed out of
+ * the device's write cache.  This is the estimated write cache size (or
+ * DEFAULT_WRITE_CACHE_SIZE, if we don't have an estimate) plus
+ * CACHE_DEFEAT_MARGIN.
+ *
+ * @param device_testing_context  The device being tested.
+ *
+ * @returns The number of bytes that need to be written.
+ */
+uint64_t get_cache_defeat_size(device_testing_context_type *device_testing_context);
+
+#endif // !defined(CACHE_SIZE_TEST_H)
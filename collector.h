@@ -0,0 +1,72 @@
+#if !defined(COLLECTOR_H)
+#define COLLECTOR_H
+
+#include <inttypes.h>
+#include <uuid/uuid.h>
+
+#include "device_testing_context.h"
+#include "sql.h"
+
+// Protocol spoken between mfst and mfst-collector over a Unix domain socket.
+// Both ends always run on the same host, so everything is sent in native byte
+// order.
+
+// Default path of the socket that mfst-collector listens on
+#define COLLECTOR_DEFAULT_SOCKET "mfst-collector.sock"
+
+// Largest payload a single message may carry
+#define COLLECTOR_MAX_PAYLOAD_SIZE (SQL_HISTORY_ROWS_PER_INSERT * sizeof(sql_sample_type))
+
+typedef enum {
+    // Look up a card by UUID.  Payload is a collector_card_info_type; the
+    // collector answers with a collector_reply_type.
+    COLLECTOR_MSG_FIND_CARD = 1,
+
+    // Register a new card.  Payload is a collector_card_info_type; the
+    // collector answers with a collector_reply_type.
+    COLLECTOR_MSG_INSERT_CARD,
+
+    // Update the size of an already-registered card.  Payload is a
+    // collector_card_info_type; the collector answers with a
+    // collector_reply_type.
+    COLLECTOR_MSG_UPDATE_CARD,
+
+    // Status samples.  Payload is an array of sql_sample_type.
+    COLLECTOR_MSG_SAMPLES,
+
+    // End-of-round summaries.  Payload is an array of round_summary_type.
+    COLLECTOR_MSG_ROUNDS,
+
+    // The card's current status and sector map.  Payload is a
+    // collector_sector_map_type.
+    COLLECTOR_MSG_SECTOR_MAP,
+
+    // The results of the most recent surface scan.  Payload is a
+    // surface_scan_result_type, which fits within COLLECTOR_MAX_PAYLOAD_SIZE.
+    COLLECTOR_MSG_SURFACE_SCAN
+} collector_msg_type;
+
+typedef struct _collector_msg_header_type {
+    uint32_t type;     // One of the COLLECTOR_MSG_* values
+    uint32_t length;   // Length of the payload that follows, in bytes
+    uint64_t card_id;  // The card the message is about (0 if not known yet)
+} collector_msg_header_type;
+
+typedef struct _collector_card_info_type {
+    uuid_t uuid;
+    uint64_t num_physical_sectors;
+    int32_t sector_size;
+    char name[256];    // Only used by COLLECTOR_MSG_INSERT_CARD
+} collector_card_info_type;
+
+typedef struct _collector_reply_type {
+    int32_t result;    // Same meaning as the return value of a report sink function
+    uint64_t card_id;  // The card's ID, if the request was successful
+} collector_reply_type;
+
+typedef struct _collector_sector_map_type {
+    sql_sample_type sample;
+    uint8_t map[CONSOLIDATED_SECTOR_MAP_BYTES];
+} collector_sector_map_type;
+
+#endif // !defined(COLLECTOR_H)
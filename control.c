@@ -0,0 +1,432 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <json-c/json_object.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "control.h"
+#include "device_testing_context.h"
+#include "messages.h"
+#include "mfst.h"
+#include "stats_block.h"
+#include "util.h"
+
+// How long to wait for a client to send a command before dropping the
+// connection, in seconds
+#define CONTROL_IDLE_TIMEOUT 300
+
+// How often the control thread checks to see if it's been asked to stop, in
+// milliseconds
+#define CONTROL_POLL_INTERVAL 500
+
+// Longest command line we're willing to accept
+#define CONTROL_MAX_LINE_LENGTH 256
+
+// If we fall this far behind the bandwidth limit (e.g., because the device
+// was disconnected for a while), start measuring again from scratch rather
+// than letting the program run flat out until it's caught up, in microseconds
+#define CONTROL_THROTTLE_MAX_DEFICIT 1000000
+
+static device_testing_context_type *control_device_testing_context;
+static int control_fd = -1;
+static char *control_socket_path;
+static volatile int control_stop_requested;
+static int control_running;
+static pthread_t control_thread;
+
+static int control_reply(int fd, const char *format, ...) {
+    char response[CONTROL_MAX_LINE_LENGTH * 2];
+    va_list ap;
+
+    va_start(ap, format);
+    vsnprintf(response, sizeof(response) - 1, format, ap);
+    va_end(ap);
+
+    strcat(response, "\n");
+    return send_all(fd, response, strlen(response));
+}
+
+static int control_json_add(struct json_object *parent, const char *key, struct json_object *obj) {
+    if(json_object_object_add(parent, key, obj)) {
+        json_object_put(obj);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Sends the device's current counters to the client as a single line of JSON.
+ *
+ * @param fd  The client's socket.
+ *
+ * @returns 0 if the stats were sent successfully, or -1 if an error occurred.
+ */
+static int control_send_stats(int fd) {
+    device_testing_context_type *device_testing_context = control_device_testing_context;
+    stats_snapshot_type snapshot;
+    struct json_object *root;
+    char uuid_str[37];
+    main_thread_status_type status = main_thread_status;
+    int ret;
+
+    stats_block_read(device_testing_context, &snapshot);
+    uuid_unparse(device_testing_context->device_info.device_uuid, uuid_str);
+
+    if(!(root = json_object_new_object())) {
+        return -1;
+    }
+
+    ret = control_json_add(root, "uuid", json_object_new_string(uuid_str)) ||
+        control_json_add(root, "status", json_object_new_string(main_thread_status_labels[status])) ||
+        control_json_add(root, "rounds_completed", json_object_new_int64(snapshot.rounds_completed)) ||
+        control_json_add(root, "total_bytes_written", json_object_new_int64(snapshot.total_bytes_written)) ||
+        control_json_add(root, "total_bytes_read", json_object_new_int64(snapshot.total_bytes_read)) ||
+        control_json_add(root, "total_bad_sectors", json_object_new_int64(snapshot.total_bad_sectors)) ||
+        control_json_add(root, "bad_sectors_this_round", json_object_new_int64(snapshot.num_bad_sectors_this_round)) ||
+        control_json_add(root, "avg_read_latency", json_object_new_double(snapshot.io_latency_stats.num_reads ? ((double) snapshot.io_latency_stats.total_read_time) / snapshot.io_latency_stats.num_reads : 0)) ||
+        control_json_add(root, "avg_write_latency", json_object_new_double(snapshot.io_latency_stats.num_writes ? ((double) snapshot.io_latency_stats.total_write_time) / snapshot.io_latency_stats.num_writes : 0)) ||
+        control_json_add(root, "io_timeouts", json_object_new_int64(snapshot.io_timeout_stats.num_timeouts)) ||
+        control_json_add(root, "disconnects", json_object_new_int64(snapshot.device_event_stats.num_disconnects)) ||
+        control_json_add(root, "resets", json_object_new_int64(snapshot.device_event_stats.num_resets)) ||
+        control_json_add(root, "lockfile_pause_seconds", json_object_new_double(((double) snapshot.device_event_stats.total_lockfile_pause_time) / 1000000)) ||
+        control_json_add(root, "paused", json_object_new_boolean(device_testing_context->control_state.pause_requested)) ||
+        control_json_add(root, "bandwidth_limit", json_object_new_int64(device_testing_context->control_state.bandwidth_limit)) ||
+        control_json_add(root, "block_size", json_object_new_int64(snapshot.optimal_block_size)) ||
+        control_json_add(root, "pending_block_size", json_object_new_int64(device_testing_context->control_state.requested_block_size)) ||
+        control_json_add(root, "checkpoint_pending", json_object_new_boolean(device_testing_context->control_state.checkpoint_requested));
+
+    if(!ret) {
+        ret = control_reply(fd, "%s", json_object_to_json_string_ext(root, JSON_C_TO_STRING_PLAIN));
+    }
+
+    json_object_put(root);
+    return ret ? -1 : 0;
+}
+
+/**
+ * Parses an unsigned integer argument to a command.
+ *
+ * @param arg    The argument to parse.
+ * @param value  A pointer to a variable which will receive the parsed value.
+ *
+ * @returns 0 if the argument was parsed successfully, or -1 if it was missing
+ *          or invalid.
+ */
+static int control_parse_number(const char *arg, uint64_t *value) {
+    char *endptr;
+
+    if(!arg || !*arg || *arg == '-') {
+        return -1;
+    }
+
+    errno = 0;
+    *value = strtoull(arg, &endptr, 10);
+    if(errno || *endptr) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Carries out a single command received on the control socket and sends the
+ * response back to the client.
+ *
+ * @param fd    The client's socket.
+ * @param line  The command to carry out.  This buffer is modified in-place.
+ *
+ * @returns 0 if the response was sent successfully, or -1 if the connection
+ *          should be dropped.
+ */
+static int control_handle_command(int fd, char *line) {
+    device_testing_context_type *device_testing_context = control_device_testing_context;
+    char *command, *arg, *saveptr;
+    uint64_t value;
+    int sector_size;
+
+    if(!(command = strtok_r(line, " \t", &saveptr))) {
+        return 0;
+    }
+
+    arg = strtok_r(NULL, " \t", &saveptr);
+    if(strtok_r(NULL, " \t", &saveptr)) {
+        return control_reply(fd, "ERROR Too many arguments");
+    }
+
+    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_CONTROL_COMMAND, command);
+
+    if(!strcasecmp(command, "pause")) {
+        device_testing_context->control_state.pause_requested = 1;
+        return control_reply(fd, "OK Pausing at the next block");
+    } else if(!strcasecmp(command, "resume")) {
+        device_testing_context->control_state.pause_requested = 0;
+        return control_reply(fd, "OK Resuming");
+    } else if(!strcasecmp(command, "bandwidth")) {
+        if(control_parse_number(arg, &value) || value > (UINT64_MAX / 1048576)) {
+            return control_reply(fd, "ERROR Usage: bandwidth <MB/sec> (0 for no limit)");
+        }
+
+        device_testing_context->control_state.bandwidth_limit = value * 1048576;
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_BANDWIDTH_LIMIT_CHANGED, value * 1048576);
+        return control_reply(fd, "OK Bandwidth limit set to %lu bytes/sec", value * 1048576);
+    } else if(!strcasecmp(command, "blocksize")) {
+        sector_size = device_testing_context->device_info.sector_size;
+        if(control_parse_number(arg, &value)) {
+            return control_reply(fd, "ERROR Usage: blocksize <bytes>");
+        }
+
+        if(!sector_size || value < sector_size || value > CONTROL_MAX_BLOCK_SIZE || value % sector_size) {
+            return control_reply(fd, "ERROR Block size must be a multiple of %d bytes and no larger than %d bytes", sector_size, CONTROL_MAX_BLOCK_SIZE);
+        }
+
+        device_testing_context->control_state.requested_block_size = value;
+        return control_reply(fd, "OK Block size will change to %lu bytes at the next slice", value);
+    } else if(!strcasecmp(command, "checkpoint")) {
+        if(!program_options.state_file) {
+            return control_reply(fd, "ERROR Save stating is not enabled");
+        }
+
+        device_testing_context->control_state.checkpoint_requested = 1;
+        return control_reply(fd, "OK State will be saved at the next slice");
+    } else if(!strcasecmp(command, "stats")) {
+        return control_send_stats(fd);
+    } else if(!strcasecmp(command, "help")) {
+        return control_reply(fd, "OK Commands: pause, resume, bandwidth <MB/sec>, blocksize <bytes>, checkpoint, stats, help");
+    }
+
+    return control_reply(fd, "ERROR Unknown command \"%s\" (try \"help\")", command);
+}
+
+/**
+ * Reads commands from the given client, one per line, until it disconnects,
+ * goes quiet for too long, or we're asked to stop.
+ *
+ * @param fd  The client's socket.
+ */
+static void control_handle_client(int fd) {
+    char buffer[CONTROL_MAX_LINE_LENGTH + 1];
+    struct pollfd pfd;
+    size_t received = 0;
+    ssize_t ret;
+    char *eol;
+    int idle_time = 0;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while(!control_stop_requested) {
+        if((ret = poll(&pfd, 1, CONTROL_POLL_INTERVAL)) <= 0) {
+            if(!ret && (idle_time += CONTROL_POLL_INTERVAL) >= CONTROL_IDLE_TIMEOUT * 1000) {
+                return;
+            }
+
+            continue;
+        }
+
+        if((ret = recv(fd, buffer + received, sizeof(buffer) - 1 - received, 0)) <= 0) {
+            if(ret == -1 && errno == EINTR) {
+                continue;
+            }
+
+            return;
+        }
+
+        idle_time = 0;
+        received += ret;
+        buffer[received] = 0;
+
+        while(eol = strchr(buffer, '\n')) {
+            *eol = 0;
+            if(eol > buffer && eol[-1] == '\r') {
+                eol[-1] = 0;
+            }
+
+            if(control_handle_command(fd, buffer)) {
+                return;
+            }
+
+            received -= (eol + 1) - buffer;
+            memmove(buffer, eol + 1, received + 1);
+        }
+
+        if(received == sizeof(buffer) - 1) {
+            control_reply(fd, "ERROR Line too long");
+            return;
+        }
+    }
+}
+
+static void *control_main(void *arg) {
+    struct pollfd pfd;
+    int client_fd;
+
+    pfd.fd = control_fd;
+    pfd.events = POLLIN;
+
+    while(!control_stop_requested) {
+        if(poll(&pfd, 1, CONTROL_POLL_INTERVAL) <= 0) {
+            continue;
+        }
+
+        if((client_fd = accept4(control_fd, NULL, NULL, SOCK_CLOEXEC)) == -1) {
+            if(errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+                log_log(control_device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_CONTROL_ACCEPT_ERROR, strerror(errno));
+            }
+
+            continue;
+        }
+
+        control_handle_client(client_fd);
+        close(client_fd);
+    }
+
+    return NULL;
+}
+
+int control_start(device_testing_context_type *device_testing_context, const char *path) {
+    struct sockaddr_un addr;
+    struct stat fs;
+    int ret, local_errno;
+
+    if(control_running) {
+        return 0;
+    }
+
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    if((control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+        return -1;
+    }
+
+    // Clean up after a previous run -- but only if what's there is actually a
+    // socket
+    if(!lstat(path, &fs) && S_ISSOCK(fs.st_mode)) {
+        unlink(path);
+    }
+
+    // Anyone who can connect to the socket can pause the test, so don't let
+    // anyone else connect to it
+    if(bind(control_fd, (struct sockaddr *) &addr, sizeof(addr)) || chmod(path, 0600) || listen(control_fd, 4)) {
+        local_errno = errno;
+        close(control_fd);
+        control_fd = -1;
+        errno = local_errno;
+        return -1;
+    }
+
+    if(!(control_socket_path = strdup(path))) {
+        local_errno = errno;
+        close(control_fd);
+        control_fd = -1;
+        unlink(path);
+        errno = local_errno;
+        return -1;
+    }
+
+    control_device_testing_context = device_testing_context;
+    control_stop_requested = 0;
+
+    if(ret = pthread_create(&control_thread, NULL, &control_main, NULL)) {
+        close(control_fd);
+        control_fd = -1;
+        unlink(control_socket_path);
+        free(control_socket_path);
+        control_socket_path = NULL;
+        errno = ret;
+        return -1;
+    }
+
+    control_running = 1;
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_CONTROL_LISTENING, path);
+    return 0;
+}
+
+void control_stop() {
+    if(!control_running) {
+        return;
+    }
+
+    control_stop_requested = 1;
+    pthread_join(control_thread, NULL);
+
+    close(control_fd);
+    control_fd = -1;
+
+    unlink(control_socket_path);
+    free(control_socket_path);
+    control_socket_path = NULL;
+
+    control_running = 0;
+}
+
+void control_throttle(device_testing_context_type *device_testing_context) {
+    control_state_type *state = &device_testing_context->control_state;
+    uint64_t limit = state->bandwidth_limit;
+    uint64_t total_bytes;
+    struct timeval now;
+    int64_t elapsed, expected;
+
+    total_bytes = device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written +
+        device_testing_context->endurance_test_info.stats_file_counters.total_bytes_read;
+
+    assert(!gettimeofday(&now, NULL));
+
+    // Start measuring again from here whenever the limit changes
+    if(limit != state->throttle_limit) {
+        state->throttle_limit = limit;
+        state->throttle_start_time = now;
+        state->throttle_start_bytes = total_bytes;
+    }
+
+    if(!limit) {
+        return;
+    }
+
+    elapsed = timediff(state->throttle_start_time, now);
+    expected = (int64_t) ((((double) (total_bytes - state->throttle_start_bytes)) * 1000000) / limit);
+
+    if(expected > elapsed) {
+        usleep(expected - elapsed);
+    } else if(elapsed - expected > CONTROL_THROTTLE_MAX_DEFICIT) {
+        state->throttle_start_time = now;
+        state->throttle_start_bytes = total_bytes;
+    }
+}
+
+int control_take_block_size_request(device_testing_context_type *device_testing_context) {
+    uint64_t requested = device_testing_context->control_state.requested_block_size;
+
+    if(!requested) {
+        return 0;
+    }
+
+    device_testing_context->control_state.requested_block_size = 0;
+    if(requested == device_testing_context->device_info.optimal_block_size) {
+        return 0;
+    }
+
+    device_testing_context->device_info.optimal_block_size = requested;
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_BLOCK_SIZE_CHANGED, requested);
+    return 1;
+}
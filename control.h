@@ -0,0 +1,56 @@
+#if !defined(CONTROL_H)
+#define CONTROL_H
+
+#include "device_testing_context.h"
+
+// Largest block size that can be requested through the control socket
+#define CONTROL_MAX_BLOCK_SIZE (64 * 1048576)
+
+/**
+ * Starts the control socket thread.  The thread listens on a Unix domain
+ * socket for simple line-based commands that let an operator pause, resume,
+ * throttle, or re-tune a running test without restarting it.  Send `help`
+ * over the socket for the list of commands.
+ *
+ * Requests that affect the main thread are recorded in the device's
+ * control_state; it's up to the main thread to act on them (see
+ * control_throttle() and control_take_block_size_request()).
+ *
+ * @param device_testing_context  The device being tested.
+ * @param path                    The path of the socket to listen on.  If a
+ *                                stale socket already exists at this path, it
+ *                                is removed first.
+ *
+ * @returns 0 if the thread was started successfully, or -1 if an error
+ *          occurred.  On error, errno is set to the underlying error.
+ */
+int control_start(device_testing_context_type *device_testing_context, const char *path);
+
+/**
+ * Stops the control socket thread, waits for it to exit, and removes the
+ * socket.  Does nothing if the thread isn't running.
+ */
+void control_stop();
+
+/**
+ * Enforces the bandwidth limit set through the control socket, if there is
+ * one, by sleeping until the combined number of bytes read from and written to
+ * the device is back under the limit.  Should be called by the main thread
+ * before each block is read or written.
+ *
+ * @param device_testing_context  The device being tested.
+ */
+void control_throttle(device_testing_context_type *device_testing_context);
+
+/**
+ * Checks to see if a new block size has been requested through the control
+ * socket.  If so, the device's optimal block size is updated and the request
+ * is cleared.  Should only be called by the main thread, between slices.
+ *
+ * @param device_testing_context  The device being tested.
+ *
+ * @returns 1 if the block size was changed, or 0 if it was not.
+ */
+int control_take_block_size_request(device_testing_context_type *device_testing_context);
+
+#endif // !defined(CONTROL_H)
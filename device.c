@@ -14,12 +14,17 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "buffer_pool.h"
 #include "crc32.h"
 #include "device.h"
 #include "device_testing_context.h"
 #include "messages.h"
 #include "mfst.h"
 
+int get_device_open_flags() {
+    return O_DIRECT | O_LARGEFILE | O_RDWR | (program_options.sync_mode == SYNC_MODE_ALWAYS ? O_SYNC : 0);
+}
+
 int is_block_device(char *filename) {
     struct stat fs;
 
@@ -88,6 +93,33 @@ int did_device_disconnect(dev_t device_num) {
     return 0;
 }
 
+uint64_t get_device_au_size(dev_t device_num) {
+    const char *erase_size_str;
+    uint64_t au_size = 0;
+    struct udev *udev_handle;
+    struct udev_device *udev_dev, *mmc_dev;
+
+    if(!(udev_handle = udev_new())) {
+        return 0;
+    }
+
+    if(!(udev_dev = udev_device_new_from_devnum(udev_handle, 'b', device_num))) {
+        udev_unref(udev_handle);
+        return 0;
+    }
+
+    // mmc_dev belongs to udev_dev, so it doesn't need to be unref'ed
+    if((mmc_dev = udev_device_get_parent_with_subsystem_devtype(udev_dev, "mmc", NULL))) {
+        if((erase_size_str = udev_device_get_sysattr_value(mmc_dev, "preferred_erase_size"))) {
+            au_size = strtoull(erase_size_str, NULL, 10);
+        }
+    }
+
+    udev_device_unref(udev_dev);
+    udev_unref(udev_handle);
+    return au_size;
+}
+
 /**
  * Compares the two devices and determines whether they are identical.
  *
@@ -134,11 +166,8 @@ int are_devices_identical(const char *devname1, const char *devname2) {
 
 /**
  * Reads the beginning-of-device and middle-of-device data and compares it with
- * what is stored in bod_buffer/mod_buffer.
- *
- * Note that this function will move the position of the file pointer
- * represented by fd.  Callers are responsible for saving the position of the
- * file pointer and re-seeking to that position after this call completes.
+ * what is stored in bod_buffer/mod_buffer.  The position of the file pointer
+ * represented by fd is not affected.
  *
  * @param device_testing_context  The device context that has the BOD/MOD data
  *                                from the device being tested.
@@ -156,41 +185,29 @@ int compare_bod_mod_data(device_testing_context_type *device_testing_context, in
     int sector_size;
     uint64_t num_sectors_to_read;
 
-    if(!(read_buffer = malloc(device_testing_context->device_info.bod_mod_buffer_size))) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MALLOC_ERROR, strerror(errno));
+    if(!(read_buffer = buffer_pool_get(device_testing_context, device_testing_context->device_info.bod_mod_buffer_size))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, (uint64_t) device_testing_context->device_info.bod_mod_buffer_size, strerror(errno));
         return -1;
     }
 
     // Get the device's sector size.
     if(ioctl(fd, BLKSSZGET, &sector_size)) {
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_IOCTL_ERROR, strerror(errno));
-        free(read_buffer);
+        buffer_pool_put(device_testing_context, read_buffer);
         return -1;
     }
 
     partial_match_threshold = device_testing_context->device_info.bod_mod_buffer_size / sector_size; // 50%
 
-    // Make sure we're at the beginning of the device
-    if(lseek(fd, 0, SEEK_SET) == -1) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errno));
-        free(read_buffer);
-        return -1;
-    }
-
     // Read in the first 1MB.
     bytes_left_to_read = device_testing_context->device_info.bod_mod_buffer_size;
     while(bytes_left_to_read) {
         num_sectors_to_read = get_max_writable_sectors(device_testing_context, (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read) / device_testing_context->device_info.sector_size, bytes_left_to_read / device_testing_context->device_info.sector_size);
         if(num_sectors_to_read) {
-            if((ret = read(fd, read_buffer + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read), (num_sectors_to_read * device_testing_context->device_info.sector_size) + (bytes_left_to_read % device_testing_context->device_info.sector_size))) == -1) {
+            if((ret = pread(fd, read_buffer + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read), (num_sectors_to_read * device_testing_context->device_info.sector_size) + (bytes_left_to_read % device_testing_context->device_info.sector_size), device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read)) == -1) {
                 // If we get a read error here, we'll just zero out the rest of the sector and move on.
                 memset(read_buffer + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read), 0, ((bytes_left_to_read % device_testing_context->device_info.sector_size) == 0) ? device_testing_context->device_info.sector_size : (bytes_left_to_read % device_testing_context->device_info.sector_size));
                 bytes_left_to_read -= ((bytes_left_to_read % device_testing_context->device_info.sector_size) == 0) ? device_testing_context->device_info.sector_size : (bytes_left_to_read % device_testing_context->device_info.sector_size);
-                if(lseek(fd, device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read, SEEK_SET) == -1) {
-                    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errno));
-                    free(read_buffer);
-                    return -1;
-                }
             } else {
                 bytes_left_to_read -= ret;
             }
@@ -201,19 +218,12 @@ int compare_bod_mod_data(device_testing_context_type *device_testing_context, in
         if(num_sectors_to_read) {
             memset(read_buffer + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read), 0, num_sectors_to_read * device_testing_context->device_info.sector_size);
             bytes_left_to_read -= num_sectors_to_read * device_testing_context->device_info.sector_size;
-
-            // Seek past the bad sectors
-            if(lseek(fd, device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read, SEEK_SET) == -1) {
-                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errno));
-                free(read_buffer);
-                return -1;
-            }
         }
     }
 
     if(!memcmp(read_buffer, device_testing_context->device_info.bod_buffer, device_testing_context->device_info.bod_mod_buffer_size)) {
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_COMPARE_BOD_MOD_DATA_BOD_MATCHES);
-        free(read_buffer);
+        buffer_pool_put(device_testing_context, read_buffer);
         return 0;
     } else {
       // Do a sector-by-sector comparison and count up the sectors
@@ -228,24 +238,13 @@ int compare_bod_mod_data(device_testing_context_type *device_testing_context, in
     bytes_left_to_read = device_testing_context->device_info.bod_mod_buffer_size;
     middle = device_testing_context->device_info.physical_size / 2;
 
-    if(lseek(fd, middle, SEEK_SET) == -1) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errno));
-        free(read_buffer);
-        return -1;
-    }
-
     while(bytes_left_to_read) {
         num_sectors_to_read = get_max_writable_sectors(device_testing_context, (middle + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read)) / device_testing_context->device_info.sector_size, bytes_left_to_read / device_testing_context->device_info.sector_size);
         if(num_sectors_to_read) {
-            if((ret = read(fd, read_buffer + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read), (num_sectors_to_read * device_testing_context->device_info.sector_size) + (bytes_left_to_read % device_testing_context->device_info.sector_size))) == -1) {
+            if((ret = pread(fd, read_buffer + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read), (num_sectors_to_read * device_testing_context->device_info.sector_size) + (bytes_left_to_read % device_testing_context->device_info.sector_size), middle + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read))) == -1) {
                 // If we get a read error here, we'll just zero out the rest of the sector and move on
                 memset(read_buffer + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read), 0, ((bytes_left_to_read % device_testing_context->device_info.sector_size) == 0) ? device_testing_context->device_info.sector_size : (bytes_left_to_read % device_testing_context->device_info.sector_size));
                 bytes_left_to_read -= ((bytes_left_to_read % device_testing_context->device_info.sector_size) == 0) ? device_testing_context->device_info.sector_size : (bytes_left_to_read % device_testing_context->device_info.sector_size);
-                if(lseek(fd, middle + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read), SEEK_SET) == -1) {
-                    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errno));
-                    free(read_buffer);
-                    return -1;
-                }
             } else {
                 bytes_left_to_read -= ret;
             }
@@ -256,23 +255,16 @@ int compare_bod_mod_data(device_testing_context_type *device_testing_context, in
         if(num_sectors_to_read) {
             memset(read_buffer + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read), 0, num_sectors_to_read * device_testing_context->device_info.sector_size);
             bytes_left_to_read -= num_sectors_to_read * device_testing_context->device_info.sector_size;
-
-            // Seek past the bad sectors
-            if(lseek(fd, middle + (device_testing_context->device_info.bod_mod_buffer_size - bytes_left_to_read), SEEK_SET) == -1) {
-                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errno));
-                free(read_buffer);
-                return -1;
-            }
         }
     }
 
     if(!memcmp(read_buffer, device_testing_context->device_info.mod_buffer, device_testing_context->device_info.bod_mod_buffer_size)) {
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_COMPARE_BOD_MOD_DATA_MOD_MATCHES);
-        free(read_buffer);
+        buffer_pool_put(device_testing_context, read_buffer);
         return 0;
     } else {
-        // We're done with read_buffer now, we can go ahead and free() it
-        free(read_buffer);
+        // We're done with read_buffer now, we can go ahead and return it
+        buffer_pool_put(device_testing_context, read_buffer);
 
         // Do a sector-by-sector comparison and count up the sectors
         for(bytes_left_to_read = 0; bytes_left_to_read < device_testing_context->device_info.bod_mod_buffer_size; bytes_left_to_read += sector_size) {
@@ -331,7 +323,6 @@ int compare_device_uuids(device_testing_context_type *device_testing_context, in
     // Get the device's sector size.
     if(ioctl(fd, BLKSSZGET, &sector_size)) {
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_IOCTL_ERROR, strerror(errno));
-        free(buffer);
         return -1;
     }
 
@@ -341,8 +332,8 @@ int compare_device_uuids(device_testing_context_type *device_testing_context, in
         return -1;
     }
 
-    if(!(buffer = malloc(sector_size))) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MALLOC_ERROR, strerror(errno));
+    if(!(buffer = buffer_pool_get(device_testing_context, sector_size))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, (uint64_t) sector_size, strerror(errno));
         return -1;
     }
 
@@ -378,13 +369,7 @@ int compare_device_uuids(device_testing_context_type *device_testing_context, in
 
     // Ok, we have a list of sectors to check -- let's go!
     for(i = 0; i < num_sectors_to_check && (num_matching_sectors + (num_sectors_to_check - i)) >= (num_sectors_to_check / 2); i++) {
-        if((ret = lseek(fd, sectors_to_check[i] * sector_size, SEEK_SET)) == -1) {
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errno));
-            free(buffer);
-            return -1;
-        }
-
-        if((ret = read(fd, buffer, sector_size)) != sector_size) {
+        if((ret = pread(fd, buffer, sector_size, sectors_to_check[i] * sector_size)) != sector_size) {
             if(ret == -1) {
                 // Just skip over this sector
                 log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_READ_ERROR, strerror(errno));
@@ -403,7 +388,7 @@ int compare_device_uuids(device_testing_context_type *device_testing_context, in
         get_embedded_device_uuid(buffer, device_uuid);
         if(!uuid_compare(device_uuid, device_testing_context->device_info.device_uuid)) {
             if(++num_matching_sectors >= (num_sectors_to_check / 2)) {
-                free(buffer);
+                buffer_pool_put(device_testing_context, buffer);
 
                 log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_COMPARE_DEVICE_UUIDS_MATCHED);
                 return 0;
@@ -411,7 +396,7 @@ int compare_device_uuids(device_testing_context_type *device_testing_context, in
         }
     }
 
-    free(buffer);
+    buffer_pool_put(device_testing_context, buffer);
 
     if(!num_matching_sectors) {
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_COMPARE_DEVICE_UUIDS_NO_SECTORS_MATCHED);
@@ -550,7 +535,7 @@ int find_device(device_testing_context_type *device_testing_context, device_sear
                 }
 
                 // Re-open the device
-                if((fd = open(device_search_params->preferred_dev_name, O_DIRECT | O_SYNC | O_LARGEFILE | O_RDWR)) == -1) {
+                if((fd = open(device_search_params->preferred_dev_name, get_device_open_flags())) == -1) {
                     // Well crap.
                     log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_FIND_DEVICE_OPEN_ERROR, device_search_params->preferred_dev_name, strerror(errno));
 
@@ -802,7 +787,7 @@ int find_device(device_testing_context_type *device_testing_context, device_sear
     }
 
     // Ok, we have a single match.  Re-open the device read/write.
-    if((fd = open(matched_devices[match_index], O_DIRECT | O_SYNC | O_LARGEFILE | O_RDWR)) == -1) {
+    if((fd = open(matched_devices[match_index], get_device_open_flags())) == -1) {
         // Well crap.
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_FIND_DEVICE_OPEN_ERROR, matched_devices[match_index], strerror(errno));
 
@@ -958,7 +943,7 @@ device_search_result_t *wait_for_device_reconnect(device_testing_context_type *d
             }
 
             // Re-open the device read/write.
-            if((fd = open(dev_name, O_DIRECT | O_SYNC | O_LARGEFILE | O_RDWR)) == -1) {
+            if((fd = open(dev_name, get_device_open_flags())) == -1) {
                 // Well crap.
                 log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_FIND_DEVICE_OPEN_ERROR, dev_name, strerror(errno));
 
@@ -1038,28 +1023,11 @@ int can_reset_device(device_testing_context_type *device_testing_context) {
     return 1;
 }
 
-int reset_device(device_testing_context_type *device_testing_context) {
+int kick_device(dev_t device_num) {
     struct udev *udev_handle;
     struct udev_device *child_device, *parent_device;
     const char *device_name;
-    char *new_device_name;
-    dev_t device_num, new_device_num;
-    int fd, ret;
-    struct stat dev_stat;
-    device_search_params_t device_search_params;
-    device_search_result_t *device_search_result;
-
-    if(ret = fstat(device_testing_context->device_info.fd, &dev_stat)) {
-        // Can't stat the device
-        return -1;
-    }
-
-    if(!S_ISBLK(dev_stat.st_mode)) {
-        // Device isn't a block device
-        return -1;
-    }
-
-    device_num = dev_stat.st_rdev;
+    int fd, local_errno;
 
     udev_handle = udev_new();
     if(!udev_handle) {
@@ -1087,19 +1055,52 @@ int reset_device(device_testing_context_type *device_testing_context) {
     }
 
     if((fd = open(device_name, O_WRONLY | O_NONBLOCK)) == -1) {
+        local_errno = errno;
         udev_device_unref(child_device);
         udev_unref(udev_handle);
+        errno = local_errno;
         return -1;
     }
 
-    device_info_invalidate_file_handle(device_testing_context);
+    udev_device_unref(child_device);
+    udev_unref(udev_handle);
 
     if(ioctl(fd, USBDEVFS_RESET) == -1) {
-      close(fd);
-      return -1;
+        local_errno = errno;
+        close(fd);
+        errno = local_errno;
+        return -1;
     }
 
     close(fd);
+    return 0;
+}
+
+int reset_device(device_testing_context_type *device_testing_context) {
+    dev_t device_num;
+    int ret;
+    struct stat dev_stat;
+    device_search_params_t device_search_params;
+    device_search_result_t *device_search_result;
+
+    if(ret = fstat(device_testing_context->device_info.fd, &dev_stat)) {
+        // Can't stat the device
+        return -1;
+    }
+
+    if(!S_ISBLK(dev_stat.st_mode)) {
+        // Device isn't a block device
+        return -1;
+    }
+
+    device_num = dev_stat.st_rdev;
+
+    device_info_invalidate_file_handle(device_testing_context);
+    device_testing_context->device_event_stats.num_resets++;
+
+    if(kick_device(device_num)) {
+        return -1;
+    }
 
     device_search_params.preferred_dev_name = program_options.device_name;
     device_search_params.must_match_preferred_dev_name = 0;
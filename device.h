@@ -147,6 +147,42 @@ int can_reset_device(device_testing_context_type *device_testing_context);
  */
 int reset_device(device_testing_context_type *device_testing_context);
 
+/**
+ * Issues a USB reset to the USB device that the given block device belongs to,
+ * without touching any of the state in the device testing context.  The kernel
+ * will fail any I/O requests that are outstanding against the device when the
+ * reset occurs, which makes this useful for unsticking a thread that is stuck
+ * waiting on a hung request.  Callers are responsible for detecting the
+ * disconnect/reconnect that usually follows.
+ *
+ * @param device_num  The device number of the block device to reset.
+ *
+ * @returns 0 if the reset was issued successfully, or -1 if the device is not
+ *          a USB device or an error occurred.
+ */
+int kick_device(dev_t device_num);
+
+/**
+ * Gets the allocation unit (AU) size that an SD card reports in its SD Status
+ * register.  The kernel only exposes this (as the card's preferred erase size)
+ * for cards attached to an MMC/SD host controller; cards in USB readers don't
+ * report it.
+ *
+ * @param device_num  The device number of the block device to query.
+ *
+ * @returns The AU size, in bytes, or 0 if it isn't available.
+ */
+uint64_t get_device_au_size(dev_t device_num);
+
+/**
+ * Gets the flags that should be passed to open() when opening the device under
+ * test.  The device is always opened for direct I/O; it is also opened with
+ * O_SYNC if the sync mode is set to SYNC_MODE_ALWAYS.
+ *
+ * @returns The flags to pass to open().
+ */
+int get_device_open_flags();
+
 /**
  * Indicates whether the specified device is a block device.
  *
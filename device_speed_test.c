@@ -7,32 +7,54 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "au_speed_test.h"
+#include "buffer_pool.h"
+#include "cache_size_test.h"
+#include "device.h"
 #include "device_speed_test.h"
+#include "io_watchdog.h"
+#include "latency_histogram.h"
 #include "lockfile.h"
 #include "messages.h"
 #include "mfst.h"
 #include "ncurses.h"
 #include "rng.h"
+#include "sustained_write_test.h"
 #include "util.h"
+#include "workload.h"
+
+// Number of seconds to spend on each queue depth during the queue depth sweep
+#define QUEUE_DEPTH_SWEEP_SECONDS 5
+
+// Number of seconds to spend on each of the sequential and random speed tests
+#define SPEED_TEST_SECONDS 30
+
+// Interval at which throughput is sampled during the speed tests, in
+// microseconds
+#define SPEED_TEST_SAMPLE_INTERVAL 100000
+
+#define SPEED_TEST_NUM_SAMPLES ((SPEED_TEST_SECONDS * 1000000) / SPEED_TEST_SAMPLE_INTERVAL)
+
+// Number of samples that make up the window used to work out the minimum
+// sustained rate (one second's worth)
+#define SPEED_TEST_SUSTAINED_WINDOW (1000000 / SPEED_TEST_SAMPLE_INTERVAL)
+
+// Number of samples at the end of each test that are averaged together to get
+// the steady-state rate (ten seconds' worth)
+#define SPEED_TEST_STEADY_STATE_SAMPLES ((10 * 1000000) / SPEED_TEST_SAMPLE_INTERVAL)
 
 // Scratch buffer for messages; we're allocating it statically so that we can
 // still log messages in case of memory shortages
 static char msg_buffer[512];
 
-void lseek_error_during_speed_test(device_testing_context_type *device_testing_context, int errnum) {
-    log_log(device_testing_context, "probe_device_speeds", SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errnum));
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_ABORTING_SPEED_TEST_DUE_TO_IO_ERROR);
-
-    snprintf(msg_buffer, sizeof(msg_buffer),
-             "We got an error while trying to move around the device.  It "
-             "could be that the device was removed or experienced an error and "
-             "disconnected itself.  If that's the case, the remainder of the "
-             "tests are going to fail pretty quickly.\n\nUnfortunately, this "
-             "means that we won't be able to complete the speed tests.\n\nThe "
-             "error we got was: %s", strerror(errnum));
+// Names of the speed tests, in the order of speed_test_type
+static const char *speed_test_names[SPEED_TEST_COUNT] = { "Sequential read", "Sequential write", "Random read", "Random write" };
 
-    message_window(device_testing_context, stdscr, WARNING_TITLE, msg_buffer, 1);
-}
+typedef struct _speed_test_sample_type {
+    uint64_t bytes;                     // Bytes transferred during the interval
+    uint64_t requests;                  // Requests completed during the
+                                        // interval
+} speed_test_sample_type;
 
 void io_error_during_speed_test(device_testing_context_type *device_testing_context, char write, int errnum) {
     log_log(device_testing_context, "probe_device_speeds", SEVERITY_LEVEL_DEBUG, write ? MSG_WRITE_ERROR : MSG_READ_ERROR, strerror(errnum));
@@ -48,20 +70,217 @@ void io_error_during_speed_test(device_testing_context_type *device_testing_cont
     message_window(device_testing_context, stdscr, WARNING_TITLE, msg_buffer, 1);
 }
 
+/**
+ * Works out the minimum sustained rate and the steady-state rate from the
+ * throughput samples taken during one of the speed tests.
+ *
+ * @param samples      The samples taken during the test.
+ * @param num_samples  The number of samples in `samples`.
+ * @param random       Non-zero if this was one of the random tests, in which
+ *                     case the rates are given in IOPS instead of bytes per
+ *                     second.
+ * @param result       The structure to place the rates in.
+ */
+static void summarize_speed_test_samples(speed_test_sample_type *samples, int num_samples, char random, speed_test_result_type *result) {
+    uint64_t window_total, total;
+    double rate;
+    int i, window;
+
+    window = num_samples < SPEED_TEST_SUSTAINED_WINDOW ? num_samples : SPEED_TEST_SUSTAINED_WINDOW;
+    result->min_sustained_rate = 0;
+    result->steady_state_rate = 0;
+
+    if(!window) {
+        return;
+    }
+
+    // Slide a one-second window across the samples and take the slowest one.
+    // A one-second window is long enough to smooth over a single slow request,
+    // but short enough to catch the device stalling to do garbage collection.
+    for(i = 0, window_total = 0; i < num_samples; i++) {
+        window_total += random ? samples[i].requests : samples[i].bytes;
+        if(i >= window) {
+            window_total -= random ? samples[i - window].requests : samples[i - window].bytes;
+        }
+
+        if(i >= (window - 1)) {
+            rate = ((double) window_total) / (((double) (window * SPEED_TEST_SAMPLE_INTERVAL)) / 1000000.0);
+            if(i == (window - 1) || rate < result->min_sustained_rate) {
+                result->min_sustained_rate = rate;
+            }
+        }
+    }
+
+    // Devices with an SLC cache tend to start out fast and settle down once
+    // the cache fills up, so only look at the tail end of the test
+    window = num_samples < SPEED_TEST_STEADY_STATE_SAMPLES ? num_samples : SPEED_TEST_STEADY_STATE_SAMPLES;
+    for(i = num_samples - window, total = 0; i < num_samples; i++) {
+        total += random ? samples[i].requests : samples[i].bytes;
+    }
+
+    result->steady_state_rate = ((double) total) / (((double) (window * SPEED_TEST_SAMPLE_INTERVAL)) / 1000000.0);
+}
+
+/**
+ * Writes the throughput samples taken during one of the speed tests out to the
+ * speed series file.
+ *
+ * @param file         The file to write the samples to.
+ * @param test_name    The name of the test.
+ * @param samples      The samples taken during the test.
+ * @param num_samples  The number of samples in `samples`.
+ * @param random       Non-zero if this was one of the random tests, in which
+ *                     case the rate is given in IOPS instead of bytes per
+ *                     second.
+ */
+static void write_speed_series(FILE *file, const char *test_name, speed_test_sample_type *samples, int num_samples, char random) {
+    int i;
+
+    for(i = 0; i < num_samples; i++) {
+        fprintf(file, "%s,%0.1f,%lu,%lu,%0.2f\n", test_name, ((double) ((i + 1) * SPEED_TEST_SAMPLE_INTERVAL)) / 1000000.0, samples[i].bytes, samples[i].requests,
+                ((double) (random ? samples[i].requests : samples[i].bytes)) / (((double) SPEED_TEST_SAMPLE_INTERVAL) / 1000000.0));
+    }
+
+    fflush(file);
+}
+
+/**
+ * Measures random 4K read and write speeds at queue depths of 1, 2, 4, 8, 16,
+ * and 32, spending QUEUE_DEPTH_SWEEP_SECONDS on each.  The results are placed
+ * in device_testing_context->performance_test_info.queue_depth_sweep.
+ *
+ * If no requests complete for --io-timeout seconds, the device is reset to
+ * knock the stuck requests loose and the sweep is abandoned.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param window                  The window being displayed to the user.
+ *
+ * @returns 0 if the sweep completed successfully, or -1 if an error occurred.
+ *          On error, errno is set to the underlying error.
+ */
+static int run_queue_depth_sweep(device_testing_context_type *device_testing_context, WINDOW *window) {
+    workload_job_type job;
+    workload_result_type job_result;
+    latency_histogram_type *histogram;
+    queue_depth_result_type *result;
+    int step, max_depth, local_errno;
+    char wr;
+
+    max_depth = 1 << (QUEUE_DEPTH_SWEEP_STEPS - 1);
+
+    // Each step of the sweep is just a random 4K workload job that runs for
+    // QUEUE_DEPTH_SWEEP_SECONDS across the whole device
+    memset(&job, 0, sizeof(job));
+    job.name = "queue depth sweep";
+    job.pattern = WORKLOAD_PATTERN_RANDOM;
+    job.block_sizes[0].size = RANDOM_IO_SIZE;
+    job.block_sizes[0].weight = 1;
+    job.num_block_sizes = 1;
+    job.total_weight = 1;
+    job.region_end = 100;
+    job.duration = QUEUE_DEPTH_SWEEP_SECONDS;
+
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_QUEUE_DEPTH_SWEEP_STARTING, max_depth);
+    device_testing_context->performance_test_info.queue_depth_sweep_steps = 0;
+
+    for(step = 0; step < QUEUE_DEPTH_SWEEP_STEPS; step++) {
+        result = &device_testing_context->performance_test_info.queue_depth_sweep[step];
+        result->queue_depth = job.queue_depth = 1 << step;
+
+        for(wr = 0; wr < 2; wr++) {
+            job.read_percent = wr ? 0 : 100;
+
+            if(execute_workload_job(device_testing_context, &job, 0, device_testing_context->device_info.num_physical_sectors * device_testing_context->device_info.sector_size,
+                                    RANDOM_IO_SIZE, window, 0, &job_result)) {
+                local_errno = errno;
+
+                if(job_result.failure == WORKLOAD_FAILURE_STALLED) {
+                    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_QUEUE_DEPTH_SWEEP_STALLED, program_options.io_timeout);
+                } else if(job_result.failure == WORKLOAD_FAILURE_THREAD) {
+                    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_QUEUE_DEPTH_SWEEP_THREAD_ERROR, strerror(local_errno));
+                }
+
+                errno = local_errno;
+                return -1;
+            }
+
+            histogram = wr ? &job_result.write_histogram : &job_result.read_histogram;
+
+            if(wr) {
+                result->write_iops = histogram->num_samples / job_result.secs;
+                result->write_latency_p50 = latency_histogram_percentile(histogram, 50);
+                result->write_latency_p99 = latency_histogram_percentile(histogram, 99);
+                result->write_latency_p999 = latency_histogram_percentile(histogram, 99.9);
+            } else {
+                result->read_iops = histogram->num_samples / job_result.secs;
+                result->read_latency_p50 = latency_histogram_percentile(histogram, 50);
+                result->read_latency_p99 = latency_histogram_percentile(histogram, 99);
+                result->read_latency_p999 = latency_histogram_percentile(histogram, 99.9);
+            }
+
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_QUEUE_DEPTH_SWEEP_RESULT, wr ? "write" : "read", result->queue_depth, wr ? result->write_iops : result->read_iops,
+                    wr ? result->write_latency_p50 : result->read_latency_p50, wr ? result->write_latency_p99 : result->read_latency_p99,
+                    wr ? result->write_latency_p999 : result->read_latency_p999);
+        }
+
+        device_testing_context->performance_test_info.queue_depth_sweep_steps = step + 1;
+    }
+
+    return 0;
+}
+
+double get_best_random_iops(device_testing_context_type *device_testing_context, char write) {
+    double best;
+    int i;
+
+    best = write ? device_testing_context->performance_test_info.random_write_iops : device_testing_context->performance_test_info.random_read_iops;
+
+    for(i = 0; i < device_testing_context->performance_test_info.queue_depth_sweep_steps; i++) {
+        if(write && device_testing_context->performance_test_info.queue_depth_sweep[i].write_iops > best) {
+            best = device_testing_context->performance_test_info.queue_depth_sweep[i].write_iops;
+        } else if(!write && device_testing_context->performance_test_info.queue_depth_sweep[i].read_iops > best) {
+            best = device_testing_context->performance_test_info.queue_depth_sweep[i].read_iops;
+        }
+    }
+
+    return best;
+}
+
+double get_sustained_write_speed(device_testing_context_type *device_testing_context) {
+    if(device_testing_context->sustained_write_test_info.sustained_write_speed) {
+        return device_testing_context->sustained_write_test_info.sustained_write_speed;
+    }
+
+    return device_testing_context->performance_test_info.sequential_write_speed;
+}
+
+double get_class_marking_write_speed(device_testing_context_type *device_testing_context, char large_ru) {
+    if(device_testing_context->au_speed_test_info.small_ru.min_write_speed && device_testing_context->au_speed_test_info.large_ru.min_write_speed) {
+        return large_ru ? device_testing_context->au_speed_test_info.large_ru.min_write_speed : device_testing_context->au_speed_test_info.small_ru.min_write_speed;
+    }
+
+    return get_sustained_write_speed(device_testing_context);
+}
+
 int probe_device_speeds(device_testing_context_type *device_testing_context) {
     char *buf, wr, rd;
     uint64_t ctr, bytes_left, cur;
     int64_t ret;
-    struct timeval start_time, cur_time;
-    double secs, prev_secs;
-    char rate[15];
-    int local_errno;
+    struct timeval start_time, cur_time, op_start_time;
+    double secs, prev_secs, small_ru_write_speed, large_ru_write_speed;
+    char rate[15], sustained_rate[24], steady_state_rate[24];
+    int local_errno, sample, num_samples;
     WINDOW *window;
+    FILE *series_file = NULL;
+    latency_histogram_type histogram;
+    speed_test_sample_type samples[SPEED_TEST_NUM_SAMPLES];
+    speed_test_result_type *result;
 
     device_testing_context->performance_test_info.sequential_write_speed = 0;
     device_testing_context->performance_test_info.sequential_read_speed = 0;
     device_testing_context->performance_test_info.random_write_iops = 0;
     device_testing_context->performance_test_info.random_read_iops = 0;
+    memset(device_testing_context->performance_test_info.speed_test_results, 0, sizeof(device_testing_context->performance_test_info.speed_test_results));
 
     if(lock_lockfile(device_testing_context)) {
         local_errno = errno;
@@ -76,8 +295,9 @@ int probe_device_speeds(device_testing_context_type *device_testing_context) {
         return -1;
     }
 
-    if(local_errno = posix_memalign((void **) &buf, sysconf(_SC_PAGESIZE), device_testing_context->device_info.optimal_block_size < 4096 ? 4096 : device_testing_context->device_info.optimal_block_size)) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_POSIX_MEMALIGN_ERROR, strerror(local_errno));
+    if(!(buf = buffer_pool_get(device_testing_context, device_testing_context->device_info.optimal_block_size < 4096 ? 4096 : device_testing_context->device_info.optimal_block_size))) {
+        local_errno = errno;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, device_testing_context->device_info.optimal_block_size < 4096 ? 4096 : device_testing_context->device_info.optimal_block_size, strerror(local_errno));
         log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_ABORTING_SPEED_TEST_DUE_TO_MEMORY_ERROR);
 
         unlock_lockfile(device_testing_context);
@@ -92,79 +312,77 @@ int probe_device_speeds(device_testing_context_type *device_testing_context) {
         return -1;
     }
 
+    if(program_options.speed_series_file) {
+        if(!(series_file = fopen(program_options.speed_series_file, "a"))) {
+            // Not worth giving up on the speed tests over
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SPEED_SERIES_FILE_OPEN_ERROR, program_options.speed_series_file, strerror(errno));
+        } else {
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_LOGGING_SPEED_SERIES_TO_FILE, program_options.speed_series_file);
+
+            // Only write the CSV headers if the file is new
+            if(!ftell(series_file)) {
+                fprintf(series_file, "Test,Time (s),Bytes,Requests,Rate (bytes/sec or IOPS)\n");
+            }
+        }
+    }
+
     log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_SPEED_TEST_STARTING);
     window = message_window(device_testing_context, stdscr, NULL, "Testing read/write speeds...", 0);
 
     for(rd = 0; rd < 2; rd++) {
         for(wr = 0; wr < 2; wr++) {
             ctr = 0;
+            num_samples = 0;
+            memset(samples, 0, sizeof(samples));
+            latency_histogram_reset(&histogram);
             assert(!gettimeofday(&start_time, NULL));
 
             if(!rd) {
-                if(lseek(device_testing_context->device_info.fd, 0, SEEK_SET) == -1) {
-                    local_errno = errno;
-                    erase_and_delete_window(window);
-                    free(buf);
-
-                    lseek_error_during_speed_test(device_testing_context, local_errno);
-
-                    return -1;
+                // The capacity test just finished writing to the start of the
+                // device, so start the sequential read test past the point where
+                // any of that could still be in the device's write cache
+                cur = wr ? 0 : (get_cache_defeat_size(device_testing_context) / device_testing_context->device_info.optimal_block_size) * device_testing_context->device_info.optimal_block_size;
+                if(cur >= (device_testing_context->device_info.num_physical_sectors * device_testing_context->device_info.sector_size)) {
+                    cur = 0;
                 }
-
-                cur = 0;
             }
 
             secs = 0;
             prev_secs = 0;
-            while(secs < 30) {
+            while(secs < SPEED_TEST_SECONDS) {
                 if(wr) {
                     rng_fill_buffer(device_testing_context, buf, rd ? 4096 : device_testing_context->device_info.optimal_block_size);
                 }
 
                 bytes_left = rd ? 4096 : device_testing_context->device_info.optimal_block_size;
-                while(bytes_left && secs < 30) {
+                while(bytes_left && secs < SPEED_TEST_SECONDS) {
                     handle_key_inputs(device_testing_context, window);
                     if(rd) {
                         // Choose a random sector, aligned on a 4K boundary
                         cur = (((((uint64_t) rng_get_random_number(device_testing_context)) << 32) | rng_get_random_number(device_testing_context)) & 0x7FFFFFFFFFFFFFFF) %
                             (device_testing_context->device_info.num_physical_sectors - (4096 / device_testing_context->device_info.sector_size)) & 0xFFFFFFFFFFFFFFF8;
-                        if(lseek(device_testing_context->device_info.fd, cur * device_testing_context->device_info.sector_size, SEEK_SET) == -1) {
-                            erase_and_delete_window(window);
-                            lseek_error_during_speed_test(device_testing_context, local_errno);
-                            free(buf);
-                            unlock_lockfile(device_testing_context);
-                            return -1;
-                        }
-                    } else {
-                        if(cur >= (device_testing_context->device_info.num_physical_sectors * device_testing_context->device_info.sector_size)) {
-                            if(lseek(device_testing_context->device_info.fd, 0, SEEK_SET) == -1) {
-                                local_errno = errno;
-
-                                erase_and_delete_window(window);
-
-                                free(buf);
-
-                                lseek_error_during_speed_test(device_testing_context, local_errno);
-
-                                return -1;
-                            }
-
-                            cur = 0;
-                        }
+                    } else if(cur >= (device_testing_context->device_info.num_physical_sectors * device_testing_context->device_info.sector_size)) {
+                        // Wrap back around to the start of the device
+                        cur = 0;
                     }
 
+                    assert(!gettimeofday(&op_start_time, NULL));
                     if(wr) {
-                        ret = write(device_testing_context->device_info.fd, buf, bytes_left);
+                        ret = io_watchdog_write(device_testing_context, buf, bytes_left, rd ? cur * device_testing_context->device_info.sector_size : cur);
                     } else {
-                        ret = read(device_testing_context->device_info.fd, buf, bytes_left);
+                        ret = io_watchdog_read(device_testing_context, buf, bytes_left, rd ? cur * device_testing_context->device_info.sector_size : cur);
                     }
 
                     if(ret == -1) {
                         local_errno = errno;
                         erase_and_delete_window(window);
-                        free(buf);
+                        buffer_pool_put(device_testing_context, buf);
                         unlock_lockfile(device_testing_context);
 
+                        if(series_file) {
+                            fclose(series_file);
+                        }
+
                         io_error_during_speed_test(device_testing_context, wr, local_errno);
 
                         return -1;
@@ -182,6 +400,20 @@ int probe_device_speeds(device_testing_context_type *device_testing_context) {
                     assert(!gettimeofday(&cur_time, NULL));
                     secs = ((double)timediff(start_time, cur_time)) / 1000000.0;
 
+                    latency_histogram_add(&histogram, timediff(op_start_time, cur_time));
+
+                    // Credit the request to the interval it finished in.  The
+                    // last request may finish a little past the end of the
+                    // test; lump it in with the last interval.
+                    sample = timediff(start_time, cur_time) / SPEED_TEST_SAMPLE_INTERVAL;
+                    if(sample >= SPEED_TEST_NUM_SAMPLES) {
+                        sample = SPEED_TEST_NUM_SAMPLES - 1;
+                    }
+
+                    samples[sample].bytes += ret;
+                    samples[sample].requests++;
+                    num_samples = sample + 1;
+
                     if(!program_options.no_curses) {
                         // Update the on-screen display every half second
                         if((secs - prev_secs) >= 0.5) {
@@ -215,9 +447,57 @@ int probe_device_speeds(device_testing_context_type *device_testing_context) {
                     print_class_marking_qualifications(device_testing_context);
                 }
             }
+
+            result = &device_testing_context->performance_test_info.speed_test_results[(rd * 2) + wr];
+            result->latency_p50 = latency_histogram_percentile(&histogram, 50);
+            result->latency_p99 = latency_histogram_percentile(&histogram, 99);
+            result->latency_p999 = latency_histogram_percentile(&histogram, 99.9);
+            summarize_speed_test_samples(samples, num_samples, rd, result);
+
+            if(rd) {
+                snprintf(sustained_rate, sizeof(sustained_rate), "%0.2f IOPS", result->min_sustained_rate);
+                snprintf(steady_state_rate, sizeof(steady_state_rate), "%0.2f IOPS", result->steady_state_rate);
+            } else {
+                format_rate(result->min_sustained_rate, sustained_rate, sizeof(sustained_rate));
+                format_rate(result->steady_state_rate, steady_state_rate, sizeof(steady_state_rate));
+            }
+
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_LATENCY_RESULTS, speed_test_names[(rd * 2) + wr], result->latency_p50, result->latency_p99,
+                    result->latency_p999);
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_CONSISTENCY_RESULTS, speed_test_names[(rd * 2) + wr], sustained_rate, steady_state_rate);
+
+            if(series_file) {
+                write_speed_series(series_file, speed_test_names[(rd * 2) + wr], samples, num_samples, rd);
+            }
         }
     }
     
+    if(program_options.sustained_write_percent) {
+        // Errors are logged and reported by probe_sustained_write_speed()
+        probe_sustained_write_speed(device_testing_context);
+    }
+
+    if(program_options.au_speed_test) {
+        // Errors are logged and reported by probe_au_write_speeds()
+        probe_au_write_speeds(device_testing_context);
+    }
+
+    if(run_queue_depth_sweep(device_testing_context, window)) {
+        local_errno = errno;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_IO_ERROR_DURING_QUEUE_DEPTH_SWEEP, strerror(local_errno));
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_ABORTING_QUEUE_DEPTH_SWEEP);
+    }
+
+    if(program_options.num_workload_jobs) {
+        // Errors are logged and reported by run_workload_jobs()
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_RUNNING_WORKLOAD_FILE, program_options.num_workload_jobs, program_options.workload_file);
+        run_workload_jobs(device_testing_context, program_options.workload_jobs, program_options.num_workload_jobs);
+    }
+
+    if(series_file) {
+        fclose(series_file);
+    }
+
     unlock_lockfile(device_testing_context);
 
     erase_and_delete_window(window);
@@ -229,29 +509,37 @@ int probe_device_speeds(device_testing_context_type *device_testing_context) {
     // because we're going to use print_class_marking_qualifications() to
     // repaint them on the display, and we don't want to print them to the log
     // a second time if they've already been printed out.
+    small_ru_write_speed = get_class_marking_write_speed(device_testing_context, 0);
+    large_ru_write_speed = get_class_marking_write_speed(device_testing_context, 1);
+    if(device_testing_context->au_speed_test_info.test_performed) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_USING_AU_SPEED_TEST_RESULTS);
+    } else if(device_testing_context->sustained_write_test_info.test_performed) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_USING_SUSTAINED_WRITE_SPEED, format_rate(large_ru_write_speed, rate, sizeof(rate)));
+    }
+
     log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_SPEED_CLASS_QUALIFICATION_RESULTS);
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_CLASS_2, device_testing_context->performance_test_info.sequential_write_speed >= 2000000 ? "Yes" : "No");
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_CLASS_4, device_testing_context->performance_test_info.sequential_write_speed >= 4000000 ? "Yes" : "No");
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_CLASS_6, device_testing_context->performance_test_info.sequential_write_speed >= 6000000 ? "Yes" : "No");
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_CLASS_10, device_testing_context->performance_test_info.sequential_write_speed >= 10000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_CLASS_2, small_ru_write_speed >= 2000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_CLASS_4, small_ru_write_speed >= 4000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_CLASS_6, small_ru_write_speed >= 6000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_CLASS_10, large_ru_write_speed >= 10000000 ? "Yes" : "No");
     log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_BLANK_LINE);
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_U1, device_testing_context->performance_test_info.sequential_write_speed >= 10000000 ? "Yes" : "No");
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_U3, device_testing_context->performance_test_info.sequential_write_speed >= 30000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_U1, large_ru_write_speed >= 10000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_U3, large_ru_write_speed >= 30000000 ? "Yes" : "No");
     log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_BLANK_LINE);
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_V6, device_testing_context->performance_test_info.sequential_write_speed >= 6000000 ? "Yes" : "No");
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_V10, device_testing_context->performance_test_info.sequential_write_speed >= 10000000 ? "Yes" : "No");
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_V30, device_testing_context->performance_test_info.sequential_write_speed >= 30000000 ? "Yes" : "No");
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_V60, device_testing_context->performance_test_info.sequential_write_speed >= 60000000 ? "Yes" : "No");
-    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_V90, device_testing_context->performance_test_info.sequential_write_speed >= 90000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_V6, large_ru_write_speed >= 6000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_V10, large_ru_write_speed >= 10000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_V30, large_ru_write_speed >= 30000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_V60, large_ru_write_speed >= 60000000 ? "Yes" : "No");
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_V90, large_ru_write_speed >= 90000000 ? "Yes" : "No");
     log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_BLANK_LINE);
     log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_A1,
             (device_testing_context->performance_test_info.sequential_write_speed >= 10485760 && device_testing_context->performance_test_info.random_read_iops >= 1500 &&
              device_testing_context->performance_test_info.random_write_iops >= 500) ? "Yes" : "No");
     log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_QUALIFIES_FOR_A2,
-            (device_testing_context->performance_test_info.sequential_write_speed >= 10485760 && device_testing_context->performance_test_info.random_read_iops >= 4000 &&
-             device_testing_context->performance_test_info.random_write_iops >= 2000) ? "Yes" : "No");
+            (device_testing_context->performance_test_info.sequential_write_speed >= 10485760 && get_best_random_iops(device_testing_context, 0) >= 4000 &&
+             get_best_random_iops(device_testing_context, 1) >= 2000) ? "Yes" : "No");
     log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_BLANK_LINE);
 
-    free(buf);
+    buffer_pool_put(device_testing_context, buf);
     return 0;
 }
@@ -3,7 +3,49 @@
 
 #include "device_testing_context.h"
 
+// Size of the requests issued during the random I/O tests
+#define RANDOM_IO_SIZE 4096
+
 void print_class_marking_qualifications(device_testing_context_type *device_testing_context);
 int probe_device_speeds(device_testing_context_type *device_testing_context);
 
+/**
+ * Returns the best random read or write speed measured by the speed test, at
+ * any queue depth.
+ *
+ * @param device_testing_context  The device that was tested.
+ * @param write                   Non-zero to return the best random write
+ *                                speed, or zero to return the best random read
+ *                                speed.
+ *
+ * @returns The best speed, in IOPS per second.
+ */
+double get_best_random_iops(device_testing_context_type *device_testing_context, char write);
+
+/**
+ * Returns the write speed that the speed class markings should be judged
+ * against: the sustained write speed, if the sustained write test was run, or
+ * the speed measured by the 30-second sequential write test otherwise.
+ *
+ * @param device_testing_context  The device that was tested.
+ *
+ * @returns The write speed, in bytes per second.
+ */
+double get_sustained_write_speed(device_testing_context_type *device_testing_context);
+
+/**
+ * Returns the write speed that a speed class marking should be judged against.
+ * If the AU speed test was run, this is the write speed of its slowest AU
+ * using the recording unit size that the marking calls for; otherwise, it's
+ * the same as get_sustained_write_speed().
+ *
+ * @param device_testing_context  The device that was tested.
+ * @param large_ru                Non-zero for Speed Class 10, the UHS Speed
+ *                                Classes, and the Video Speed Classes, or zero
+ *                                for Speed Class 2, 4, and 6.
+ *
+ * @returns The write speed, in bytes per second.
+ */
+double get_class_marking_write_speed(device_testing_context_type *device_testing_context, char large_ru);
+
 #endif // !defined(DEVICE_SPEED_TEST_H)
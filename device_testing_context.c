@@ -3,7 +3,9 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "buffer_pool.h"
 #include "device_testing_context.h"
+#include "stats_block.h"
 
 device_testing_context_type *new_device_testing_context(int bod_mod_buffer_size) {
     device_testing_context_type *ret;
@@ -36,12 +38,17 @@ device_testing_context_type *new_device_testing_context(int bod_mod_buffer_size)
 
     ret->device_info.bod_mod_buffer_size = bod_mod_buffer_size;
 
+    // Publish the initial values so that nobody sees the thresholds as having
+    // been reached before the first snapshot is published
+    stats_block_publish(ret);
+
     return ret;
 }
 
 void delete_device_testing_context(device_testing_context_type *dtc) {
     if(dtc) {
         device_info_invalidate_file_handle(dtc);
+        buffer_pool_release(dtc);
 
         if(dtc->device_info.device_name) {
             free(dtc->device_info.device_name);
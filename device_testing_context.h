@@ -49,6 +49,11 @@ typedef struct _device_info_type {
                                    // run, by multiplying sector_size by
                                    // max_sectors_per_request.
 
+    uint64_t write_cache_size;     // Estimated size of the device's write
+                                   // cache, in bytes, as determined by the
+                                   // write cache size test; or 0 if the test
+                                   // was not run or was inconclusive.
+
     FakeFlashEnum is_fake_flash;   // Whether the device is considered fake
                                    // as determined by the capacity test; or, if
                                    // the capacity test was not run, as
@@ -84,6 +89,161 @@ typedef struct _optimal_block_size_test_info_type {
 
 } optimal_block_size_test_info_type;
 
+typedef struct _write_cache_size_test_info_type {
+    int test_performed;          // Was the test run, and did it complete
+                                 // successfully?
+
+    uint64_t write_cache_size;   // Estimated size of the device's write cache,
+                                 // in bytes, as determined by the write cache
+                                 // size test.  0 if the test couldn't tell.
+
+} write_cache_size_test_info_type;
+
+typedef struct _sustained_write_test_info_type {
+    int test_performed;            // Was the test run, and did it complete
+                                   // successfully?
+
+    int cliff_detected;            // Did the write speed drop off partway
+                                   // through the test?
+
+    int plateau_detected;          // Did the test end early because the write
+                                   // speed held steady without dropping off?
+
+    uint64_t bytes_written;        // Total number of bytes written during the
+                                   // test
+
+    uint64_t write_cache_size;     // Number of bytes written before the write
+                                   // speed dropped off.  0 if it never did.
+
+    double pre_cliff_write_speed;  // Average write speed before the drop, in
+                                   // bytes per second.  0 if there wasn't one.
+
+    double post_cliff_write_speed; // Average write speed after the drop, in
+                                   // bytes per second.  0 if there wasn't one.
+
+    double sustained_write_speed;  // The write speed the device can keep up
+                                   // indefinitely, in bytes per second: the
+                                   // post-cliff speed if there was a drop, or
+                                   // the average speed for the whole test if
+                                   // there wasn't
+
+} sustained_write_test_info_type;
+
+// Recording unit sizes used by the AU speed test.  The SD Association's
+// performance model uses the smaller size for Speed Class 2, 4, and 6, and the
+// larger size for Speed Class 10, the UHS Speed Classes, and the Video Speed
+// Classes.
+#define AU_SPEED_TEST_SMALL_RU_SIZE 65536
+#define AU_SPEED_TEST_LARGE_RU_SIZE 524288
+
+typedef struct _au_speed_test_result_type {
+    uint64_t ru_size;              // Recording unit size used, in bytes
+
+    int num_aus;                   // Number of AUs written
+
+    double min_write_speed;        // Write speed of the slowest AU, in bytes
+                                   // per second
+
+    uint64_t slowest_au;           // Byte offset of the slowest AU
+
+    double avg_write_speed;        // Average write speed across all of the AUs,
+                                   // in bytes per second
+
+} au_speed_test_result_type;
+
+typedef struct _au_speed_test_info_type {
+    int test_performed;            // Was the test run, and did it complete
+                                   // successfully?
+
+    uint64_t au_size;              // Allocation unit size used for the test, in
+                                   // bytes
+
+    au_speed_test_result_type small_ru;
+                                   // Results using AU_SPEED_TEST_SMALL_RU_SIZE
+                                   // recording units
+
+    au_speed_test_result_type large_ru;
+                                   // Results using AU_SPEED_TEST_LARGE_RU_SIZE
+                                   // recording units
+
+} au_speed_test_info_type;
+
+// Number of regions the surface scan divides the device into
+#define SURFACE_SCAN_REGIONS 1024
+
+typedef struct _surface_scan_region_type {
+    double read_rate;              // Average read speed across the region, in
+                                   // bytes per second.  0 if the region hasn't
+                                   // been scanned.
+
+    uint64_t avg_latency;          // Average time taken by each read, in
+                                   // microseconds
+
+    uint64_t max_latency;          // Time taken by the slowest read, in
+                                   // microseconds
+
+    uint64_t read_errors;          // Number of reads that failed
+
+} surface_scan_region_type;
+
+typedef struct _surface_scan_result_type {
+    uint64_t scan_num;             // Which scan this is, starting from 1
+
+    uint64_t round_num;            // Number of rounds of the endurance test
+                                   // that had been completed when the scan was
+                                   // run
+
+    time_t end_time;               // When the scan finished
+
+    int num_regions;               // Number of regions the device was divided
+                                   // into (SURFACE_SCAN_REGIONS, unless the
+                                   // device has fewer sectors than that)
+
+    uint64_t region_size;          // Size of each region, in bytes.  The last
+                                   // region also picks up any sectors left
+                                   // over at the end of the device.
+
+    unsigned int sample_percent;   // Percentage of each region that was read
+
+    double median_read_rate;       // Median of the regions' read speeds, in
+                                   // bytes per second
+
+    surface_scan_region_type regions[SURFACE_SCAN_REGIONS];
+
+} surface_scan_result_type;
+
+typedef struct _surface_scan_info_type {
+    surface_scan_result_type latest;
+                                   // Results of the most recent scan to
+                                   // complete
+
+    surface_scan_result_type current;
+                                   // Results so far of the scan in progress
+
+    volatile uint64_t scans_performed;
+                                   // Number of scans that have completed
+
+    unsigned int sequence;         // Sequence counter for the seqlock that
+                                   // protects latest and scans_performed (see
+                                   // stats_block_publish_surface_scan())
+
+    int scan_in_progress;          // Is a scan running right now?
+
+} surface_scan_info_type;
+
+typedef struct _fake_flash_screen_info_type {
+    int test_performed;            // Was the screening run, and did it
+                                   // complete successfully?
+
+    FakeFlashEnum is_fake_flash;   // The verdict reached by the screening.
+
+    uint64_t points_checked;       // Number of points that were read back
+                                   // before the verdict was reached.
+
+    uint64_t points_failed;        // Number of points that failed to verify.
+
+} fake_flash_screen_info_type;
+
 typedef struct _capacity_test_info_type {
     int perform_test;            // Should the test be run?
 
@@ -103,6 +263,64 @@ typedef struct _capacity_test_info_type {
 
 } capacity_test_info_type;
 
+// Number of queue depths tried by the queue depth sweep (1, 2, 4, ... 32)
+#define QUEUE_DEPTH_SWEEP_STEPS 6
+
+typedef struct _queue_depth_result_type {
+    int queue_depth;                // Number of requests kept in flight
+
+    double read_iops;               // Measured random read speed at this
+                                    // queue depth, in IOPS per second
+
+    double write_iops;              // Measured random write speed at this
+                                    // queue depth, in IOPS per second
+
+    uint64_t read_latency_p50;      // Median random read latency, in
+                                    // microseconds
+
+    uint64_t read_latency_p99;      // 99th percentile random read latency,
+                                    // in microseconds
+
+    uint64_t read_latency_p999;     // 99.9th percentile random read latency,
+                                    // in microseconds
+
+    uint64_t write_latency_p50;     // Median random write latency, in
+                                    // microseconds
+
+    uint64_t write_latency_p99;     // 99th percentile random write latency,
+                                    // in microseconds
+
+    uint64_t write_latency_p999;    // 99.9th percentile random write latency,
+                                    // in microseconds
+} queue_depth_result_type;
+
+// Indices into performance_test_info_type.speed_test_results
+typedef enum {
+    SPEED_TEST_SEQUENTIAL_READ,
+    SPEED_TEST_SEQUENTIAL_WRITE,
+    SPEED_TEST_RANDOM_READ,
+    SPEED_TEST_RANDOM_WRITE,
+    SPEED_TEST_COUNT
+} speed_test_type;
+
+typedef struct _speed_test_result_type {
+    uint64_t latency_p50;          // Median request latency, in microseconds
+
+    uint64_t latency_p99;          // 99th percentile request latency, in
+                                   // microseconds
+
+    uint64_t latency_p999;         // 99.9th percentile request latency, in
+                                   // microseconds
+
+    double min_sustained_rate;     // Lowest rate seen over any one-second
+                                   // stretch of the test (bytes per second for
+                                   // the sequential tests, IOPS for the random
+                                   // tests)
+
+    double steady_state_rate;      // Average rate over the last part of the
+                                   // test, in the same units
+} speed_test_result_type;
+
 typedef struct _performance_test_info_type {
     int perform_test;              // Should the test be run?
 
@@ -122,6 +340,17 @@ typedef struct _performance_test_info_type {
     double random_read_iops;       // Measured random read speed, in IOPS per
                                    // second
 
+    speed_test_result_type speed_test_results[SPEED_TEST_COUNT];
+                                   // Latency and consistency results for each
+                                   // of the four speed tests
+
+    int queue_depth_sweep_steps;   // Number of entries in queue_depth_sweep
+                                   // that have been filled in
+
+    queue_depth_result_type queue_depth_sweep[QUEUE_DEPTH_SWEEP_STEPS];
+                                   // Random read/write results at each queue
+                                   // depth tried by the queue depth sweep
+
 } performance_test_info_type;
 
 typedef enum _current_phase_type {
@@ -148,6 +377,9 @@ typedef struct _stats_file_counters_type {
     uint64_t last_bad_sectors;       // Total number of bad sectors at last
                                      // update
 
+    uint64_t last_io_timeouts;       // Total number of I/O timeouts at last
+                                     // update
+
 } stats_file_counters_type;
 
 typedef struct _screen_counters_type {
@@ -171,6 +403,46 @@ typedef struct _rng_state_type {
 
 } rng_state_type;
     
+// Number of end-of-round summaries kept around for the SQL thread to pick up
+#define ROUND_HISTORY_SIZE 64
+
+typedef struct _round_summary_type {
+    uint64_t round_num;                      // Which round this summary is for
+
+    time_t end_time;                         // When the round ended
+
+    uint64_t num_bad_sectors_this_round;     // Sectors that failed this round
+
+    uint64_t num_new_bad_sectors_this_round; // Sectors that failed for the
+                                             // first time this round
+
+    uint64_t num_good_sectors_this_round;    // Previously bad sectors that
+                                             // tested good this round
+
+    uint64_t total_bad_sectors;              // Bad sectors as of the end of
+                                             // the round
+
+    uint64_t total_bytes_read;               // Bytes read from the device as of
+                                             // the end of the round
+
+    uint64_t total_bytes_written;            // Bytes written to the device as
+                                             // of the end of the round
+} round_summary_type;
+
+typedef struct _round_history_type {
+                                             // The most recent summaries.
+                                             // Summary n is stored at
+                                             // entries[n % ROUND_HISTORY_SIZE].
+    round_summary_type entries[ROUND_HISTORY_SIZE];
+
+                                             // Total number of summaries that
+                                             // have been recorded.  Written
+                                             // with a release store once the
+                                             // summary is complete, and read
+                                             // with an acquire load.
+    uint64_t num_recorded;
+} round_history_type;
+
 typedef struct _endurance_test_info_type {
     int perform_test;                        // Should the test be performed?
 
@@ -256,14 +528,205 @@ typedef struct _endurance_test_info_type {
     rng_state_type rng_state;                // State for the RNG used with this
                                              // device
 
+    round_history_type round_history;        // Summaries of the most recently
+                                             // completed rounds
+
+    struct timeval phase_start_time;         // When the current read or write
+                                             // phase started
+
+    uint64_t phase_start_bytes;              // Total bytes read (or written,
+                                             // for a write phase) when the
+                                             // current phase started
+
+    double last_write_phase_rate;            // Average write rate over the
+                                             // last completed write phase, in
+                                             // bytes per second
+
+    double last_read_phase_rate;             // Average read rate over the last
+                                             // completed read phase, in bytes
+                                             // per second
+
 } endurance_test_info_type;
 
+typedef struct _io_timeout_stats_type {
+                                     // Number of I/O operations that exceeded
+                                     // the I/O timeout
+    volatile uint64_t num_timeouts;
+
+                                     // Number of times the device had to be
+                                     // reset to cancel a hung I/O operation
+    volatile uint64_t num_forced_resets;
+
+                                     // Total time spent in I/O operations that
+                                     // timed out, in microseconds
+    volatile uint64_t total_timeout_time;
+
+                                     // Longest time spent in a single I/O
+                                     // operation that timed out, in
+                                     // microseconds
+    volatile uint64_t longest_timeout_time;
+
+} io_timeout_stats_type;
+
+// Number of buckets in the I/O latency histograms.  The upper bound of each
+// bucket is listed in io_latency_bucket_bounds (see io_watchdog.h); the last
+// bucket holds everything that took longer than that.
+#define IO_LATENCY_BUCKETS 17
+
+typedef struct _io_latency_stats_type {
+                                     // Number of reads issued to the device
+    volatile uint64_t num_reads;
+
+                                     // Total time spent in reads, in
+                                     // microseconds
+    volatile uint64_t total_read_time;
+
+                                     // Number of writes issued to the device
+    volatile uint64_t num_writes;
+
+                                     // Total time spent in writes, in
+                                     // microseconds
+    volatile uint64_t total_write_time;
+
+                                     // Number of reads that fell into each
+                                     // latency bucket
+    volatile uint64_t read_latency_buckets[IO_LATENCY_BUCKETS];
+
+                                     // Number of writes that fell into each
+                                     // latency bucket
+    volatile uint64_t write_latency_buckets[IO_LATENCY_BUCKETS];
+
+} io_latency_stats_type;
+
+typedef struct _device_event_stats_type {
+                                     // Number of times the device was
+                                     // disconnected during the endurance test
+    volatile uint64_t num_disconnects;
+
+                                     // Number of times the device was found
+                                     // again after being disconnected
+    volatile uint64_t num_reconnects;
+
+                                     // Number of times the device was reset to
+                                     // recover from an I/O error
+    volatile uint64_t num_resets;
+
+                                     // Number of times we paused to let
+                                     // another copy of the program run its
+                                     // speed tests
+    volatile uint64_t num_lockfile_pauses;
+
+                                     // Total time spent paused waiting for the
+                                     // lockfile, in microseconds
+    volatile uint64_t total_lockfile_pause_time;
+
+} device_event_stats_type;
+
+typedef struct _control_state_type {
+                                     // Has a pause been requested through the
+                                     // control socket?
+    volatile int pause_requested;
+
+                                     // Maximum combined read/write rate, in
+                                     // bytes per second (0 for no limit)
+    volatile uint64_t bandwidth_limit;
+
+                                     // Block size to switch to at the next
+                                     // slice boundary, in bytes (0 if no
+                                     // change is pending)
+    volatile uint64_t requested_block_size;
+
+                                     // Should the state be saved at the next
+                                     // slice boundary?
+    volatile int checkpoint_requested;
+
+                                     // The rest is used by the main thread to
+                                     // enforce the bandwidth limit: the limit
+                                     // that was in effect, and the time and
+                                     // byte count it's being measured from
+    uint64_t throttle_limit;
+    struct timeval throttle_start_time;
+    uint64_t throttle_start_bytes;
+
+} control_state_type;
+
+typedef struct _stats_snapshot_type {
+                                     // Copies of the endurance test counters
+    uint64_t total_bytes_written;
+    uint64_t total_bytes_read;
+    uint64_t rounds_completed;
+    uint64_t total_bad_sectors;
+    uint64_t num_bad_sectors_this_round;
+    uint64_t rounds_to_first_error;
+    uint64_t rounds_to_0_1_threshold;
+    uint64_t rounds_to_1_threshold;
+    uint64_t rounds_to_10_threshold;
+    uint64_t rounds_to_25_threshold;
+
+                                     // Which phase we're in, and when (and
+                                     // at how many bytes) it started
+    current_phase_type current_phase;
+    struct timeval phase_start_time;
+    uint64_t phase_start_bytes;
+    double last_write_phase_rate;
+    double last_read_phase_rate;
+
+                                     // Block size currently in use
+    uint64_t optimal_block_size;
+
+    io_latency_stats_type io_latency_stats;
+    io_timeout_stats_type io_timeout_stats;
+    device_event_stats_type device_event_stats;
+
+} stats_snapshot_type;
+
+typedef struct _stats_block_type {
+                                     // Sequence counter for the seqlock.  Odd
+                                     // while the main thread is in the middle
+                                     // of publishing a new snapshot.
+    unsigned int sequence;
+
+                                     // The most recently published snapshot
+    stats_snapshot_type snapshot;
+
+} stats_block_type;
+
+// Maximum number of buffers the buffer pool will hold on to at once
+#define BUFFER_POOL_MAX_BUFFERS 8
+
+typedef struct _buffer_pool_entry_type {
+    void *buffer;                    // The buffer, or NULL if this slot is
+                                     // empty
+
+    size_t size;                     // Size of the buffer, in bytes
+
+    int in_use;                      // Is the buffer currently borrowed?
+} buffer_pool_entry_type;
+
+typedef struct _buffer_pool_type {
+    buffer_pool_entry_type entries[BUFFER_POOL_MAX_BUFFERS];
+
+    int mlock_failed;                // Has mlock() failed on one of the
+                                     // buffers?
+} buffer_pool_type;
+
 typedef struct _device_testing_context_type {
     device_info_type device_info;
     optimal_block_size_test_info_type optimal_block_size_test_info;
+    write_cache_size_test_info_type write_cache_size_test_info;
+    fake_flash_screen_info_type fake_flash_screen_info;
+    sustained_write_test_info_type sustained_write_test_info;
+    au_speed_test_info_type au_speed_test_info;
+    surface_scan_info_type surface_scan_info;
     capacity_test_info_type capacity_test_info;
     performance_test_info_type performance_test_info;
     endurance_test_info_type endurance_test_info;
+    io_timeout_stats_type io_timeout_stats;
+    io_latency_stats_type io_latency_stats;
+    device_event_stats_type device_event_stats;
+    control_state_type control_state;
+    stats_block_type stats_block;
+    buffer_pool_type buffer_pool;
     char *state_file_name;
     char *log_file_name;
     FILE *log_file_handle;
@@ -0,0 +1,213 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer_pool.h"
+#include "cache_size_test.h"
+#include "fake_flash_screen.h"
+#include "messages.h"
+#include "mfst.h"
+#include "ncurses.h"
+#include "rng.h"
+#include "util.h"
+
+// Size of the buffer used to push the points out of the device's write cache
+#define FAKE_FLASH_SCREEN_FLUSH_BUFFER_SIZE 1048576
+
+/**
+ * Comparison function for qsort() that sorts sector numbers from highest to
+ * lowest.
+ */
+static int compare_sectors_descending(const void *a, const void *b) {
+    uint64_t x = *((const uint64_t *) a), y = *((const uint64_t *) b);
+
+    return x < y ? 1 : (x > y ? -1 : 0);
+}
+
+/**
+ * Adds a point to the list of points to be written, unless it would overlap a
+ * point that's already in the list.
+ *
+ * @param points      The list of points.
+ * @param num_points  A pointer to the number of points in the list.  Updated
+ *                    if the point is added.
+ * @param sector      The first sector of the point to be added.
+ */
+static void add_screening_point(uint64_t *points, uint64_t *num_points, uint64_t sector) {
+    uint64_t i;
+
+    for(i = 0; i < *num_points; i++) {
+        if((sector + FAKE_FLASH_SCREEN_SECTORS_PER_POINT) > points[i] && sector < (points[i] + FAKE_FLASH_SCREEN_SECTORS_PER_POINT)) {
+            return;
+        }
+    }
+
+    points[(*num_points)++] = sector;
+}
+
+int screen_for_fake_flash(device_testing_context_type *device_testing_context) {
+    struct timeval cur_time;
+    char *buf, *flushbuf;
+    uint64_t points[FAKE_FLASH_SCREEN_POINTS];
+    uint64_t num_points, flush_sectors, first_point, last_point, cur, i, j, k, embedded_sector, attempts;
+    uint64_t points_checked, points_failed;
+    int aliasing_detected, local_errno;
+    const uint64_t sector_size = device_testing_context->device_info.sector_size;
+    const uint64_t point_size = sector_size * FAKE_FLASH_SCREEN_SECTORS_PER_POINT;
+    WINDOW *window;
+
+    // Anything below the end of the flush area would just get overwritten by
+    // the flush itself
+    flush_sectors = (get_cache_defeat_size(device_testing_context) + sector_size - 1) / sector_size;
+    for(first_point = 1; first_point < flush_sectors; first_point <<= 1);
+    last_point = device_testing_context->device_info.num_logical_sectors - FAKE_FLASH_SCREEN_SECTORS_PER_POINT;
+
+    if(device_testing_context->device_info.num_logical_sectors < (first_point + FAKE_FLASH_SCREEN_SECTORS_PER_POINT)) {
+        // Device is too small to leave any room past the flush area
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_ERROR, MSG_FAKE_FLASH_SCREEN_DEVICE_TOO_SMALL);
+        errno = ENOSPC;
+        return -1;
+    }
+
+    if(!(buf = buffer_pool_get(device_testing_context, (point_size * FAKE_FLASH_SCREEN_POINTS) + FAKE_FLASH_SCREEN_FLUSH_BUFFER_SIZE))) {
+        local_errno = errno;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, (point_size * FAKE_FLASH_SCREEN_POINTS) + FAKE_FLASH_SCREEN_FLUSH_BUFFER_SIZE, strerror(local_errno));
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_ERROR, MSG_FAKE_FLASH_SCREEN_ABORTING_MEM_ALLOC_ERROR);
+
+        errno = local_errno;
+        return -1;
+    }
+
+    flushbuf = buf + (point_size * FAKE_FLASH_SCREEN_POINTS);
+
+    assert(!gettimeofday(&cur_time, NULL));
+    rng_init(device_testing_context, cur_time.tv_sec + cur_time.tv_usec);
+
+    // Fake flash usually keeps its real storage at the start of the device, so
+    // the points at the end of the device and at the larger powers of two are
+    // the ones most likely to catch it.  The random points are there to catch
+    // devices that are missing storage somewhere other than the end.
+    num_points = 0;
+    add_screening_point(points, &num_points, last_point);
+    for(cur = first_point; cur < last_point; cur <<= 1) {
+        add_screening_point(points, &num_points, cur);
+    }
+
+    for(attempts = 0; num_points < FAKE_FLASH_SCREEN_POINTS && attempts < (FAKE_FLASH_SCREEN_POINTS * 4); attempts++) {
+        cur = (((uint64_t) (rng_get_random_number(device_testing_context) & RAND_MAX)) << 31) | (rng_get_random_number(device_testing_context) & RAND_MAX);
+        cur = first_point + ((cur % (last_point - first_point + 1)) / FAKE_FLASH_SCREEN_SECTORS_PER_POINT) * FAKE_FLASH_SCREEN_SECTORS_PER_POINT;
+        add_screening_point(points, &num_points, cur);
+    }
+
+    // Write the points highest first, so that if a higher point wraps around
+    // onto a lower one, the lower one gets written last and wins
+    qsort(points, num_points, sizeof(uint64_t), compare_sectors_descending);
+
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_FAKE_FLASH_SCREEN_STARTING, num_points);
+    window = message_window(device_testing_context, stdscr, NULL, "Screening for fake flash...", 0);
+
+    rng_fill_buffer(device_testing_context, buf, point_size * num_points);
+    for(i = 0; i < num_points; i++) {
+        stamp_probe_data(device_testing_context, buf + (i * point_size), FAKE_FLASH_SCREEN_SECTORS_PER_POINT, points[i]);
+    }
+
+    for(i = 0; i < num_points; i++) {
+        handle_key_inputs(device_testing_context, window);
+        if(write_data_to_device(device_testing_context, buf + (i * point_size), point_size, points[i] * sector_size)) {
+            local_errno = errno;
+            erase_and_delete_window(window);
+            buffer_pool_put(device_testing_context, buf);
+
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR, strerror(local_errno));
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_ERROR, MSG_FAKE_FLASH_SCREEN_ABORTING_DEVICE_ERROR);
+
+            errno = local_errno;
+            return -1;
+        }
+    }
+
+    if(flush_device_write_cache(device_testing_context, flushbuf, FAKE_FLASH_SCREEN_FLUSH_BUFFER_SIZE)) {
+        local_errno = errno;
+        erase_and_delete_window(window);
+        buffer_pool_put(device_testing_context, buf);
+
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR, strerror(local_errno));
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_ERROR, MSG_FAKE_FLASH_SCREEN_ABORTING_DEVICE_ERROR);
+
+        errno = local_errno;
+        return -1;
+    }
+
+    // Read the points back in the order they were written, so that the oldest
+    // data (the data most likely to have left the write cache) is checked
+    // first.  Stop as soon as we're sure.
+    points_checked = points_failed = 0;
+    aliasing_detected = 0;
+
+    for(i = 0; i < num_points && !aliasing_detected && points_failed < FAKE_FLASH_SCREEN_FAILURE_THRESHOLD; i++) {
+        handle_key_inputs(device_testing_context, window);
+
+        read_data_from_device(device_testing_context, flushbuf, point_size, points[i] * sector_size);
+        points_checked++;
+
+        for(j = 0; j < FAKE_FLASH_SCREEN_SECTORS_PER_POINT; j++) {
+            if(memcmp(flushbuf + (j * sector_size), buf + (i * point_size) + (j * sector_size), sector_size)) {
+                break;
+            }
+        }
+
+        if(j == FAKE_FLASH_SCREEN_SECTORS_PER_POINT) {
+            continue;
+        }
+
+        points_failed++;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_FAKE_FLASH_SCREEN_POINT_FAILED, points[i] + j);
+
+        // If the sector holds exactly what we wrote to a sector in one of the
+        // other points, or what looks like data from the flush area, the
+        // device is aliasing its addresses.  (A sector that's filled with a
+        // single value -- like an unwritten or zeroed-out sector -- decodes as
+        // sector 0, so it doesn't count.)
+        embedded_sector = decode_embedded_sector_number(flushbuf + (j * sector_size));
+        if(embedded_sector < flush_sectors && memcmp(flushbuf + (j * sector_size), flushbuf + (j * sector_size) + 1, sector_size - 1)) {
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_SECTOR_ALIASES_SECTOR, points[i] + j, embedded_sector);
+            aliasing_detected = 1;
+        }
+
+        for(k = 0; k < num_points && !aliasing_detected; k++) {
+            if(k != i && embedded_sector >= points[k] && embedded_sector < (points[k] + FAKE_FLASH_SCREEN_SECTORS_PER_POINT) &&
+               !memcmp(flushbuf + (j * sector_size), buf + (k * point_size) + ((embedded_sector - points[k]) * sector_size), sector_size)) {
+                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_SECTOR_ALIASES_SECTOR, points[i] + j, embedded_sector);
+                aliasing_detected = 1;
+                break;
+            }
+        }
+    }
+
+    erase_and_delete_window(window);
+    buffer_pool_put(device_testing_context, buf);
+
+    device_testing_context->fake_flash_screen_info.test_performed = 1;
+    device_testing_context->fake_flash_screen_info.points_checked = points_checked;
+    device_testing_context->fake_flash_screen_info.points_failed = points_failed;
+
+    if(aliasing_detected || points_failed >= FAKE_FLASH_SCREEN_FAILURE_THRESHOLD) {
+        device_testing_context->fake_flash_screen_info.is_fake_flash = FAKE_FLASH_YES;
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_FAKE_FLASH_SCREEN_FAKE_FLASH, points_failed, points_checked);
+    } else if(points_failed) {
+        // A single bad point could just be a bad sector
+        device_testing_context->fake_flash_screen_info.is_fake_flash = FAKE_FLASH_UNKNOWN;
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_FAKE_FLASH_SCREEN_INCONCLUSIVE, points_failed, points_checked);
+    } else {
+        device_testing_context->fake_flash_screen_info.is_fake_flash = FAKE_FLASH_NO;
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_FAKE_FLASH_SCREEN_GENUINE, points_checked);
+    }
+
+    return 0;
+}
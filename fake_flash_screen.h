@@ -0,0 +1,50 @@
+#if !defined(FAKE_FLASH_SCREEN_H)
+#define FAKE_FLASH_SCREEN_H
+
+#include <inttypes.h>
+
+#include "device_testing_context.h"
+
+// Total number of points written during fake flash screening, including the
+// ones at power-of-two sector numbers and the one at the end of the device
+#define FAKE_FLASH_SCREEN_POINTS 64
+
+// Number of sectors written at each point
+#define FAKE_FLASH_SCREEN_SECTORS_PER_POINT 8
+
+// Number of points that have to fail to verify before we call the device fake
+// flash.  (A single point that reads back the data written to another point is
+// enough on its own.)
+#define FAKE_FLASH_SCREEN_FAILURE_THRESHOLD 2
+
+// Exit statuses used by --quick-screen
+#define FAKE_FLASH_SCREEN_EXIT_GENUINE      0
+#define FAKE_FLASH_SCREEN_EXIT_FAKE_FLASH   2
+#define FAKE_FLASH_SCREEN_EXIT_INCONCLUSIVE 3
+
+/**
+ * Quickly screens the device for fake flash without working out its actual
+ * size.
+ *
+ * A small block of stamped random data is written at every power-of-two sector
+ * number on the device, at the very end of the device, and at random places
+ * in between (up to FAKE_FLASH_SCREEN_POINTS points in all), highest sector
+ * first.  Enough data is then written to the start of the device to push the
+ * points out of its write cache (see get_cache_defeat_size()), and the points
+ * are read back in the order they were written.  Reading stops as soon as the
+ * verdict is certain: either a point reads back the data that was written to
+ * another point (meaning the device is aliasing its addresses), or
+ * FAKE_FLASH_SCREEN_FAILURE_THRESHOLD points have failed to verify.
+ *
+ * The screening doesn't take the lockfile, since it only writes a few
+ * megabytes of data.
+ *
+ * @param device_testing_context  The device to be screened.
+ *
+ * @returns 0 if the screening completed successfully, or -1 if an error
+ *          occurred.  On success, the results are placed in
+ *          device_testing_context->fake_flash_screen_info.
+ */
+int screen_for_fake_flash(device_testing_context_type *device_testing_context);
+
+#endif // !defined(FAKE_FLASH_SCREEN_H)
@@ -0,0 +1,348 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "device.h"
+#include "device_testing_context.h"
+#include "io_watchdog.h"
+#include "messages.h"
+#include "mfst.h"
+
+// The signal used to knock the I/O thread out of a blocked system call
+#define IO_WATCHDOG_SIGNAL SIGUSR2
+
+typedef struct _io_watchdog_state_type {
+    int running;                   // Is the watchdog thread running?
+
+    int stop_requested;            // Has io_watchdog_stop() been called?
+
+    int timeout;                   // Number of seconds an operation may take
+
+    int armed;                     // Is an operation currently in flight?
+
+    int timed_out;                 // Has the current operation exceeded its
+                                   // deadline?
+
+    int device_kicked;             // Has the device been reset to cancel the
+                                   // current operation?
+
+    pthread_t io_thread;           // The thread that issued the current
+                                   // operation
+
+    off_t position;                // Position of the current operation
+
+    dev_t device_num;              // Device the current operation was issued
+                                   // against
+
+    struct timespec start_time;    // When the current operation was issued
+
+    struct timespec deadline;      // When the watchdog should next take action
+
+    device_testing_context_type *device_testing_context;
+} io_watchdog_state_type;
+
+const uint64_t io_latency_bucket_bounds[IO_LATENCY_BUCKETS - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000,
+    500000, 1000000, 2500000, 5000000, 10000000
+};
+
+static io_watchdog_state_type watchdog_state;
+static pthread_mutex_t watchdog_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t watchdog_cond;
+static pthread_t watchdog_thread;
+
+static void io_watchdog_signal_handler(int signum) {
+    // Nothing to do here -- we only need the signal to interrupt the system
+    // call that the I/O thread is blocked in.
+}
+
+static int timespec_passed(struct timespec *deadline) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+static uint64_t usec_since(struct timespec *start) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((now.tv_sec - start->tv_sec) * 1000000) + ((now.tv_nsec - start->tv_nsec) / 1000);
+}
+
+/**
+ * Works out which latency histogram bucket an operation belongs in.
+ *
+ * @param elapsed  The time the operation took, in microseconds.
+ *
+ * @returns The index of the bucket.
+ */
+static int io_latency_bucket(uint64_t elapsed) {
+    int i;
+
+    for(i = 0; i < IO_LATENCY_BUCKETS - 1 && elapsed > io_latency_bucket_bounds[i]; i++);
+    return i;
+}
+
+static void *io_watchdog_main(void *arg) {
+    dev_t device_num;
+    device_testing_context_type *device_testing_context;
+    uint64_t sector;
+
+    pthread_mutex_lock(&watchdog_mutex);
+
+    while(!watchdog_state.stop_requested) {
+        if(!watchdog_state.armed) {
+            pthread_cond_wait(&watchdog_cond, &watchdog_mutex);
+            continue;
+        }
+
+        if(pthread_cond_timedwait(&watchdog_cond, &watchdog_mutex, &watchdog_state.deadline) != ETIMEDOUT) {
+            // Either the operation completed, or we got woken up for some
+            // other reason -- either way, go back around and re-check
+            continue;
+        }
+
+        if(!watchdog_state.armed || !timespec_passed(&watchdog_state.deadline)) {
+            continue;
+        }
+
+        device_testing_context = watchdog_state.device_testing_context;
+        sector = watchdog_state.position / device_testing_context->device_info.sector_size;
+        watchdog_state.deadline.tv_sec += watchdog_state.timeout;
+
+        if(!watchdog_state.timed_out) {
+            // First strike: try to interrupt the system call
+            watchdog_state.timed_out = 1;
+
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_IO_TIMEOUT, sector, watchdog_state.timeout);
+            pthread_kill(watchdog_state.io_thread, IO_WATCHDOG_SIGNAL);
+        } else if(!watchdog_state.device_kicked) {
+            // Second strike: the request is stuck in the kernel, so reset the
+            // device to force the kernel to fail it
+            watchdog_state.device_kicked = 1;
+            device_num = watchdog_state.device_num;
+
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_IO_TIMEOUT_RESETTING_DEVICE, sector);
+
+            pthread_mutex_unlock(&watchdog_mutex);
+            if(kick_device(device_num)) {
+                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_IO_TIMEOUT_RESET_FAILED, strerror(errno));
+            }
+            pthread_mutex_lock(&watchdog_mutex);
+        } else {
+            // Nothing more we can do other than keep poking it
+            pthread_kill(watchdog_state.io_thread, IO_WATCHDOG_SIGNAL);
+        }
+    }
+
+    pthread_mutex_unlock(&watchdog_mutex);
+    return NULL;
+}
+
+int io_watchdog_start(device_testing_context_type *device_testing_context, int timeout) {
+    struct sigaction action;
+    pthread_condattr_t condattr;
+    int ret;
+
+    if(timeout <= 0 || watchdog_state.running) {
+        return 0;
+    }
+
+    // Deliberately leave out SA_RESTART so that blocked reads/writes return
+    // EINTR instead of being restarted
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = io_watchdog_signal_handler;
+    sigemptyset(&action.sa_mask);
+    if(sigaction(IO_WATCHDOG_SIGNAL, &action, NULL) == -1) {
+        return -1;
+    }
+
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&watchdog_cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+
+    memset(&watchdog_state, 0, sizeof(watchdog_state));
+    watchdog_state.timeout = timeout;
+    watchdog_state.device_testing_context = device_testing_context;
+
+    if(ret = pthread_create(&watchdog_thread, NULL, &io_watchdog_main, NULL)) {
+        pthread_cond_destroy(&watchdog_cond);
+        errno = ret;
+        return -1;
+    }
+
+    watchdog_state.running = 1;
+    return 0;
+}
+
+void io_watchdog_stop() {
+    if(!watchdog_state.running) {
+        return;
+    }
+
+    pthread_mutex_lock(&watchdog_mutex);
+    watchdog_state.stop_requested = 1;
+    pthread_cond_signal(&watchdog_cond);
+    pthread_mutex_unlock(&watchdog_mutex);
+
+    pthread_join(watchdog_thread, NULL);
+    pthread_cond_destroy(&watchdog_cond);
+    watchdog_state.running = 0;
+}
+
+/**
+ * Tells the watchdog that an I/O operation is about to be issued.
+ *
+ * @param device_testing_context  The device the operation is being issued
+ *                                against.
+ * @param position                The position of the operation.
+ */
+static void io_watchdog_arm(device_testing_context_type *device_testing_context, off_t position) {
+    pthread_mutex_lock(&watchdog_mutex);
+
+    watchdog_state.device_testing_context = device_testing_context;
+    watchdog_state.device_num = device_testing_context->device_info.device_num;
+    watchdog_state.io_thread = pthread_self();
+    watchdog_state.position = position;
+    watchdog_state.timed_out = 0;
+    watchdog_state.device_kicked = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &watchdog_state.start_time);
+    watchdog_state.deadline = watchdog_state.start_time;
+    watchdog_state.deadline.tv_sec += watchdog_state.timeout;
+
+    watchdog_state.armed = 1;
+    pthread_cond_signal(&watchdog_cond);
+
+    pthread_mutex_unlock(&watchdog_mutex);
+}
+
+/**
+ * Tells the watchdog that the current I/O operation has completed.  If the
+ * operation timed out, it's added to the timeout stats.  The stats are only
+ * ever updated here, on the I/O thread, so that they don't change underneath
+ * stats_block_publish().
+ *
+ * @param device_testing_context  The device the operation was issued against.
+ *
+ * @returns Non-zero if the operation exceeded its deadline, or 0 if it did
+ *          not.
+ */
+static int io_watchdog_disarm(device_testing_context_type *device_testing_context) {
+    int timed_out, device_kicked;
+    uint64_t elapsed;
+
+    pthread_mutex_lock(&watchdog_mutex);
+
+    watchdog_state.armed = 0;
+    timed_out = watchdog_state.timed_out;
+    device_kicked = watchdog_state.device_kicked;
+
+    if(timed_out) {
+        device_testing_context->io_timeout_stats.num_timeouts++;
+        if(device_kicked) {
+            device_testing_context->io_timeout_stats.num_forced_resets++;
+        }
+
+        elapsed = usec_since(&watchdog_state.start_time);
+        device_testing_context->io_timeout_stats.total_timeout_time += elapsed;
+        if(elapsed > device_testing_context->io_timeout_stats.longest_timeout_time) {
+            device_testing_context->io_timeout_stats.longest_timeout_time = elapsed;
+        }
+    }
+
+    pthread_cond_signal(&watchdog_cond);
+    pthread_mutex_unlock(&watchdog_mutex);
+
+    return timed_out;
+}
+
+ssize_t io_watchdog_read(device_testing_context_type *device_testing_context, void *buf, size_t count, off_t position) {
+    ssize_t ret;
+    int local_errno;
+    struct timespec start_time;
+    uint64_t elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    if(!watchdog_state.running) {
+        ret = pread(device_testing_context->device_info.fd, buf, count, position);
+        local_errno = errno;
+    } else {
+        io_watchdog_arm(device_testing_context, position);
+        ret = pread(device_testing_context->device_info.fd, buf, count, position);
+        local_errno = errno;
+
+        // If the operation managed to complete in spite of going over the
+        // deadline, then we'll take the data -- otherwise it's a timeout
+        if(io_watchdog_disarm(device_testing_context) && ret != count) {
+            ret = -1;
+            local_errno = ETIMEDOUT;
+        }
+    }
+
+    elapsed = usec_since(&start_time);
+    device_testing_context->io_latency_stats.total_read_time += elapsed;
+    device_testing_context->io_latency_stats.read_latency_buckets[io_latency_bucket(elapsed)]++;
+    device_testing_context->io_latency_stats.num_reads++;
+
+    errno = local_errno;
+    return ret;
+}
+
+ssize_t io_watchdog_write(device_testing_context_type *device_testing_context, void *buf, size_t count, off_t position) {
+    ssize_t ret;
+    int local_errno;
+    struct timespec start_time;
+    uint64_t elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    if(!watchdog_state.running) {
+        ret = pwrite(device_testing_context->device_info.fd, buf, count, position);
+        local_errno = errno;
+    } else {
+        io_watchdog_arm(device_testing_context, position);
+        ret = pwrite(device_testing_context->device_info.fd, buf, count, position);
+        local_errno = errno;
+
+        if(io_watchdog_disarm(device_testing_context) && ret != count) {
+            ret = -1;
+            local_errno = ETIMEDOUT;
+        }
+    }
+
+    elapsed = usec_since(&start_time);
+    device_testing_context->io_latency_stats.total_write_time += elapsed;
+    device_testing_context->io_latency_stats.write_latency_buckets[io_latency_bucket(elapsed)]++;
+    device_testing_context->io_latency_stats.num_writes++;
+
+    errno = local_errno;
+    return ret;
+}
+
+int io_watchdog_sync(device_testing_context_type *device_testing_context, off_t position) {
+    int ret, local_errno;
+
+    if(!watchdog_state.running) {
+        return fdatasync(device_testing_context->device_info.fd);
+    }
+
+    io_watchdog_arm(device_testing_context, position);
+    ret = fdatasync(device_testing_context->device_info.fd);
+    local_errno = errno;
+
+    if(io_watchdog_disarm(device_testing_context) && ret) {
+        local_errno = ETIMEDOUT;
+    }
+
+    errno = local_errno;
+    return ret;
+}
@@ -0,0 +1,94 @@
+#if !defined(IO_WATCHDOG_H)
+#define IO_WATCHDOG_H
+
+#include <sys/types.h>
+
+#include "device_testing_context.h"
+
+// Upper bound of each of the I/O latency histogram buckets, in microseconds.
+// The last bucket has no upper bound, so there are only IO_LATENCY_BUCKETS - 1
+// entries.
+extern const uint64_t io_latency_bucket_bounds[IO_LATENCY_BUCKETS - 1];
+
+/**
+ * Starts the I/O watchdog thread.  The watchdog keeps an eye on the I/O
+ * operations issued through io_watchdog_read() and io_watchdog_write().  If an
+ * operation is still in flight when its deadline expires, the watchdog will
+ * signal the thread that issued it in an attempt to interrupt the system call.
+ * If the operation is still in flight after a second timeout period has
+ * elapsed, the watchdog will reset the USB device that the device is attached
+ * to, which causes the kernel to fail any outstanding requests.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param timeout                 The number of seconds an I/O operation is
+ *                                allowed to take before it is considered to
+ *                                have timed out.  If set to 0, the watchdog is
+ *                                not started and I/O operations are allowed to
+ *                                take as long as they need.
+ *
+ * @returns 0 if the watchdog was started successfully (or if `timeout` is 0),
+ *          or -1 if an error occurred.  On error, errno is set to the error
+ *          returned by pthread_create() or sigaction().
+ */
+int io_watchdog_start(device_testing_context_type *device_testing_context, int timeout);
+
+/**
+ * Stops the I/O watchdog thread and waits for it to exit.  Does nothing if the
+ * watchdog isn't running.
+ */
+void io_watchdog_stop();
+
+/**
+ * Reads from the device at the given position, under the supervision of the
+ * I/O watchdog.  If the watchdog isn't running, this is equivalent to calling
+ * pread() on the device's file handle.  The file pointer is not used or
+ * modified.  The time taken is added to the device's latency stats.
+ *
+ * @param device_testing_context  The device from which to read.
+ * @param buf                     A pointer to a buffer which will receive the
+ *                                data read from the device.
+ * @param count                   The number of bytes to read from the device.
+ * @param position                The position on the device from which to
+ *                                read, relative to the start of the device.
+ *
+ * @returns The number of bytes read from the device, or -1 if an error
+ *          occurred.  If the operation timed out and did not complete, -1 is
+ *          returned and errno is set to ETIMEDOUT.
+ */
+ssize_t io_watchdog_read(device_testing_context_type *device_testing_context, void *buf, size_t count, off_t position);
+
+/**
+ * Writes to the device at the given position, under the supervision of the
+ * I/O watchdog.  If the watchdog isn't running, this is equivalent to calling
+ * pwrite() on the device's file handle.  The file pointer is not used or
+ * modified.  The time taken is added to the device's latency stats.
+ *
+ * @param device_testing_context  The device to which to write.
+ * @param buf                     A pointer to a buffer containing the data to
+ *                                be written to the device.
+ * @param count                   The number of bytes to write to the device.
+ * @param position                The position on the device at which to
+ *                                write, relative to the start of the device.
+ *
+ * @returns The number of bytes written to the device, or -1 if an error
+ *          occurred.  If the operation timed out and did not complete, -1 is
+ *          returned and errno is set to ETIMEDOUT.
+ */
+ssize_t io_watchdog_write(device_testing_context_type *device_testing_context, void *buf, size_t count, off_t position);
+
+/**
+ * Flushes any data written to the device out to stable storage, under the
+ * supervision of the I/O watchdog.  If the watchdog isn't running, this is
+ * equivalent to calling fdatasync() on the device's file handle.
+ *
+ * @param device_testing_context  The device to flush.
+ * @param position                The position of the last write issued to the
+ *                                device.  Used for logging purposes only.
+ *
+ * @returns 0 if the flush completed successfully, or -1 if an error occurred.
+ *          If the operation timed out, -1 is returned and errno is set to
+ *          ETIMEDOUT.
+ */
+int io_watchdog_sync(device_testing_context_type *device_testing_context, off_t position);
+
+#endif // !defined(IO_WATCHDOG_H)
@@ -0,0 +1,124 @@
+#include <string.h>
+
+#include "latency_histogram.h"
+
+/**
+ * Works out which bucket a sample belongs in.  Latencies below
+ * LATENCY_HISTOGRAM_SUB_BUCKETS get a bucket of their own; above that, each
+ * power of two is split into LATENCY_HISTOGRAM_SUB_BUCKETS equal parts.
+ *
+ * @param latency  The latency of the sample, in microseconds.
+ *
+ * @returns The index of the bucket.
+ */
+static int latency_histogram_bucket(uint64_t latency) {
+    int msb, bucket;
+
+    if(latency < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return latency;
+    }
+
+    msb = 63 - __builtin_clzll(latency);
+    bucket = ((msb - 2) * LATENCY_HISTOGRAM_SUB_BUCKETS) + ((latency >> (msb - 3)) & (LATENCY_HISTOGRAM_SUB_BUCKETS - 1));
+
+    return bucket < LATENCY_HISTOGRAM_BUCKETS ? bucket : LATENCY_HISTOGRAM_BUCKETS - 1;
+}
+
+/**
+ * Works out the largest latency that belongs in the given bucket.
+ *
+ * @param bucket  The index of the bucket.
+ *
+ * @returns The upper bound of the bucket, in microseconds.
+ */
+static uint64_t latency_histogram_bucket_bound(int bucket) {
+    int msb;
+
+    if(bucket < LATENCY_HISTOGRAM_SUB_BUCKETS) {
+        return bucket;
+    }
+
+    msb = (bucket / LATENCY_HISTOGRAM_SUB_BUCKETS) + 2;
+    return ((((uint64_t) LATENCY_HISTOGRAM_SUB_BUCKETS + (bucket % LATENCY_HISTOGRAM_SUB_BUCKETS)) + 1) << (msb - 3)) - 1;
+}
+
+void latency_histogram_reset(latency_histogram_type *histogram) {
+    memset(histogram, 0, sizeof(latency_histogram_type));
+}
+
+void latency_histogram_add(latency_histogram_type *histogram, uint64_t latency) {
+    histogram->counts[latency_histogram_bucket(latency)]++;
+
+    if(!histogram->num_samples || latency < histogram->min_latency) {
+        histogram->min_latency = latency;
+    }
+
+    if(latency > histogram->max_latency) {
+        histogram->max_latency = latency;
+    }
+
+    histogram->num_samples++;
+    histogram->total_latency += latency;
+}
+
+void latency_histogram_merge(latency_histogram_type *dest, latency_histogram_type *src) {
+    int i;
+
+    if(!src->num_samples) {
+        return;
+    }
+
+    for(i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        dest->counts[i] += src->counts[i];
+    }
+
+    if(!dest->num_samples || src->min_latency < dest->min_latency) {
+        dest->min_latency = src->min_latency;
+    }
+
+    if(src->max_latency > dest->max_latency) {
+        dest->max_latency = src->max_latency;
+    }
+
+    dest->num_samples += src->num_samples;
+    dest->total_latency += src->total_latency;
+}
+
+uint64_t latency_histogram_percentile(latency_histogram_type *histogram, double percentile) {
+    uint64_t target, seen, bound;
+    double rank;
+    int i;
+
+    if(!histogram->num_samples) {
+        return 0;
+    }
+
+    // Number of samples that have to be at or below the result (the nearest
+    // rank, rounded up -- done by hand so that we don't need libm for ceil())
+    rank = (histogram->num_samples * percentile) / 100.0;
+    target = (uint64_t) rank;
+    if(target < rank) {
+        target++;
+    }
+
+    if(target < 1) {
+        target = 1;
+    } else if(target > histogram->num_samples) {
+        target = histogram->num_samples;
+    }
+
+    for(i = 0, seen = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if(seen >= target) {
+            break;
+        }
+    }
+
+    // The last bucket has no upper bound
+    if(i == LATENCY_HISTOGRAM_BUCKETS - 1) {
+        return histogram->max_latency;
+    }
+
+    bound = latency_histogram_bucket_bound(i);
+    return bound > histogram->max_latency ? histogram->max_latency : bound;
+}
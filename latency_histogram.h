@@ -0,0 +1,67 @@
+#if !defined(LATENCY_HISTOGRAM_H)
+#define LATENCY_HISTOGRAM_H
+
+#include <inttypes.h>
+
+// Each power of two is split into this many buckets, so a percentile read back
+// from the histogram is never more than 1/8th (12.5%) higher than the real
+// value
+#define LATENCY_HISTOGRAM_SUB_BUCKETS 8
+
+// Enough buckets to cover latencies of up to 2^40 microseconds (about 12
+// days).  Anything longer lands in the last bucket.
+#define LATENCY_HISTOGRAM_BUCKETS (38 * LATENCY_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct _latency_histogram_type {
+    uint64_t counts[LATENCY_HISTOGRAM_BUCKETS]; // Number of samples in each
+                                                // bucket
+
+    uint64_t num_samples;                       // Total number of samples
+
+    uint64_t min_latency;                       // Shortest sample, in
+                                                // microseconds
+
+    uint64_t max_latency;                       // Longest sample, in
+                                                // microseconds
+
+    uint64_t total_latency;                     // Sum of all of the samples,
+                                                // in microseconds
+} latency_histogram_type;
+
+/**
+ * Clears out a latency histogram.
+ *
+ * @param histogram  The histogram to be cleared.
+ */
+void latency_histogram_reset(latency_histogram_type *histogram);
+
+/**
+ * Adds a sample to a latency histogram.
+ *
+ * @param histogram  The histogram to add the sample to.
+ * @param latency    The latency of the operation, in microseconds.
+ */
+void latency_histogram_add(latency_histogram_type *histogram, uint64_t latency);
+
+/**
+ * Adds all of the samples from one latency histogram to another.
+ *
+ * @param dest  The histogram to add the samples to.
+ * @param src   The histogram to take the samples from.
+ */
+void latency_histogram_merge(latency_histogram_type *dest, latency_histogram_type *src);
+
+/**
+ * Works out the given percentile of the samples in a latency histogram.  The
+ * result is the upper bound of the bucket the percentile falls in (capped at
+ * the longest sample), so it errs on the high side.
+ *
+ * @param histogram   The histogram to examine.
+ * @param percentile  The percentile to compute, from 0 to 100 (e.g., 99.9).
+ *
+ * @returns The latency at the given percentile, in microseconds, or 0 if the
+ *          histogram is empty.
+ */
+uint64_t latency_histogram_percentile(latency_histogram_type *histogram, double percentile);
+
+#endif // !defined(LATENCY_HISTOGRAM_H)
@@ -239,7 +239,123 @@ const char **log_file_messages = (const char *[])
      "Rejecting state file: %s contains the wrong amount of data (expected %lu bytes, got %lu bytes)",
      "  Read/write cycles to 0.1%% failure    : %'lu",
      "  Read/write cycles to 1%% failure      : %'lu",
-     "Terminal is now big enough -- re-enabling curses mode"
+     "Terminal is now big enough -- re-enabling curses mode",
+     // 210
+     "I/O operation at sector %lu has been running for more than %d seconds -- attempting to cancel it",
+     "I/O operation at sector %lu is still stuck -- resetting device to cancel it",
+     "Unable to reset device to cancel stuck I/O operation: %s",
+     "Unable to start I/O watchdog (%s) -- I/O operations will not be subject to a timeout",
+     "Device disconnect was detected during this slice -- resuming slice at sector %lu",
+     "fdatasync() returned an error: %s",
+     "Device disconnect was detected during the write phase -- restarting the write phase",
+     "Unable to lock buffer memory (%s) -- buffers may be paged out during the test",
+     "Unable to get a %lu byte buffer from the buffer pool: %s",
+     "Unable to commit a database transaction: %s",
+     "mysql_real_query() failed: %s",
+     "Unable to open database spool file %s: %s.  Progress made while the database is unreachable will not be reported once it comes back.",
+     "Unable to write to the database spool file: %s",
+     "Unable to read from the database spool file: %s",
+     "Replayed %lu spooled updates to the database",
+     "Unable to open SQLite database %s: %s",
+     "SQLite error: %s",
+     "The SQLite database is locked by another process; will try again later",
+     "Unable to connect to mfst-collector at %s: %s",
+     "Lost connection to mfst-collector: %s",
+     "mfst-collector was unable to complete the request",
+     "Unable to listen on %s: %s",
+     "Listening for mfst instances on %s",
+     "accept() failed: %s",
+     "poll() failed: %s",
+     "Accepted a connection from an mfst instance",
+     "An mfst instance disconnected (card ID %lu)",
+     "Too many mfst instances are connected; rejecting a new connection",
+     "Received an invalid message from an mfst instance; closing its connection",
+     "Too many cards are being tracked; dropping updates for card %lu",
+     "Too many updates are queued for card %lu; dropping the oldest ones",
+     "Unable to write to the database; will try again in %d seconds",
+     "The database rejected a batch of updates; %lu status samples were dropped",
+     "Wrote %lu status samples, %lu round summaries, and %lu sector maps in one batch",
+     "Unable to write the collector status file %s: %s",
+     "Writing out pending updates and shutting down",
+     "Unable to start the metrics exporter on %s (%s) -- metrics will not be available",
+     "Serving metrics on %s",
+     "Error accepting a connection for the metrics exporter: %s",
+     "Unable to start the control socket on %s (%s) -- the program can only be controlled from the keyboard",
+     // 250
+     "Listening for control commands on %s",
+     "Error accepting a connection on the control socket: %s",
+     "Control command received: %s",
+     "Pausing by request from the control socket",
+     "Resuming by request from the control socket",
+     "Bandwidth limit set to %lu bytes/sec (0 means no limit)",
+     "Block size changed to %lu bytes",
+     "Saved the program state by request from the control socket",
+     "Sector %'lu read back the data that was written to sector %'lu",
+     "Device appears to be wraparound flash (device addresses repeat every %'lu bytes)",
+     // 260
+     "Probing for write cache size",
+     "Aborting write cache size test due to a lockfile error",
+     "Aborting write cache size test due to a memory allocation error",
+     "Aborting write cache size test due to an error with the device",
+     "%'lu bytes written: oldest data read back in %'lu us, last 1MB written in %'lu us",
+     "Oldest data didn't match what was written after %'lu bytes were written",
+     "Write cache size test complete; estimated write cache size is %'lu bytes",
+     "Write cache size test was inconclusive; assuming a write cache size of %'lu bytes",
+     "Screening device for fake flash at %'lu points",
+     "Aborting fake flash screening due to a memory allocation error",
+     // 270
+     "Aborting fake flash screening due to an error with the device",
+     "Screening point at sector %'lu failed to verify",
+     "Fake flash screening complete: device is fake flash (%'lu of %'lu points checked failed to verify)",
+     "Fake flash screening complete: all %'lu points verified; device does not appear to be fake flash",
+     "Fake flash screening was inconclusive (%'lu of %'lu points checked failed to verify)",
+     "Device is too small to be screened for fake flash",
+     "Measuring random I/O speeds at queue depths from 1 to %d",
+     "Random %s at queue depth %d: %0.2f IOPS/s, latency p50 %'lu us, p99 %'lu us, p99.9 %'lu us",
+     "No requests completed for %d seconds during the queue depth sweep; resetting the device",
+     "Unable to start a thread for the queue depth sweep: %s",
+     // 280
+     "Aborting the queue depth sweep",
+     "Error during queue depth sweep: %s",
+     "%s latency: p50 %'lu us, p99 %'lu us, p99.9 %'lu us",
+     "%s: minimum sustained rate %s, steady-state rate %s",
+     "Unable to open speed test series file %s: %s",
+     "Logging speed test series to %s",
+     "Starting sustained write test (writing up to %'lu bytes)",
+     "Write speed dropped from %s to %s after %'lu bytes (estimated write cache size)",
+     "No drop in write speed after %'lu bytes; sustained write speed: %s",
+     "Aborting sustained write test due to memory allocation error",
+     // 290
+     "Aborting sustained write test due to device error",
+     "Class, UHS, and video speed class markings are based on the sustained write speed of %s",
+     "Starting AU speed test (AU size: %'lu bytes, %s; %d AUs per recording unit size)",
+     "AU at offset %'lu, %'lu-byte recording units: %s",
+     "%'lu-byte recording units: slowest AU %s (at offset %'lu), average %s",
+     "Unable to discard AU before writing it (results may be pessimistic): %s",
+     "Aborting AU speed test due to memory allocation error",
+     "Aborting AU speed test due to device error",
+     "Skipping AU speed test: device is too small to hold two AUs",
+     "Class, UHS, and video speed class markings are based on the AU speed test",
+     // 300
+     "Starting workload job %s (%u%% reads, %s access, queue depth %d)",
+     "Workload job %s: %s (%0.2f IOPS/s) over %0.1f seconds; slowest second %s",
+     "Skipping workload job %s: block size %'lu isn't a multiple of the device's sector size",
+     "Skipping workload job %s: its region is smaller than its largest block size",
+     "No requests completed for %d seconds during workload job %s; resetting the device",
+     "Unable to start a thread for workload job %s: %s",
+     "Aborting workload jobs due to memory allocation error",
+     "Aborting workload jobs due to device error",
+     "Running %d workload jobs from %s",
+     "Starting surface scan (reading %u%% of the device in %'lu-byte blocks across %d regions)",
+     // 310
+     "Surface scan complete: median read speed %s, slowest region at byte %'lu (%s), %d of %d regions slower than half the median speed",
+     "Read error at byte %'lu during surface scan: %s",
+     "%'lu reads failed during the surface scan, in %d regions",
+     "Aborting surface scan due to memory allocation error",
+     "Aborting surface scan due to device error",
+     "Skipping surface scan: unable to obtain a lock on the lockfile",
+     "Write speed held steady at %s for %d seconds without dropping off; ending the sustained write test early",
+     "Unable to allocate I/O buffers up front (%s); they will be allocated as they are needed instead"
     };
 
 const char **display_messages = (const char *[])
@@ -473,5 +589,124 @@ const char **display_messages = (const char *[])
      NULL,
      NULL,
      NULL,
+     NULL,
+     // 210
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     // 220
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     // 230
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     // 240
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     // 250
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     // 260
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     // 270
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     // 280
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     // 290
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     // 300
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     // 310
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
+     NULL,
      NULL
     };
@@ -220,5 +220,113 @@ extern const char **display_messages;
 #define MSG_ENDURANCE_TEST_ROUNDS_TO_0_1_PERCENT_FAILURE          207
 #define MSG_ENDURANCE_TEST_ROUNDS_TO_1_PERCENT_FAILURE            208
 #define MSG_NCURSES_REENABLING_NCURSES                            209
+#define MSG_IO_TIMEOUT                                            210
+#define MSG_IO_TIMEOUT_RESETTING_DEVICE                           211
+#define MSG_IO_TIMEOUT_RESET_FAILED                               212
+#define MSG_ERROR_STARTING_IO_WATCHDOG                            213
+#define MSG_RESUMING_SLICE_AT_SECTOR                              214
+#define MSG_FDATASYNC_ERROR                                       215
+#define MSG_RESTARTING_WRITE_PHASE                                216
+#define MSG_BUFFER_POOL_MLOCK_ERROR                               217
+#define MSG_BUFFER_POOL_GET_ERROR                                 218
+#define MSG_MYSQL_TRANSACTION_ERROR                               219
+#define MSG_MYSQL_QUERY_ERROR                                     220
+#define MSG_SQL_SPOOL_OPEN_ERROR                                  221
+#define MSG_SQL_SPOOL_WRITE_ERROR                                 222
+#define MSG_SQL_SPOOL_READ_ERROR                                  223
+#define MSG_SQL_SPOOL_REPLAYED                                    224
+#define MSG_SQLITE_OPEN_ERROR                                     225
+#define MSG_SQLITE_ERROR                                          226
+#define MSG_SQLITE_DATABASE_BUSY                                  227
+#define MSG_COLLECTOR_CONNECT_ERROR                               228
+#define MSG_COLLECTOR_LOST_CONNECTION                             229
+#define MSG_COLLECTOR_REQUEST_FAILED                              230
+#define MSG_COLLECTOR_LISTEN_ERROR                                231
+#define MSG_COLLECTOR_LISTENING                                   232
+#define MSG_COLLECTOR_ACCEPT_ERROR                                233
+#define MSG_COLLECTOR_POLL_ERROR                                  234
+#define MSG_COLLECTOR_CLIENT_CONNECTED                            235
+#define MSG_COLLECTOR_CLIENT_DISCONNECTED                         236
+#define MSG_COLLECTOR_TOO_MANY_CLIENTS                            237
+#define MSG_COLLECTOR_BAD_MESSAGE                                 238
+#define MSG_COLLECTOR_TOO_MANY_CARDS                              239
+#define MSG_COLLECTOR_QUEUE_FULL                                  240
+#define MSG_COLLECTOR_BACKEND_UNAVAILABLE                         241
+#define MSG_COLLECTOR_BATCH_DROPPED                               242
+#define MSG_COLLECTOR_BATCH_WRITTEN                               243
+#define MSG_COLLECTOR_STATUS_FILE_ERROR                           244
+#define MSG_COLLECTOR_SHUTTING_DOWN                               245
+#define MSG_ERROR_STARTING_METRICS_EXPORTER                       246
+#define MSG_METRICS_LISTENING                                     247
+#define MSG_METRICS_ACCEPT_ERROR                                  248
+#define MSG_ERROR_STARTING_CONTROL_SOCKET                         249
+#define MSG_CONTROL_LISTENING                                     250
+#define MSG_CONTROL_ACCEPT_ERROR                                  251
+#define MSG_CONTROL_COMMAND                                       252
+#define MSG_PAUSED_BY_OPERATOR                                    253
+#define MSG_RESUMED_BY_OPERATOR                                   254
+#define MSG_BANDWIDTH_LIMIT_CHANGED                               255
+#define MSG_BLOCK_SIZE_CHANGED                                    256
+#define MSG_CHECKPOINT_SAVED                                      257
+#define MSG_SECTOR_ALIASES_SECTOR                                 258
+#define MSG_WRAPAROUND_FLASH_DETECTED                             259
+#define MSG_CACHE_SIZE_TEST_STARTING                              260
+#define MSG_CACHE_SIZE_TEST_ABORTING_LOCKFILE_ERROR               261
+#define MSG_CACHE_SIZE_TEST_ABORTING_MEM_ALLOC_ERROR              262
+#define MSG_CACHE_SIZE_TEST_ABORTING_DEVICE_ERROR                 263
+#define MSG_CACHE_SIZE_TEST_SPAN_RESULT                           264
+#define MSG_CACHE_SIZE_TEST_STALE_READ                            265
+#define MSG_CACHE_SIZE_TEST_COMPLETE                              266
+#define MSG_CACHE_SIZE_TEST_INCONCLUSIVE                          267
+#define MSG_FAKE_FLASH_SCREEN_STARTING                            268
+#define MSG_FAKE_FLASH_SCREEN_ABORTING_MEM_ALLOC_ERROR            269
+#define MSG_FAKE_FLASH_SCREEN_ABORTING_DEVICE_ERROR               270
+#define MSG_FAKE_FLASH_SCREEN_POINT_FAILED                        271
+#define MSG_FAKE_FLASH_SCREEN_FAKE_FLASH                          272
+#define MSG_FAKE_FLASH_SCREEN_GENUINE                             273
+#define MSG_FAKE_FLASH_SCREEN_INCONCLUSIVE                        274
+#define MSG_FAKE_FLASH_SCREEN_DEVICE_TOO_SMALL                    275
+#define MSG_QUEUE_DEPTH_SWEEP_STARTING                            276
+#define MSG_QUEUE_DEPTH_SWEEP_RESULT                              277
+#define MSG_QUEUE_DEPTH_SWEEP_STALLED                             278
+#define MSG_QUEUE_DEPTH_SWEEP_THREAD_ERROR                        279
+#define MSG_ABORTING_QUEUE_DEPTH_SWEEP                            280
+#define MSG_IO_ERROR_DURING_QUEUE_DEPTH_SWEEP                     281
+#define MSG_SPEED_TEST_LATENCY_RESULTS                            282
+#define MSG_SPEED_TEST_CONSISTENCY_RESULTS                        283
+#define MSG_SPEED_SERIES_FILE_OPEN_ERROR                          284
+#define MSG_LOGGING_SPEED_SERIES_TO_FILE                          285
+#define MSG_SUSTAINED_WRITE_TEST_STARTING                         286
+#define MSG_SUSTAINED_WRITE_TEST_CLIFF                            287
+#define MSG_SUSTAINED_WRITE_TEST_NO_CLIFF                         288
+#define MSG_SUSTAINED_WRITE_TEST_ABORTING_MEM_ALLOC_ERROR         289
+#define MSG_SUSTAINED_WRITE_TEST_ABORTING_DEVICE_ERROR            290
+#define MSG_SPEED_TEST_USING_SUSTAINED_WRITE_SPEED                291
+#define MSG_AU_SPEED_TEST_STARTING                                292
+#define MSG_AU_SPEED_TEST_AU_RESULT                               293
+#define MSG_AU_SPEED_TEST_RESULT                                  294
+#define MSG_AU_SPEED_TEST_DISCARD_ERROR                           295
+#define MSG_AU_SPEED_TEST_ABORTING_MEM_ALLOC_ERROR                296
+#define MSG_AU_SPEED_TEST_ABORTING_DEVICE_ERROR                   297
+#define MSG_AU_SPEED_TEST_DEVICE_TOO_SMALL                        298
+#define MSG_SPEED_TEST_USING_AU_SPEED_TEST_RESULTS                299
+#define MSG_WORKLOAD_JOB_STARTING                                 300
+#define MSG_WORKLOAD_JOB_RESULT                                   301
+#define MSG_WORKLOAD_JOB_BAD_BLOCK_SIZE                           302
+#define MSG_WORKLOAD_JOB_REGION_TOO_SMALL                         303
+#define MSG_WORKLOAD_JOB_STALLED                                  304
+#define MSG_WORKLOAD_JOB_THREAD_ERROR                             305
+#define MSG_ABORTING_WORKLOAD_JOBS_MEM_ALLOC_ERROR                306
+#define MSG_ABORTING_WORKLOAD_JOBS_DEVICE_ERROR                   307
+#define MSG_RUNNING_WORKLOAD_FILE                                 308
+#define MSG_SURFACE_SCAN_STARTING                                 309
+#define MSG_SURFACE_SCAN_RESULT                                   310
+#define MSG_SURFACE_SCAN_READ_ERROR                               311
+#define MSG_SURFACE_SCAN_READ_ERRORS                              312
+#define MSG_SURFACE_SCAN_ABORTING_MEM_ALLOC_ERROR                 313
+#define MSG_SURFACE_SCAN_ABORTING_DEVICE_ERROR                    314
+#define MSG_SURFACE_SCAN_ABORTING_LOCK_ERROR                      315
+#define MSG_SUSTAINED_WRITE_TEST_PLATEAU                          316
+#define MSG_BUFFER_POOL_RESERVE_ERROR                             317
 
 #endif // !defined(MESSAGES_H)
@@ -0,0 +1,416 @@
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "device_testing_context.h"
+#include "io_watchdog.h"
+#include "messages.h"
+#include "metrics.h"
+#include "mfst.h"
+#include "stats_block.h"
+#include "util.h"
+
+// How long to wait for a client to send its request, in seconds
+#define METRICS_REQUEST_TIMEOUT 5
+
+// How often the exporter thread checks to see if it's been asked to stop, in
+// milliseconds
+#define METRICS_POLL_INTERVAL 500
+
+// Largest request we're willing to read
+#define METRICS_MAX_REQUEST_SIZE 4096
+
+// Labels used for the threshold gauges
+static const char *threshold_labels[] = { "first_failure", "0.1%", "1%", "10%", "25%" };
+
+static device_testing_context_type *metrics_device_testing_context;
+static int metrics_fd = -1;
+static char *metrics_socket_path;
+static volatile int metrics_stop_requested;
+static int metrics_running;
+static pthread_t metrics_thread;
+
+int metrics_parse_address(const char *address, struct sockaddr_storage *addr, socklen_t *addrlen) {
+    struct sockaddr_un *sun = (struct sockaddr_un *) addr;
+    struct sockaddr_in *sin = (struct sockaddr_in *) addr;
+    char host[64];
+    const char *colon;
+    char *endptr;
+    unsigned long port;
+
+    memset(addr, 0, sizeof(*addr));
+
+    if(strchr(address, '/')) {
+        if(strlen(address) >= sizeof(sun->sun_path)) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        sun->sun_family = AF_UNIX;
+        strcpy(sun->sun_path, address);
+        *addrlen = sizeof(struct sockaddr_un);
+        return 0;
+    }
+
+    if(colon = strrchr(address, ':')) {
+        if(colon - address >= sizeof(host)) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        memcpy(host, address, colon - address);
+        host[colon - address] = 0;
+        colon++;
+    } else {
+        strcpy(host, "127.0.0.1");
+        colon = address;
+    }
+
+    if(!strcmp(host, "localhost")) {
+        strcpy(host, "127.0.0.1");
+    }
+
+    port = strtoul(colon, &endptr, 10);
+    if(!*colon || *endptr || !port || port > 65535) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    sin->sin_family = AF_INET;
+    sin->sin_port = htons(port);
+    if(inet_pton(AF_INET, host, &sin->sin_addr) != 1 || (ntohl(sin->sin_addr.s_addr) >> 24) != 127) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    *addrlen = sizeof(struct sockaddr_in);
+    return 0;
+}
+
+/**
+ * Works out the throughput of the current (or, if a different phase is
+ * currently running, the most recently completed) phase of the given type.
+ *
+ * @param snapshot  The snapshot to work from.
+ * @param phase     The phase to report on.
+ *
+ * @returns The average throughput of the phase, in bytes per second.
+ */
+static double metrics_phase_rate(stats_snapshot_type *snapshot, current_phase_type phase) {
+    struct timeval now;
+    double elapsed;
+
+    if(snapshot->current_phase != phase || !snapshot->phase_start_time.tv_sec) {
+        return phase == CURRENT_PHASE_WRITING ? snapshot->last_write_phase_rate : snapshot->last_read_phase_rate;
+    }
+
+    gettimeofday(&now, NULL);
+    if((elapsed = ((double) timediff(snapshot->phase_start_time, now)) / 1000000) <= 0) {
+        return 0;
+    }
+
+    return ((double) ((phase == CURRENT_PHASE_WRITING ? snapshot->total_bytes_written : snapshot->total_bytes_read) - snapshot->phase_start_bytes)) / elapsed;
+}
+
+static void metrics_write_histogram(FILE *out, const char *name, const char *help, volatile uint64_t *buckets, uint64_t total_time) {
+    uint64_t cumulative = 0;
+    int i;
+
+    fprintf(out, "# TYPE %s histogram\n# UNIT %s seconds\n# HELP %s %s\n", name, name, name, help);
+    for(i = 0; i < IO_LATENCY_BUCKETS - 1; i++) {
+        cumulative += buckets[i];
+        fprintf(out, "%s_bucket{le=\"%g\"} %lu\n", name, ((double) io_latency_bucket_bounds[i]) / 1000000, cumulative);
+    }
+
+    // Use the buckets for the count as well, so that it always agrees with
+    // them
+    cumulative += buckets[IO_LATENCY_BUCKETS - 1];
+    fprintf(out, "%s_bucket{le=\"+Inf\"} %lu\n", name, cumulative);
+    fprintf(out, "%s_sum %0.6f\n%s_count %lu\n", name, ((double) total_time) / 1000000, name, cumulative);
+}
+
+static void metrics_write_counter(FILE *out, const char *name, const char *unit, const char *help, uint64_t value) {
+    fprintf(out, "# TYPE %s counter\n", name);
+    if(unit) {
+        fprintf(out, "# UNIT %s %s\n", name, unit);
+    }
+
+    fprintf(out, "# HELP %s %s\n%s_total %lu\n", name, help, name, value);
+}
+
+/**
+ * Renders the current metrics in the OpenMetrics text format.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param size                    A pointer to a variable which will receive
+ *                                the length of the rendered text.
+ *
+ * @returns A pointer to a buffer containing the rendered text (which must be
+ *          freed by the caller), or NULL if an error occurred.
+ */
+static char *metrics_render(device_testing_context_type *device_testing_context, size_t *size) {
+    stats_snapshot_type snapshot;
+    main_thread_status_type status = main_thread_status;
+    uint64_t rounds_to_thresholds[5];
+    char uuid_str[37];
+    char *buf;
+    FILE *out;
+    int i;
+
+    stats_block_read(device_testing_context, &snapshot);
+    rounds_to_thresholds[0] = snapshot.rounds_to_first_error;
+    rounds_to_thresholds[1] = snapshot.rounds_to_0_1_threshold;
+    rounds_to_thresholds[2] = snapshot.rounds_to_1_threshold;
+    rounds_to_thresholds[3] = snapshot.rounds_to_10_threshold;
+    rounds_to_thresholds[4] = snapshot.rounds_to_25_threshold;
+    uuid_unparse(device_testing_context->device_info.device_uuid, uuid_str);
+
+    if(!(out = open_memstream(&buf, size))) {
+        return NULL;
+    }
+
+    fprintf(out, "# TYPE mfst_device info\n# HELP mfst_device The device being tested\nmfst_device_info{uuid=\"%s\"} 1\n", uuid_str);
+    fprintf(out, "# TYPE mfst_device_size_bytes gauge\n# UNIT mfst_device_size_bytes bytes\n# HELP mfst_device_size_bytes Physical size of the device\nmfst_device_size_bytes %lu\n", device_testing_context->device_info.physical_size);
+
+    fprintf(out, "# TYPE mfst_status stateset\n# HELP mfst_status What the program is currently doing\n");
+    for(i = 0; i < MAIN_THREAD_STATUS_COUNT; i++) {
+        fprintf(out, "mfst_status{mfst_status=\"%s\"} %d\n", main_thread_status_labels[i], status == i);
+    }
+
+    metrics_write_counter(out, "mfst_written_bytes", "bytes", "Bytes written to the device during the endurance test", snapshot.total_bytes_written);
+    metrics_write_counter(out, "mfst_read_bytes", "bytes", "Bytes read from the device during the endurance test", snapshot.total_bytes_read);
+
+    fprintf(out, "# TYPE mfst_phase_throughput_bytes_per_second gauge\n"
+            "# HELP mfst_phase_throughput_bytes_per_second Average throughput of the current or most recent phase of each type\n"
+            "mfst_phase_throughput_bytes_per_second{phase=\"write\"} %0.2f\n"
+            "mfst_phase_throughput_bytes_per_second{phase=\"read\"} %0.2f\n",
+            metrics_phase_rate(&snapshot, CURRENT_PHASE_WRITING), metrics_phase_rate(&snapshot, CURRENT_PHASE_READING));
+
+    metrics_write_histogram(out, "mfst_read_latency_seconds", "Time taken by each read issued to the device", snapshot.io_latency_stats.read_latency_buckets, snapshot.io_latency_stats.total_read_time);
+    metrics_write_histogram(out, "mfst_write_latency_seconds", "Time taken by each write issued to the device", snapshot.io_latency_stats.write_latency_buckets, snapshot.io_latency_stats.total_write_time);
+
+    metrics_write_counter(out, "mfst_rounds_completed", NULL, "Rounds of the endurance test completed", snapshot.rounds_completed);
+
+    fprintf(out, "# TYPE mfst_bad_sectors gauge\n# HELP mfst_bad_sectors Sectors flagged as bad so far\nmfst_bad_sectors %lu\n", snapshot.total_bad_sectors);
+    fprintf(out, "# TYPE mfst_bad_sectors_this_round gauge\n# HELP mfst_bad_sectors_this_round Sectors that have failed so far this round\nmfst_bad_sectors_this_round %lu\n", snapshot.num_bad_sectors_this_round);
+
+    // Only report the thresholds that have actually been reached
+    fprintf(out, "# TYPE mfst_rounds_to_threshold gauge\n# HELP mfst_rounds_to_threshold Rounds completed before the device reached each failure threshold\n");
+    for(i = 0; i < sizeof(threshold_labels) / sizeof(threshold_labels[0]); i++) {
+        if(rounds_to_thresholds[i] != -1ULL) {
+            fprintf(out, "mfst_rounds_to_threshold{threshold=\"%s\"} %lu\n", threshold_labels[i], rounds_to_thresholds[i]);
+        }
+    }
+
+    metrics_write_counter(out, "mfst_device_disconnects", NULL, "Times the device was disconnected", snapshot.device_event_stats.num_disconnects);
+    metrics_write_counter(out, "mfst_device_reconnects", NULL, "Times the device was found again after a disconnect", snapshot.device_event_stats.num_reconnects);
+    metrics_write_counter(out, "mfst_device_resets", NULL, "Times the device was reset to recover from an I/O error", snapshot.device_event_stats.num_resets);
+    metrics_write_counter(out, "mfst_io_timeouts", NULL, "I/O operations that exceeded the I/O timeout", snapshot.io_timeout_stats.num_timeouts);
+    metrics_write_counter(out, "mfst_io_timeout_resets", NULL, "Times the device was reset to cancel a hung I/O operation", snapshot.io_timeout_stats.num_forced_resets);
+    metrics_write_counter(out, "mfst_lockfile_pauses", NULL, "Times the program paused for another copy's speed tests", snapshot.device_event_stats.num_lockfile_pauses);
+    fprintf(out, "# TYPE mfst_lockfile_pause_seconds counter\n# UNIT mfst_lockfile_pause_seconds seconds\n"
+            "# HELP mfst_lockfile_pause_seconds Time spent paused for another copy's speed tests\n"
+            "mfst_lockfile_pause_seconds_total %0.6f\n", ((double) snapshot.device_event_stats.total_lockfile_pause_time) / 1000000);
+
+    fprintf(out, "# EOF\n");
+
+    if(fclose(out)) {
+        free(buf);
+        return NULL;
+    }
+
+    return buf;
+}
+
+static void metrics_send_error(int fd, const char *status) {
+    char response[128];
+
+    snprintf(response, sizeof(response), "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: close\r\n\r\n", status);
+    send_all(fd, response, strlen(response));
+}
+
+/**
+ * Reads an HTTP request from the given client and sends back a response.
+ *
+ * @param fd  The client's socket.
+ */
+static void metrics_handle_client(int fd) {
+    char request[METRICS_MAX_REQUEST_SIZE];
+    char header[256];
+    struct timeval timeout;
+    size_t received = 0;
+    ssize_t ret;
+    char *body;
+    size_t body_len;
+
+    timeout.tv_sec = METRICS_REQUEST_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // We only need the request line, but read up to the end of the headers so
+    // that the client doesn't see a reset when we close the connection
+    while(received < sizeof(request) - 1) {
+        if((ret = recv(fd, request + received, sizeof(request) - 1 - received, 0)) <= 0) {
+            if(ret == -1 && errno == EINTR) {
+                continue;
+            }
+
+            return;
+        }
+
+        received += ret;
+        request[received] = 0;
+        if(strstr(request, "\r\n\r\n") || strstr(request, "\n\n")) {
+            break;
+        }
+    }
+
+    request[received] = 0;
+
+    if(strncmp(request, "GET ", 4)) {
+        metrics_send_error(fd, "405 Method Not Allowed");
+        return;
+    }
+
+    if(strncmp(request + 4, "/metrics ", 9) && strncmp(request + 4, "/metrics?", 9) && strncmp(request + 4, "/ ", 2)) {
+        metrics_send_error(fd, "404 Not Found");
+        return;
+    }
+
+    if(!(body = metrics_render(metrics_device_testing_context, &body_len))) {
+        metrics_send_error(fd, "500 Internal Server Error");
+        return;
+    }
+
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 200 OK\r\n"
+             "Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+             "Content-Length: %lu\r\n"
+             "Connection: close\r\n\r\n", body_len);
+
+    if(!send_all(fd, header, strlen(header))) {
+        send_all(fd, body, body_len);
+    }
+
+    free(body);
+}
+
+static void *metrics_main(void *arg) {
+    struct pollfd pfd;
+    int client_fd;
+
+    pfd.fd = metrics_fd;
+    pfd.events = POLLIN;
+
+    while(!metrics_stop_requested) {
+        if(poll(&pfd, 1, METRICS_POLL_INTERVAL) <= 0) {
+            continue;
+        }
+
+        if((client_fd = accept4(metrics_fd, NULL, NULL, SOCK_CLOEXEC)) == -1) {
+            if(errno != EINTR && errno != EAGAIN && errno != ECONNABORTED) {
+                log_log(metrics_device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_METRICS_ACCEPT_ERROR, strerror(errno));
+            }
+
+            continue;
+        }
+
+        metrics_handle_client(client_fd);
+        close(client_fd);
+    }
+
+    return NULL;
+}
+
+int metrics_start(device_testing_context_type *device_testing_context, const char *address) {
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    struct stat fs;
+    int ret, local_errno, on = 1;
+
+    if(metrics_running) {
+        return 0;
+    }
+
+    if(metrics_parse_address(address, &addr, &addrlen)) {
+        return -1;
+    }
+
+    if((metrics_fd = socket(addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+        return -1;
+    }
+
+    if(addr.ss_family == AF_UNIX) {
+        // Clean up after a previous run -- but only if what's there is
+        // actually a socket
+        if(!lstat(address, &fs) && S_ISSOCK(fs.st_mode)) {
+            unlink(address);
+        }
+
+        metrics_socket_path = strdup(address);
+    } else {
+        setsockopt(metrics_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    }
+
+    if(bind(metrics_fd, (struct sockaddr *) &addr, addrlen) || listen(metrics_fd, 8)) {
+        local_errno = errno;
+        close(metrics_fd);
+        metrics_fd = -1;
+        free(metrics_socket_path);
+        metrics_socket_path = NULL;
+        errno = local_errno;
+        return -1;
+    }
+
+    metrics_device_testing_context = device_testing_context;
+    metrics_stop_requested = 0;
+
+    if(ret = pthread_create(&metrics_thread, NULL, &metrics_main, NULL)) {
+        close(metrics_fd);
+        metrics_fd = -1;
+        if(metrics_socket_path) {
+            unlink(metrics_socket_path);
+            free(metrics_socket_path);
+            metrics_socket_path = NULL;
+        }
+
+        errno = ret;
+        return -1;
+    }
+
+    metrics_running = 1;
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_METRICS_LISTENING, address);
+    return 0;
+}
+
+void metrics_stop() {
+    if(!metrics_running) {
+        return;
+    }
+
+    metrics_stop_requested = 1;
+    pthread_join(metrics_thread, NULL);
+
+    close(metrics_fd);
+    metrics_fd = -1;
+
+    if(metrics_socket_path) {
+        unlink(metrics_socket_path);
+        free(metrics_socket_path);
+        metrics_socket_path = NULL;
+    }
+
+    metrics_running = 0;
+}
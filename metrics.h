@@ -0,0 +1,48 @@
+#if !defined(METRICS_H)
+#define METRICS_H
+
+#include <sys/socket.h>
+
+#include "device_testing_context.h"
+
+/**
+ * Parses the address that the metrics exporter should listen on.  The address
+ * can either be the path to a Unix domain socket (anything containing a `/`),
+ * or a port number optionally preceded by a loopback address and a colon
+ * (e.g., `9400`, `127.0.0.1:9400`, or `localhost:9400`).  Non-loopback
+ * addresses are rejected, since the exporter has no access control of its own.
+ *
+ * @param address  The address to parse.
+ * @param addr     A pointer to a sockaddr_storage which will receive the
+ *                 parsed address.
+ * @param addrlen  A pointer to a variable which will receive the length of the
+ *                 parsed address.
+ *
+ * @returns 0 if the address was parsed successfully, or -1 if it was invalid.
+ *          On error, errno is set to EINVAL.
+ */
+int metrics_parse_address(const char *address, struct sockaddr_storage *addr, socklen_t *addrlen);
+
+/**
+ * Starts the metrics exporter thread.  The exporter answers HTTP requests for
+ * `/metrics` with the device's current counters in the OpenMetrics text
+ * format, so that the program can be scraped by Prometheus (or anything else
+ * that speaks OpenMetrics).  The counters are read without taking any locks,
+ * so the exporter never holds up the main thread.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param address                 The address to listen on (see
+ *                                metrics_parse_address()).
+ *
+ * @returns 0 if the exporter was started successfully, or -1 if an error
+ *          occurred.  On error, errno is set to the underlying error.
+ */
+int metrics_start(device_testing_context_type *device_testing_context, const char *address);
+
+/**
+ * Stops the metrics exporter thread and waits for it to exit.  Does nothing if
+ * the exporter isn't running.
+ */
+void metrics_stop();
+
+#endif // !defined(METRICS_H)
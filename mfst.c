@@ -20,22 +20,36 @@
 #include <uuid/uuid.h>
 
 #include "block_size_test.h"
+#include "buffer_pool.h"
+#include "cache_size_test.h"
+#include "control.h"
 #include "crc32.h"
 #include "device.h"
 #include "device_speed_test.h"
 #include "device_testing_context.h"
+#include "fake_flash_screen.h"
+#include "io_watchdog.h"
 #include "lockfile.h"
 #include "messages.h"
+#include "metrics.h"
 #include "mfst.h"
 #include "ncurses.h"
 #include "rng.h"
 #include "state.h"
+#include "stats_block.h"
 #include "sql.h"
+#include "sql_collector.h"
+#include "sql_mariadb.h"
+#include "sql_sqlite.h"
+#include "surface_scan.h"
 #include "util.h"
 
 // Number of slices per round of endurance testing
 #define NUM_SLICES 16
 
+// Number of points probed on each pass of the device size test's search
+#define CAPACITY_PROBE_POINTS 8
+
 // Since we use these strings so frequently, these are just here to save space
 const char *WARNING_TITLE = "WARNING";
 const char *ERROR_TITLE = "ERROR";
@@ -46,11 +60,17 @@ sector_display_type sector_display;
 program_options_type program_options;
 
 volatile main_thread_status_type main_thread_status;
+const char *main_thread_status_labels[MAIN_THREAD_STATUS_COUNT] = { "idle", "paused", "writing", "reading", "device_disconnected", "ending", "scanning" };
 
 volatile int log_log_lock = 0;
 
 static struct timeval stats_cur_time;
 
+// Column headers for the stats file.  If the columns ever change, files
+// written by older versions get a fresh header (see stats_file_needs_header()).
+static const char *STATS_FILE_HEADER =
+    "Date/Time,Rounds Completed,Bytes Written,Total Bytes Written,Write Rate (bytes/sec),Bytes Read,Total Bytes Read,Read Rate (bytes/sec),Bad Sectors,Total Bad Sesctors,Bad Sector Rate (counts/min),I/O Timeouts,Total I/O Timeouts,Total Time Spent in Timed Out I/O (ms),Longest Timed Out I/O (ms)\n";
+
 // Scratch buffer for messages; we're allocating it statically so that we can
 // still log messages in case of memory shortages
 static char msg_buffer[512];
@@ -101,6 +121,66 @@ void log_log(device_testing_context_type *device_testing_context, const char *fu
     log_log_lock = 0;
 }
 
+/**
+ * Counts the number of columns in a line of CSV.  None of the values in the
+ * stats file are quoted, so this is just the number of commas plus one.
+ *
+ * @param line  The line to examine.
+ *
+ * @returns The number of columns in the line.
+ */
+static int count_csv_columns(const char *line) {
+    int columns = 1;
+
+    for(; *line && *line != '\n'; line++) {
+        if(*line == ',') {
+            columns++;
+        }
+    }
+
+    return columns;
+}
+
+/**
+ * Checks whether the CSV headers need to be written to the stats file before
+ * any more rows are added to it.  That's the case if the file is empty, or if
+ * the last line in the file doesn't have the same number of columns as the
+ * rows we're about to write (e.g., it was written by an older version of the
+ * program).
+ *
+ * @param fp  The stats file.  Must be open for reading as well as appending.
+ *
+ * @returns Non-zero if the headers need to be written, or 0 if they don't.
+ */
+static int stats_file_needs_header(FILE *fp) {
+    char buf[1024];
+    char *line;
+    long size, start;
+    size_t len;
+
+    if(fseek(fp, 0, SEEK_END) || (size = ftell(fp)) <= 0) {
+        return 1;
+    }
+
+    start = size > (long) (sizeof(buf) - 1) ? size - (long) (sizeof(buf) - 1) : 0;
+    if(fseek(fp, start, SEEK_SET)) {
+        return 1;
+    }
+
+    len = fread(buf, 1, size - start, fp);
+    buf[len] = 0;
+
+    // Skip over the trailing newline, then find the start of the last line
+    while(len && buf[len - 1] == '\n') {
+        buf[--len] = 0;
+    }
+
+    line = strrchr(buf, '\n');
+    line = line ? line + 1 : buf;
+
+    return count_csv_columns(line) != count_csv_columns(STATS_FILE_HEADER);
+}
+
 /**
  * Log the given stats to the stats file.  The stats file is a CSV file with
  * the following columns:
@@ -125,6 +205,14 @@ void log_log(device_testing_context_type *device_testing_context, const char *fu
  * * The rate at which sectors are failing verification (in counts/minute) --
  *   note that sectors which failed verification during a previous round of
  *   testing are not accounted for in this number)
+ * * The number of I/O operations that exceeded the I/O timeout since the
+ *   timestamp indicated in the previous row (or since the start of the stress
+ *   test, if this is the first row)
+ * * The total number of I/O operations that have exceeded the I/O timeout
+ * * The total amount of time (in milliseconds) spent waiting on I/O operations
+ *   that exceeded the I/O timeout
+ * * The longest amount of time (in milliseconds) spent waiting on a single I/O
+ *   operation that exceeded the I/O timeout
  *
  * @param device_testing_context  The device against which stats are to be
  *                                logged.
@@ -132,7 +220,7 @@ void log_log(device_testing_context_type *device_testing_context, const char *fu
  */
 void stats_log(device_testing_context_type *device_testing_context) {
     double write_rate, read_rate, bad_sector_rate;
-    uint64_t total_bytes_written, total_bytes_read, total_bad_sectors;
+    uint64_t total_bytes_written, total_bytes_read, total_bad_sectors, total_io_timeouts;
     time_t now = time(NULL);
     char *ctime_str;
     struct timeval micronow;
@@ -149,6 +237,7 @@ void stats_log(device_testing_context_type *device_testing_context) {
     total_bytes_written = device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written;
     total_bytes_read = device_testing_context->endurance_test_info.stats_file_counters.total_bytes_read;
     total_bad_sectors = device_testing_context->endurance_test_info.total_bad_sectors;
+    total_io_timeouts = device_testing_context->io_timeout_stats.num_timeouts;
 
     ctime_str = ctime(&now);
 
@@ -162,7 +251,7 @@ void stats_log(device_testing_context_type *device_testing_context) {
         (((double)timediff(device_testing_context->endurance_test_info.stats_file_counters.last_update_time, micronow)) / 60000000);
 
     fprintf(device_testing_context->endurance_test_info.stats_file_handle,
-            "%s,%lu,%lu,%lu,%0.2f,%lu,%lu,%0.2f,%lu,%lu,%0.2f\n",
+            "%s,%lu,%lu,%lu,%0.2f,%lu,%lu,%0.2f,%lu,%lu,%0.2f,%lu,%lu,%lu,%lu\n",
             ctime_str,
             device_testing_context->endurance_test_info.rounds_completed,
             total_bytes_written - device_testing_context->endurance_test_info.stats_file_counters.last_bytes_written,
@@ -173,19 +262,24 @@ void stats_log(device_testing_context_type *device_testing_context) {
             read_rate,
             total_bad_sectors - device_testing_context->endurance_test_info.stats_file_counters.last_bad_sectors,
             total_bad_sectors,
-            bad_sector_rate);
+            bad_sector_rate,
+            total_io_timeouts - device_testing_context->endurance_test_info.stats_file_counters.last_io_timeouts,
+            total_io_timeouts,
+            device_testing_context->io_timeout_stats.total_timeout_time / 1000,
+            device_testing_context->io_timeout_stats.longest_timeout_time / 1000);
     fflush(device_testing_context->endurance_test_info.stats_file_handle);
 
     memcpy(&device_testing_context->endurance_test_info.stats_file_counters.last_update_time, &micronow, sizeof(struct timeval));
     device_testing_context->endurance_test_info.stats_file_counters.last_bytes_written = total_bytes_written;
     device_testing_context->endurance_test_info.stats_file_counters.last_bytes_read = total_bytes_read;
     device_testing_context->endurance_test_info.stats_file_counters.last_bad_sectors = total_bad_sectors;
+    device_testing_context->endurance_test_info.stats_file_counters.last_io_timeouts = total_io_timeouts;
 }
 
 /**
  * Mark the given sectors as "written" in the sector map.  The blocks
- * containing the given sectors are redrawn on the display.  The display is not
- * refreshed after the blocks are drawn.
+ * containing the given sectors are redrawn on the display at the next screen
+ * update.
  *
  * @param device_testing_context  The device whose sectors should be marked as
  *                                "written".
@@ -208,8 +302,7 @@ void mark_sectors_written(device_testing_context_type *device_testing_context, u
 
 /**
  * Mark the given sectors as "read" in the sector map.  The blocks containing
- * the given sectors are redrawn on the display.  The display is not refreshed
- * after the blocks are drawn.
+ * the given sectors are redrawn on the display at the next screen update.
  *
  * @param device_testing_context  The device whose sectors should be marked as
  *                                "read".
@@ -232,8 +325,7 @@ void mark_sectors_read(device_testing_context_type *device_testing_context, uint
 
 /**
  * Mark the given sector as "bad" in the sector map.  The block containing the
- * given sector is redrawn on the display.  The display is not refreshed after
- * the blocks are drawn.
+ * given sector is redrawn on the display at the next screen update.
  *
  * @param device_testing_context  The device whose sectors should be marked as
  *                                bad.
@@ -248,7 +340,6 @@ void mark_sector_bad(device_testing_context_type *device_testing_context, uint64
     device_testing_context->endurance_test_info.sector_map[sector_num] |= SECTOR_MAP_FLAG_FAILED_THIS_ROUND | SECTOR_MAP_FLAG_FAILED;
 
     draw_sectors(device_testing_context, sector_num, sector_num + 1);
-    draw_percentage(device_testing_context);
 }
 
 /**
@@ -284,10 +375,13 @@ void wait_for_file_lock(device_testing_context_type *device_testing_context, WIN
     FILE *memfile;
 #endif // defined(HAVE_NCURSES)
     main_thread_status_type previous_status;
+    struct timeval last_time, cur_time;
 
     if(is_lockfile_locked()) {
         previous_status = main_thread_status;
         main_thread_status = MAIN_THREAD_STATUS_PAUSED;
+        device_testing_context->device_event_stats.num_lockfile_pauses++;
+        assert(!gettimeofday(&last_time, NULL));
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WAITING_FOR_FILE_LOCK);
         if(!program_options.no_curses) {
 #if defined(HAVE_NCURSES)
@@ -315,6 +409,13 @@ void wait_for_file_lock(device_testing_context_type *device_testing_context, WIN
             } else {
                 sleep(1);
             }
+
+            // Keep the pause time up to date as we go so that it's visible
+            // while we're still waiting
+            assert(!gettimeofday(&cur_time, NULL));
+            device_testing_context->device_event_stats.total_lockfile_pause_time += timediff(last_time, cur_time);
+            last_time = cur_time;
+            stats_block_publish(device_testing_context);
         }
 
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_FILE_LOCK_RELEASED);
@@ -335,6 +436,49 @@ void wait_for_file_lock(device_testing_context_type *device_testing_context, WIN
     }
 }
 
+/**
+ * Waits for an operator to resume the test after pausing it through the
+ * control socket.  Does nothing if the test hasn't been paused.
+ *
+ * @param device_testing_context  The current device being tested.  (This is
+ *                                needed in case the screen needs to be redrawn
+ *                                while the test is paused.)
+ */
+void wait_while_paused_by_operator(device_testing_context_type *device_testing_context) {
+    WINDOW *window = NULL;
+    main_thread_status_type previous_status;
+
+    if(device_testing_context->control_state.pause_requested) {
+        previous_status = main_thread_status;
+        main_thread_status = MAIN_THREAD_STATUS_PAUSED;
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_PAUSED_BY_OPERATOR);
+        if(!program_options.no_curses) {
+            window = message_window(device_testing_context, stdscr, "Paused",
+                                    "The test has been paused from the control "
+                                    "socket.  Send the \"resume\" command to "
+                                    "the control socket to pick up where it "
+                                    "left off.", 0);
+        }
+
+        while(device_testing_context->control_state.pause_requested) {
+            if(!program_options.no_curses) {
+                handle_key_inputs(device_testing_context, window);
+                usleep(100000);
+            } else {
+                sleep(1);
+            }
+        }
+
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_RESUMED_BY_OPERATOR);
+        main_thread_status = previous_status;
+
+        if(!program_options.no_curses) {
+            erase_and_delete_window(window);
+            redraw_screen(device_testing_context);
+        }
+    }
+}
+
 /**
  * Profiles the system's random number generator.
  *
@@ -397,32 +541,29 @@ double profile_random_number_generator(device_testing_context_type *device_testi
 }
 
 /**
- * Writes the given data to the device.  Data is copied to a page-aligned
- * buffer, then written in chunks that correspond to the device's optimal block
- * size (as specified in device_testing_context->device_info.optimal_block_size)
- * or the number of bytes remaining, whichever is smaller.  This function is
- * used primarily for the device size test; it does not gracefully handle device
+ * Writes the given data to the device.  Data is written in chunks that
+ * correspond to the device's optimal block size (as specified in
+ * device_testing_context->device_info.optimal_block_size) or the number of
+ * bytes remaining, whichever is smaller.  This function is used primarily for
+ * the device size test; it does not gracefully handle device
  * disconnects/reconnects.
  *
  * @param device_testing_context  The device to which to write the data.
  * @param buf                     A pointer to the buffer containing the data to
- *                                be written.
+ *                                be written.  The data is written directly
+ *                                from this buffer, so it must be suitably
+ *                                aligned for O_DIRECT (for example, a buffer
+ *                                obtained from buffer_pool_get()).
  * @param len                     The number of bytes to be written.
+ * @param position                The position on the device at which to start
+ *                                writing the data.
  *
  * @returns 0 if the operation completed successfully, or -1 if it did not.  On
  *          error, errno is set to the underlying error.
  */
-int write_data_to_device(device_testing_context_type *device_testing_context, void *buf, uint64_t len) {
+int write_data_to_device(device_testing_context_type *device_testing_context, void *buf, uint64_t len, off_t position) {
     uint64_t block_size, bytes_left, block_bytes_left;
-    char *aligned_buf;
     int64_t ret;
-    int iret;
-
-    if(ret = posix_memalign((void **) &aligned_buf, sysconf(_SC_PAGESIZE), len)) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_POSIX_MEMALIGN_ERROR, strerror(ret));
-        errno = ret;
-        return -1;
-    }
 
     block_size = len > device_testing_context->device_info.optimal_block_size ? device_testing_context->device_info.optimal_block_size : len;
 
@@ -430,13 +571,7 @@ int write_data_to_device(device_testing_context_type *device_testing_context, vo
     while(bytes_left) {
         block_bytes_left = block_size > bytes_left ? bytes_left : block_size;
         while(block_bytes_left) {
-            // Make sure the data is in an aligned buffer
-            memcpy(aligned_buf, ((char *) buf) + (len - bytes_left), block_bytes_left);
-            if((ret = write(device_testing_context->device_info.fd, aligned_buf, block_bytes_left)) == -1) {
-                // In case free() modifies errno
-                iret = errno;
-                free(aligned_buf);
-                errno = iret;
+            if((ret = io_watchdog_write(device_testing_context, ((char *) buf) + (len - bytes_left), block_bytes_left, position + (len - bytes_left))) == -1) {
                 return -1;
             }
 
@@ -445,10 +580,37 @@ int write_data_to_device(device_testing_context_type *device_testing_context, vo
         }
     }
 
-    free(aligned_buf);
     return 0;
 }
 
+/**
+ * Reads data from the device for the device size test.  If a read fails, the
+ * remainder of the buffer is zeroed out instead, so that it'll fail to verify
+ * against whatever was written there.
+ *
+ * @param device_testing_context  The device to read from.
+ * @param buf                     A pointer to the buffer that will receive the
+ *                                data.  Must be suitably aligned for O_DIRECT.
+ * @param len                     The number of bytes to be read.
+ * @param position                The position on the device at which to start
+ *                                reading the data.
+ */
+void read_data_from_device(device_testing_context_type *device_testing_context, void *buf, uint64_t len, off_t position) {
+    uint64_t bytes_left;
+    int64_t ret;
+
+    bytes_left = len;
+    while(bytes_left) {
+        // We're just going to try to read the whole thing all at once
+        if((ret = io_watchdog_read(device_testing_context, ((char *) buf) + (len - bytes_left), bytes_left, position + (len - bytes_left))) <= 0) {
+            memset(((char *) buf) + (len - bytes_left), 0, bytes_left);
+            return;
+        }
+
+        bytes_left -= ret;
+    }
+}
+
 /**
  * Displays a dialog to the user indicating that the device size test
  * encountered an I/O error.  This function blocks until the user dismisses the
@@ -478,10 +640,12 @@ void io_error_during_size_probe(device_testing_context_type *device_testing_cont
  * @param device_testing_context  The current device being tested.  (This is
  *                                needed in case the display needs to be redrawn
  *                                while the dialog is being shown to the user.)
+ * @param size                    The size of the buffer that could not be
+ *                                allocated.
  * @param errnum                  The error number of the error that occurred.
  */
-void memory_error_during_size_probe(device_testing_context_type *device_testing_context, int errnum) {
-    log_log(device_testing_context, "probe_device_size", SEVERITY_LEVEL_DEBUG, MSG_POSIX_MEMALIGN_ERROR, strerror(errnum));
+void memory_error_during_size_probe(device_testing_context_type *device_testing_context, uint64_t size, int errnum) {
+    log_log(device_testing_context, "probe_device_size", SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, size, strerror(errnum));
     log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_ABORTING_DEVICE_SIZE_TEST_DUE_TO_MEMORY_ERROR);
 
     message_window(device_testing_context, stdscr, WARNING_TITLE,
@@ -492,18 +656,200 @@ void memory_error_during_size_probe(device_testing_context_type *device_testing_
                    "fail pretty quickly.", 1);
 }
 
+/**
+ * Checks to see whether a sector that failed to verify during the device size
+ * test actually holds the data that was written to a lower-numbered sector.  If
+ * it does, both sector numbers map to the same place on the device (e.g., the
+ * device is wraparound flash), and the distance between them is a multiple of
+ * the device's real size.
+ *
+ * The embedded sector number alone isn't enough to go on: a sector that's
+ * filled with a single value (which is what a lot of fake flash returns past
+ * its real capacity, and what read_data_from_device() leaves behind on a read
+ * error) decodes as sector 0.  So sectors like that are ignored, and the sector
+ * that the data claims to have been written to is read back to make sure it
+ * holds exactly the same data.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param data                    A pointer to the data that was read back from
+ *                                the sector.
+ * @param scratch                 A pointer to a buffer of at least one sector
+ *                                to read the other sector into.  Must be
+ *                                suitably aligned for O_DIRECT.
+ * @param sector_number           The sector that the data was read from.
+ *
+ * @returns The distance between the sector that the data was read from and the
+ *          sector that it was written to, or 0 if the data wasn't written to a
+ *          lower-numbered sector.
+ */
+uint64_t get_sector_alias_distance(device_testing_context_type *device_testing_context, char *data, char *scratch, uint64_t sector_number) {
+    uint64_t embedded_sector_number = decode_embedded_sector_number(data);
+    const uint64_t sector_size = device_testing_context->device_info.sector_size;
+
+    if(embedded_sector_number >= sector_number || !memcmp(data, data + 1, sector_size - 1)) {
+        return 0;
+    }
+
+    read_data_from_device(device_testing_context, scratch, sector_size, embedded_sector_number * sector_size);
+    if(memcmp(data, scratch, sector_size)) {
+        return 0;
+    }
+
+    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_SECTOR_ALIASES_SECTOR, sector_number, embedded_sector_number);
+    return sector_number - embedded_sector_number;
+}
+
+/**
+ * Stamps each sector in a buffer of data that's about to be written during the
+ * device size test with the number of the sector it's going to be written to.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param buf                     A pointer to the buffer to be stamped.
+ * @param num_sectors             The number of sectors in the buffer.
+ * @param starting_sector         The sector that the buffer will be written to.
+ */
+void stamp_probe_data(device_testing_context_type *device_testing_context, char *buf, uint64_t num_sectors, uint64_t starting_sector) {
+    uint64_t i;
+
+    for(i = 0; i < num_sectors; i++) {
+        embed_sector_number(buf + (i * device_testing_context->device_info.sector_size), starting_sector + i);
+    }
+}
+
+/**
+ * Writes stamped random data to the start of the device to push anything
+ * written before it out of the device's write cache.  The amount written is
+ * determined by get_cache_defeat_size(), rounded up to a whole sector.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param buf                     A pointer to a buffer to use for the data.
+ *                                Must be suitably aligned for O_DIRECT.
+ * @param buf_size                The size of the buffer, in bytes.  Must be a
+ *                                multiple of the sector size.  If it's smaller
+ *                                than the amount of data that needs to be
+ *                                written, the data is written in pieces.
+ *
+ * @returns 0 if the data was written successfully, or -1 if a write error
+ *          occurred.  On error, errno is set to the underlying error.
+ */
+int flush_device_write_cache(device_testing_context_type *device_testing_context, char *buf, uint64_t buf_size) {
+    uint64_t flush_size, cur, len;
+    const uint64_t sector_size = device_testing_context->device_info.sector_size;
+
+    flush_size = ((get_cache_defeat_size(device_testing_context) + sector_size - 1) / sector_size) * sector_size;
+
+    for(cur = 0; cur < flush_size; cur += len) {
+        len = (flush_size - cur) > buf_size ? buf_size : (flush_size - cur);
+
+        rng_fill_buffer(device_testing_context, buf, len);
+        stamp_probe_data(device_testing_context, buf, len / sector_size, cur / sector_size);
+        if(write_data_to_device(device_testing_context, buf, len, cur)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Checks to see if the device is wraparound flash whose real size is a power of
+ * two.  A single stamped sector is written at every power-of-two sector number
+ * on the device (highest first), then flush_device_write_cache() writes stamped
+ * data to the start of the device, which both overwrites any of those sectors
+ * that wrap around onto it and pushes them out of the device's write cache.
+ * The lowest power-of-two sector that reads back the data that was written to
+ * sector 0 (as checked by get_sector_alias_distance()) is the real size of the
+ * device.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param buf                     A pointer to a buffer of at least 64 sectors
+ *                                to hold the stamped sectors.  Must be
+ *                                suitably aligned for O_DIRECT.
+ * @param flushbuf                A pointer to a buffer to pass to
+ *                                flush_device_write_cache().  Must be at least
+ *                                two sectors long and suitably aligned for
+ *                                O_DIRECT.
+ * @param flushbuf_size           The size of flushbuf, in bytes.
+ * @param window                  A pointer to the window being displayed to
+ *                                the user, in case it needs to be redrawn.
+ * @param wraparound_sectors      A pointer to a variable that receives the
+ *                                real size of the device, in sectors, or 0 if
+ *                                the device doesn't appear to wrap around.
+ *
+ * @returns 0 if the test completed successfully, or -1 if a write error
+ *          occurred.  On error, errno is set to the underlying error.
+ */
+int probe_for_wraparound(device_testing_context_type *device_testing_context, char *buf, char *flushbuf, uint64_t flushbuf_size, WINDOW **window, uint64_t *wraparound_sectors) {
+    uint64_t cur, first_point, num_points, i;
+    const uint64_t sector_size = device_testing_context->device_info.sector_size;
+
+    *wraparound_sectors = 0;
+
+    // Anything below the end of the flush area would just get overwritten by
+    // the flush itself
+    for(first_point = 1; (first_point * sector_size) < get_cache_defeat_size(device_testing_context); first_point <<= 1);
+    for(num_points = 0, cur = first_point; cur < device_testing_context->device_info.num_logical_sectors; num_points++, cur <<= 1);
+
+    if(!num_points) {
+        return 0;
+    }
+
+    rng_fill_buffer(device_testing_context, buf, num_points * sector_size);
+    for(i = 0, cur = first_point; i < num_points; i++, cur <<= 1) {
+        stamp_probe_data(device_testing_context, buf + (i * sector_size), 1, cur);
+    }
+
+    for(i = num_points, cur = first_point << (num_points - 1); i > 0; i--, cur >>= 1) {
+        handle_key_inputs(device_testing_context, *window);
+        if(write_data_to_device(device_testing_context, buf + ((i - 1) * sector_size), sector_size, cur * sector_size)) {
+            return -1;
+        }
+
+        wait_for_file_lock(device_testing_context, window);
+    }
+
+    if(flush_device_write_cache(device_testing_context, flushbuf, flushbuf_size)) {
+        return -1;
+    }
+
+    for(i = 0, cur = first_point; i < num_points; i++, cur <<= 1) {
+        handle_key_inputs(device_testing_context, *window);
+        wait_for_file_lock(device_testing_context, window);
+
+        read_data_from_device(device_testing_context, flushbuf, sector_size, cur * sector_size);
+        if(memcmp(flushbuf, buf + (i * sector_size), sector_size) && get_sector_alias_distance(device_testing_context, flushbuf, flushbuf + sector_size, cur) == cur) {
+            *wraparound_sectors = cur;
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * Executes the device capacity test.
  *
- * NOTE: This test works by writing 32MB of data to the card, then going back
- *       and verifying the first 16MB of that data.  The idea is that if a
- *       device is caching writes, and you make a write that is at least twice
- *       the size of the write cache, the first half of the write should be
- *       flushed out to the device's cold storage.  Of course, this assumes a
- *       couple of things: (1) that no device is going to have a cache size of
- *       more than 16MB; and (2) that the device flushes the cache in a
- *       first-in, first-out fashion.  If either of those ever turn out not to
- *       be true, we may have to come back and revisit our approach.
+ * NOTE: This test works by writing 4MB probes to several places on the card,
+ *       following them up with enough writes to fill the device's write
+ *       cache (see get_cache_defeat_size()), then going back and verifying
+ *       the probes.  The idea is that if a device is caching writes, and you
+ *       write enough data after the probes, the probes should be flushed out
+ *       to the device's cold storage.  Of course, this assumes a couple of
+ *       things: (1) that the write cache is no bigger than the write cache
+ *       size test said it was (or 16MB, if the test wasn't run); and (2) that
+ *       the device flushes the cache in a first-in, first-out fashion.  If
+ *       either of those ever turn out not to be true, we may have to come back
+ *       and revisit our approach.
+ *
+ * Every sector written by the test is stamped with its own sector number.  If
+ * a sector reads back the data that was written to a lower-numbered sector,
+ * the device is aliasing its addresses (e.g., it's wraparound flash), and the
+ * distance between the two sectors usually tells us the real size of the
+ * device outright.
+ *
+ * Once the initial probes have narrowed down where the first bad sector is,
+ * the test probes CAPACITY_PROBE_POINTS places per pass (rather than
+ * bisecting), so it only takes a handful of passes even on very large devices.
  *
  * On success, device_testing_context->capacity_test_info is populated with
  * information on the detected capacity of the device.
@@ -516,10 +862,11 @@ uint64_t probe_device_size(device_testing_context_type *device_testing_context)
     // Start out by writing to 9 different places on the card to minimize the
     // chances that the card is interspersed with good blocks.
     int errnum, iret;
-    char *buf, *readbuf, keep_searching;
-    unsigned int random_seed, i, bytes_left, ret;
+    char *buf, *readbuf;
+    unsigned int random_seed, i, num_probes;
     uint64_t initial_sectors[9];
-    uint64_t low, high, cur, size, j;
+    uint64_t probe_points[CAPACITY_PROBE_POINTS], probe_lengths[CAPACITY_PROBE_POINTS];
+    uint64_t low, high, cur, size, j, probe_sectors, alias_distance, wraparound_size;
     const uint64_t slice_size = 4194304;
     const uint64_t num_slices = 9;
     const uint64_t buf_size = slice_size * num_slices;
@@ -528,25 +875,49 @@ uint64_t probe_device_size(device_testing_context_type *device_testing_context)
     log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_PROBING_FOR_DEVICE_SIZE);
     window = message_window(device_testing_context, stdscr, NULL, "Probing for actual device size...", 0);
 
-    if(iret = posix_memalign((void **) &buf, sysconf(_SC_PAGESIZE), buf_size)) {
+    // Borrow a single buffer for both the write and read buffers
+    if(!(buf = buffer_pool_get(device_testing_context, buf_size * 2))) {
+        iret = errno;
         erase_and_delete_window(window);
 
-        memory_error_during_size_probe(device_testing_context, iret);
+        memory_error_during_size_probe(device_testing_context, buf_size * 2, iret);
 
         return -1;
     }
 
-    if(iret = posix_memalign((void **) &readbuf, sysconf(_SC_PAGESIZE), buf_size)) {
+    readbuf = buf + buf_size;
+
+    random_seed = time(NULL);
+    rng_init(device_testing_context, random_seed);
+
+    // Check for the most common kind of wraparound flash first, since if we
+    // find it, we don't need to do anything else
+    if(probe_for_wraparound(device_testing_context, buf, readbuf, buf_size, &window, &wraparound_size)) {
+        errnum = errno;
         erase_and_delete_window(window);
-        free(buf);
+        buffer_pool_put(device_testing_context, buf);
 
-        memory_error_during_size_probe(device_testing_context, iret);
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR, strerror(errnum));
+        io_error_during_size_probe(device_testing_context);
 
         return -1;
     }
 
-    random_seed = time(NULL);
-    rng_init(device_testing_context, random_seed);
+    if(wraparound_size) {
+        erase_and_delete_window(window);
+        buffer_pool_put(device_testing_context, buf);
+
+        device_testing_context->capacity_test_info.test_performed = 1;
+        device_testing_context->capacity_test_info.device_size = wraparound_size * device_testing_context->device_info.sector_size;
+        device_testing_context->capacity_test_info.num_sectors = wraparound_size;
+        device_testing_context->capacity_test_info.is_fake_flash = FAKE_FLASH_YES;
+
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_WRAPAROUND_FLASH_DETECTED, device_testing_context->capacity_test_info.device_size);
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_DEVICE_SIZE, device_testing_context->capacity_test_info.device_size);
+
+        return 0;
+    }
+
     rng_fill_buffer(device_testing_context, buf, buf_size);
 
     // Decide where we'll put the initial data.  The first and last writes will
@@ -575,27 +946,20 @@ uint64_t probe_device_size(device_testing_context_type *device_testing_context)
         }
     }
 
+    for(i = 0; i < num_slices; i++) {
+        stamp_probe_data(device_testing_context, buf + (i * slice_size), slice_size / device_testing_context->device_info.sector_size, initial_sectors[i]);
+    }
+
     // Write the blocks to the card.  We're going to write them in reverse order
     // so that if the card is caching some of the data when we go to read it
     // back, hopefully the stuff toward the end of the device will already be
     // flushed out of the cache.
     for(i = num_slices; i > 0; i--) {
         handle_key_inputs(device_testing_context, window);
-        if(lseek(device_testing_context->device_info.fd, initial_sectors[i - 1] * device_testing_context->device_info.sector_size, SEEK_SET) == -1) {
+        if(write_data_to_device(device_testing_context, buf + ((i - 1) * slice_size), slice_size, initial_sectors[i - 1] * device_testing_context->device_info.sector_size)) {
             errnum = errno;
             erase_and_delete_window(window);
-            multifree(2, buf, readbuf);
-
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errnum));
-            io_error_during_size_probe(device_testing_context);
-
-            return -1;
-        }
-
-        if(write_data_to_device(device_testing_context, buf + ((i - 1) * slice_size), slice_size)) {
-            errnum = errno;
-            erase_and_delete_window(window);
-            multifree(2, buf, readbuf);
+            buffer_pool_put(device_testing_context, buf);
 
             log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR, strerror(errnum));
             io_error_during_size_probe(device_testing_context);
@@ -614,30 +978,8 @@ uint64_t probe_device_size(device_testing_context_type *device_testing_context)
     // Read the blocks back.
     for(i = 0; i < num_slices; i++) {
         handle_key_inputs(device_testing_context, window);
-        if(lseek(device_testing_context->device_info.fd, initial_sectors[i] * device_testing_context->device_info.sector_size, SEEK_SET) == -1) {
-            errnum = errno;
-            erase_and_delete_window(window);
-            multifree(2, buf, readbuf);
-
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errnum));
-            io_error_during_size_probe(device_testing_context);
-
-            return -1;
-        }
-
-        bytes_left = slice_size;
-        while(bytes_left) {
-            wait_for_file_lock(device_testing_context, &window);
-
-            // For the read portion, we're just going to try to read the whole thing all at once
-            if((ret = read(device_testing_context->device_info.fd, readbuf + (slice_size - bytes_left), bytes_left)) == -1) {
-                // Ignore a read failure and just zero out the remainder of the buffer instead
-                memset(buf + (slice_size - bytes_left), 0, bytes_left);
-                bytes_left = 0;
-            } else {
-                bytes_left -= ret;
-            }
-        }
+        wait_for_file_lock(device_testing_context, &window);
+        read_data_from_device(device_testing_context, readbuf, slice_size, initial_sectors[i] * device_testing_context->device_info.sector_size);
 
         // Compare the two buffers, sector_size bytes at a time
         for(j = 0; j < slice_size; j += device_testing_context->device_info.sector_size) {
@@ -645,7 +987,7 @@ uint64_t probe_device_size(device_testing_context_type *device_testing_context)
                 // Are we at the beginning of the device?
                 if(i == 0) {
                     // Are we at the very first block?
-                    multifree(2, buf, readbuf);
+                    buffer_pool_put(device_testing_context, buf);
                     if(j == 0) {
                         log_log(device_testing_context, __func__, SEVERITY_LEVEL_WARNING, MSG_FIRST_SECTOR_ISNT_STABLE);
                         erase_and_delete_window(window);
@@ -679,7 +1021,7 @@ uint64_t probe_device_size(device_testing_context_type *device_testing_context)
                 } else {
                     if(j > 0) {
                         erase_and_delete_window(window);
-                        multifree(2, buf, readbuf);
+                        buffer_pool_put(device_testing_context, buf);
 
                         device_testing_context->capacity_test_info.test_performed = 1;
                         device_testing_context->capacity_test_info.device_size = (initial_sectors[i] * device_testing_context->device_info.sector_size) + j;
@@ -691,6 +1033,14 @@ uint64_t probe_device_size(device_testing_context_type *device_testing_context)
                         return 0;
                     } else {
                         high = initial_sectors[i];
+                        if((alias_distance = get_sector_alias_distance(device_testing_context, readbuf, readbuf + slice_size, initial_sectors[i])) >= low) {
+                            if(alias_distance < (low * 2)) {
+                                wraparound_size = alias_distance;
+                            } else if(alias_distance < high) {
+                                high = alias_distance;
+                            }
+                        }
+
                         i = 9;
                         break;
                     }
@@ -701,10 +1051,17 @@ uint64_t probe_device_size(device_testing_context_type *device_testing_context)
         }
     }
 
+    // If the first bad slice read back data that was written somewhere below
+    // it, and the distance between the two is too small to be more than one
+    // multiple of the device's real size, then we already have our answer.
+    if(wraparound_size) {
+        low = high = wraparound_size;
+    }
+
     // If we didn't have any mismatches, then the card is probably good.
     if(high == device_testing_context->device_info.num_logical_sectors) {
         erase_and_delete_window(window);
-        multifree(2, buf, readbuf);
+        buffer_pool_put(device_testing_context, buf);
 
         log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_DEVICE_SIZE, device_testing_context->device_info.logical_size);
 
@@ -716,114 +1073,134 @@ uint64_t probe_device_size(device_testing_context_type *device_testing_context)
         return 0;
     }
 
-    // Otherwise, start bisecting the area between low and high to figure out
-    // where the first "bad" block is
-    keep_searching = 1;
+    // Otherwise, narrow down where the first "bad" sector is.  Rather than
+    // bisecting, each pass probes CAPACITY_PROBE_POINTS evenly spaced points
+    // between low and high, which cuts the search area down to
+    // 1/(CAPACITY_PROBE_POINTS + 1) of its previous size.  Once the search
+    // area is small enough, the probes are laid end to end across all of it.
+    probe_sectors = slice_size / device_testing_context->device_info.sector_size;
 
-    while(keep_searching) {
+    while(low < high) {
         handle_key_inputs(device_testing_context, window);
-        // Select a 32MB area centered between low and high
+
         size = high - low;
-        if(size > ((slice_size * num_slices) / device_testing_context->device_info.sector_size)) {
-            cur = (size / 2) + low;
-            size = (slice_size * num_slices) / device_testing_context->device_info.sector_size;
+        if(size <= (CAPACITY_PROBE_POINTS * probe_sectors)) {
+            for(num_probes = 0, cur = low; cur < high; num_probes++, cur += probe_sectors) {
+                probe_points[num_probes] = cur;
+                probe_lengths[num_probes] = (high - cur) > probe_sectors ? probe_sectors : (high - cur);
+            }
         } else {
-            // The area between high and low isn't big enough to hold 32MB
-            cur = low;
-
-            // Give up after this round
-            keep_searching = 0;
+            for(num_probes = 0; num_probes < CAPACITY_PROBE_POINTS; num_probes++) {
+                // Probes get cut short if they'd run into each other
+                probe_points[num_probes] = low + ((size / (CAPACITY_PROBE_POINTS + 1)) * (num_probes + 1));
+                probe_lengths[num_probes] = (size / (CAPACITY_PROBE_POINTS + 1)) > probe_sectors ? probe_sectors : (size / (CAPACITY_PROBE_POINTS + 1));
+            }
         }
 
-        if(lseek(device_testing_context->device_info.fd, cur * device_testing_context->device_info.sector_size, SEEK_SET) == -1) {
-            errnum = errno;
-            erase_and_delete_window(window);
-            multifree(2, buf, readbuf);
-
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errnum));
-            io_error_during_size_probe(device_testing_context);
-
-            return -1;
+        // Write the probes in reverse order, just like the initial slices.  If
+        // a probe that lands past the end of the real storage wraps around
+        // onto a probe further down, the lower probe gets written last and
+        // wins.
+        rng_fill_buffer(device_testing_context, buf, slice_size * num_probes);
+        for(i = 0; i < num_probes; i++) {
+            stamp_probe_data(device_testing_context, buf + (i * slice_size), probe_lengths[i], probe_points[i]);
         }
 
-        // Generate some more random data
-        rng_fill_buffer(device_testing_context, buf, slice_size * num_slices);
-        if(write_data_to_device(device_testing_context, buf, slice_size * num_slices)) {
-            errnum = errno;
-            erase_and_delete_window(window);
-            multifree(2, buf, readbuf);
+        for(i = num_probes; i > 0; i--) {
+            handle_key_inputs(device_testing_context, window);
+            if(write_data_to_device(device_testing_context, buf + ((i - 1) * slice_size), probe_lengths[i - 1] * device_testing_context->device_info.sector_size,
+                                    probe_points[i - 1] * device_testing_context->device_info.sector_size)) {
+                errnum = errno;
+                erase_and_delete_window(window);
+                buffer_pool_put(device_testing_context, buf);
 
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR, strerror(errnum));
-            io_error_during_size_probe(device_testing_context);
+                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR, strerror(errnum));
+                io_error_during_size_probe(device_testing_context);
 
-            return -1;
+                return -1;
+            }
+
+            wait_for_file_lock(device_testing_context, &window);
         }
 
-        if(lseek(device_testing_context->device_info.fd, cur * device_testing_context->device_info.sector_size, SEEK_SET) == -1) {
-            errnum = errno;
-            erase_and_delete_window(window);
-            multifree(2, buf, readbuf);
+        // The last few probes we wrote could still be sitting in the device's
+        // write cache, so push them out by writing over the (known good)
+        // start of the device.  If the known good area isn't big enough, we'll
+        // just have to take our chances.
+        if((low * device_testing_context->device_info.sector_size) >= get_cache_defeat_size(device_testing_context)) {
+            if(flush_device_write_cache(device_testing_context, readbuf, buf_size)) {
+                errnum = errno;
+                erase_and_delete_window(window);
+                buffer_pool_put(device_testing_context, buf);
 
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_ERROR, strerror(errnum));
-            io_error_during_size_probe(device_testing_context);
+                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR, strerror(errnum));
+                io_error_during_size_probe(device_testing_context);
 
-            return -1;
+                return -1;
+            }
+
+            wait_for_file_lock(device_testing_context, &window);
         }
 
-        // Read the data back -- we're only going to read back half the data
-        // to avoid the possibility that any part of the other half is cached
-        for(i = 0; i < 4; i++) {
+        // Read the probes back in order.  Everything before the first probe
+        // that doesn't verify is good; everything from its first bad sector
+        // onward is bad.
+        for(i = 0; i < num_probes; i++) {
             handle_key_inputs(device_testing_context, window);
-            bytes_left = slice_size;
-            while(bytes_left) {
-                if((ret = read(device_testing_context->device_info.fd, readbuf + (slice_size - bytes_left), bytes_left)) == -1) {
-                    // Ignore a read failure and just zero out the remainder of the buffer instead
-                    memset(buf + (slice_size - bytes_left), 0, bytes_left);
-                    bytes_left = 0;
-                } else {
-                    bytes_left -= ret;
+            wait_for_file_lock(device_testing_context, &window);
+
+            read_data_from_device(device_testing_context, readbuf, probe_lengths[i] * device_testing_context->device_info.sector_size,
+                                  probe_points[i] * device_testing_context->device_info.sector_size);
+
+            for(j = 0; j < (probe_lengths[i] * device_testing_context->device_info.sector_size); j += device_testing_context->device_info.sector_size) {
+                if(memcmp(buf + (i * slice_size) + j, readbuf + j, device_testing_context->device_info.sector_size)) {
+                    break;
                 }
             }
 
-            // Compare the data, sector_size bytes at a time.
-            for(j = 0; j < slice_size; j += device_testing_context->device_info.sector_size) {
-                handle_key_inputs(device_testing_context, window);
-                if(memcmp(buf + (i * slice_size) + j, readbuf + j, device_testing_context->device_info.sector_size)) {
-                    if(j > 0) {
-                        erase_and_delete_window(window);
-                        multifree(2, buf, readbuf);
+            if(j == (probe_lengths[i] * device_testing_context->device_info.sector_size)) {
+                // We verified the whole probe, so the bad area has to be past it
+                low = probe_points[i] + probe_lengths[i];
+            } else if(j > 0) {
+                erase_and_delete_window(window);
+                buffer_pool_put(device_testing_context, buf);
 
-                        device_testing_context->capacity_test_info.test_performed = 1;
-                        device_testing_context->capacity_test_info.device_size = (cur * device_testing_context->device_info.sector_size) + (i * slice_size) + j;
-                        device_testing_context->capacity_test_info.num_sectors = device_testing_context->capacity_test_info.device_size / device_testing_context->device_info.sector_size;
-                        device_testing_context->capacity_test_info.is_fake_flash = (device_testing_context->capacity_test_info.device_size == device_testing_context->device_info.logical_size) ? FAKE_FLASH_NO : FAKE_FLASH_YES;
+                device_testing_context->capacity_test_info.test_performed = 1;
+                device_testing_context->capacity_test_info.device_size = (probe_points[i] * device_testing_context->device_info.sector_size) + j;
+                device_testing_context->capacity_test_info.num_sectors = device_testing_context->capacity_test_info.device_size / device_testing_context->device_info.sector_size;
+                device_testing_context->capacity_test_info.is_fake_flash = (device_testing_context->capacity_test_info.device_size == device_testing_context->device_info.logical_size) ? FAKE_FLASH_NO : FAKE_FLASH_YES;
 
-                        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_DEVICE_SIZE, device_testing_context->capacity_test_info.device_size);
+                log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_DEVICE_SIZE, device_testing_context->capacity_test_info.device_size);
 
-                        return 0;
-                    } else {
-                        high = cur + (((i * slice_size) + j) / device_testing_context->device_info.sector_size);
-                        i = 4;
-                        break;
+                return 0;
+            } else {
+                high = probe_points[i];
+                if((alias_distance = get_sector_alias_distance(device_testing_context, readbuf, readbuf + slice_size, probe_points[i])) >= low) {
+                    if(alias_distance < (low * 2)) {
+                        wraparound_size = alias_distance;
+                        low = high = alias_distance;
+                    } else if(alias_distance < high) {
+                        high = alias_distance;
                     }
                 }
-            }
 
-            if(i != 4) {
-                // We verified all the data successfully, so the bad area has to be past where we are now
-                low = cur + ((slice_size * 4) / device_testing_context->device_info.sector_size);
+                break;
             }
         }
     }
 
     erase_and_delete_window(window);
-    multifree(2, buf, readbuf);
+    buffer_pool_put(device_testing_context, buf);
 
     device_testing_context->capacity_test_info.test_performed = 1;
     device_testing_context->capacity_test_info.device_size = low * device_testing_context->device_info.sector_size;
     device_testing_context->capacity_test_info.num_sectors = low;
     device_testing_context->capacity_test_info.is_fake_flash = (device_testing_context->capacity_test_info.device_size == device_testing_context->device_info.logical_size) ? FAKE_FLASH_NO : FAKE_FLASH_YES;
 
+    if(wraparound_size) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_WRAPAROUND_FLASH_DETECTED, device_testing_context->capacity_test_info.device_size);
+    }
+
     log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_DEVICE_SIZE, device_testing_context->capacity_test_info.device_size);
 
     return 0;
@@ -863,6 +1240,51 @@ int *random_list(device_testing_context_type *device_testing_context) {
     return list;
 }
 
+/**
+ * Moves the slices that were written last to the end of a list of slices to be
+ * read, so that the device has had as long as possible to flush them out of its
+ * write cache by the time we read them back.  Only as many slices as could
+ * still be sitting in the write cache (see get_cache_defeat_size()) are moved;
+ * otherwise, the order of the list is left alone.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param read_order              The list of slices to be read, as returned by
+ *                                random_list().  Reordered in place.
+ * @param write_order             The list of slices in the order they were
+ *                                written.
+ */
+void defer_recently_written_slices(device_testing_context_type *device_testing_context, int *read_order, int *write_order) {
+    int i, j, k, num_deferred, deferred[NUM_SLICES], reordered[NUM_SLICES];
+    uint64_t slice_size;
+
+    slice_size = (device_testing_context->device_info.num_physical_sectors / NUM_SLICES) * device_testing_context->device_info.sector_size;
+    if(!slice_size) {
+        return;
+    }
+
+    num_deferred = (get_cache_defeat_size(device_testing_context) + slice_size - 1) / slice_size;
+
+    // If every slice could be in the cache, moving them around won't help
+    if(num_deferred >= NUM_SLICES) {
+        return;
+    }
+
+    memset(deferred, 0, sizeof(deferred));
+    for(i = NUM_SLICES - num_deferred; i < NUM_SLICES; i++) {
+        deferred[write_order[i]] = 1;
+    }
+
+    for(i = 0, j = 0, k = NUM_SLICES - num_deferred; i < NUM_SLICES; i++) {
+        if(deferred[read_order[i]]) {
+            reordered[k++] = read_order[i];
+        } else {
+            reordered[j++] = read_order[i];
+        }
+    }
+
+    memcpy(read_order, reordered, sizeof(reordered));
+}
+
 /**
  * Get the starting sector for a slice.
  *
@@ -994,8 +1416,17 @@ void print_help(char *program_name) {
 #endif // defined(HAVE_NCURSES)
            "[--this-will-destroy-my-device]\n");
     printf("       [-f | --lockfile filename] [-e | --sectors count]\n");
+    printf("       [--io-timeout seconds] [--sync-mode mode] [--metrics address]\n");
+    printf("       [--control-socket path] [--probe-for-cache-size] [--quick-screen]\n");
+    printf("       [--speed-series-file filename] [--sustained-write-test percent]\n");
+    printf("       [--au-speed-test [--au-size megabytes]] [--workload-file filename]\n");
+    printf("       [--surface-scan [--surface-scan-interval rounds]\n");
+    printf("       [--surface-scan-sample percent]]\n");
     printf("       [--dbhost hostname --dbuser username --dbpass password --dbname database\n");
-    printf("       [--dbport port] [--cardname name|--cardid id]] device-name |\n");
+    printf("       [--dbport port] [--dbspool filename] [--cardname name|--cardid id]]\n");
+    printf("       [--dbfile filename [--cardname name|--cardid id]]\n");
+    printf("       [--collector socket [--dbspool filename] [--cardname name|--cardid id]]\n");
+    printf("       device-name |\n");
     printf("       [-h | --help]]\n\n");
     printf("  device_name                    The device to test (for example, /dev/sdc).\n");
     printf("  -s|--stats-file filename       Write stats periodically to the given file.  If\n");
@@ -1012,6 +1443,47 @@ void print_help(char *program_name) {
     printf("                                 kernel. Note that this process may take several\n");
     printf("                                 minutes to run, depending on the speed of the\n");
     printf("                                 device.\n");
+    printf("  --probe-for-cache-size         Probe the device to estimate the size of its\n");
+    printf("                                 write cache instead of assuming it's 16MB.\n");
+    printf("                                 The estimate is used to make sure data has\n");
+    printf("                                 been pushed out of the cache before it's read\n");
+    printf("                                 back.  Note that this process writes up to\n");
+    printf("                                 1GB of data to the device.\n");
+    printf("  --quick-screen                 Screen the device for fake flash by writing a\n");
+    printf("                                 few small blocks across it and reading them\n");
+    printf("                                 back, then exit without running any other\n");
+    printf("                                 tests.  Exits with 0 if the device appears to\n");
+    printf("                                 be genuine, 2 if it is fake flash, or 3 if the\n");
+    printf("                                 result was inconclusive.  Implies --no-curses.\n");
+    printf("  --speed-series-file filename   Write the throughput of each speed test,\n");
+    printf("                                 sampled every 100ms, to the given file in CSV\n");
+    printf("                                 format.  If the given file already exists, the\n");
+    printf("                                 samples are appended to the file.\n");
+    printf("  --sustained-write-test percent Keep writing to the device after the speed\n");
+    printf("                                 tests until its write speed drops off and\n");
+    printf("                                 levels out, or until percent percent of the\n");
+    printf("                                 device has been written, and base the speed\n");
+    printf("                                 class results on the speed it levels out at.\n");
+    printf("  --au-speed-test                Measure write speeds the way the SD\n");
+    printf("                                 Association's performance model does (by\n");
+    printf("                                 writing whole allocation units) and base the\n");
+    printf("                                 speed class results on the slowest one.\n");
+    printf("  --au-size megabytes            The allocation unit size to use for\n");
+    printf("                                 --au-speed-test.  Default: the size reported\n");
+    printf("                                 by the card, if available, or 4MB (for cards\n");
+    printf("                                 32GB and under) or 16MB (for larger cards).\n");
+    printf("  --workload-file filename       After the speed tests, run the jobs described\n");
+    printf("                                 in the given workload file and report the\n");
+    printf("                                 throughput and latency of each.\n");
+    printf("  --surface-scan                 Before the stress test starts, read the whole\n");
+    printf("                                 device and map out how fast each part of it\n");
+    printf("                                 reads.  Press h to switch between the sector\n");
+    printf("                                 map and a heatmap of the results.\n");
+    printf("  --surface-scan-interval rounds Repeat the surface scan every rounds rounds of\n");
+    printf("                                 the stress test.  Implies --surface-scan.\n");
+    printf("  --surface-scan-sample percent  Only read percent percent of the device during\n");
+    printf("                                 each surface scan, spread out evenly across\n");
+    printf("                                 the device.  Default: 100\n");
     printf("  -n|--no-curses                 Don't use ncurses to display progress and\n");
     printf("                                 stats.  In this mode, log messages are printed\n");
     printf("                                 to stdout.  Note that this mode is\n");
@@ -1031,6 +1503,29 @@ void print_help(char *program_name) {
     printf("                                 state file.  Only use this option with\n");
     printf("                                 problematic devices and you are sure the device\n");
     printf("                                 you specify is the correct device.\n");
+    printf("  --io-timeout seconds           Consider a read or write that takes longer\n");
+    printf("                                 than this many seconds to have timed out.\n");
+    printf("                                 Timed out operations are cancelled and retried\n");
+    printf("                                 after resetting the device.  Set to 0 to let\n");
+    printf("                                 operations take as long as they need.\n");
+    printf("                                 Default: 30\n");
+    printf("  --sync-mode mode               Controls when data written during the\n");
+    printf("                                 endurance test is flushed to the device.\n");
+    printf("                                 \"always\" opens the device with O_SYNC;\n");
+    printf("                                 \"block\" flushes after every block; a number N\n");
+    printf("                                 flushes after every N megabytes; \"slice\"\n");
+    printf("                                 flushes at the end of every slice; \"phase\"\n");
+    printf("                                 flushes once before the read phase.  Note that\n");
+    printf("                                 \"always\" also applies to the speed test.\n");
+    printf("                                 Default: always\n");
+    printf("  --metrics address              Serve OpenMetrics-format stats over HTTP\n");
+    printf("                                 (at /metrics) on the given address, which can\n");
+    printf("                                 be a port number, a loopback address and port\n");
+    printf("                                 (e.g., 127.0.0.1:9400), or the path to a Unix\n");
+    printf("                                 domain socket.\n");
+    printf("  --control-socket path          Listen for commands (pause, resume, bandwidth,\n");
+    printf("                                 blocksize, checkpoint, stats) on a Unix domain\n");
+    printf("                                 socket at the given path.\n");
     printf("  --dbhost hostname              Name of the MySQL host to connect to.\n");
     printf("  --dbuser username              Username to use with the MySQL connection.\n");
     printf("  --dbpass password              Password to use with the MySQL connection.\n");
@@ -1038,6 +1533,16 @@ void print_help(char *program_name) {
     printf("                                 connection.\n");
     printf("  --dbport port                  Port to use to connect to the MYSQL server.\n");
     printf("                                 Default: 3306\n");
+    printf("  --dbspool filename             File to hold progress updates while the\n");
+    printf("                                 database is unreachable.  The updates are sent\n");
+    printf("                                 once the connection is re-established.\n");
+    printf("                                 Default: mfst-<device UUID>.spool\n");
+    printf("  --dbfile filename              Log progress to a local SQLite database\n");
+    printf("                                 instead of a MySQL server.  The database is\n");
+    printf("                                 created if it doesn't exist.\n");
+    printf("  --collector socket             Send progress to the mfst-collector process\n");
+    printf("                                 listening on the given socket, which writes\n");
+    printf("                                 it to the database on our behalf.\n");
     printf("  --cardname name                Name of the card to register in the database.\n");
     printf("  --cardid id                    Force data to be logged to the database using\n");
     printf("                                 the given card ID instead of auto-detecting or\n");
@@ -1050,8 +1555,11 @@ void print_help(char *program_name) {
  * program_options global struct.  If a particular option was not supplied on
  * the command line, it is set to its default value, which is:
  *
- * * `NULL` for `-s`/`--stats-file` and `-l`/`--log-file`,
- * * `60` for `-i`/`--stats-interval`, and
+ * * `NULL` for `-s`/`--stats-file`, `-l`/`--log-file`, and
+ *   `--speed-series-file`,
+ * * `60` for `-i`/`--stats-interval`,
+ * * `30` for `--io-timeout`,
+ * * `SYNC_MODE_ALWAYS` for `--sync-mode`, and
  * * `0` for `-p`/`--probe` and `-n`/`--no-curses`.
  *
  * @param argc  The number of arguments passed on the command line.  The caller
@@ -1068,6 +1576,11 @@ void print_help(char *program_name) {
  */
 int parse_command_line_arguments(int argc, char **argv) {
     int optindex, c;
+    char workload_error[256];
+    char *endptr;
+    uint64_t sync_interval;
+    struct sockaddr_storage metrics_addr;
+    socklen_t metrics_addrlen;
     struct option options[] = {
         { "stats-file"                 , required_argument, NULL, 's' },
         { "log-file"                   , required_argument, NULL, 'l' },
@@ -1089,12 +1602,32 @@ int parse_command_line_arguments(int argc, char **argv) {
         { "dbport"                     , required_argument, NULL, 8   },
         { "cardid"                     , required_argument, NULL, 9   },
         { "cardname"                   , required_argument, NULL, 10  },
+        { "io-timeout"                 , required_argument, NULL, 11  },
+        { "sync-mode"                  , required_argument, NULL, 12  },
+        { "dbspool"                    , required_argument, NULL, 13  },
+        { "dbfile"                     , required_argument, NULL, 14  },
+        { "collector"                  , required_argument, NULL, 15  },
+        { "metrics"                    , required_argument, NULL, 16  },
+        { "control-socket"             , required_argument, NULL, 17  },
+        { "probe-for-cache-size"       , no_argument      , NULL, 18  },
+        { "quick-screen"               , no_argument      , NULL, 19  },
+        { "speed-series-file"          , required_argument, NULL, 20  },
+        { "sustained-write-test"       , required_argument, NULL, 21  },
+        { "au-speed-test"              , no_argument      , NULL, 22  },
+        { "au-size"                    , required_argument, NULL, 23  },
+        { "workload-file"              , required_argument, NULL, 24  },
+        { "surface-scan"               , no_argument      , NULL, 25  },
+        { "surface-scan-interval"      , required_argument, NULL, 26  },
+        { "surface-scan-sample"        , required_argument, NULL, 27  },
         { 0                            , 0                , 0   , 0   }
     };
 
     // Set the defaults for the command-line options
     memset(&program_options, 0, sizeof(program_options));
     program_options.stats_interval = 60;
+    program_options.io_timeout = 30;
+    program_options.sync_mode = SYNC_MODE_ALWAYS;
+    program_options.surface_scan_sample_percent = 100;
 
 #if !defined(HAVE_NCURSES)
     program_options.no_curses = 1;
@@ -1112,7 +1645,12 @@ int parse_command_line_arguments(int argc, char **argv) {
             case 3:
                 assert(forced_device = strdup(optarg)); break;
             case 4:
+#if defined(HAVE_MARIADB)
                 assert(program_options.db_host = strdup(optarg)); break;
+#else
+                printf("This copy of mfst was built without MariaDB support, so the --dbhost option is not available.\n");
+                return -1;
+#endif // defined(HAVE_MARIADB)
             case 5:
                 assert(program_options.db_user = strdup(optarg)); break;
             case 6:
@@ -1130,6 +1668,111 @@ int parse_command_line_arguments(int argc, char **argv) {
                 program_options.card_id = strtoull(optarg, NULL, 10); break;
             case 10:
                 assert(program_options.card_name = strdup(optarg)); break;
+            case 11:
+                program_options.io_timeout = strtol(optarg, NULL, 10); break;
+            case 12:
+                if(!strcmp(optarg, "always")) {
+                    program_options.sync_mode = SYNC_MODE_ALWAYS;
+                } else if(!strcmp(optarg, "block")) {
+                    program_options.sync_mode = SYNC_MODE_BLOCK;
+                } else if(!strcmp(optarg, "slice")) {
+                    program_options.sync_mode = SYNC_MODE_SLICE;
+                } else if(!strcmp(optarg, "phase")) {
+                    program_options.sync_mode = SYNC_MODE_PHASE;
+                } else {
+                    // Anything else has to be a number of megabytes
+                    errno = 0;
+                    sync_interval = strtoull(optarg, &endptr, 10);
+                    if(errno || *endptr || *optarg == '-' || !sync_interval || sync_interval > (UINT64_MAX / 1048576ULL)) {
+                        printf("Invalid sync mode: %s\n", optarg);
+                        return -1;
+                    }
+
+                    program_options.sync_mode = SYNC_MODE_INTERVAL;
+                    program_options.sync_interval = sync_interval * 1048576ULL;
+                }
+
+                break;
+            case 13:
+                assert(program_options.db_spool_file = strdup(optarg)); break;
+            case 14:
+#if defined(HAVE_SQLITE)
+                assert(program_options.db_file = strdup(optarg)); break;
+#else
+                printf("This copy of mfst was built without SQLite support, so the --dbfile option is not available.\n");
+                return -1;
+#endif // defined(HAVE_SQLITE)
+            case 15:
+                assert(program_options.collector_socket = strdup(optarg)); break;
+            case 16:
+                if(metrics_parse_address(optarg, &metrics_addr, &metrics_addrlen)) {
+                    printf("Invalid metrics address: %s (must be a port number, a loopback address and port, or the path to a Unix domain socket)\n", optarg);
+                    return -1;
+                }
+
+                assert(program_options.metrics_address = strdup(optarg)); break;
+            case 17:
+                assert(program_options.control_socket = strdup(optarg)); break;
+            case 18:
+                program_options.probe_for_write_cache_size = 1; break;
+            case 19:
+                program_options.quick_screen = 1; break;
+            case 20:
+                if(program_options.speed_series_file) {
+                    printf("Only one speed series file option may be specified on the command line.\n");
+                    return -1;
+                }
+
+                assert(program_options.speed_series_file = strdup(optarg)); break;
+            case 21:
+                c = strtol(optarg, NULL, 10);
+                if(c < 1 || c > 100) {
+                    printf("The --sustained-write-test option must be a percentage between 1 and 100.\n");
+                    return -1;
+                }
+
+                program_options.sustained_write_percent = c;
+                break;
+            case 22:
+                program_options.au_speed_test = 1; break;
+            case 23:
+                if(!(program_options.au_size = strtoull(optarg, NULL, 10) * 1048576ULL)) {
+                    printf("Invalid AU size: %s\n", optarg);
+                    return -1;
+                }
+
+                break;
+            case 24:
+                if(program_options.workload_file) {
+                    printf("Only one workload file option may be specified on the command line.\n");
+                    return -1;
+                }
+
+                if(load_workload_file(optarg, &program_options.workload_jobs, &program_options.num_workload_jobs, workload_error, sizeof(workload_error))) {
+                    printf("Unable to load workload file %s: %s\n", optarg, workload_error);
+                    return -1;
+                }
+
+                assert(program_options.workload_file = strdup(optarg)); break;
+            case 25:
+                program_options.surface_scan = 1; break;
+            case 26:
+                if(!(program_options.surface_scan_interval = strtoull(optarg, NULL, 10))) {
+                    printf("Invalid surface scan interval: %s\n", optarg);
+                    return -1;
+                }
+
+                program_options.surface_scan = 1;
+                break;
+            case 27:
+                c = strtol(optarg, NULL, 10);
+                if(c < 1 || c > 100) {
+                    printf("The --surface-scan-sample option must be a percentage between 1 and 100.\n");
+                    return -1;
+                }
+
+                program_options.surface_scan_sample_percent = c;
+                break;
             case 'e':
                 program_options.force_sectors = strtoull(optarg, NULL, 10); break;
             case 'f':
@@ -1187,6 +1830,18 @@ int parse_command_line_arguments(int argc, char **argv) {
         return -1;
     }
 
+    if(program_options.quick_screen) {
+        if(program_options.state_file) {
+            printf("The --quick-screen option can't be used with a state file.\n");
+            return -1;
+        }
+
+        // Screening is meant to be run on lots of devices at once, so just
+        // log the results to stdout
+        program_options.no_curses = 1;
+        program_options.orig_no_curses = 1;
+    }
+
     if(!program_options.lock_file) {
         program_options.lock_file = strdup("mfst.lock");
     }
@@ -1198,26 +1853,16 @@ int parse_command_line_arguments(int argc, char **argv) {
     return 0;
 }
 
-int64_t lseek_or_reset_device(device_testing_context_type *device_testing_context, off_t position, int *device_was_disconnected);
-
 /**
  * Displays a message to the user indicating that the device has been
  * disconnected and waits for the device to be reconnected.
  *
  * @param device_testing_context  The device currently being tested.
- * @param position                The position to seek to once the device has
- *                                been reconnected.  If `seek_after_reconnect`
- *                                is set to zero, this parameter is ignored.
- * @param seek_after_reconnect    Non-zero to indicate that a seek operation, to
- *                                the position indicated by `position`, should
- *                                be performed after the device has been
- *                                reconnected, or zero to indicate that no seek
- *                                operation should be performed.
  *
  * @returns 0 if the device was reconnected successfully, or -1 if an error
  *          occurred.
  */
-int handle_device_disconnect(device_testing_context_type *device_testing_context, off_t position, int seek_after_reconnect) {
+int handle_device_disconnect(device_testing_context_type *device_testing_context) {
     WINDOW *window;
     char *new_device_name;
     dev_t new_device_num;
@@ -1226,6 +1871,8 @@ int handle_device_disconnect(device_testing_context_type *device_testing_context
     device_search_params_t device_search_params;
     device_search_result_t *device_search_result;
     main_thread_status = MAIN_THREAD_STATUS_DEVICE_DISCONNECTED;
+    device_testing_context->device_event_stats.num_disconnects++;
+    stats_block_publish(device_testing_context);
 
     if(device_testing_context->device_info.fd != -1) {
         device_info_invalidate_file_handle(device_testing_context);
@@ -1244,6 +1891,8 @@ int handle_device_disconnect(device_testing_context_type *device_testing_context
 
     if(device_search_result) {
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_DEVICE_RECONNECTED, device_search_result->device_name);
+        device_testing_context->device_event_stats.num_reconnects++;
+        stats_block_publish(device_testing_context);
 
         device_testing_context->device_info.fd = device_search_result->fd;
 
@@ -1260,161 +1909,25 @@ int handle_device_disconnect(device_testing_context_type *device_testing_context
             erase_and_delete_window(window);
             redraw_screen(device_testing_context);
 
-            return -1;
-        }
-
-        device_testing_context->device_info.device_num = device_search_result->device_num;
-
-        free_device_search_result(device_search_result);
-
-        if(seek_after_reconnect) {
-            if(lseek_or_reset_device(device_testing_context, position, NULL) == -1) {
-                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_AFTER_DEVICE_RESET_FAILED);
-
-                erase_and_delete_window(window);
-                redraw_screen(device_testing_context);
-
-                return -1;
-            }
-        }
-
-        erase_and_delete_window(window);
-        redraw_screen(device_testing_context);
-
-        return 0;
-    } else {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_FAILED_TO_REOPEN_DEVICE);
-
-        erase_and_delete_window(window);
-        redraw_screen(device_testing_context);
-
-        return -1;
-    }
-}
-
-/**
- * Seeks to the given position relative to the start of the device.  Gracefully
- * handles device errors and disconnects by retrying the operation or, if the
- * device has been disconnected, waiting for the device to reconnect.
- *
- * @param device_testing_context   The device on which to seek.
- * @param position                 The position to which to seek, relative to
- *                                 the start of the device.
- * @param device_was_disconnected  A pointer to a variable which will be set to
- *                                 1 if the device was disconnected during the
- *                                 course of this function, or left unmodified
- *                                 otherwise.  This parameter may be set to
- *                                 NULL.
- *
- * @returns The current position of the file pointer, or -1 if (a) an
- *          unrecoverable error occurred, or (b) an error occurred and retry
- *          attempts have been exhausted.
- */
-off_t lseek_or_retry(device_testing_context_type *device_testing_context, off_t position, int *device_was_disconnected) {
-    int retry_count = 0;
-    int64_t ret;
-    int iret;
-    char *new_device_name;
-    dev_t new_device_num;
-    main_thread_status_type previous_status = main_thread_status;
-
-    if((ret = lseek(device_testing_context->device_info.fd, position, SEEK_SET)) == -1) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_TO_SECTOR_ERROR, position / device_testing_context->device_info.sector_size);
-    }
-
-    while(ret == -1 && retry_count < MAX_RESET_RETRIES) {
-        if(did_device_disconnect(device_testing_context->device_info.device_num)) {
-            if(device_was_disconnected) {
-                *device_was_disconnected = 1;
-            }
-
-            if(handle_device_disconnect(device_testing_context, position, 0) == -1) {
-                return -1;
-            }
-        } else {
-            ret = lseek(device_testing_context->device_info.fd, position, SEEK_SET);
-            retry_count++;
-        }
-    }
-
-    return ret;
-}
-
-/**
- * Seeks to the given position relative to the start of the device.  Gracefully
- * handles device errors and disconnects by retrying the operation, attempting
- * to reset the device, and/or waiting for the device to reconnect.
- *
- * @param device_testing_context   The device on which to seek.
- * @param position                 The position to which to seek, relative to
- *                                 the start of the device.
- * @param device_was_disconnected  A pointer to a variable which will be set to
- *                                 1 if the device was disconnected during the
- *                                 course of this function, or left unmodified
- *                                 otherwise.  This parameter may be set to
- *                                 NULL.
- *
- * @returns The current position of the file pointer, or -1 if (a) an
- *          unrecoverable error occurred, or (b) an error occurred and retry
- *          attempts have been exhausted.
- */
-int64_t lseek_or_reset_device(device_testing_context_type *device_testing_context, off_t position, int *device_was_disconnected) {
-    int retry_count = 0;
-    WINDOW *window;
-    int64_t ret;
-    int iret;
-    char *new_device_name;
-    dev_t new_device_num;
-    main_thread_status_type previous_status = main_thread_status;
-
-    ret = lseek_or_retry(device_testing_context, position, device_was_disconnected);
-    while(ret == -1 && retry_count < MAX_RESET_RETRIES) {
-        if(did_device_disconnect(device_testing_context->device_info.device_num) || device_testing_context->device_info.fd == -1) {
-            if(device_was_disconnected) {
-                *device_was_disconnected = 1;
-            }
-
-            if(handle_device_disconnect(device_testing_context, position, 0)) {
-                return -1;
-            }
-        } else {
-            if(can_reset_device(device_testing_context)) {
-                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_ATTEMPTING_DEVICE_RESET);
-                window = resetting_device_message();
-
-                main_thread_status = MAIN_THREAD_STATUS_DEVICE_DISCONNECTED;
-                iret = reset_device(device_testing_context);
-                main_thread_status = previous_status;
-
-                if(iret) {
-                    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_DEVICE_RESET_FAILED);
+            return -1;
+        }
 
-                    erase_and_delete_window(window);
-                    redraw_screen(device_testing_context);
+        device_testing_context->device_info.device_num = device_search_result->device_num;
 
-                    return -1;
-                }
+        free_device_search_result(device_search_result);
 
-                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_DEVICE_RESET_SUCCESS);
-                retry_count++;
+        erase_and_delete_window(window);
+        redraw_screen(device_testing_context);
 
-                ret = lseek_or_retry(device_testing_context, position, device_was_disconnected);
+        return 0;
+    } else {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_FAILED_TO_REOPEN_DEVICE);
 
-                if(device_was_disconnected) {
-                    *device_was_disconnected = 1;
-                }
+        erase_and_delete_window(window);
+        redraw_screen(device_testing_context);
 
-                erase_and_delete_window(window);
-                redraw_screen(device_testing_context);
-            } else {
-                // Insta-fail
-                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_DONT_KNOW_HOW_TO_RESET_DEVICE);
-                return -1;
-            }
-        }
+        return -1;
     }
-
-    return ret;
 }
 
 /**
@@ -1426,11 +1939,8 @@ int64_t lseek_or_reset_device(device_testing_context_type *device_testing_contex
  * @param buf                     A pointer to a buffer which will receive the
  *                                data read from the device.
  * @param count                   The number of bytes to read from the device.
- * @param position                The current position of the file pointer in
- *                                the device.  If the device is disconnected or
- *                                needs to be reset, a seek operation to the
- *                                given position is performed after the device
- *                                reconnects.
+ * @param position                The position on the device from which to
+ *                                read, relative to the start of the device.
  *
  * @returns The number of bytes read from the device, or -1 if (a) an
  *          unrecoverable error occurred, or (b) an error occurred and retry
@@ -1438,20 +1948,25 @@ int64_t lseek_or_reset_device(device_testing_context_type *device_testing_contex
  */
 int64_t read_or_retry(device_testing_context_type *device_testing_context, void *buf, uint64_t count, off_t position) {
     int retry_count = 0;
+    int timed_out;
     int64_t ret;
 
-    ret = read(device_testing_context->device_info.fd, buf, count);
+    ret = io_watchdog_read(device_testing_context, buf, count, position);
+    timed_out = ret == -1 && errno == ETIMEDOUT;
     if(ret == -1) {
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_READ_ERROR_IN_SECTOR, position / device_testing_context->device_info.sector_size);
     }
 
-    while(ret <= 0 && retry_count < MAX_RESET_RETRIES) {
+    // If the operation timed out, don't bother retrying it -- let the caller
+    // escalate to a device reset instead
+    while(ret <= 0 && retry_count < MAX_RESET_RETRIES && !timed_out) {
         if(did_device_disconnect(device_testing_context->device_info.device_num)) {
-            if(handle_device_disconnect(device_testing_context, position, 1)) {
+            if(handle_device_disconnect(device_testing_context)) {
                 return -1;
             }
         } else {
-            ret = read(device_testing_context->device_info.fd, buf, count);
+            ret = io_watchdog_read(device_testing_context, buf, count, position);
+            timed_out = ret == -1 && errno == ETIMEDOUT;
             retry_count++;
         }
     }
@@ -1468,11 +1983,8 @@ int64_t read_or_retry(device_testing_context_type *device_testing_context, void
  * @param buf                     A pointer to a buffer which will receive the
  *                                data read from the device.
  * @param count                   The number of bytes to read from the device.
- * @param position                The current position of the file pointer in
- *                                the device.  If the device is disconnected or
- *                                needs to be reset, a seek operation to the
- *                                given position is performed after the device
- *                                reconnects.
+ * @param position                The position on the device from which to
+ *                                read, relative to the start of the device.
  *
  * @returns The number of bytes read from the device, or -1 if (a) an
  *          unrecoverable error occurred, or (b) an error occurred and retry
@@ -1490,7 +2002,7 @@ int64_t read_or_reset_device(device_testing_context_type *device_testing_context
     ret = read_or_retry(device_testing_context, buf, count, position);
     while(ret == -1 && retry_count < MAX_RESET_RETRIES) {
         if(did_device_disconnect(device_testing_context->device_info.device_num) || device_testing_context->device_info.fd == -1) {
-            if(handle_device_disconnect(device_testing_context, position, 1)) {
+            if(handle_device_disconnect(device_testing_context)) {
                 return -1;
             }
         } else {
@@ -1509,13 +2021,6 @@ int64_t read_or_reset_device(device_testing_context_type *device_testing_context
                     log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_DEVICE_RESET_SUCCESS);
                     retry_count++;
 
-                    if(lseek_or_retry(device_testing_context, position, NULL) == -1) {
-                        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_AFTER_DEVICE_RESET_FAILED);
-                        erase_and_delete_window(window);
-                        redraw_screen(device_testing_context);
-                        return -1;
-                    }
-
                     ret = read_or_retry(device_testing_context, buf, count, position);
                 }
 
@@ -1541,11 +2046,8 @@ int64_t read_or_reset_device(device_testing_context_type *device_testing_context
  * @param buf                      A pointer to a buffer containing the data to
  *                                 be written to the device.
  * @param count                    The number of bytes to write to the device.
- * @param position                 The current position of the file pointer in
- *                                 the device.  If the device is disconnected
- *                                 or needs to be reset, a seek operation to the
- *                                 given position is performed after the device
- *                                 reconnects.
+ * @param position                 The position on the device at which to
+ *                                 write, relative to the start of the device.
  * @param device_was_disconnected  A pointer to a variable which will be set to
  *                                 1 if the device was disconnected during the
  *                                 course of this function, or left unmodified
@@ -1557,18 +2059,22 @@ int64_t read_or_reset_device(device_testing_context_type *device_testing_context
  */
 int64_t write_or_retry(device_testing_context_type *device_testing_context, void *buf, uint64_t count, off_t position, int *device_was_disconnected) {
     int retry_count = 0;
+    int timed_out;
     int64_t ret;
     int iret;
     char *new_device_name;
     dev_t new_device_num;
     main_thread_status_type previous_status = main_thread_status;
 
-    ret = write(device_testing_context->device_info.fd, buf, count);
+    ret = io_watchdog_write(device_testing_context, buf, count, position);
+    timed_out = ret == -1 && errno == ETIMEDOUT;
     if(ret == -1) {
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR_IN_SECTOR, position / device_testing_context->device_info.sector_size);
     }
 
-    while(ret == -1 && retry_count < MAX_RESET_RETRIES) {
+    // If the operation timed out, don't bother retrying it -- let the caller
+    // escalate to a device reset instead
+    while(ret == -1 && retry_count < MAX_RESET_RETRIES && !timed_out) {
         // If we haven't completed at least one round, then we can't be sure that the
         // beginning-of-device and middle-of-device are accurate -- and if the device
         // is disconnected and reconnected (or reset), the device name might change --
@@ -1576,7 +2082,7 @@ int64_t write_or_retry(device_testing_context_type *device_testing_context, void
         if(did_device_disconnect(device_testing_context->device_info.device_num)) {
             *device_was_disconnected = 1;
             if(device_testing_context->endurance_test_info.rounds_completed) {
-                if(handle_device_disconnect(device_testing_context, position, 1)) {
+                if(handle_device_disconnect(device_testing_context)) {
                     return -1;
                 }
             } else {
@@ -1584,7 +2090,8 @@ int64_t write_or_retry(device_testing_context_type *device_testing_context, void
                 return -1;
             }
         } else {
-            ret = write(device_testing_context->device_info.fd, buf, count);
+            ret = io_watchdog_write(device_testing_context, buf, count, position);
+            timed_out = ret == -1 && errno == ETIMEDOUT;
             retry_count++;
         }
     }
@@ -1601,11 +2108,8 @@ int64_t write_or_retry(device_testing_context_type *device_testing_context, void
  * @param buf                     A pointer to a buffer containing the data to
  *                                be written to the device.
  * @param count                   The number of bytes to write to the device.
- * @param position                The current position of the file pointer in
- *                                the device.  If the device is disconnected or
- *                                needs to be reset, a seek operation to the
- *                                given position is performed after the device
- *                                reconnects.
+ * @param position                The position on the device at which to
+ *                                write, relative to the start of the device.
  * @param device_was_disconnected  A pointer to a variable which will be set to
  *                                 1 if the device was disconnected during the
  *                                 course of this function, or left unmodified
@@ -1633,7 +2137,7 @@ int64_t write_or_reset_device(device_testing_context_type *device_testing_contex
         if(did_device_disconnect(device_testing_context->device_info.device_num) || device_testing_context->device_info.fd == -1) {
             *device_was_disconnected = 1;
             if(device_testing_context->endurance_test_info.rounds_completed) {
-                if(handle_device_disconnect(device_testing_context, position, 1)) {
+                if(handle_device_disconnect(device_testing_context)) {
                     return -1;
                 }
             } else {
@@ -1658,13 +2162,6 @@ int64_t write_or_reset_device(device_testing_context_type *device_testing_contex
                         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_DEVICE_RESET_SUCCESS);
                         retry_count++;
 
-                        if(lseek_or_retry(device_testing_context, position, device_was_disconnected) == -1) {
-                            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_LSEEK_AFTER_DEVICE_RESET_FAILED);
-                            erase_and_delete_window(window);
-                            redraw_screen(device_testing_context);
-                            return -1;
-                        }
-
                         ret = write_or_retry(device_testing_context, buf, count, position, device_was_disconnected);
                     }
 
@@ -1688,6 +2185,78 @@ int64_t write_or_reset_device(device_testing_context_type *device_testing_contex
     return ret;
 }
 
+/**
+ * Flushes any data written to the device out to stable storage.  If the flush
+ * fails, we can't be sure how much of the data written since the last
+ * successful flush actually made it to the device -- so if the device was
+ * disconnected, this function waits for it to be reconnected, and otherwise it
+ * attempts to reset the device.  Either way, `device_was_disconnected` is set
+ * so that the caller knows to rewrite the data.
+ *
+ * @param device_testing_context   The device to flush.
+ * @param position                 The position just past the last byte written
+ *                                 to the device.
+ * @param device_was_disconnected  A pointer to a variable which will be set to
+ *                                 1 if the device was disconnected or reset
+ *                                 during the course of this function, or left
+ *                                 unmodified otherwise.
+ *
+ * @returns 0 if the flush completed successfully or the device was recovered,
+ *          or -1 if an unrecoverable error occurred.
+ */
+int sync_or_reset_device(device_testing_context_type *device_testing_context, off_t position, int *device_was_disconnected) {
+    WINDOW *window;
+    int ret;
+    main_thread_status_type previous_status = main_thread_status;
+
+    if(!io_watchdog_sync(device_testing_context, position)) {
+        return 0;
+    }
+
+    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_FDATASYNC_ERROR, strerror(errno));
+
+    // Same deal as write_or_reset_device() -- don't try to recover during
+    // round 1.
+    if(did_device_disconnect(device_testing_context->device_info.device_num) || device_testing_context->device_info.fd == -1) {
+        *device_was_disconnected = 1;
+        if(device_testing_context->endurance_test_info.rounds_completed) {
+            return handle_device_disconnect(device_testing_context);
+        } else {
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_ENDURANCE_TEST_DEVICE_DISCONNECTED_DURING_ROUND_1);
+            return -1;
+        }
+    }
+
+    if(!device_testing_context->endurance_test_info.rounds_completed) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_ENDURANCE_TEST_REFUSING_TO_RESET_DURING_ROUND_1);
+        return -1;
+    }
+
+    if(!can_reset_device(device_testing_context)) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_DONT_KNOW_HOW_TO_RESET_DEVICE);
+        return -1;
+    }
+
+    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_ATTEMPTING_DEVICE_RESET);
+    window = resetting_device_message();
+
+    main_thread_status = MAIN_THREAD_STATUS_DEVICE_DISCONNECTED;
+    ret = reset_device(device_testing_context);
+    main_thread_status = previous_status;
+
+    erase_and_delete_window(window);
+    redraw_screen(device_testing_context);
+
+    if(ret) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_DEVICE_RESET_FAILED);
+        return -1;
+    }
+
+    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_DEVICE_RESET_SUCCESS);
+    *device_was_disconnected = 1;
+    return 0;
+}
+
 /**
  * Resets the read/written flags in every sector of the given device's sector
  * map.
@@ -2176,6 +2745,118 @@ void mark_sector_unwritable(device_testing_context_type *device_testing_context,
     device_testing_context->endurance_test_info.sector_map[sector_num] |= SECTOR_MAP_FLAG_DO_NOT_USE;
 }
 
+void update_bod_mod_buffers(device_testing_context_type *device_testing_context, uint64_t starting_byte, void *buffer, uint64_t num_bytes);
+
+/**
+ * Narrows down which sectors in a failed read or write request are actually
+ * bad.  The range is split in half, and each half is sent through the usual
+ * retry-and-reset path (read_or_reset_device() or write_or_reset_device()), so
+ * that a device that's been wedged by an earlier error gets reset before we
+ * decide that anything else is bad.  Halves that succeed are left alone;
+ * halves that fail are split again, until the failing sectors have been
+ * isolated.  A sector is only marked bad once a request for that sector alone
+ * has failed.  This finds a run of bad sectors in O(log n) requests, rather
+ * than having to push a full-size request through the device for every bad
+ * sector.
+ *
+ * Sectors that are isolated as bad are marked unwritable and bad.  On reads,
+ * the portion of the buffer corresponding to the bad sectors is zeroed out.  On
+ * writes, the BOD/MOD buffers and the stats counters are updated for the data
+ * that was successfully written.
+ *
+ * @param device_testing_context   The device being tested.
+ * @param buffer                   A pointer to the part of the buffer that
+ *                                 corresponds to `starting_sector`.
+ * @param starting_sector          The first sector of the failed request.
+ * @param num_sectors              The number of sectors in the failed request.
+ * @param is_write                 Non-zero if the failed request was a write,
+ *                                 or zero if it was a read.
+ * @param device_was_disconnected  For writes, a pointer to a variable which
+ *                                 will be set to 1 if the device disconnects
+ *                                 or is reset while the bad sectors are being
+ *                                 isolated.  (The caller is expected to give
+ *                                 up on the block in this case.)  For reads, a
+ *                                 disconnect is handled by waiting for the
+ *                                 device to reconnect, and this parameter may
+ *                                 be set to NULL.
+ *
+ * @returns 0 if the bad sectors were isolated, 1 if the device disconnected
+ *          during a write before they could be isolated, or -1 if an
+ *          unrecoverable error occurred.
+ */
+int endurance_test_isolate_bad_sectors(device_testing_context_type *device_testing_context, char *buffer, uint64_t starting_sector, uint64_t num_sectors, int is_write, int *device_was_disconnected) {
+    uint64_t half, position, cur_sector, cur_num_sectors;
+    char *cur_buffer;
+    int64_t ret;
+    int i, iret, sector_size = device_testing_context->device_info.sector_size;
+
+    if(num_sectors == 1) {
+        if(!is_sector_bad(device_testing_context, starting_sector)) {
+            if(is_write) {
+                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR_SECTOR_UNUSABLE, starting_sector);
+                device_testing_context->endurance_test_info.num_new_bad_sectors_this_round++;
+            } else {
+                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_READ_ERROR_MARKING_SECTOR_UNUSABLE, starting_sector);
+            }
+        }
+
+        mark_sector_unwritable(device_testing_context, starting_sector);
+        mark_sector_bad(device_testing_context, starting_sector);
+
+        if(is_write) {
+            device_testing_context->endurance_test_info.num_bad_sectors_this_round++;
+        } else {
+            memset(buffer, 0, sector_size);
+        }
+
+        return 0;
+    }
+
+    half = num_sectors / 2;
+    for(i = 0; i < 2; i++) {
+        cur_sector = i ? starting_sector + half : starting_sector;
+        cur_num_sectors = i ? num_sectors - half : half;
+        cur_buffer = buffer + ((cur_sector - starting_sector) * sector_size);
+
+        handle_key_inputs(device_testing_context, NULL);
+
+        position = cur_sector * sector_size;
+        if(is_write) {
+            ret = write_or_reset_device(device_testing_context, cur_buffer, cur_num_sectors * sector_size, position, device_was_disconnected);
+        } else {
+            ret = read_or_reset_device(device_testing_context, cur_buffer, cur_num_sectors * sector_size, position);
+        }
+
+        if(ret == -1) {
+            if(device_testing_context->device_info.fd == -1) {
+                // The device has disconnected, and attempts to wait for it to
+                // reconnect have failed
+                return -1;
+            }
+
+            // Writes give up on the block if the device went away (as opposed
+            // to the request failing because of bad sectors)
+            if(is_write && did_device_disconnect(device_testing_context->device_info.device_num)) {
+                *device_was_disconnected = 1;
+                return 1;
+            }
+        }
+
+        if(ret == cur_num_sectors * sector_size) {
+            if(is_write) {
+                update_bod_mod_buffers(device_testing_context, position, cur_buffer, ret);
+                device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written += ret;
+            }
+
+            device_testing_context->endurance_test_info.screen_counters.bytes_since_last_update += ret;
+        } else if(iret = endurance_test_isolate_bad_sectors(device_testing_context, cur_buffer, cur_sector, cur_num_sectors, is_write, device_was_disconnected)) {
+            return iret;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * Reads a block of data from the device, automatically skipping over any
  * sectors that have been flagged as "unwritable".  This function gracefully
@@ -2199,6 +2880,9 @@ int endurance_test_read_block(device_testing_context_type *device_testing_contex
     uint64_t num_sectors_to_read;
     handle_key_inputs(device_testing_context, NULL);
     wait_for_file_lock(device_testing_context, NULL);
+    wait_while_paused_by_operator(device_testing_context);
+    control_throttle(device_testing_context);
+    stats_block_publish(device_testing_context);
 
     bytes_left_to_read = block_size = device_testing_context->device_info.sector_size * num_sectors;
 
@@ -2209,27 +2893,20 @@ int endurance_test_read_block(device_testing_context_type *device_testing_contex
             if((ret = read_or_reset_device(device_testing_context,
                                            buffer + (block_size - bytes_left_to_read),
                                            num_sectors_to_read * device_testing_context->device_info.sector_size,
-                                           lseek(device_testing_context->device_info.fd, 0, SEEK_CUR))) == -1) {
+                                           (starting_sector * device_testing_context->device_info.sector_size) + (block_size - bytes_left_to_read))) == -1) {
                 if(device_testing_context->device_info.fd == -1) {
                     return -1;
                 } else {
-                    // Mark this sector as bad and skip over it
-                    if(!is_sector_bad(device_testing_context, starting_sector + ((block_size - bytes_left_to_read) / device_testing_context->device_info.sector_size))) {
-                        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_READ_ERROR_MARKING_SECTOR_UNUSABLE, starting_sector + ((block_size - bytes_left_to_read) / device_testing_context->device_info.sector_size));
-                    }
-
-                    mark_sector_unwritable(device_testing_context, starting_sector + ((block_size - bytes_left_to_read) / device_testing_context->device_info.sector_size));
-                    mark_sector_bad(device_testing_context, starting_sector + ((block_size - bytes_left_to_read) / device_testing_context->device_info.sector_size));
-
-                    // Zero out the portion of the buffer that corresponds to the bad sector
-                    memset(buffer + (block_size - bytes_left_to_read), 0, device_testing_context->device_info.sector_size);
-                    bytes_left_to_read -= device_testing_context->device_info.sector_size;
-
-                    if((lseek_or_retry(device_testing_context, (starting_sector * device_testing_context->device_info.sector_size) + (block_size - bytes_left_to_read), NULL)) == -1) {
-                        // Give up if we can't seek
+                    // Figure out which sectors in this request are bad, mark
+                    // them as such, and skip over the whole request
+                    if(endurance_test_isolate_bad_sectors(device_testing_context,
+                                                          buffer + (block_size - bytes_left_to_read),
+                                                          starting_sector + ((block_size - bytes_left_to_read) / device_testing_context->device_info.sector_size),
+                                                          num_sectors_to_read, 0, NULL)) {
                         return -1;
                     }
 
+                    bytes_left_to_read -= num_sectors_to_read * device_testing_context->device_info.sector_size;
                     continue;
                 }
             }
@@ -2243,15 +2920,8 @@ int endurance_test_read_block(device_testing_context_type *device_testing_contex
             if(num_sectors_to_read) {
                 memset(buffer + (block_size - bytes_left_to_read), 0, num_sectors_to_read * device_testing_context->device_info.sector_size);
                 bytes_left_to_read -= num_sectors_to_read * device_testing_context->device_info.sector_size;
-
-                // Seek past the unwritable sectors
-                if(lseek_or_retry(device_testing_context, (starting_sector * device_testing_context->device_info.sector_size) + (block_size - bytes_left_to_read), NULL) == -1) {
-                    return -1;
-                }
             }
         }
-
-        print_status_update(device_testing_context);
     }
 
     return 0;
@@ -2650,6 +3320,9 @@ int endurance_test_write_block(device_testing_context_type *device_testing_conte
     while(num_bytes_remaining && !*device_was_disconnected) {
         handle_key_inputs(device_testing_context, NULL);
         wait_for_file_lock(device_testing_context, NULL);
+        wait_while_paused_by_operator(device_testing_context);
+        control_throttle(device_testing_context);
+        stats_block_publish(device_testing_context);
 
         num_sectors_remaining = num_bytes_remaining / device_testing_context->device_info.sector_size;
         num_sectors_written = num_sectors - num_sectors_remaining;
@@ -2665,23 +3338,17 @@ int endurance_test_write_block(device_testing_context_type *device_testing_conte
                     // for it to reconnect have failed
                     return ABORT_REASON_WRITE_ERROR;
                 } else {
-                    // Mark this sector bad and skip over it
-                    if(!is_sector_bad(device_testing_context, current_sector)) {
-                        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR_SECTOR_UNUSABLE, current_sector);
-                        device_testing_context->endurance_test_info.num_new_bad_sectors_this_round++;
+                    // Figure out which sectors in this request are bad, mark
+                    // them as such, and skip over the whole request
+                    if(endurance_test_isolate_bad_sectors(device_testing_context, buffer + num_bytes_written, current_sector, num_sectors_to_write, 1, device_was_disconnected) == -1) {
+                        return ABORT_REASON_WRITE_ERROR;
                     }
 
-                    mark_sector_unwritable(device_testing_context, current_sector);
-                    mark_sector_bad(device_testing_context, current_sector);
-                    device_testing_context->endurance_test_info.num_bad_sectors_this_round++;
-
-                    num_bytes_remaining -= device_testing_context->device_info.sector_size;
-
-                    if((lseek_or_retry(device_testing_context, current_byte + device_testing_context->device_info.sector_size, device_was_disconnected)) == -1) {
-                        // Give up if we can't seek
-                        return ABORT_REASON_SEEK_ERROR;
+                    if(*device_was_disconnected) {
+                        break;
                     }
 
+                    num_bytes_remaining -= num_bytes_to_write;
                     continue;
                 }
             } else {
@@ -2696,31 +3363,26 @@ int endurance_test_write_block(device_testing_context_type *device_testing_conte
         }
 
         // If the device disconnected during the write operation, we want to
-        // give up right away so that we can restart the slice.
+        // give up right away so that we can resume the slice from the last
+        // block that was written successfully.
         if(*device_was_disconnected) {
             break;
         }
 
         if(num_sectors_to_write = get_max_unwritable_sectors(device_testing_context, current_sector, num_sectors_remaining)) {
-            // Seek past the bad sectors
+            // Skip over the bad sectors
             num_sectors_remaining -= num_sectors_to_write;
             num_bytes_remaining -= num_sectors_to_write * device_testing_context->device_info.sector_size;
             num_sectors_written += num_sectors_to_write;
             num_bytes_written += num_sectors_to_write * device_testing_context->device_info.sector_size;
             num_sectors_affected_this_round += num_sectors_to_write;
             num_bytes_affected_this_round = num_sectors_affected_this_round * device_testing_context->device_info.sector_size;
-
-            if(lseek_or_retry(device_testing_context, starting_byte + num_bytes_written, device_was_disconnected) == -1) {
-                return ABORT_REASON_SEEK_ERROR;
-            }
         }
 
         // Update the BOD and MOD buffers if necessary
         update_bod_mod_buffers(device_testing_context, current_byte, buffer + (current_byte - starting_byte), num_bytes_affected_this_round);
         device_testing_context->endurance_test_info.screen_counters.bytes_since_last_update += ret;
         device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written += ret;
-
-        print_status_update(device_testing_context);
     }
 
     return 0;
@@ -2768,19 +3430,31 @@ void prepare_endurance_test_block(device_testing_context_type *device_testing_co
  *                                past the end of the device, the write is
  *                                automatically truncated to fit the remaining
  *                                space on the deivce.
+ * @param phase_needs_restart     A pointer to a variable which will be set to 1
+ *                                if the sync mode is SYNC_MODE_PHASE and the
+ *                                device was disconnected while writing the
+ *                                slice, or left unmodified otherwise.  In this
+ *                                case, the function returns early and the
+ *                                caller should restart the write phase from
+ *                                the beginning, as there is no way to know
+ *                                which of the previously written slices made it
+ *                                to the device.
  *
  * @returns 0 if the write completed successfully, -1 if an error occurred (not
  *          related to the device), or one of the ABORT_REASON_* codes if an
  *          unrecoverable error occurred.
  */
-int endurance_test_write_slice(device_testing_context_type *device_testing_context, unsigned int rng_seed, uint64_t slice_num, uint64_t num_sectors) {
+int endurance_test_write_slice(device_testing_context_type *device_testing_context, unsigned int rng_seed, uint64_t slice_num, uint64_t num_sectors, int *phase_needs_restart) {
     uint64_t cur_sector, last_sector, cur_block_size, sectors_in_cur_block, bytes_left_to_write, i, num_sectors_to_write, sectors_per_block;
-    int device_was_disconnected, ret;
+    uint64_t checkpoint_sector, bytes_since_sync;
+    int device_was_disconnected, ret, should_sync;
     sql_thread_status_type prev_sql_thread_status = sql_thread_status;
+    rng_state_type checkpoint_rng_state;
     char *write_buffer;
 
-    if(ret = posix_memalign((void **) &write_buffer, sysconf(_SC_PAGESIZE), device_testing_context->device_info.optimal_block_size)) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_POSIX_MEMALIGN_ERROR, strerror(ret));
+    if(!(write_buffer = buffer_pool_get(device_testing_context, device_testing_context->device_info.optimal_block_size))) {
+        ret = errno;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, device_testing_context->device_info.optimal_block_size, strerror(ret));
         malloc_error(device_testing_context, ret);
         return -1;
     }
@@ -2794,16 +3468,22 @@ int endurance_test_write_slice(device_testing_context_type *device_testing_conte
         last_sector = get_slice_start(device_testing_context, slice_num + 1);
     }
 
+    // Keep track of the last block we know made it to the device, along with
+    // the state of the RNG at that point.  If the device disconnects, we can
+    // rewind the RNG and pick up where we left off instead of having to
+    // rewrite the entire slice.  Unless the device was opened with O_SYNC, a
+    // block isn't known to have made it to the device until it's been flushed,
+    // so the checkpoint only moves forward when we flush.
+    rng_reseed(device_testing_context, rng_seed);
+    checkpoint_sector = get_slice_start(device_testing_context, slice_num);
+    rng_save_state(device_testing_context, &checkpoint_rng_state);
+
     do {
         device_was_disconnected = 0;
-        rng_reseed(device_testing_context, rng_seed);
-
-        if(lseek_or_retry(device_testing_context, get_slice_start(device_testing_context, slice_num) * device_testing_context->device_info.sector_size, &device_was_disconnected) == -1) {
-            free(write_buffer);
-            return ABORT_REASON_SEEK_ERROR;
-        }
+        bytes_since_sync = 0;
+        rng_restore_state(device_testing_context, &checkpoint_rng_state);
 
-        for(cur_sector = get_slice_start(device_testing_context, slice_num); cur_sector < last_sector && !device_was_disconnected; cur_sector += sectors_in_cur_block) {
+        for(cur_sector = checkpoint_sector; cur_sector < last_sector && !device_was_disconnected; cur_sector += sectors_in_cur_block) {
             if(sql_thread_status != prev_sql_thread_status) {
                 prev_sql_thread_status = sql_thread_status;
                 print_sql_status(sql_thread_status);
@@ -2827,29 +3507,62 @@ int endurance_test_write_slice(device_testing_context_type *device_testing_conte
 
             ret = endurance_test_write_block(device_testing_context, cur_sector, sectors_in_cur_block, write_buffer, &device_was_disconnected);
             if(ret == -1) {
-                free(write_buffer);
+                buffer_pool_put(device_testing_context, write_buffer);
                 return ABORT_REASON_WRITE_ERROR;
             }
 
+            if(!device_was_disconnected) {
+                mark_sectors_written(device_testing_context, cur_sector, cur_sector + sectors_in_cur_block);
+                bytes_since_sync += cur_block_size;
+
+                switch(program_options.sync_mode) {
+                    case SYNC_MODE_BLOCK:
+                        should_sync = 1; break;
+                    case SYNC_MODE_INTERVAL:
+                        should_sync = bytes_since_sync >= program_options.sync_interval || (cur_sector + sectors_in_cur_block) == last_sector; break;
+                    case SYNC_MODE_SLICE:
+                        should_sync = (cur_sector + sectors_in_cur_block) == last_sector; break;
+                    default:
+                        should_sync = 0; break;
+                }
+
+                if(should_sync) {
+                    if(sync_or_reset_device(device_testing_context, (cur_sector + sectors_in_cur_block) * device_testing_context->device_info.sector_size, &device_was_disconnected)) {
+                        buffer_pool_put(device_testing_context, write_buffer);
+                        return ABORT_REASON_WRITE_ERROR;
+                    }
+
+                    bytes_since_sync = 0;
+                }
+
+                if(!device_was_disconnected && (program_options.sync_mode == SYNC_MODE_ALWAYS || should_sync)) {
+                    checkpoint_sector = cur_sector + sectors_in_cur_block;
+                    rng_save_state(device_testing_context, &checkpoint_rng_state);
+                }
+            }
+
             if(device_was_disconnected) {
-                // Unmark the sectors we've written in this slice so far
-                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_RESTARTING_SLICE);
-                reset_sector_map_partial(device_testing_context, get_slice_start(device_testing_context, slice_num), last_sector);
+                if(program_options.sync_mode == SYNC_MODE_PHASE) {
+                    *phase_needs_restart = 1;
+                    buffer_pool_put(device_testing_context, write_buffer);
+                    return 0;
+                }
+
+                // We don't know how much of the data written since the last
+                // checkpoint made it to the device, so we'll rewrite all of it
+                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_RESUMING_SLICE_AT_SECTOR, checkpoint_sector);
+                reset_sector_map_partial(device_testing_context, checkpoint_sector, last_sector);
                 redraw_sector_map(device_testing_context);
             } else {
-                mark_sectors_written(device_testing_context, cur_sector, cur_sector + sectors_in_cur_block);
-
                 assert(!gettimeofday(&stats_cur_time, NULL));
                 if(timediff(device_testing_context->endurance_test_info.stats_file_counters.last_update_time, stats_cur_time) >= (program_options.stats_interval * 1000000)) {
                     stats_log(device_testing_context);
                 }
             }
-
-            refresh();
         }
     } while(device_was_disconnected);
 
-    free(write_buffer);
+    buffer_pool_put(device_testing_context, write_buffer);
     return 0;
 }
 
@@ -2908,12 +3621,52 @@ int probe_device_info(device_testing_context_type *device_testing_context) {
 }
 
 /**
- * Prints the end of round summary to the log file, and checks to see if we've
- * passed any of the major thresholds.
+ * Marks the start of a read or write phase of the endurance test.  The average
+ * rate of the phase that just ended is saved off so that it can be reported
+ * later.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param phase                   The phase that is starting.
+ */
+void start_endurance_test_phase(device_testing_context_type *device_testing_context, current_phase_type phase) {
+    struct timeval now;
+    double elapsed;
+
+    assert(!gettimeofday(&now, NULL));
+
+    if(device_testing_context->endurance_test_info.phase_start_time.tv_sec) {
+        elapsed = ((double) timediff(device_testing_context->endurance_test_info.phase_start_time, now)) / 1000000;
+
+        if(elapsed > 0) {
+            if(device_testing_context->endurance_test_info.current_phase == CURRENT_PHASE_WRITING) {
+                device_testing_context->endurance_test_info.last_write_phase_rate =
+                    ((double) (device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written - device_testing_context->endurance_test_info.phase_start_bytes)) / elapsed;
+            } else if(device_testing_context->endurance_test_info.current_phase == CURRENT_PHASE_READING) {
+                device_testing_context->endurance_test_info.last_read_phase_rate =
+                    ((double) (device_testing_context->endurance_test_info.stats_file_counters.total_bytes_read - device_testing_context->endurance_test_info.phase_start_bytes)) / elapsed;
+            }
+        }
+    }
+
+    device_testing_context->endurance_test_info.phase_start_time = now;
+    device_testing_context->endurance_test_info.phase_start_bytes = phase == CURRENT_PHASE_WRITING ?
+        device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written :
+        device_testing_context->endurance_test_info.stats_file_counters.total_bytes_read;
+    device_testing_context->endurance_test_info.current_phase = phase;
+    stats_block_publish(device_testing_context);
+}
+
+/**
+ * Prints the end of round summary to the log file, checks to see if we've
+ * passed any of the major thresholds, and records the summary in the round
+ * history so that the SQL thread can report it.
  *
  * @param device_testing_context  The device whose summary should be logged.
  */
 void perform_end_of_round_summary(device_testing_context_type *device_testing_context) {
+    round_summary_type *summary;
+    uint64_t num_recorded;
+
     if(!device_testing_context->endurance_test_info.num_new_bad_sectors_this_round && !device_testing_context->endurance_test_info.total_bad_sectors) {
         log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_ENDURANCE_TEST_ROUND_COMPLETE_NO_BAD_SECTORS, device_testing_context->endurance_test_info.rounds_completed + 1);
     } else {
@@ -2949,10 +3702,60 @@ void perform_end_of_round_summary(device_testing_context_type *device_testing_co
             device_testing_context->endurance_test_info.rounds_to_25_threshold = device_testing_context->endurance_test_info.rounds_completed;
         }
     }
+
+    num_recorded = device_testing_context->endurance_test_info.round_history.num_recorded;
+    summary = &device_testing_context->endurance_test_info.round_history.entries[num_recorded % ROUND_HISTORY_SIZE];
+    summary->round_num = device_testing_context->endurance_test_info.rounds_completed + 1;
+    summary->end_time = time(NULL);
+    summary->num_bad_sectors_this_round = device_testing_context->endurance_test_info.num_bad_sectors_this_round;
+    summary->num_new_bad_sectors_this_round = device_testing_context->endurance_test_info.num_new_bad_sectors_this_round;
+    summary->num_good_sectors_this_round = device_testing_context->endurance_test_info.num_good_sectors_this_round;
+    summary->total_bad_sectors = device_testing_context->endurance_test_info.total_bad_sectors;
+    summary->total_bytes_read = device_testing_context->endurance_test_info.stats_file_counters.total_bytes_read;
+    summary->total_bytes_written = device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written;
+
+    // Only publish the summary once it's been filled in -- the release store
+    // keeps the writes above from being moved past it, so the SQL thread never
+    // sees the new count before the summary is complete
+    __atomic_store_n(&device_testing_context->endurance_test_info.round_history.num_recorded, num_recorded + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Allocates the buffers used by the speed tests and the endurance test up
+ * front, now that the block size is known, so that they don't have to be
+ * mapped (and faulted in) partway through a test.  If something goes wrong,
+ * the buffers are simply allocated as they're needed instead.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param speed_tests             Non-zero if the speed tests are going to be
+ *                                run.
+ */
+static void reserve_io_buffers(device_testing_context_type *device_testing_context, int speed_tests) {
+    size_t sizes[4];
+    int num_sizes = 0;
+
+    // The endurance test reads into one buffer and generates the data to
+    // compare it against in another
+    sizes[num_sizes++] = device_testing_context->device_info.optimal_block_size;
+    sizes[num_sizes++] = device_testing_context->device_info.optimal_block_size;
+
+    // One request's worth of buffer for every worker at the deepest queue
+    // depth of the queue depth sweep
+    if(speed_tests) {
+        sizes[num_sizes++] = RANDOM_IO_SIZE << (QUEUE_DEPTH_SWEEP_STEPS - 1);
+    }
+
+    if(program_options.surface_scan) {
+        sizes[num_sizes++] = SURFACE_SCAN_BLOCK_SIZE;
+    }
+
+    if(buffer_pool_reserve(device_testing_context, sizes, num_sizes)) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_RESERVE_ERROR, strerror(errno));
+    }
 }
 
 int main(int argc, char **argv) {
-    int cur_block_size, local_errno, restart_slice, state_file_status;
+    int cur_block_size, local_errno, restart_write_phase, state_file_status;
     struct stat fs;
     uint64_t bytes_left_to_write, ret, cur_sector;
     unsigned int sectors_per_block;
@@ -2961,8 +3764,7 @@ int main(int argc, char **argv) {
     struct timeval rng_init_time;
     uint64_t cur_sectors_per_block, last_sector;
     uint64_t cur_slice, j;
-    int *read_order;
-    int device_was_disconnected;
+    int *read_order, *write_order;
     int iret;
     char device_uuid_str[37];
     uuid_t device_uuid_from_device;
@@ -2993,6 +3795,9 @@ int main(int argc, char **argv) {
 
         sql_thread_params.program_ended = 1;
 
+        io_watchdog_stop();
+        metrics_stop();
+        control_stop();
         close_lockfile();
 
         if(ncurses_active) {
@@ -3001,13 +3806,8 @@ int main(int argc, char **argv) {
             endwin();
         }
 
-        if(buf) {
-            free(buf);
-        }
-
-        if(compare_buf) {
-            free(compare_buf);
-        }
+        // buf and compare_buf belong to the buffer pool, which is freed along
+        // with the device testing context
 
         if(zero_buf) {
             free(zero_buf);
@@ -3029,6 +3829,15 @@ int main(int argc, char **argv) {
             free(program_options.stats_file);
         }
 
+        if(program_options.speed_series_file) {
+            free(program_options.speed_series_file);
+        }
+
+        if(program_options.workload_file) {
+            free(program_options.workload_file);
+            free_workload_jobs(program_options.workload_jobs, program_options.num_workload_jobs);
+        }
+
         if(program_options.lock_file) {
             free(program_options.lock_file);
         }
@@ -3044,6 +3853,41 @@ int main(int argc, char **argv) {
         delete_device_testing_context(device_testing_context);
     }
 
+    // Carries out anything requested through the control socket that has to
+    // wait until we're between slices.  Returns -1 if the buffers couldn't be
+    // replaced after a block size change (in which case cleanup() has already
+    // been called), or 0 otherwise.
+    int handle_slice_boundary() {
+        if(device_testing_context->control_state.checkpoint_requested) {
+            device_testing_context->control_state.checkpoint_requested = 0;
+            if(program_options.state_file) {
+                if(save_state(device_testing_context)) {
+                    save_state_error(device_testing_context);
+                } else {
+                    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_CHECKPOINT_SAVED);
+                }
+            }
+        }
+
+        if(control_take_block_size_request(device_testing_context)) {
+            buffer_pool_put(device_testing_context, buf);
+            buffer_pool_put(device_testing_context, compare_buf);
+            buf = compare_buf = NULL;
+
+            if(!(buf = buffer_pool_get(device_testing_context, device_testing_context->device_info.optimal_block_size)) ||
+               !(compare_buf = buffer_pool_get(device_testing_context, device_testing_context->device_info.optimal_block_size))) {
+                log_log(device_testing_context, __func__, SEVERITY_LEVEL_ERROR, MSG_BUFFER_POOL_GET_ERROR, device_testing_context->device_info.optimal_block_size, strerror(errno));
+                malloc_error(device_testing_context, errno);
+                cleanup();
+                return -1;
+            }
+
+            sectors_per_block = device_testing_context->device_info.optimal_block_size / device_testing_context->device_info.sector_size;
+        }
+
+        return 0;
+    }
+
     sector_display.sectors_per_block = 0;
     main_thread_status = MAIN_THREAD_STATUS_IDLE;
 
@@ -3136,7 +3980,7 @@ int main(int argc, char **argv) {
     }
 
     if(program_options.stats_file) {
-        if(!(device_testing_context->endurance_test_info.stats_file_handle = fopen(program_options.stats_file, "a"))) {
+        if(!(device_testing_context->endurance_test_info.stats_file_handle = fopen(program_options.stats_file, "a+"))) {
             stats_file_open_error(device_testing_context, errno);
             cleanup();
             return -1;
@@ -3144,15 +3988,27 @@ int main(int argc, char **argv) {
 
         log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_LOGGING_STATS_TO_FILE, program_options.stats_file);
 
-        // Write the CSV headers out to the file, but only if we're not
-        // resuming from a state file
-        if(state_file_status != LOAD_STATE_SUCCESS) {
-            fprintf(device_testing_context->endurance_test_info.stats_file_handle,
-                    "Date/Time,Rounds Completed,Bytes Written,Total Bytes Written,Write Rate (bytes/sec),Bytes Read,Total Bytes Read,Read Rate (bytes/sec),Bad Sectors,Total Bad Sesctors,Bad Sector Rate (counts/min)\n");
+        // Write the CSV headers out to the file if we're starting a new test,
+        // or if the rows already in the file don't match the ones we're going
+        // to write
+        if(state_file_status != LOAD_STATE_SUCCESS || stats_file_needs_header(device_testing_context->endurance_test_info.stats_file_handle)) {
+            fputs(STATS_FILE_HEADER, device_testing_context->endurance_test_info.stats_file_handle);
             fflush(device_testing_context->endurance_test_info.stats_file_handle);
         }
     }
 
+    if(io_watchdog_start(device_testing_context, program_options.io_timeout)) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_ERROR_STARTING_IO_WATCHDOG, strerror(errno));
+    }
+
+    if(program_options.metrics_address && metrics_start(device_testing_context, program_options.metrics_address)) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_ERROR_STARTING_METRICS_EXPORTER, program_options.metrics_address, strerror(errno));
+    }
+
+    if(program_options.control_socket && control_start(device_testing_context, program_options.control_socket)) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_ERROR_STARTING_CONTROL_SOCKET, program_options.control_socket, strerror(errno));
+    }
+
     // Does the system have a working gettimeofday?
     if(gettimeofday(&speed_start_time, NULL) == -1) {
         no_working_gettimeofday(device_testing_context, errno);
@@ -3285,7 +4141,7 @@ int main(int argc, char **argv) {
             return -1;
         }
 
-        if((device_testing_context->device_info.fd = open(device_testing_context->device_info.device_name, O_DIRECT | O_SYNC | O_LARGEFILE | O_RDWR)) == -1) {
+        if((device_testing_context->device_info.fd = open(device_testing_context->device_info.device_name, get_device_open_flags())) == -1) {
             local_errno = errno;
             log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_OPEN_ERROR, strerror(local_errno));
             device_open_error(device_testing_context, local_errno);
@@ -3302,6 +4158,25 @@ int main(int argc, char **argv) {
         return -1;
     }
 
+    if(program_options.quick_screen) {
+        device_testing_context->device_info.optimal_block_size = device_testing_context->device_info.sector_size * device_testing_context->device_info.max_sectors_per_request;
+
+        if(screen_for_fake_flash(device_testing_context)) {
+            cleanup();
+            return -1;
+        }
+
+        cleanup();
+
+        if(device_testing_context->fake_flash_screen_info.is_fake_flash == FAKE_FLASH_YES) {
+            return FAKE_FLASH_SCREEN_EXIT_FAKE_FLASH;
+        } else if(device_testing_context->fake_flash_screen_info.is_fake_flash == FAKE_FLASH_NO) {
+            return FAKE_FLASH_SCREEN_EXIT_GENUINE;
+        } else {
+            return FAKE_FLASH_SCREEN_EXIT_INCONCLUSIVE;
+        }
+    }
+
     if(state_file_status == LOAD_STATE_FILE_NOT_SPECIFIED || state_file_status == LOAD_STATE_FILE_DOES_NOT_EXIST) {
         profile_random_number_generator(device_testing_context);
 
@@ -3319,6 +4194,15 @@ int main(int argc, char **argv) {
         }
 
         sectors_per_block = device_testing_context->device_info.optimal_block_size / device_testing_context->device_info.sector_size;
+        reserve_io_buffers(device_testing_context, 1);
+
+        if(program_options.probe_for_write_cache_size) {
+            wait_for_file_lock(device_testing_context, NULL);
+
+            if(!probe_for_write_cache_size(device_testing_context)) {
+                device_testing_context->device_info.write_cache_size = device_testing_context->write_cache_size_test_info.write_cache_size;
+            }
+        }
 
         wait_for_file_lock(device_testing_context, NULL);
 
@@ -3385,6 +4269,7 @@ int main(int argc, char **argv) {
         device_testing_context->device_info.is_fake_flash = (device_testing_context->device_info.logical_size == device_testing_context->device_info.physical_size) ? FAKE_FLASH_NO : FAKE_FLASH_YES;
         sectors_per_block = device_testing_context->device_info.optimal_block_size / device_testing_context->device_info.sector_size;
         device_testing_context->device_info.middle_of_device = device_testing_context->device_info.physical_size / 2;
+        reserve_io_buffers(device_testing_context, 0);
         redraw_screen(device_testing_context);
     }
 
@@ -3411,19 +4296,19 @@ int main(int argc, char **argv) {
 
     rng_init(device_testing_context, device_testing_context->endurance_test_info.rng_state.initial_seed);
 
-    // Allocate buffers for reading from/writing to the device.  We're using
-    // posix_memalign because the memory needs to be aligned on a page boundary
-    // (since we're doing unbuffered reading/writing).
-    if(ret = posix_memalign((void **) &buf, sysconf(_SC_PAGESIZE), device_testing_context->device_info.optimal_block_size)) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_ERROR, MSG_POSIX_MEMALIGN_ERROR, strerror(ret));
-        malloc_error(device_testing_context, ret);
+    // Borrow buffers for reading from/writing to the device.  The memory needs
+    // to be aligned on a page boundary (since we're doing unbuffered
+    // reading/writing), which the buffer pool takes care of for us.
+    if(!(buf = buffer_pool_get(device_testing_context, device_testing_context->device_info.optimal_block_size))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_ERROR, MSG_BUFFER_POOL_GET_ERROR, device_testing_context->device_info.optimal_block_size, strerror(errno));
+        malloc_error(device_testing_context, errno);
         cleanup();
         return -1;
     }
 
-    if(ret = posix_memalign((void **) &compare_buf, sysconf(_SC_PAGESIZE), device_testing_context->device_info.optimal_block_size)) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_ERROR, MSG_POSIX_MEMALIGN_ERROR, strerror(ret));
-        malloc_error(device_testing_context, ret);
+    if(!(compare_buf = buffer_pool_get(device_testing_context, device_testing_context->device_info.optimal_block_size))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_ERROR, MSG_BUFFER_POOL_GET_ERROR, device_testing_context->device_info.optimal_block_size, strerror(errno));
+        malloc_error(device_testing_context, errno);
         cleanup();
         return -1;
     }
@@ -3513,6 +4398,7 @@ int main(int argc, char **argv) {
         device_testing_context->endurance_test_info.stats_file_counters.last_bytes_written = device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written;
         device_testing_context->endurance_test_info.stats_file_counters.last_bytes_read = device_testing_context->endurance_test_info.stats_file_counters.total_bytes_read;
         device_testing_context->endurance_test_info.stats_file_counters.last_bad_sectors = device_testing_context->endurance_test_info.total_bad_sectors;
+        device_testing_context->endurance_test_info.stats_file_counters.last_io_timeouts = device_testing_context->io_timeout_stats.num_timeouts;
 
         log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_ENDURANCE_TEST_RESUMING, device_testing_context->endurance_test_info.rounds_completed + 1);
     }
@@ -3523,7 +4409,22 @@ int main(int argc, char **argv) {
     // Fire up the SQL thread
     sql_thread_status = SQL_THREAD_NOT_CONNECTED;
 
-    if(program_options.db_host && program_options.db_user && program_options.db_pass && program_options.db_name) {
+    if(program_options.collector_socket || program_options.db_file || (program_options.db_host && program_options.db_user && program_options.db_pass && program_options.db_name)) {
+        sql_thread_params.sink = NULL;
+        if(program_options.collector_socket) {
+            sql_thread_params.sink = &collector_report_sink;
+        } else if(program_options.db_file) {
+#if defined(HAVE_SQLITE)
+            sql_thread_params.sink = &sqlite_report_sink;
+#endif // defined(HAVE_SQLITE)
+        } else {
+#if defined(HAVE_MARIADB)
+            sql_thread_params.sink = &mariadb_report_sink;
+#endif // defined(HAVE_MARIADB)
+        }
+
+        sql_thread_params.sqlite_file = program_options.db_file;
+        sql_thread_params.collector_socket = program_options.collector_socket;
         sql_thread_params.mysql_host = program_options.db_host;
         sql_thread_params.mysql_username = program_options.db_user;
         sql_thread_params.mysql_password = program_options.db_pass;
@@ -3531,6 +4432,7 @@ int main(int argc, char **argv) {
         sql_thread_params.mysql_db_name = program_options.db_name;
         sql_thread_params.card_name = program_options.card_name;
         sql_thread_params.card_id = program_options.card_id;
+        sql_thread_params.spool_file = program_options.db_spool_file;
         sql_thread_params.device_testing_context = device_testing_context;
         sql_thread_params.program_ended = 0;
 
@@ -3544,6 +4446,7 @@ int main(int argc, char **argv) {
     }
 
     device_testing_context->endurance_test_info.test_started = 1;
+    stats_block_publish(device_testing_context);
 
     for(; device_testing_context->endurance_test_info.total_bad_sectors < (device_testing_context->device_info.num_physical_sectors / 2); device_testing_context->endurance_test_info.rounds_completed++) {
         main_thread_status = MAIN_THREAD_STATUS_WRITING;
@@ -3555,6 +4458,19 @@ int main(int argc, char **argv) {
             print_sql_status(sql_thread_status);
         }
 
+        // Scan the device before the first round, and then every
+        // --surface-scan-interval rounds after that
+        if(program_options.surface_scan && (!device_testing_context->surface_scan_info.scans_performed || (program_options.surface_scan_interval &&
+           (device_testing_context->endurance_test_info.rounds_completed - device_testing_context->surface_scan_info.latest.round_num) >= program_options.surface_scan_interval))) {
+            main_thread_status = MAIN_THREAD_STATUS_SCANNING;
+            wait_for_file_lock(device_testing_context, NULL);
+
+            // Errors are logged by run_surface_scan().  If the scan didn't
+            // finish, it'll be tried again next round.
+            run_surface_scan(device_testing_context);
+            main_thread_status = MAIN_THREAD_STATUS_WRITING;
+        }
+
         // If we're past the first round of testing, save the program state.
         if(device_testing_context->endurance_test_info.rounds_completed) {
             if(save_state(device_testing_context)) {
@@ -3571,7 +4487,7 @@ int main(int argc, char **argv) {
             print_sql_status(sql_thread_status);
         }
 
-        device_testing_context->endurance_test_info.current_phase = CURRENT_PHASE_WRITING;
+        start_endurance_test_phase(device_testing_context, CURRENT_PHASE_WRITING);
         if(!program_options.no_curses) {
             j = snprintf(msg_buffer, sizeof(msg_buffer), " Round %'lu ", device_testing_context->endurance_test_info.rounds_completed + 1);
             mvaddstr(ROUNDNUM_DISPLAY_Y, ROUNDNUM_DISPLAY_X(j), msg_buffer);
@@ -3585,42 +4501,67 @@ int main(int argc, char **argv) {
 
         read_order = random_list(device_testing_context);
 
-        for(cur_slice = 0, restart_slice = 0; cur_slice < NUM_SLICES; cur_slice++, restart_slice = 0) {
-            if(ret = endurance_test_write_slice(device_testing_context,
-                                                device_testing_context->endurance_test_info.rng_state.initial_seed + read_order[cur_slice] + (device_testing_context->endurance_test_info.rounds_completed * NUM_SLICES),
-                                                read_order[cur_slice],
-                                                sectors_per_block)) {
-                main_thread_status = MAIN_THREAD_STATUS_ENDING;
+        do {
+            restart_write_phase = 0;
 
-                if(ret > 0) {
-                    print_device_summary(device_testing_context, ret);
+            for(cur_slice = 0; cur_slice < NUM_SLICES && !restart_write_phase; cur_slice++) {
+                if(handle_slice_boundary()) {
+                    return -1;
                 }
 
-                cleanup();
-                return 0;
+                if(ret = endurance_test_write_slice(device_testing_context,
+                                                    device_testing_context->endurance_test_info.rng_state.initial_seed + read_order[cur_slice] + (device_testing_context->endurance_test_info.rounds_completed * NUM_SLICES),
+                                                    read_order[cur_slice],
+                                                    sectors_per_block,
+                                                    &restart_write_phase)) {
+                    main_thread_status = MAIN_THREAD_STATUS_ENDING;
+
+                    if(ret > 0) {
+                        print_device_summary(device_testing_context, ret);
+                    }
+
+                    cleanup();
+                    return 0;
+                }
             }
-        }
 
-        free(read_order);
+            // In every other mode, each slice has already been flushed by the
+            // time endurance_test_write_slice() returns.
+            if(!restart_write_phase && program_options.sync_mode == SYNC_MODE_PHASE) {
+                if(sync_or_reset_device(device_testing_context, device_testing_context->device_info.num_physical_sectors * device_testing_context->device_info.sector_size, &restart_write_phase)) {
+                    main_thread_status = MAIN_THREAD_STATUS_ENDING;
+                    print_device_summary(device_testing_context, ABORT_REASON_WRITE_ERROR);
+                    cleanup();
+                    return 0;
+                }
+            }
+
+            if(restart_write_phase) {
+                log_log(device_testing_context, NULL, SEVERITY_LEVEL_DEBUG, MSG_RESTARTING_WRITE_PHASE);
+                reset_sector_map(device_testing_context);
+                redraw_sector_map(device_testing_context);
+                refresh();
+            }
+        } while(restart_write_phase);
 
         main_thread_status = MAIN_THREAD_STATUS_READING;
+        write_order = read_order;
         read_order = random_list(device_testing_context);
-        device_testing_context->endurance_test_info.current_phase = CURRENT_PHASE_READING;
+        defer_recently_written_slices(device_testing_context, read_order, write_order);
+        free(write_order);
+        start_endurance_test_phase(device_testing_context, CURRENT_PHASE_READING);
 
         if(!program_options.no_curses) {
             mvaddstr(READWRITE_DISPLAY_Y, READWRITE_DISPLAY_X, " Reading ");
         }
 
         for(cur_slice = 0; cur_slice < NUM_SLICES; cur_slice++) {
-            rng_reseed(device_testing_context, device_testing_context->endurance_test_info.rng_state.initial_seed + read_order[cur_slice] + (device_testing_context->endurance_test_info.rounds_completed * NUM_SLICES));
-
-            if(lseek_or_retry(device_testing_context, get_slice_start(device_testing_context, read_order[cur_slice]) * device_testing_context->device_info.sector_size, &device_was_disconnected) == -1) {
-                main_thread_status = MAIN_THREAD_STATUS_ENDING;
-                print_device_summary(device_testing_context, ABORT_REASON_SEEK_ERROR);
-                cleanup();
-                return 0;
+            if(handle_slice_boundary()) {
+                return -1;
             }
 
+            rng_reseed(device_testing_context, device_testing_context->endurance_test_info.rng_state.initial_seed + read_order[cur_slice] + (device_testing_context->endurance_test_info.rounds_completed * NUM_SLICES));
+
             if(read_order[cur_slice] == 15) {
                 last_sector = device_testing_context->device_info.num_physical_sectors;
             } else {
@@ -3673,14 +4614,6 @@ int main(int argc, char **argv) {
                                     uuid_unparse(device_uuid_from_device, device_uuid_str);
 
                                     if(num_uuid_mismatches < 5) {
-                                        // Seek back to the beginning of the block
-                                        if(lseek_or_retry(device_testing_context, cur_sector * device_testing_context->device_info.sector_size, &device_was_disconnected) == -1) {
-                                            main_thread_status = MAIN_THREAD_STATUS_ENDING;
-                                            print_device_summary(device_testing_context, ABORT_REASON_WRITE_ERROR);
-                                            cleanup();
-                                            return 0;
-                                        }
-
                                         log_log(device_testing_context, NULL, SEVERITY_LEVEL_DEBUG, MSG_DEVICE_MANGLING_DETECTED, cur_sector + (j / device_testing_context->device_info.sector_size), device_uuid_str);
                                     }
 
@@ -3697,7 +4630,6 @@ int main(int argc, char **argv) {
                 // Compare
                 num_uuid_mismatches = 0;
                 for(j = 0; j < cur_block_size; j += device_testing_context->device_info.sector_size) {
-                    handle_key_inputs(device_testing_context, NULL);
                     if(memcmp(buf + j, compare_buf + j, device_testing_context->device_info.sector_size)) {
                         if(!is_sector_bad(device_testing_context, cur_sector + (j / device_testing_context->device_info.sector_size))) {
                             get_embedded_device_uuid(compare_buf + j, device_uuid_from_device);
@@ -3749,8 +4681,6 @@ int main(int argc, char **argv) {
                     }
                 }
 
-                refresh();
-
                 assert(!gettimeofday(&stats_cur_time, NULL));
                 if(timediff(device_testing_context->endurance_test_info.stats_file_counters.last_update_time, stats_cur_time) >= (program_options.stats_interval * 1000000)) {
                     stats_log(device_testing_context);
@@ -9,6 +9,7 @@
 #include "config.h"
 #include "device_testing_context.h"
 #include "fake_flash_enum.h"
+#include "workload.h"
 
 #define PROGRAM_NAME " Mikaey's Flash Stress Test v" VERSION " "
 
@@ -34,6 +35,13 @@
 // How many times to try resetting the device before giving up
 #define MAX_RESET_RETRIES 5
 
+// How often data written during the endurance test is flushed to the device
+#define SYNC_MODE_ALWAYS   0 // Device is opened with O_SYNC; every write is synchronous
+#define SYNC_MODE_BLOCK    1 // Flush after every block
+#define SYNC_MODE_INTERVAL 2 // Flush after every sync_interval bytes (and at the end of every slice)
+#define SYNC_MODE_SLICE    3 // Flush at the end of every slice
+#define SYNC_MODE_PHASE    4 // Flush once at the end of the write phase
+
 // Abort reasons
 #define ABORT_REASON_READ_ERROR            1
 #define ABORT_REASON_WRITE_ERROR           2
@@ -401,12 +409,96 @@ uint64_t get_max_unwritable_sectors(device_testing_context_type *device_testing_
  */
 void get_embedded_device_uuid(char *data, char *uuid_buffer);
 
+/**
+ * Embeds the given sector number into the sector data (specified by data).  The
+ * sector number is XOR-masked with bytes from elsewhere in the sector, so the
+ * data should already be filled in before this is called.
+ *
+ * @param data           A pointer to a buffer containing the sector data.
+ * @param sector_number  The sector number to be embedded.
+ */
+void embed_sector_number(char *data, uint64_t sector_number);
+
+/**
+ * Decodes the sector number embedded in the sector data (specified by data).
+ *
+ * @param data  A pointer to a buffer containing sector data that the sector
+ *              number will be extracted from.  The buffer is expected to be at
+ *              least 145 bytes long.
+ *
+ * @returns The embedded sector number.
+ */
+uint64_t decode_embedded_sector_number(char *data);
+
+/**
+ * Writes data to the device for the device size test and fake flash screening.
+ * Note that this function does not gracefully handle device
+ * disconnects/reconnects.
+ *
+ * @param buf       A pointer to the data to be written.  Must be suitably
+ *                  aligned for O_DIRECT.
+ * @param len       The number of bytes to be written.
+ * @param position  The position on the device at which to start writing.
+ *
+ * @returns 0 if the operation completed successfully, or -1 if it did not.  On
+ *          error, errno is set to the underlying error.
+ */
+int write_data_to_device(device_testing_context_type *device_testing_context, void *buf, uint64_t len, off_t position);
+
+/**
+ * Reads data from the device for the device size test and fake flash
+ * screening.  If a read fails, the remainder of the buffer is zeroed out.
+ *
+ * @param buf       A pointer to the buffer that will receive the data.  Must be
+ *                  suitably aligned for O_DIRECT.
+ * @param len       The number of bytes to be read.
+ * @param position  The position on the device at which to start reading.
+ */
+void read_data_from_device(device_testing_context_type *device_testing_context, void *buf, uint64_t len, off_t position);
+
+/**
+ * Stamps each sector in a buffer of data that's about to be written with the
+ * number of the sector it's going to be written to.
+ *
+ * @param buf              A pointer to the buffer to be stamped.
+ * @param num_sectors      The number of sectors in the buffer.
+ * @param starting_sector  The sector that the buffer will be written to.
+ */
+void stamp_probe_data(device_testing_context_type *device_testing_context, char *buf, uint64_t num_sectors, uint64_t starting_sector);
+
+/**
+ * Writes stamped random data to the start of the device to push anything
+ * written before it out of the device's write cache.  The amount written is
+ * determined by get_cache_defeat_size(), rounded up to a whole sector.
+ *
+ * @param buf       A pointer to a buffer to use for the data.  Must be
+ *                  suitably aligned for O_DIRECT.
+ * @param buf_size  The size of the buffer, in bytes.  Must be a multiple of
+ *                  the sector size.
+ *
+ * @returns 0 if the data was written successfully, or -1 if a write error
+ *          occurred.  On error, errno is set to the underlying error.
+ */
+int flush_device_write_cache(device_testing_context_type *device_testing_context, char *buf, uint64_t buf_size);
+
 typedef struct _program_options_type {
     char *stats_file;
+    char *speed_series_file;
     char *log_file;
     char *device_name;
     uint64_t stats_interval;
     unsigned char probe_for_optimal_block_size;
+    unsigned char probe_for_write_cache_size;
+    unsigned char quick_screen;
+    unsigned char sustained_write_percent;
+    unsigned char au_speed_test;
+    uint64_t au_size;
+    char *workload_file;
+    workload_job_type *workload_jobs;
+    int num_workload_jobs;
+    unsigned char surface_scan;
+    uint64_t surface_scan_interval;       // Rounds between surface scans (0 to only scan once)
+    unsigned char surface_scan_sample_percent;
     char no_curses;      // What's the current setting of no-curses?
     char orig_no_curses; // What was passed on the command line?
     char dont_show_warning_message;
@@ -418,8 +510,16 @@ typedef struct _program_options_type {
     char *db_pass;
     char *db_name;
     int db_port;
+    char *db_spool_file;
+    char *db_file;
+    char *collector_socket;
+    char *metrics_address;
+    char *control_socket;
     char *card_name;
     uint64_t card_id;
+    int io_timeout;
+    int sync_mode;
+    uint64_t sync_interval;   // Bytes to write between flushes (SYNC_MODE_INTERVAL only)
 } program_options_type;
 
 extern program_options_type program_options;
@@ -430,6 +530,7 @@ typedef struct _sector_display_type {
     uint64_t num_blocks;
     uint64_t num_lines;
     uint64_t blocks_per_line;
+    int show_heatmap;          // Show the surface scan heatmap instead of the sector map?
 } sector_display_type;
 
 extern sector_display_type sector_display;
@@ -440,11 +541,18 @@ typedef enum {
               MAIN_THREAD_STATUS_WRITING             = 2, // Main thread is writing
               MAIN_THREAD_STATUS_READING             = 3, // Main thread is reading
               MAIN_THREAD_STATUS_DEVICE_DISCONNECTED = 4, // Device has disconnected and the main thread is waiting for it to be reconnected
-              MAIN_THREAD_STATUS_ENDING              = 5  // Main thread is showing the failure dialog and will end once the user acknowledges
+              MAIN_THREAD_STATUS_ENDING              = 5, // Main thread is showing the failure dialog and will end once the user acknowledges
+              MAIN_THREAD_STATUS_SCANNING            = 6, // Main thread is running a surface scan
+              MAIN_THREAD_STATUS_COUNT
 } main_thread_status_type;
 
 extern volatile main_thread_status_type main_thread_status;
 
+// Labels used for the main thread status when reporting it to the outside
+// world (e.g., through the metrics exporter or the control socket), indexed by
+// main_thread_status_type
+extern const char *main_thread_status_labels[MAIN_THREAD_STATUS_COUNT];
+
 extern const char *WARNING_TITLE;
 extern const char *ERROR_TITLE;
 
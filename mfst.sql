@@ -55,6 +55,76 @@ CREATE TABLE `consolidated_sector_maps` (
 ) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;
 /*!40101 SET character_set_client = @saved_cs_client */;
 
+--
+-- Table structure for table `status_history`
+--
+
+DROP TABLE IF EXISTS `status_history`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+/*!40101 SET character_set_client = utf8 */;
+CREATE TABLE `status_history` (
+  `id` bigint(20) unsigned NOT NULL,
+  `sample_time` bigint(20) unsigned NOT NULL,
+  `cur_round_num` bigint(20) unsigned DEFAULT NULL,
+  `num_bad_sectors` bigint(20) unsigned DEFAULT NULL,
+  `status` int(11) DEFAULT NULL,
+  `rate` double DEFAULT NULL,
+  `total_bytes_read` bigint(20) unsigned DEFAULT NULL,
+  `total_bytes_written` bigint(20) unsigned DEFAULT NULL,
+  `read_rate` double DEFAULT NULL,
+  `write_rate` double DEFAULT NULL,
+  `avg_read_latency` double DEFAULT NULL,
+  `avg_write_latency` double DEFAULT NULL,
+  PRIMARY KEY (`id`,`sample_time`),
+  KEY `sample_time` (`sample_time`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
+--
+-- Table structure for table `round_history`
+--
+
+DROP TABLE IF EXISTS `round_history`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+/*!40101 SET character_set_client = utf8 */;
+CREATE TABLE `round_history` (
+  `id` bigint(20) unsigned NOT NULL,
+  `round_num` bigint(20) unsigned NOT NULL,
+  `end_time` bigint(20) unsigned DEFAULT NULL,
+  `num_bad_sectors_this_round` bigint(20) unsigned DEFAULT NULL,
+  `num_new_bad_sectors_this_round` bigint(20) unsigned DEFAULT NULL,
+  `num_good_sectors_this_round` bigint(20) unsigned DEFAULT NULL,
+  `total_bad_sectors` bigint(20) unsigned DEFAULT NULL,
+  `total_bytes_read` bigint(20) unsigned DEFAULT NULL,
+  `total_bytes_written` bigint(20) unsigned DEFAULT NULL,
+  PRIMARY KEY (`id`,`round_num`),
+  KEY `round_num` (`round_num`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
+--
+-- Table structure for table `surface_scans`
+--
+
+DROP TABLE IF EXISTS `surface_scans`;
+/*!40101 SET @saved_cs_client     = @@character_set_client */;
+/*!40101 SET character_set_client = utf8 */;
+CREATE TABLE `surface_scans` (
+  `id` bigint(20) unsigned NOT NULL,
+  `scan_num` bigint(20) unsigned NOT NULL,
+  `region_num` int(10) unsigned NOT NULL,
+  `round_num` bigint(20) unsigned DEFAULT NULL,
+  `end_time` bigint(20) unsigned DEFAULT NULL,
+  `region_offset` bigint(20) unsigned DEFAULT NULL,
+  `read_rate` double DEFAULT NULL,
+  `avg_latency` bigint(20) unsigned DEFAULT NULL,
+  `max_latency` bigint(20) unsigned DEFAULT NULL,
+  `read_errors` bigint(20) unsigned DEFAULT NULL,
+  PRIMARY KEY (`id`,`scan_num`,`region_num`),
+  KEY `round_num` (`round_num`)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_general_ci;
+/*!40101 SET character_set_client = @saved_cs_client */;
+
 --
 -- Temporary table structure for view `endurance_test_data`
 --
@@ -0,0 +1,960 @@
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <json-c/json_object.h>
+#include <json-c/json_util.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "collector.h"
+#include "device_testing_context.h"
+#include "messages.h"
+#include "mfst.h"
+#include "sql.h"
+#include "sql_mariadb.h"
+#include "sql_sqlite.h"
+
+// mfst-collector: accepts progress updates from any number of mfst instances
+// running on the same host and writes them to the database in batches, so that
+// the database sees one connection and one transaction per interval instead of
+// one of each per instance.
+
+#define COLLECTOR_MAX_CLIENTS 256
+#define COLLECTOR_MAX_CARDS   256
+
+// Number of status samples held per card while the database is unreachable.
+// At the SQL thread's rate of one every 30 seconds, this is a day's worth.
+#define COLLECTOR_MAX_PENDING_SAMPLES 2880
+
+// Cards that nobody has reported on for this many seconds (and that don't have
+// anything left to write) are dropped from the status file
+#define COLLECTOR_CARD_EXPIRY 3600
+
+#define COLLECTOR_BUFFER_SIZE (sizeof(collector_msg_header_type) + COLLECTOR_MAX_PAYLOAD_SIZE)
+
+typedef struct _collector_options_type {
+    char *socket_path;
+    char *log_file;
+    char *status_file;
+    int interval;
+    char *db_host;
+    char *db_user;
+    char *db_pass;
+    char *db_name;
+    int db_port;
+    char *db_file;
+} collector_options_type;
+
+typedef struct _collector_card_type {
+    uint64_t card_id;
+    int num_clients;                  // Number of connected instances reporting on this card
+    time_t last_seen;
+
+    sql_sample_type *samples;         // Status samples waiting to be written
+    int num_samples;
+    int samples_size;                 // Number of samples the buffer can hold
+
+    round_summary_type rounds[ROUND_HISTORY_SIZE]; // Round summaries waiting to be written
+    int num_rounds;
+
+    collector_sector_map_type latest; // The most recent status and sector map
+    int have_latest;
+    int map_dirty;                    // Does the latest map still need to be written?
+
+    surface_scan_result_type *scan;   // The most recent surface scan (allocated on first use)
+    int scan_dirty;                   // Does the scan still need to be written?
+} collector_card_type;
+
+typedef struct _collector_client_type {
+    int fd;
+    uint64_t card_id;                 // The card this instance is reporting on (0 if not known yet)
+    uint8_t *buffer;                  // Partially-received messages
+    size_t buffer_used;
+} collector_client_type;
+
+// The report sinks keep this up to date
+volatile sql_thread_status_type sql_thread_status;
+
+static collector_options_type options;
+static FILE *log_file_handle;
+static volatile sig_atomic_t stop_requested;
+
+static collector_client_type clients[COLLECTOR_MAX_CLIENTS];
+static collector_card_type cards[COLLECTOR_MAX_CARDS];
+static int num_cards;
+
+static report_sink_type *sink;
+static sql_thread_params_type sink_params;
+static int backend_connected;
+
+// The report sinks take their card details from a device testing context, so
+// we fill this one in with the details sent by whichever instance we're
+// working on behalf of
+static device_testing_context_type card_ctx;
+
+void log_log(device_testing_context_type *device_testing_context, const char *funcname, int severity, int msg, ...) {
+    va_list ap;
+    time_t now = time(NULL);
+    char *t = ctime(&now);
+    const char *severity_str = severity == SEVERITY_LEVEL_INFO ? "INFO" : (severity == SEVERITY_LEVEL_ERROR ? "ERROR" : (severity == SEVERITY_LEVEL_WARNING ? "WARNING" : "DEBUG"));
+
+    // Get rid of the newline on the end of the time
+    t[strlen(t) - 1] = 0;
+
+    if(log_file_handle) {
+        va_start(ap, msg);
+        fprintf(log_file_handle, "[%s] [%s] ", t, severity_str);
+        if(funcname) {
+            fprintf(log_file_handle, "%s(): ", funcname);
+        }
+
+        vfprintf(log_file_handle, log_file_messages[msg], ap);
+        fprintf(log_file_handle, "\n");
+        fflush(log_file_handle);
+        va_end(ap);
+    }
+
+    // Only send debug messages to the log file
+    if(severity < SEVERITY_LEVEL_DEBUG) {
+        va_start(ap, msg);
+        printf("[%s] [%s] ", t, severity_str);
+        vprintf(log_file_messages[msg], ap);
+        printf("\n");
+        fflush(stdout);
+        va_end(ap);
+    }
+}
+
+static void collector_signal_handler(int signum) {
+    stop_requested = 1;
+}
+
+static void print_help(char *program_name) {
+    printf("Usage: %s [-s | --socket path] [-i | --interval seconds]\n", program_name);
+    printf("       [-l | --log-file filename] [--status-file filename]\n");
+    printf("       [--dbhost hostname --dbuser username --dbpass password --dbname database\n");
+    printf("       [--dbport port] | --dbfile filename]\n\n");
+    printf("  -s|--socket path               Path of the socket to listen on.\n");
+    printf("                                 Default: " COLLECTOR_DEFAULT_SOCKET "\n");
+    printf("  -i|--interval seconds          Write queued updates to the database this\n");
+    printf("                                 often.  Default: 30\n");
+    printf("  -l|--log-file filename         Write log messages to the file filename.\n");
+    printf("  --status-file filename         Write a JSON summary of every instance that\n");
+    printf("                                 is reporting in to this file after each\n");
+    printf("                                 batch, for use by the web monitor.\n");
+    printf("  --dbhost hostname              Name of the MySQL host to connect to.\n");
+    printf("  --dbuser username              Username to use with the MySQL connection.\n");
+    printf("  --dbpass password              Password to use with the MySQL connection.\n");
+    printf("  --dbname database              Name of the database to use with the MySQL\n");
+    printf("                                 connection.\n");
+    printf("  --dbport port                  Port to use to connect to the MYSQL server.\n");
+    printf("                                 Default: 3306\n");
+    printf("  --dbfile filename              Write to a local SQLite database instead of a\n");
+    printf("                                 MySQL server.\n");
+    printf("  -h|--help                      Display this help message.\n\n");
+}
+
+/**
+ * Parse the command line arguments.  Parsed arguments are placed in the
+ * options global struct.
+ *
+ * @param argc  The argc passed to main().
+ * @param argv  The argv passed to main().
+ *
+ * @returns 0 if the command line arguments were parsed successfully, or -1 if
+ *          the program should exit.
+ */
+static int parse_command_line_arguments(int argc, char **argv) {
+    int c, optindex;
+    struct option long_options[] = {
+        { "socket"     , required_argument, NULL, 's' },
+        { "interval"   , required_argument, NULL, 'i' },
+        { "log-file"   , required_argument, NULL, 'l' },
+        { "help"       , no_argument      , NULL, 'h' },
+        { "status-file", required_argument, NULL, 2   },
+        { "dbhost"     , required_argument, NULL, 3   },
+        { "dbuser"     , required_argument, NULL, 4   },
+        { "dbpass"     , required_argument, NULL, 5   },
+        { "dbname"     , required_argument, NULL, 6   },
+        { "dbport"     , required_argument, NULL, 7   },
+        { "dbfile"     , required_argument, NULL, 8   },
+        { 0            , 0                , 0   , 0   }
+    };
+
+    memset(&options, 0, sizeof(options));
+    options.socket_path = COLLECTOR_DEFAULT_SOCKET;
+    options.interval = 30;
+    options.db_port = 3306;
+
+    while((c = getopt_long(argc, argv, "hi:l:s:", long_options, &optindex)) != -1) {
+        switch(c) {
+            case 's':
+                options.socket_path = optarg; break;
+            case 'i':
+                options.interval = strtol(optarg, NULL, 10); break;
+            case 'l':
+                options.log_file = optarg; break;
+            case 2:
+                options.status_file = optarg; break;
+            case 3:
+                options.db_host = optarg; break;
+            case 4:
+                options.db_user = optarg; break;
+            case 5:
+                options.db_pass = strdup(optarg);
+                // Mask the password so that it isn't visible to ps
+                memset(optarg, '*', strlen(optarg));
+                break;
+            case 6:
+                options.db_name = optarg; break;
+            case 7:
+                options.db_port = strtol(optarg, NULL, 10); break;
+            case 8:
+                options.db_file = optarg; break;
+            default:
+                print_help(argv[0]);
+                return -1;
+        }
+    }
+
+    if(options.interval <= 0) {
+        printf("The interval must be at least 1 second.\n");
+        return -1;
+    }
+
+    if(options.db_file) {
+#if defined(HAVE_SQLITE)
+        sink = &sqlite_report_sink;
+#else
+        printf("This copy of mfst-collector was built without SQLite support, so the --dbfile option is not available.\n");
+        return -1;
+#endif // defined(HAVE_SQLITE)
+    } else if(options.db_host && options.db_user && options.db_pass && options.db_name) {
+#if defined(HAVE_MARIADB)
+        sink = &mariadb_report_sink;
+#else
+        printf("This copy of mfst-collector was built without MariaDB support, so the --dbhost option is not available.\n");
+        return -1;
+#endif // defined(HAVE_MARIADB)
+    } else {
+        print_help(argv[0]);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int collector_backend_connect() {
+    if(backend_connected) {
+        return 0;
+    }
+
+    if(sink->connect(&card_ctx)) {
+        return 1;
+    }
+
+    backend_connected = 1;
+    return 0;
+}
+
+static void collector_backend_disconnect() {
+    sink->disconnect();
+    backend_connected = 0;
+}
+
+static collector_card_type *collector_find_card(uint64_t card_id) {
+    int i;
+
+    for(i = 0; i < num_cards; i++) {
+        if(cards[i].card_id == card_id) {
+            return &cards[i];
+        }
+    }
+
+    if(num_cards == COLLECTOR_MAX_CARDS) {
+        log_log(NULL, __func__, SEVERITY_LEVEL_WARNING, MSG_COLLECTOR_TOO_MANY_CARDS, card_id);
+        return NULL;
+    }
+
+    memset(&cards[num_cards], 0, sizeof(collector_card_type));
+    cards[num_cards].card_id = card_id;
+    return &cards[num_cards++];
+}
+
+/**
+ * Drops cards that nobody is reporting on anymore and that don't have
+ * anything left to write.
+ */
+static void collector_expire_cards() {
+    time_t now = time(NULL);
+    int i;
+
+    for(i = 0; i < num_cards; i++) {
+        if(cards[i].num_clients || cards[i].num_samples || cards[i].num_rounds || cards[i].map_dirty || cards[i].scan_dirty || now - cards[i].last_seen < COLLECTOR_CARD_EXPIRY) {
+            continue;
+        }
+
+        free(cards[i].samples);
+        free(cards[i].scan);
+        memcpy(&cards[i], &cards[--num_cards], sizeof(collector_card_type));
+        i--;
+    }
+}
+
+/**
+ * Points a client at the given card.
+ *
+ * @param client   The client to update.
+ * @param card_id  The card the client is reporting on.
+ *
+ * @returns The card, or NULL if there's no room to keep track of it.
+ */
+static collector_card_type *collector_attach_card(collector_client_type *client, uint64_t card_id) {
+    collector_card_type *card;
+
+    if(client->card_id == card_id) {
+        return collector_find_card(card_id);
+    }
+
+    if(client->card_id && (card = collector_find_card(client->card_id))) {
+        card->num_clients--;
+    }
+
+    client->card_id = 0;
+    if(!(card = collector_find_card(card_id))) {
+        return NULL;
+    }
+
+    client->card_id = card_id;
+    card->num_clients++;
+    return card;
+}
+
+static void collector_queue_samples(collector_card_type *card, sql_sample_type *samples, int num_samples) {
+    sql_sample_type *new_samples;
+    int excess, new_size;
+
+    if(num_samples > COLLECTOR_MAX_PENDING_SAMPLES) {
+        samples += num_samples - COLLECTOR_MAX_PENDING_SAMPLES;
+        num_samples = COLLECTOR_MAX_PENDING_SAMPLES;
+    }
+
+    if((excess = card->num_samples + num_samples - COLLECTOR_MAX_PENDING_SAMPLES) > 0) {
+        log_log(NULL, __func__, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_QUEUE_FULL, card->card_id);
+        memmove(card->samples, card->samples + excess, (card->num_samples - excess) * sizeof(sql_sample_type));
+        card->num_samples -= excess;
+    }
+
+    if(card->num_samples + num_samples > card->samples_size) {
+        new_size = card->samples_size ? card->samples_size * 2 : 64;
+        while(new_size < card->num_samples + num_samples) {
+            new_size *= 2;
+        }
+
+        if(new_size > COLLECTOR_MAX_PENDING_SAMPLES) {
+            new_size = COLLECTOR_MAX_PENDING_SAMPLES;
+        }
+
+        if(!(new_samples = realloc(card->samples, new_size * sizeof(sql_sample_type)))) {
+            log_log(NULL, __func__, SEVERITY_LEVEL_DEBUG, MSG_MALLOC_ERROR, strerror(errno));
+            return;
+        }
+
+        card->samples = new_samples;
+        card->samples_size = new_size;
+    }
+
+    memcpy(card->samples + card->num_samples, samples, num_samples * sizeof(sql_sample_type));
+    card->num_samples += num_samples;
+}
+
+static void collector_queue_rounds(collector_card_type *card, round_summary_type *summaries, int num_summaries) {
+    int excess;
+
+    if(num_summaries > ROUND_HISTORY_SIZE) {
+        summaries += num_summaries - ROUND_HISTORY_SIZE;
+        num_summaries = ROUND_HISTORY_SIZE;
+    }
+
+    if((excess = card->num_rounds + num_summaries - ROUND_HISTORY_SIZE) > 0) {
+        memmove(card->rounds, card->rounds + excess, (card->num_rounds - excess) * sizeof(round_summary_type));
+        card->num_rounds -= excess;
+    }
+
+    memcpy(card->rounds + card->num_rounds, summaries, num_summaries * sizeof(round_summary_type));
+    card->num_rounds += num_summaries;
+}
+
+/**
+ * Handles one of the card registration messages.  These are passed straight
+ * through to the database, since the instance can't do anything else until it
+ * gets an answer.
+ */
+static void collector_handle_card_request(collector_client_type *client, collector_msg_header_type *header, collector_card_info_type *info) {
+    collector_reply_type reply;
+
+    memset(&reply, 0, sizeof(reply));
+
+    uuid_copy(card_ctx.device_info.device_uuid, info->uuid);
+    card_ctx.device_info.num_physical_sectors = info->num_physical_sectors;
+    card_ctx.device_info.sector_size = info->sector_size;
+    info->name[sizeof(info->name) - 1] = 0;
+
+    if(!(reply.result = collector_backend_connect())) {
+        switch(header->type) {
+            case COLLECTOR_MSG_FIND_CARD:
+                reply.result = sink->find_card(&card_ctx, &reply.card_id); break;
+            case COLLECTOR_MSG_INSERT_CARD:
+                reply.result = sink->insert_card(&card_ctx, info->name, &reply.card_id); break;
+            case COLLECTOR_MSG_UPDATE_CARD:
+                reply.card_id = header->card_id;
+                reply.result = sink->update_card(&card_ctx, header->card_id);
+                break;
+        }
+
+        if(reply.result == 1) {
+            collector_backend_disconnect();
+        }
+    }
+
+    if(!reply.result && reply.card_id) {
+        collector_attach_card(client, reply.card_id);
+    }
+
+    // If this fails, we'll find out the next time we try to read from it
+    send(client->fd, &reply, sizeof(reply), MSG_NOSIGNAL);
+}
+
+/**
+ * Handles a complete message received from an instance.
+ *
+ * @returns 0 if the message was handled, or -1 if it was invalid.
+ */
+static int collector_handle_message(collector_client_type *client, collector_msg_header_type *header, void *payload) {
+    collector_card_type *card = NULL;
+
+    switch(header->type) {
+        case COLLECTOR_MSG_FIND_CARD:
+        case COLLECTOR_MSG_INSERT_CARD:
+        case COLLECTOR_MSG_UPDATE_CARD:
+            if(header->length != sizeof(collector_card_info_type)) {
+                return -1;
+            }
+
+            collector_handle_card_request(client, header, payload);
+            return 0;
+
+        case COLLECTOR_MSG_SAMPLES:
+            if(!header->card_id || header->length % sizeof(sql_sample_type)) {
+                return -1;
+            }
+
+            if(card = collector_attach_card(client, header->card_id)) {
+                collector_queue_samples(card, payload, header->length / sizeof(sql_sample_type));
+            }
+
+            break;
+
+        case COLLECTOR_MSG_ROUNDS:
+            if(!header->card_id || header->length % sizeof(round_summary_type)) {
+                return -1;
+            }
+
+            if(card = collector_attach_card(client, header->card_id)) {
+                collector_queue_rounds(card, payload, header->length / sizeof(round_summary_type));
+            }
+
+            break;
+
+        case COLLECTOR_MSG_SECTOR_MAP:
+            if(!header->card_id || header->length != sizeof(collector_sector_map_type)) {
+                return -1;
+            }
+
+            // Only the latest map matters, so this simply replaces whatever
+            // hasn't been written yet
+            if(card = collector_attach_card(client, header->card_id)) {
+                memcpy(&card->latest, payload, sizeof(card->latest));
+                card->have_latest = 1;
+                card->map_dirty = 1;
+            }
+
+            break;
+
+        case COLLECTOR_MSG_SURFACE_SCAN:
+            if(!header->card_id || header->length != sizeof(surface_scan_result_type)) {
+                return -1;
+            }
+
+            // Scans are only sent once apiece, but if a newer one shows up
+            // before the last one was written, the older one can go
+            if(card = collector_attach_card(client, header->card_id)) {
+                if(!card->scan && !(card->scan = malloc(sizeof(surface_scan_result_type)))) {
+                    log_log(NULL, __func__, SEVERITY_LEVEL_DEBUG, MSG_MALLOC_ERROR, strerror(errno));
+                    break;
+                }
+
+                memcpy(card->scan, payload, sizeof(surface_scan_result_type));
+                card->scan_dirty = 1;
+            }
+
+            break;
+
+        default:
+            return -1;
+    }
+
+    if(card) {
+        card->last_seen = time(NULL);
+    }
+
+    return 0;
+}
+
+/**
+ * Reads whatever is waiting on a client's socket and handles any complete
+ * messages.
+ *
+ * @returns 0 if the client is still connected, or -1 if it disconnected or
+ *          sent something invalid.
+ */
+static int collector_read_client(collector_client_type *client) {
+    collector_msg_header_type *header;
+    size_t msg_size;
+    ssize_t ret;
+
+    if((ret = recv(client->fd, client->buffer + client->buffer_used, COLLECTOR_BUFFER_SIZE - client->buffer_used, 0)) == -1) {
+        return errno == EINTR ? 0 : -1;
+    } else if(!ret) {
+        return -1;
+    }
+
+    client->buffer_used += ret;
+
+    while(client->buffer_used >= sizeof(collector_msg_header_type)) {
+        header = (collector_msg_header_type *) client->buffer;
+        if(header->length > COLLECTOR_MAX_PAYLOAD_SIZE) {
+            log_log(NULL, __func__, SEVERITY_LEVEL_WARNING, MSG_COLLECTOR_BAD_MESSAGE);
+            return -1;
+        }
+
+        msg_size = sizeof(collector_msg_header_type) + header->length;
+        if(client->buffer_used < msg_size) {
+            break;
+        }
+
+        if(collector_handle_message(client, header, client->buffer + sizeof(collector_msg_header_type))) {
+            log_log(NULL, __func__, SEVERITY_LEVEL_WARNING, MSG_COLLECTOR_BAD_MESSAGE);
+            return -1;
+        }
+
+        memmove(client->buffer, client->buffer + msg_size, client->buffer_used - msg_size);
+        client->buffer_used -= msg_size;
+    }
+
+    return 0;
+}
+
+static void collector_drop_client(collector_client_type *client) {
+    collector_card_type *card;
+
+    log_log(NULL, __func__, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_CLIENT_DISCONNECTED, client->card_id);
+
+    // Anything it sent us is kept until it's been written
+    if(client->card_id && (card = collector_find_card(client->card_id))) {
+        card->num_clients--;
+    }
+
+    close(client->fd);
+    free(client->buffer);
+    memset(client, 0, sizeof(collector_client_type));
+    client->fd = -1;
+}
+
+static void collector_accept(int listen_fd) {
+    int fd, i;
+
+    if((fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) == -1) {
+        if(errno != EINTR && errno != EAGAIN) {
+            log_log(NULL, __func__, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_ACCEPT_ERROR, strerror(errno));
+        }
+
+        return;
+    }
+
+    for(i = 0; i < COLLECTOR_MAX_CLIENTS && clients[i].fd != -1; i++);
+
+    if(i == COLLECTOR_MAX_CLIENTS) {
+        log_log(NULL, __func__, SEVERITY_LEVEL_WARNING, MSG_COLLECTOR_TOO_MANY_CLIENTS);
+        close(fd);
+        return;
+    }
+
+    if(!(clients[i].buffer = malloc(COLLECTOR_BUFFER_SIZE))) {
+        log_log(NULL, __func__, SEVERITY_LEVEL_DEBUG, MSG_MALLOC_ERROR, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    clients[i].fd = fd;
+    clients[i].card_id = 0;
+    clients[i].buffer_used = 0;
+
+    log_log(NULL, __func__, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_CLIENT_CONNECTED);
+}
+
+/**
+ * Writes everything that's been queued up since the last flush to the
+ * database.  Status samples, round summaries and surface scans for every card
+ * go in a single transaction; the sector maps follow, one statement per card
+ * that changed.
+ * If the database can't be reached, everything stays queued for next time.
+ */
+static void collector_flush() {
+    uint64_t num_samples = 0, num_rounds = 0, num_maps = 0, num_scans = 0;
+    int i, offset, count, ret = 0;
+    collector_card_type *card;
+
+    for(i = 0; i < num_cards; i++) {
+        num_samples += cards[i].num_samples;
+        num_rounds += cards[i].num_rounds;
+        num_maps += cards[i].map_dirty;
+        num_scans += cards[i].scan_dirty;
+    }
+
+    if(!num_samples && !num_rounds && !num_maps && !num_scans) {
+        return;
+    }
+
+    if(collector_backend_connect()) {
+        log_log(NULL, __func__, SEVERITY_LEVEL_WARNING, MSG_COLLECTOR_BACKEND_UNAVAILABLE, options.interval);
+        return;
+    }
+
+    if(num_samples || num_rounds || num_scans) {
+        if(!(ret = sink->begin(&card_ctx))) {
+            for(i = 0; i < num_cards && !ret; i++) {
+                card = &cards[i];
+                for(offset = 0; offset < card->num_samples && !ret; offset += count) {
+                    count = card->num_samples - offset;
+                    if(count > SQL_HISTORY_ROWS_PER_INSERT) {
+                        count = SQL_HISTORY_ROWS_PER_INSERT;
+                    }
+
+                    ret = sink->insert_history(&card_ctx, card->card_id, card->samples + offset, count);
+                }
+
+                if(!ret && card->num_rounds) {
+                    ret = sink->insert_rounds(&card_ctx, card->card_id, card->rounds, card->num_rounds);
+                }
+
+                if(!ret && card->scan_dirty) {
+                    ret = sink->insert_surface_scan(&card_ctx, card->card_id, card->scan);
+                }
+            }
+
+            if(ret) {
+                sink->rollback(&card_ctx);
+            } else {
+                ret = sink->commit(&card_ctx);
+            }
+        }
+
+        if(ret == 1) {
+            log_log(NULL, __func__, SEVERITY_LEVEL_WARNING, MSG_COLLECTOR_BACKEND_UNAVAILABLE, options.interval);
+            collector_backend_disconnect();
+            return;
+        } else if(ret) {
+            // Retrying something the database refused isn't going to help
+            log_log(NULL, __func__, SEVERITY_LEVEL_WARNING, MSG_COLLECTOR_BATCH_DROPPED, num_samples);
+        }
+
+        for(i = 0; i < num_cards; i++) {
+            cards[i].num_samples = 0;
+            cards[i].num_rounds = 0;
+            cards[i].scan_dirty = 0;
+        }
+    }
+
+    for(i = 0; i < num_cards; i++) {
+        card = &cards[i];
+        if(!card->map_dirty) {
+            continue;
+        }
+
+        if((ret = sink->update_sector_map(&card_ctx, card->card_id, &card->latest.sample, card->latest.map)) == 1) {
+            log_log(NULL, __func__, SEVERITY_LEVEL_WARNING, MSG_COLLECTOR_BACKEND_UNAVAILABLE, options.interval);
+            collector_backend_disconnect();
+            return;
+        }
+
+        card->map_dirty = 0;
+    }
+
+    log_log(NULL, __func__, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_BATCH_WRITTEN, num_samples, num_rounds, num_maps);
+}
+
+static int collector_json_add(struct json_object *parent, const char *key, struct json_object *obj) {
+    if(json_object_object_add(parent, key, obj)) {
+        json_object_put(obj);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Writes a summary of every card we're tracking -- and totals across all of
+ * them -- to the status file, for the web monitor to pick up.
+ */
+static void collector_write_status() {
+    struct json_object *root, *list, *obj;
+    char *filename;
+    uint64_t total_bytes_read = 0, total_bytes_written = 0, total_bad_sectors = 0, pending_samples = 0;
+    double total_read_rate = 0, total_write_rate = 0;
+    int i, num_instances = 0, ret = 0;
+    sql_sample_type *sample;
+
+    if(!options.status_file) {
+        return;
+    }
+
+    root = json_object_new_object();
+    list = json_object_new_array();
+
+    for(i = 0; i < COLLECTOR_MAX_CLIENTS; i++) {
+        num_instances += clients[i].fd != -1;
+    }
+
+    for(i = 0; i < num_cards && !ret; i++) {
+        obj = json_object_new_object();
+        sample = &cards[i].latest.sample;
+
+        ret = collector_json_add(obj, "id", json_object_new_int64(cards[i].card_id)) ||
+            collector_json_add(obj, "connected", json_object_new_boolean(cards[i].num_clients > 0)) ||
+            collector_json_add(obj, "last_seen", json_object_new_int64(cards[i].last_seen)) ||
+            collector_json_add(obj, "pending_samples", json_object_new_int(cards[i].num_samples));
+
+        if(!ret && cards[i].have_latest) {
+            ret = collector_json_add(obj, "cur_round_num", json_object_new_int64(sample->cur_round_num)) ||
+                collector_json_add(obj, "num_bad_sectors", json_object_new_int64(sample->num_bad_sectors)) ||
+                collector_json_add(obj, "status", json_object_new_int(sample->status)) ||
+                collector_json_add(obj, "rate", json_object_new_double(sample->rate)) ||
+                collector_json_add(obj, "read_rate", json_object_new_double(sample->read_rate)) ||
+                collector_json_add(obj, "write_rate", json_object_new_double(sample->write_rate)) ||
+                collector_json_add(obj, "avg_read_latency", json_object_new_double(sample->avg_read_latency)) ||
+                collector_json_add(obj, "avg_write_latency", json_object_new_double(sample->avg_write_latency)) ||
+                collector_json_add(obj, "total_bytes_read", json_object_new_int64(sample->total_bytes_read)) ||
+                collector_json_add(obj, "total_bytes_written", json_object_new_int64(sample->total_bytes_written));
+
+            total_bytes_read += sample->total_bytes_read;
+            total_bytes_written += sample->total_bytes_written;
+            total_bad_sectors += sample->num_bad_sectors;
+
+            // Only count throughput from instances that are still running
+            if(cards[i].num_clients) {
+                total_read_rate += sample->read_rate;
+                total_write_rate += sample->write_rate;
+            }
+        }
+
+        pending_samples += cards[i].num_samples;
+
+        if(ret || json_object_array_add(list, obj)) {
+            json_object_put(obj);
+            ret = -1;
+        }
+    }
+
+    if(ret || collector_json_add(root, "cards", list)) {
+        if(ret) {
+            json_object_put(list);
+        }
+
+        json_object_put(root);
+        return;
+    }
+
+    if(collector_json_add(root, "updated", json_object_new_int64(time(NULL))) ||
+       collector_json_add(root, "database_connected", json_object_new_boolean(backend_connected)) ||
+       collector_json_add(root, "num_instances", json_object_new_int(num_instances)) ||
+       collector_json_add(root, "num_cards", json_object_new_int(num_cards)) ||
+       collector_json_add(root, "pending_samples", json_object_new_int64(pending_samples)) ||
+       collector_json_add(root, "total_read_rate", json_object_new_double(total_read_rate)) ||
+       collector_json_add(root, "total_write_rate", json_object_new_double(total_write_rate)) ||
+       collector_json_add(root, "total_bytes_read", json_object_new_int64(total_bytes_read)) ||
+       collector_json_add(root, "total_bytes_written", json_object_new_int64(total_bytes_written)) ||
+       collector_json_add(root, "total_bad_sectors", json_object_new_int64(total_bad_sectors))) {
+        json_object_put(root);
+        return;
+    }
+
+    // Write to a temporary file first so that the web monitor never sees a
+    // half-written file
+    if(!(filename = malloc(strlen(options.status_file) + 6))) {
+        json_object_put(root);
+        return;
+    }
+
+    sprintf(filename, "%s.temp", options.status_file);
+
+    if(json_object_to_file(filename, root) || rename(filename, options.status_file)) {
+        log_log(NULL, __func__, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_STATUS_FILE_ERROR, options.status_file, strerror(errno));
+        unlink(filename);
+    }
+
+    free(filename);
+    json_object_put(root);
+}
+
+static int collector_listen() {
+    struct sockaddr_un addr;
+    int fd;
+
+    if(strlen(options.socket_path) >= sizeof(addr.sun_path)) {
+        log_log(NULL, NULL, SEVERITY_LEVEL_ERROR, MSG_COLLECTOR_LISTEN_ERROR, options.socket_path, strerror(ENAMETOOLONG));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, options.socket_path);
+
+    // Clean up after a previous copy that didn't exit cleanly
+    unlink(options.socket_path);
+
+    if((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 ||
+       bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == -1 ||
+       listen(fd, SOMAXCONN) == -1) {
+        log_log(NULL, NULL, SEVERITY_LEVEL_ERROR, MSG_COLLECTOR_LISTEN_ERROR, options.socket_path, strerror(errno));
+        if(fd != -1) {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    log_log(NULL, NULL, SEVERITY_LEVEL_INFO, MSG_COLLECTOR_LISTENING, options.socket_path);
+    return fd;
+}
+
+int main(int argc, char **argv) {
+    struct sigaction action;
+    struct pollfd pollfds[COLLECTOR_MAX_CLIENTS + 1];
+    int client_index[COLLECTOR_MAX_CLIENTS + 1];
+    int listen_fd, num_fds, timeout, i;
+    time_t next_flush, now;
+
+    if(parse_command_line_arguments(argc, argv)) {
+        return -1;
+    }
+
+    if(options.log_file && !(log_file_handle = fopen(options.log_file, "a"))) {
+        printf("Unable to open log file %s: %s\n", options.log_file, strerror(errno));
+        return -1;
+    }
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = collector_signal_handler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    sink_params.mysql_host = options.db_host;
+    sink_params.mysql_username = options.db_user;
+    sink_params.mysql_password = options.db_pass;
+    sink_params.mysql_port = options.db_port;
+    sink_params.mysql_db_name = options.db_name;
+    sink_params.sqlite_file = options.db_file;
+
+    if(sink->thread_init(&sink_params)) {
+        return -1;
+    }
+
+    if((listen_fd = collector_listen()) == -1) {
+        sink->thread_end();
+        return -1;
+    }
+
+    for(i = 0; i < COLLECTOR_MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+
+    next_flush = time(NULL) + options.interval;
+
+    while(!stop_requested) {
+        pollfds[0].fd = listen_fd;
+        pollfds[0].events = POLLIN;
+        num_fds = 1;
+
+        for(i = 0; i < COLLECTOR_MAX_CLIENTS; i++) {
+            if(clients[i].fd != -1) {
+                pollfds[num_fds].fd = clients[i].fd;
+                pollfds[num_fds].events = POLLIN;
+                client_index[num_fds++] = i;
+            }
+        }
+
+        now = time(NULL);
+        timeout = next_flush > now ? (next_flush - now) * 1000 : 0;
+
+        if(poll(pollfds, num_fds, timeout) == -1) {
+            if(errno != EINTR) {
+                log_log(NULL, __func__, SEVERITY_LEVEL_ERROR, MSG_COLLECTOR_POLL_ERROR, strerror(errno));
+                break;
+            }
+
+            continue;
+        }
+
+        if(pollfds[0].revents & POLLIN) {
+            collector_accept(listen_fd);
+        }
+
+        for(i = 1; i < num_fds; i++) {
+            if(pollfds[i].revents && collector_read_client(&clients[client_index[i]])) {
+                collector_drop_client(&clients[client_index[i]]);
+            }
+        }
+
+        if(time(NULL) >= next_flush) {
+            collector_flush();
+            collector_expire_cards();
+            collector_write_status();
+            next_flush = time(NULL) + options.interval;
+        }
+    }
+
+    log_log(NULL, NULL, SEVERITY_LEVEL_INFO, MSG_COLLECTOR_SHUTTING_DOWN);
+
+    for(i = 0; i < COLLECTOR_MAX_CLIENTS; i++) {
+        if(clients[i].fd != -1) {
+            collector_drop_client(&clients[i]);
+        }
+    }
+
+    close(listen_fd);
+    unlink(options.socket_path);
+
+    collector_flush();
+    collector_write_status();
+    sink->thread_end();
+
+    if(log_file_handle) {
+        fclose(log_file_handle);
+    }
+
+    return 0;
+}
@@ -69,7 +69,11 @@ void print_device_name(device_testing_context_type *device_testing_context);
 WINDOW *message_window(device_testing_context_type *device_testing_context, WINDOW *parent, const char *title, char *msg, char wait);
 
 /**
- * A wrapper for getch()/wgetch() that handles KEY_RESIZE events.
+ * A wrapper for getch()/wgetch() that handles KEY_RESIZE events.  This also
+ * serves as the screen's frame clock: it only does anything at most once every
+ * 100ms (returning ERR the rest of the time), and if there's no window on top
+ * of the main screen, it draws any pending updates (see
+ * draw_pending_updates()) before reading from the keyboard.
  *
  * @param device_testing_context  The device currently being tested.  (This is
  *                                needed in case a KEY_RESIZE keypress is
@@ -127,8 +131,10 @@ void draw_sector(uint64_t sector_num, int color, int with_diamond, int with_x);
 void draw_percentage(device_testing_context_type *device_testing_context);
 
 /**
- * Redraw the blocks containing the given sectors.  The display is not
- * refreshed after the blocks are drawn.
+ * Marks the blocks containing the given sectors as needing to be redrawn.  The
+ * blocks are drawn the next time the screen is updated (see
+ * draw_pending_updates()), so this is cheap enough to call for every block
+ * read or written.
  *
  * @param device_testing_context  The device whose sectors should be drawn.
  * @param start_sector            The sector number of the first sector to be
@@ -139,6 +145,16 @@ void draw_percentage(device_testing_context_type *device_testing_context);
  */
 void draw_sectors(device_testing_context_type *device_testing_context, uint64_t start_sector, uint64_t end_sector);
 
+/**
+ * Draws the blocks on the sector map that have been marked as needing to be
+ * redrawn, the "% sectors failed" display, and (during the stress test) the
+ * current read/write speed.  The display is not refreshed afterwards.
+ *
+ * @param device_testing_context  The device whose details are being shown on
+ *                                the display.
+ */
+void draw_pending_updates(device_testing_context_type *device_testing_context);
+
 /**
  * Recomputes the parameters for displaying the sector map on the display, then
  * redraws the entire sector map.  The display is not refreshed after the sector
@@ -249,6 +265,7 @@ inline void print_with_color(int y, int x, int color, const char *str) {}
 inline void draw_sector(uint64_t sector_num, int color, int with_diamond, int with_x) {}
 inline void draw_percentage(device_testing_context_type *device_testing_context) {}
 inline void draw_sectors(device_testing_context_type *device_testing_context, uint64_t start_sector, uint64_t end_sector) {}
+inline void draw_pending_updates(device_testing_context_type *device_testing_context) {}
 inline void redraw_sector_map(device_testing_context_type *device_testing_context) {}
 inline void print_sql_status(sql_thread_status_type status) {}
 inline void draw_colored_char(int y_loc, int x_loc, int color_pair, chtype ch) {}
@@ -34,3 +34,11 @@ void rng_fill_buffer(device_testing_context_type *device_testing_context, char *
         int_buffer[i] = rng_get_random_number(device_testing_context);
     }
 }
+
+void rng_save_state(device_testing_context_type *device_testing_context, rng_state_type *snapshot) {
+    memcpy(snapshot, &device_testing_context->endurance_test_info.rng_state, sizeof(rng_state_type));
+}
+
+void rng_restore_state(device_testing_context_type *device_testing_context, rng_state_type *snapshot) {
+    memcpy(&device_testing_context->endurance_test_info.rng_state, snapshot, sizeof(rng_state_type));
+}
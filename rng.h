@@ -49,4 +49,30 @@ int32_t rng_get_random_number(device_testing_context_type *device_testing_contex
 */
 void rng_fill_buffer(device_testing_context_type *device_testing_context, char *buffer, size_t size);
 
+/**
+ * Takes a snapshot of the current state of the random number generator.  The
+ * snapshot can later be handed to rng_restore_state() to rewind the RNG to this
+ * point, so that it reproduces the same sequence of numbers from here on out.
+ *
+ * Note that the snapshot is only valid for the device it was taken from -- the
+ * RNG's internal pointers refer to the state buffer in the device testing
+ * context, not the copy in the snapshot.
+ *
+ * @param device_testing_context  The device whose RNG state should be saved.
+ * @param snapshot                A pointer to an rng_state_type that will
+ *                                receive the snapshot.
+ */
+void rng_save_state(device_testing_context_type *device_testing_context, rng_state_type *snapshot);
+
+/**
+ * Rewinds the random number generator to a snapshot previously taken with
+ * rng_save_state().
+ *
+ * @param device_testing_context  The device whose RNG state should be
+ *                                restored.  This must be the same device the
+ *                                snapshot was taken from.
+ * @param snapshot                A pointer to the snapshot to restore.
+ */
+void rng_restore_state(device_testing_context_type *device_testing_context, rng_state_type *snapshot);
+
 #endif // !defined(RNG_H)
@@ -1,10 +1,9 @@
 #include <errno.h>
-#include <mariadb/errmsg.h>
-#include <mariadb/mysql.h>
-#include <mariadb/mysqld_error.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -12,65 +11,44 @@
 #include "messages.h"
 #include "mfst.h"
 #include "sql.h"
-
-#define CONSOLIDATED_SECTOR_MAP_SIZE 10000
+#include "stats_block.h"
 
 volatile sql_thread_status_type sql_thread_status;
 
 static uint64_t previous_total_bytes;
 static struct timespec previous_time;
 
-int sql_thread_is_connection_error(int result) {
-    return
-        result == CR_SERVER_GONE_ERROR ||
-        result == CR_SERVER_LOST ||
-        result == ER_CONNECTION_KILLED ||
-        result == CR_CONN_HOST_ERROR ||
-        result == CR_CONNECTION_ERROR;
-}
-
-int sql_thread_update_sector_map(device_testing_context_type *device_testing_context, MYSQL *mysql, uint64_t card_id) {
-    const char *update_query = "INSERT INTO consolidated_sector_maps (id, consolidated_sector_map, last_updated, cur_round_num, num_bad_sectors, status, rate) VALUES (?, ?, ?, ?, ?, ?, ?) ON DUPLICATE KEY UPDATE consolidated_sector_map=VALUES(consolidated_sector_map), last_updated=VALUES(last_updated), cur_round_num=VALUES(cur_round_num), num_bad_sectors=VALUES(num_bad_sectors), status=VALUES(status), rate=VALUES(rate)";
-    char indicator;
+// Counters as of the previous sample, used to work out per-interval values
+static uint64_t previous_bytes_read;
+static uint64_t previous_bytes_written;
+static io_latency_stats_type previous_latency_stats;
+
+// Number of end-of-round summaries that have made it to the sink
+static uint64_t rounds_reported;
+
+// Number of surface scans that had been completed the last time we reported
+// one to the sink
+static uint64_t scans_reported;
+
+// The consolidated sector map we're about to report
+static uint8_t consolidated_sector_map[CONSOLIDATED_SECTOR_MAP_BYTES];
+
+/**
+ * Takes a snapshot of the stats that get reported to the database.  The rate
+ * is computed from the bytes read and written since the last sample.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param sample                  A pointer to a struct that will receive the
+ *                                snapshot.
+ *
+ * @returns 0 on success, or -1 if the current time could not be obtained.
+ */
+static int sql_thread_take_sample(device_testing_context_type *device_testing_context, sql_sample_type *sample) {
     time_t time_secs;
-    double rate;
     double secs;
     struct timespec new_time;
-
-    MYSQL_STMT *stmt;
-    MYSQL_BIND bind_params[7];
-    uint8_t *consolidated_sector_map = NULL;
-    int consolidated_sector_map_size = (CONSOLIDATED_SECTOR_MAP_SIZE / 2) + (CONSOLIDATED_SECTOR_MAP_SIZE % 2);
-    uint64_t sectors_per_block = device_testing_context->device_info.num_physical_sectors / CONSOLIDATED_SECTOR_MAP_SIZE;
     uint64_t total_bytes;
-    uint64_t result, i, j;
-    int64_t current_round = device_testing_context->endurance_test_info.rounds_completed + 1;
-    int ret;
-
-    // So we don't get in trouble with gcc
-    main_thread_status_type tmp_main_thread_status = main_thread_status;
-
-    // Put the consolidated sector map together
-    if(!(consolidated_sector_map = malloc(sizeof(uint8_t) * consolidated_sector_map_size))) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MALLOC_ERROR, strerror(errno));
-        return -1;
-    }
-    
-    memset(consolidated_sector_map, 0, consolidated_sector_map_size);
-
-    for(i = 0; i < CONSOLIDATED_SECTOR_MAP_SIZE; i++) {
-        if(!(i % 2)) {
-            consolidated_sector_map[i / 2] = 0x66;
-        }
-                
-        for(j = sectors_per_block * i; j < (sectors_per_block * (i + 1)) && j < device_testing_context->device_info.num_physical_sectors; j++) {
-            if(!(i % 2)) {
-                consolidated_sector_map[i / 2] = (consolidated_sector_map[i / 2] & 0x0f) | ((((consolidated_sector_map[i / 2] >> 4) & device_testing_context->endurance_test_info.sector_map[j]) | (((consolidated_sector_map[i / 2] >> 4) | device_testing_context->endurance_test_info.sector_map[j]) & 0x09)) << 4);
-            } else {
-                consolidated_sector_map[i / 2] = (consolidated_sector_map[i / 2] & 0xf0) | ((consolidated_sector_map[i / 2] & device_testing_context->endurance_test_info.sector_map[j]) | (((consolidated_sector_map[i / 2] & 0x0f) | device_testing_context->endurance_test_info.sector_map[j]) & 0x09));
-            }
-        }
-    }
+    stats_snapshot_type snapshot;
 
     if((time_secs = time(NULL)) == -1) {
         log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_TIME_ERROR, strerror(errno));
@@ -82,375 +60,216 @@ int sql_thread_update_sector_map(device_testing_context_type *device_testing_con
         return -1;
     }
 
-    // In a hypothetical future multithreaded version of this program, the
-    // counters could update mid-function call.  So to head off that possibility
-    // now, we'll just compute the total bytes now and use that for both our
-    // rate calculation and for previous_total_bytes.
-    total_bytes = device_testing_context->endurance_test_info.stats_file_counters.total_bytes_read + device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written;
+    // The main thread keeps updating the counters while we're working, so
+    // work from a snapshot of them instead
+    stats_block_read(device_testing_context, &snapshot);
+    sample->total_bytes_read = snapshot.total_bytes_read;
+    sample->total_bytes_written = snapshot.total_bytes_written;
+    total_bytes = sample->total_bytes_read + sample->total_bytes_written;
 
+    sample->rate = 0;
+    sample->read_rate = 0;
+    sample->write_rate = 0;
     if(previous_time.tv_sec) {
         secs = (((double) new_time.tv_sec) + (((double) new_time.tv_nsec) / 1000000000.0)) - (((double) previous_time.tv_sec) + (((double) previous_time.tv_nsec) / 1000000000.0));
-        rate = ((double)(total_bytes - previous_total_bytes)) / secs;
-    } else {
-        rate = 0;
-    }
-
-    memcpy(&previous_time, &new_time, sizeof(struct timespec));
-    previous_total_bytes = total_bytes;
-
-    memset(bind_params, 0, sizeof(bind_params));
-
-    bind_params[0].buffer_type = MYSQL_TYPE_LONGLONG;
-    bind_params[0].buffer = &card_id;
-    bind_params[0].buffer_length = sizeof(card_id);
-    indicator = STMT_INDICATOR_NONE;
-    bind_params[0].u.indicator = &indicator;
-    bind_params[0].is_unsigned = 1;
-
-    bind_params[1].buffer_type = MYSQL_TYPE_BLOB;
-    bind_params[1].buffer = consolidated_sector_map;
-    bind_params[1].buffer_length = consolidated_sector_map_size;
-    bind_params[1].u.indicator = &indicator;
-
-    bind_params[2].buffer_type = MYSQL_TYPE_LONGLONG;
-    bind_params[2].buffer = &time_secs;
-    bind_params[2].buffer_length = sizeof(time_secs);
-    bind_params[2].is_unsigned = 1;
-
-    bind_params[3].buffer_type = MYSQL_TYPE_LONGLONG;
-    bind_params[3].buffer = &current_round;
-    bind_params[3].buffer_length = sizeof(current_round);
-
-    bind_params[4].buffer_type = MYSQL_TYPE_LONGLONG;
-    bind_params[4].buffer = &device_testing_context->endurance_test_info.total_bad_sectors;
-    bind_params[4].buffer_length = sizeof(device_testing_context->endurance_test_info.total_bad_sectors);
-    bind_params[4].is_unsigned = 1;
-
-    bind_params[5].buffer_type = MYSQL_TYPE_LONG;
-    bind_params[5].buffer = &tmp_main_thread_status;
-    bind_params[5].buffer_length = sizeof(tmp_main_thread_status);
-
-    bind_params[6].buffer_type = MYSQL_TYPE_DOUBLE;
-    bind_params[6].buffer = &rate;
-    bind_params[6].buffer_length = sizeof(rate);
-
-    if(!(stmt = mysql_stmt_init(mysql))) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_INIT_ERROR, mysql_error(mysql));
-        free(consolidated_sector_map);
-        return -1;
-    }
-
-    if(mysql_stmt_prepare(stmt, update_query, strlen(update_query))) {
-        result = mysql_stmt_errno(stmt);
-        if(sql_thread_is_connection_error(result)) {
-            sql_thread_status = SQL_THREAD_DISCONNECTED;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
-            ret = 1;
-        } else {
-            sql_thread_status = SQL_THREAD_ERROR;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_PREPARE_ERROR, mysql_stmt_error(stmt));
-            ret = -1;
+        if(secs > 0) {
+            sample->rate = ((double)(total_bytes - previous_total_bytes)) / secs;
+            sample->read_rate = ((double)(sample->total_bytes_read - previous_bytes_read)) / secs;
+            sample->write_rate = ((double)(sample->total_bytes_written - previous_bytes_written)) / secs;
         }
-
-        mysql_stmt_close(stmt);
-        free(consolidated_sector_map);
-        return ret;
     }
 
-    if(mysql_stmt_bind_param(stmt, bind_params)) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_PARAM_ERROR, mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
-        free(consolidated_sector_map);
-        return -1;
+    sample->avg_read_latency = 0;
+    if(snapshot.io_latency_stats.num_reads > previous_latency_stats.num_reads) {
+        sample->avg_read_latency = ((double)(snapshot.io_latency_stats.total_read_time - previous_latency_stats.total_read_time)) / ((double)(snapshot.io_latency_stats.num_reads - previous_latency_stats.num_reads));
     }
 
-    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
-
-    if(mysql_stmt_send_long_data(stmt, 1, consolidated_sector_map, consolidated_sector_map_size)) {
-        result = mysql_stmt_errno(stmt);
-        if(sql_thread_is_connection_error(result)) {
-            sql_thread_status = SQL_THREAD_DISCONNECTED;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
-            ret = 1;
-        } else {
-            sql_thread_status = SQL_THREAD_ERROR;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_SEND_LONG_DATA_ERROR, mysql_stmt_error(stmt));
-            ret = -1;
-        }
-
-        mysql_stmt_close(stmt);
-        free(consolidated_sector_map);
-        return ret;
+    sample->avg_write_latency = 0;
+    if(snapshot.io_latency_stats.num_writes > previous_latency_stats.num_writes) {
+        sample->avg_write_latency = ((double)(snapshot.io_latency_stats.total_write_time - previous_latency_stats.total_write_time)) / ((double)(snapshot.io_latency_stats.num_writes - previous_latency_stats.num_writes));
     }
 
-    if(mysql_stmt_execute(stmt)) {
-        result = mysql_stmt_errno(stmt);
-        if(sql_thread_is_connection_error(result)) {
-            sql_thread_status = SQL_THREAD_DISCONNECTED;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
-            ret = 1;
-        } else {
-            sql_thread_status = SQL_THREAD_ERROR;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_EXECUTE_ERROR, mysql_stmt_error(stmt));
-            ret = -1;
-        }
-    } else {
-        sql_thread_status = SQL_THREAD_CONNECTED;
-        ret = 0;
-    }
+    memcpy(&previous_time, &new_time, sizeof(struct timespec));
+    previous_total_bytes = total_bytes;
+    previous_bytes_read = sample->total_bytes_read;
+    previous_bytes_written = sample->total_bytes_written;
+    memcpy(&previous_latency_stats, &snapshot.io_latency_stats, sizeof(io_latency_stats_type));
+
+    sample->sample_time = time_secs;
+    sample->cur_round_num = snapshot.rounds_completed + 1;
+    sample->num_bad_sectors = snapshot.total_bad_sectors;
+    sample->status = main_thread_status;
 
-    mysql_stmt_close(stmt);
-    free(consolidated_sector_map);
     return 0;
 }
 
-int sql_thread_insert_card(device_testing_context_type *device_testing_context, MYSQL *mysql, char *name, uint64_t *id) {
-    const char *insert_query = "INSERT INTO cards (name, uuid, size, sector_size) VALUES (?, ?, ?, ?)";
-    MYSQL_STMT *stmt;
-    MYSQL_BIND bind_params[4];
-    char indicator;
-    char uuid_str[37];
-    int result;
-
-    uuid_unparse(device_testing_context->device_info.device_uuid, uuid_str);
-
-    if(!(stmt = mysql_stmt_init(mysql))) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_INIT_ERROR, mysql_error(mysql));
-        return -1;
+/**
+ * Appends a sample to the spool file so that it can be sent to the database
+ * once we're able to reconnect.  If the write only partially succeeds, the
+ * partial record is removed again so that later records stay aligned.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param spool_fd                The file descriptor of the spool file, or -1
+ *                                if there isn't one.
+ * @param sample                  The sample to spool.
+ */
+static void sql_thread_spool_sample(device_testing_context_type *device_testing_context, int spool_fd, sql_sample_type *sample) {
+    struct stat statbuf;
+
+    if(spool_fd == -1) {
+        return;
     }
 
-    if(mysql_stmt_prepare(stmt, insert_query, strlen(insert_query))) {
-        result = mysql_stmt_errno(stmt);
-        if(sql_thread_is_connection_error(result)) {
-            sql_thread_status = SQL_THREAD_DISCONNECTED;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
-            result = 1;
-        } else {
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_PREPARE_ERROR, mysql_stmt_error(stmt));
-            result = -1;
-        }
-
-        mysql_stmt_close(stmt);
-        return result;
-    }
-
-    memset(bind_params, 0, sizeof(bind_params));
-
-    bind_params[0].buffer_type = MYSQL_TYPE_STRING;
-    bind_params[0].buffer = name;
-    bind_params[0].buffer_length = strlen(name);
-    indicator = STMT_INDICATOR_NTS;
-    bind_params[0].u.indicator = &indicator;
-
-    bind_params[1].buffer_type = MYSQL_TYPE_STRING;
-    bind_params[1].buffer = uuid_str;
-    bind_params[1].buffer_length = strlen(uuid_str);
-    bind_params[1].u.indicator = &indicator;
-
-    bind_params[2].buffer_type = MYSQL_TYPE_LONGLONG;
-    bind_params[2].buffer = &device_testing_context->device_info.num_physical_sectors;
-    bind_params[2].buffer_length = sizeof(device_testing_context->device_info.num_physical_sectors);
-    bind_params[2].is_unsigned = 1;
-
-    bind_params[3].buffer_type = MYSQL_TYPE_LONG;
-    bind_params[3].buffer = &device_testing_context->device_info.sector_size;
-    bind_params[3].buffer_length = sizeof(device_testing_context->device_info.sector_size);
-    bind_params[3].is_unsigned = 0;
-
-    if(mysql_stmt_bind_param(stmt, bind_params)) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_PARAM_ERROR, mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
-        return -1;
+    if(fstat(spool_fd, &statbuf) == -1) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_SQL_SPOOL_WRITE_ERROR, strerror(errno));
+        return;
     }
 
-    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
-
-    if(mysql_stmt_execute(stmt)) {
-        result = mysql_stmt_errno(stmt);
-        if(sql_thread_is_connection_error(result)) {
-            sql_thread_status = SQL_THREAD_DISCONNECTED;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
-            result = 1;
-        } else {
-            sql_thread_status = SQL_THREAD_ERROR;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_EXECUTE_ERROR, mysql_stmt_error(stmt));
-            result = -1;
-        }
-
-        mysql_stmt_close(stmt);
-        return result;
+    if(write(spool_fd, sample, sizeof(sql_sample_type)) != sizeof(sql_sample_type)) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_SQL_SPOOL_WRITE_ERROR, strerror(errno));
+        ftruncate(spool_fd, statbuf.st_size);
     }
-
-    *id = mysql_stmt_insert_id(stmt);
-    mysql_stmt_close(stmt);
-
-    sql_thread_status = SQL_THREAD_CONNECTED;
-
-    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_CARD_REGISTERED, *id);
-
-    return 0;
 }
 
-int sql_thread_find_card(device_testing_context_type *device_testing_context, MYSQL *mysql, uint64_t *id) {
-    MYSQL_STMT *stmt;
-    MYSQL_BIND bind_params[2];
-    char uuid_str[37];
-    char indicator;
-    my_bool is_error, is_null;
-    int result;
-
-    const char *find_card_query = "SELECT id FROM cards WHERE uuid=?";
-    
-    // Does the card already exist in the database?
-    uuid_unparse(device_testing_context->device_info.device_uuid, uuid_str);
+/**
+ * Condenses the device's sector map down to CONSOLIDATED_SECTOR_MAP_SIZE
+ * blocks and places the result in consolidated_sector_map.
+ *
+ * @param device_testing_context  The device being tested.
+ */
+static void sql_thread_build_consolidated_sector_map(device_testing_context_type *device_testing_context) {
+    uint64_t sectors_per_block = device_testing_context->device_info.num_physical_sectors / CONSOLIDATED_SECTOR_MAP_SIZE;
+    uint64_t i, j;
 
-    if(!(stmt = mysql_stmt_init(mysql))) {
-        sql_thread_status = SQL_THREAD_ERROR;
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_INIT_ERROR, mysql_error(mysql));
-        return -1;
-    }
+    memset(consolidated_sector_map, 0, sizeof(consolidated_sector_map));
 
-    if(mysql_stmt_prepare(stmt, find_card_query, strlen(find_card_query))) {
-        result = mysql_stmt_errno(stmt);
-        if(sql_thread_is_connection_error(result)) {
-            sql_thread_status = SQL_THREAD_DISCONNECTED;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
-            result = 1;
-        } else {
-            sql_thread_status = SQL_THREAD_ERROR;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_PREPARE_ERROR, mysql_stmt_error(stmt));
-            result = -1;
+    for(i = 0; i < CONSOLIDATED_SECTOR_MAP_SIZE; i++) {
+        if(!(i % 2)) {
+            consolidated_sector_map[i / 2] = 0x66;
+        }
+                
+        for(j = sectors_per_block * i; j < (sectors_per_block * (i + 1)) && j < device_testing_context->device_info.num_physical_sectors; j++) {
+            if(!(i % 2)) {
+                consolidated_sector_map[i / 2] = (consolidated_sector_map[i / 2] & 0x0f) | ((((consolidated_sector_map[i / 2] >> 4) & device_testing_context->endurance_test_info.sector_map[j]) | (((consolidated_sector_map[i / 2] >> 4) | device_testing_context->endurance_test_info.sector_map[j]) & 0x09)) << 4);
+            } else {
+                consolidated_sector_map[i / 2] = (consolidated_sector_map[i / 2] & 0xf0) | ((consolidated_sector_map[i / 2] & device_testing_context->endurance_test_info.sector_map[j]) | (((consolidated_sector_map[i / 2] & 0x0f) | device_testing_context->endurance_test_info.sector_map[j]) & 0x09));
+            }
         }
-
-        mysql_stmt_close(stmt);
-        return result;
-    }
-
-    memset(bind_params, 0, sizeof(bind_params));
-
-    // Use bind_params[0] for the input bind and bind_params[1] for the output bind
-    bind_params[0].buffer_type = MYSQL_TYPE_STRING;
-    bind_params[0].buffer = uuid_str;
-    bind_params[0].buffer_length = strlen(uuid_str);
-    indicator = STMT_INDICATOR_NTS;
-    bind_params[0].u.indicator = &indicator;
-
-    bind_params[1].buffer_type = MYSQL_TYPE_LONGLONG;
-    bind_params[1].buffer = id;
-    bind_params[1].buffer_length = sizeof(*id);
-    bind_params[1].error = &is_error;
-    bind_params[1].is_null = &is_null;
-    bind_params[1].is_unsigned = 1;
-
-    if(mysql_stmt_bind_param(stmt, bind_params)) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_PARAM_ERROR, mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
-        return -1;
     }
+}
 
-    if(mysql_stmt_bind_result(stmt, bind_params + 1)) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_RESULT_ERROR, mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
+/**
+ * Writes a sample to the status history, along with anything that was spooled
+ * while we were disconnected, any end-of-round summaries that haven't been
+ * reported yet, and the results of the latest surface scan if they haven't
+ * been reported yet.  Everything is sent in one transaction; once it's
+ * committed, the spool file is emptied.  If the sample can't be sent, it's
+ * added to the spool file instead.
+ *
+ * @param sink                    The sink to write to.
+ * @param device_testing_context  The device being tested.
+ * @param card_id                 The ID of the card being tested.
+ * @param spool_fd                The file descriptor of the spool file, or -1
+ *                                if there isn't one.
+ * @param sample                  The sample to write.
+ *
+ * @returns 0 on success, 1 if the connection to the sink was lost, or -1 if
+ *          any other error occurred.
+ */
+static int sql_thread_write_history(report_sink_type *sink, device_testing_context_type *device_testing_context, uint64_t card_id, int spool_fd, sql_sample_type *sample) {
+    sql_sample_type *samples;
+    round_summary_type summaries[ROUND_HISTORY_SIZE];
+    static surface_scan_result_type scan;
+    ssize_t bytes_read;
+    off_t offset = 0;
+    uint64_t first_round, last_round, scans_performed, i;
+    int num_samples, done = 0, ret;
+
+    if(!(samples = malloc(sizeof(sql_sample_type) * SQL_HISTORY_ROWS_PER_INSERT))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MALLOC_ERROR, strerror(errno));
+        sql_thread_spool_sample(device_testing_context, spool_fd, sample);
         return -1;
     }
 
     sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
-    if(mysql_stmt_execute(stmt)) {
-        result = mysql_stmt_errno(stmt);
-        if(sql_thread_is_connection_error(result)) {
-            sql_thread_status = SQL_THREAD_DISCONNECTED;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
-            result = 1;
-        } else {
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_EXECUTE_ERROR, mysql_stmt_error(stmt));
-            result = -1;
-        }
 
-        mysql_stmt_close(stmt);
-        return result;
-    }
-
-    result = mysql_stmt_fetch(stmt);
-    mysql_stmt_free_result(stmt);
-    mysql_stmt_close(stmt);
-
-    sql_thread_status = SQL_THREAD_CONNECTED;
-
-    if(result == MYSQL_NO_DATA) {
-        *id = 0ULL;
+    if(ret = sink->begin(device_testing_context)) {
+        free(samples);
+        sql_thread_spool_sample(device_testing_context, spool_fd, sample);
+        return ret;
     }
 
-    return 0;
-}
+    do {
+        num_samples = 0;
+        if(spool_fd != -1) {
+            if((bytes_read = pread(spool_fd, samples, sizeof(sql_sample_type) * SQL_HISTORY_ROWS_PER_INSERT, offset)) == -1) {
+                // Don't let a bad spool file hold up reporting forever
+                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_SQL_SPOOL_READ_ERROR, strerror(errno));
+                bytes_read = 0;
+            }
 
-int sql_thread_update_card(device_testing_context_type *device_testing_context, MYSQL *mysql, uint64_t id) {
-    MYSQL_STMT *stmt;
-    MYSQL_BIND bind_params[3];
-    int result;
+            num_samples = bytes_read / sizeof(sql_sample_type);
+            offset += num_samples * sizeof(sql_sample_type);
+        }
 
-    const char *update_query = "UPDATE cards SET size=?, sector_size=? WHERE id=?";
+        // Tack the new sample onto the end once the spool has been drained
+        if(num_samples < SQL_HISTORY_ROWS_PER_INSERT) {
+            memcpy(&samples[num_samples++], sample, sizeof(sql_sample_type));
+            done = 1;
+        }
 
-    if(!(stmt = mysql_stmt_init(mysql))) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_INIT_ERROR, mysql_error(mysql));
-        return -1;
+        if(ret = sink->insert_history(device_testing_context, card_id, samples, num_samples)) {
+            break;
+        }
+    } while(!done);
+
+    free(samples);
+
+    // If more rounds were completed than the round history can hold since the
+    // last time we got here, the oldest ones are skipped
+    // Pairs with the release store in perform_end_of_round_summary(), so that
+    // the summaries we copy below are complete
+    last_round = __atomic_load_n(&device_testing_context->endurance_test_info.round_history.num_recorded, __ATOMIC_ACQUIRE);
+    first_round = rounds_reported;
+    if(last_round - first_round > ROUND_HISTORY_SIZE) {
+        first_round = last_round - ROUND_HISTORY_SIZE;
     }
 
-    if(mysql_stmt_prepare(stmt, update_query, strlen(update_query))) {
-        result = mysql_stmt_errno(stmt);
-        if(sql_thread_is_connection_error(result)) {
-            sql_thread_status = SQL_THREAD_DISCONNECTED;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
-            result = 1;
-        } else {
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_PREPARE_ERROR, mysql_stmt_error(stmt));
-            result = -1;
+    if(!ret && first_round != last_round) {
+        for(i = first_round; i < last_round; i++) {
+            memcpy(&summaries[i - first_round], &device_testing_context->endurance_test_info.round_history.entries[i % ROUND_HISTORY_SIZE], sizeof(round_summary_type));
         }
 
-        mysql_stmt_close(stmt);
-        return result;
+        ret = sink->insert_rounds(device_testing_context, card_id, summaries, last_round - first_round);
     }
 
-    memset(bind_params, 0, sizeof(bind_params));
-
-    bind_params[0].buffer_type = MYSQL_TYPE_LONGLONG;
-    bind_params[0].buffer = &device_testing_context->device_info.num_physical_sectors;
-    bind_params[0].buffer_length = sizeof(device_testing_context->device_info.num_physical_sectors);
-    bind_params[0].is_unsigned = 1;
-
-    bind_params[1].buffer_type = MYSQL_TYPE_LONG;
-    bind_params[1].buffer = &device_testing_context->device_info.sector_size;
-    bind_params[1].buffer_length = sizeof(device_testing_context->device_info.sector_size);
-    bind_params[1].is_unsigned = 0;
-
-    bind_params[2].buffer_type = MYSQL_TYPE_LONGLONG;
-    bind_params[2].buffer = &id;
-    bind_params[2].buffer_length = sizeof(id);
-    bind_params[2].is_unsigned = 1;
+    // Only the results of the most recent surface scan are kept around, so if
+    // more than one scan finished since the last time we got here, the older
+    // ones are skipped
+    scans_performed = stats_block_read_surface_scan(device_testing_context, &scan);
+    if(!ret && scans_performed != scans_reported) {
+        ret = sink->insert_surface_scan(device_testing_context, card_id, &scan);
+    }
 
-    if(mysql_stmt_bind_param(stmt, bind_params)) {
-        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_PARAM_ERROR, mysql_stmt_error(stmt));
-        mysql_stmt_close(stmt);
-        return -1;
+    if(ret) {
+        sink->rollback(device_testing_context);
+    } else {
+        ret = sink->commit(device_testing_context);
     }
 
-    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
-    if(mysql_stmt_execute(stmt)) {
-        result = mysql_stmt_errno(stmt);
-        if(sql_thread_is_connection_error(result)) {
-            sql_thread_status = SQL_THREAD_DISCONNECTED;
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
-            result = 1;
-        } else {
-            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_EXECUTE_ERROR, mysql_stmt_error(stmt));
-            result = -1;
-        }
+    if(ret) {
+        sql_thread_spool_sample(device_testing_context, spool_fd, sample);
+        return ret;
+    }
 
-        mysql_stmt_close(stmt);
-        return result;
+    if(offset) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_SQL_SPOOL_REPLAYED, offset / sizeof(sql_sample_type));
+        ftruncate(spool_fd, 0);
     }
 
+    rounds_reported = last_round;
+    scans_reported = scans_performed;
     sql_thread_status = SQL_THREAD_CONNECTED;
-
     return 0;
 }
 
@@ -458,69 +277,71 @@ void *sql_thread_main(void *arg) {
     /* Parameters we're getting from the main thread */
     sql_thread_params_type *params = (sql_thread_params_type *) arg;
 
-    /* MySQL variables */
-    MYSQL *mysql = NULL;
+    report_sink_type *sink = params->sink;
     char card_registered = 0;
 
     int result;
     char msg[256];
     char uuid_str[37];
 
+    /* Spool file for updates made while we can't reach the server */
+    char default_spool_file[64];
+    char *spool_file;
+    int spool_fd = -1;
+    sql_sample_type sample;
+
     void *sql_thread_cleanup() {
-        if(mysql) {
-            mysql_close(mysql);
-        }
+        sink->thread_end();
 
-        mysql_thread_end();
+        if(spool_fd != -1) {
+            close(spool_fd);
+        }
 
         return NULL;
     }
 
-    if(!params->device_testing_context) {
-        sql_thread_status = SQL_THREAD_ERROR;
-        return NULL;
-    }
+    // Keep taking samples while we wait to try again, so that there isn't a
+    // gap in the history once we're able to reconnect
+    void sql_thread_wait_for_reconnect() {
+        if(!sql_thread_take_sample(params->device_testing_context, &sample)) {
+            sql_thread_spool_sample(params->device_testing_context, spool_fd, &sample);
+        }
 
-    if(!params->mysql_host || !params->mysql_username || !params->mysql_password || !params->mysql_port || !params->mysql_db_name) {
-        sql_thread_status = SQL_THREAD_ERROR;
-        log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SQL_THREAD_REQUIRED_PARAM_MISSING);
-        return NULL;
+        sleep(30);
     }
 
-    if(!mysql_thread_safe()) {
+    if(!params->device_testing_context || !sink) {
         sql_thread_status = SQL_THREAD_ERROR;
-        log_log(params->device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_THREAD_SAFE_RETURNED_0);
-        log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_MARIADB_LIBRARIES_NOT_THREAD_SAFE);
         return NULL;
     }
 
-    if(mysql_thread_init()) {
+    if(sink->thread_init(params)) {
         sql_thread_status = SQL_THREAD_ERROR;
-        log_log(params->device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_THREAD_INIT_ERROR);
-        log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_MARIADB_LIBRARY_ERROR);
         return NULL;
     }
 
     uuid_unparse(params->device_testing_context->device_info.device_uuid, uuid_str);
     memset(&previous_time, 0, sizeof(previous_time));
 
-    while(!params->program_ended) {
-        if(!(mysql = mysql_init(NULL))) {
-            sql_thread_status = SQL_THREAD_ERROR;
-            log_log(params->device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_INIT_ERROR);
-            return sql_thread_cleanup();
-        }
+    if(!(spool_file = params->spool_file)) {
+        snprintf(default_spool_file, sizeof(default_spool_file), "mfst-%s.spool", uuid_str);
+        spool_file = default_spool_file;
+    }
 
-        my_bool reconnect = 1;
-        mysql_optionsv(mysql, MYSQL_OPT_RECONNECT, (void *)&reconnect);
+    if((spool_fd = open(spool_file, O_RDWR | O_CREAT | O_APPEND, 0644)) == -1) {
+        log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SQL_SPOOL_OPEN_ERROR, spool_file, strerror(errno));
+    }
 
+    while(!params->program_ended) {
         sql_thread_status = SQL_THREAD_CONNECTING;
 
-        if(!mysql_real_connect(mysql, params->mysql_host, params->mysql_username, params->mysql_password, params->mysql_db_name, params->mysql_port, NULL, 0)) {
+        if(result = sink->connect(params->device_testing_context)) {
             sql_thread_status = SQL_THREAD_ERROR;
-            log_log(params->device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_REAL_CONNECT_ERROR);
-            mysql_close(mysql);
-            sleep(30);
+            if(result == -1) {
+                return sql_thread_cleanup();
+            }
+
+            sql_thread_wait_for_reconnect();
             continue;
         }
 
@@ -531,14 +352,14 @@ void *sql_thread_main(void *arg) {
             if(params->card_id) {
                 log_log(params->device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_FORCING_CARD_ID, params->card_id);
             } else {
-                if(result = sql_thread_find_card(params->device_testing_context, mysql, &params->card_id)) {
+                if(result = sink->find_card(params->device_testing_context, &params->card_id)) {
                     if(result == -1) {
                         sql_thread_status = SQL_THREAD_ERROR;
                         log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_FIND_CARD_ERROR);
                         return sql_thread_cleanup();
                     } else {
-                        mysql_close(mysql);
-                        sleep(30);
+                        sink->disconnect();
+                        sql_thread_wait_for_reconnect();
                         continue;
                     }
                 }
@@ -551,26 +372,26 @@ void *sql_thread_main(void *arg) {
                     }
 
                     // Register the new card
-                    if(result = sql_thread_insert_card(params->device_testing_context, mysql, params->card_name, &params->card_id)) {
+                    if(result = sink->insert_card(params->device_testing_context, params->card_name, &params->card_id)) {
                         if(result == -1) {
                             sql_thread_status = SQL_THREAD_ERROR;
                             log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_CARD_INSERT_ERROR);
                             return sql_thread_cleanup();
                         } else {
-                            mysql_close(mysql);
-                            sleep(30);
+                            sink->disconnect();
+                            sql_thread_wait_for_reconnect();
                             continue;
                         }
                     }
                 } else {
-                    if(result = sql_thread_update_card(params->device_testing_context, mysql, params->card_id)) {
+                    if(result = sink->update_card(params->device_testing_context, params->card_id)) {
                         if(result == -1) {
                             sql_thread_status = SQL_THREAD_ERROR;
                             log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_CARD_UPDATE_ERROR);
                             return sql_thread_cleanup();
                         } else {
-                            mysql_close(mysql);
-                            sleep(30);
+                            sink->disconnect();
+                            sql_thread_wait_for_reconnect();
                             continue;
                         }
                     }
@@ -583,13 +404,20 @@ void *sql_thread_main(void *arg) {
         }
 
         do {
-            if(result = sql_thread_update_sector_map(params->device_testing_context, mysql, params->card_id)) {
+            if(sql_thread_take_sample(params->device_testing_context, &sample)) {
+                result = -1;
+            } else if(!(result = sql_thread_write_history(sink, params->device_testing_context, params->card_id, spool_fd, &sample))) {
+                sql_thread_build_consolidated_sector_map(params->device_testing_context);
+                result = sink->update_sector_map(params->device_testing_context, params->card_id, &sample, consolidated_sector_map);
+            }
+
+            if(result) {
                 if(result == -1) {
                     sql_thread_status = SQL_THREAD_ERROR;
                     log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_MAP_UPDATE_ERROR);
                     return sql_thread_cleanup();
                 } else {
-                    mysql_close(mysql);
+                    sink->disconnect();
                     break;
                 }
             }
@@ -597,6 +425,6 @@ void *sql_thread_main(void *arg) {
             sleep(30);
         } while(!result && !params->program_ended);
 
-        sleep(30);
+        sql_thread_wait_for_reconnect();
     }
 }
@@ -5,6 +5,14 @@
 
 #include "device_testing_context.h"
 
+// Number of blocks the sector map is divided up into when it gets reported.
+// Each block takes up half a byte.
+#define CONSOLIDATED_SECTOR_MAP_SIZE 10000
+#define CONSOLIDATED_SECTOR_MAP_BYTES ((CONSOLIDATED_SECTOR_MAP_SIZE / 2) + (CONSOLIDATED_SECTOR_MAP_SIZE % 2))
+
+// Maximum number of status samples handed to a reporting sink at once
+#define SQL_HISTORY_ROWS_PER_INSERT 500
+
 typedef enum {
               SQL_THREAD_NOT_CONNECTED = 0, // No attempt to connect has been made
               SQL_THREAD_CONNECTING,
@@ -14,15 +22,90 @@ typedef enum {
               SQL_THREAD_ERROR
 } sql_thread_status_type;
 
+// A snapshot of the stats we report.  This is also the format of the records
+// in the spool file, so don't change it without a good reason.
+typedef struct _sql_sample_type {
+    int64_t sample_time;
+    int64_t cur_round_num;
+    uint64_t num_bad_sectors;
+    int32_t status;
+    double rate;
+    uint64_t total_bytes_read;
+    uint64_t total_bytes_written;
+    double read_rate;
+    double write_rate;
+    double avg_read_latency;   // Average over the last interval, in microseconds
+    double avg_write_latency;  // Average over the last interval, in microseconds
+} sql_sample_type;
+
+struct _sql_thread_params_type;
+
+/**
+ * A backend that the SQL thread reports progress to.  Unless noted otherwise,
+ * each function returns 0 on success, 1 if the connection to the backend was
+ * lost (in which case the SQL thread will disconnect and try again later), or
+ * -1 if any other error occurred (in which case the SQL thread gives up on
+ * reporting altogether).  Sinks are only ever used from the SQL thread.
+ */
+typedef struct _report_sink_type {
+    // Checks the parameters and sets up anything the backend needs before the
+    // first connection.  Returns 0 on success or -1 on error.
+    int (*thread_init)(struct _sql_thread_params_type *params);
+
+    // Disconnects (if needed) and releases anything set up by thread_init().
+    void (*thread_end)();
+
+    // Opens a connection to the backend.
+    int (*connect)(device_testing_context_type *device_testing_context);
+
+    // Closes the connection.  Safe to call if we aren't connected.
+    void (*disconnect)();
+
+    // Looks up the card by its UUID.  Sets *id to 0 if it isn't registered.
+    int (*find_card)(device_testing_context_type *device_testing_context, uint64_t *id);
+
+    // Registers the card and places its new ID in *id.
+    int (*insert_card)(device_testing_context_type *device_testing_context, char *name, uint64_t *id);
+
+    // Updates the size of an already-registered card.
+    int (*update_card)(device_testing_context_type *device_testing_context, uint64_t id);
+
+    // Transaction control for insert_history(), insert_rounds(), and
+    // insert_surface_scan().
+    int (*begin)(device_testing_context_type *device_testing_context);
+    int (*commit)(device_testing_context_type *device_testing_context);
+    void (*rollback)(device_testing_context_type *device_testing_context);
+
+    // Appends samples to the status history.  Samples that have already been
+    // recorded must be ignored.
+    int (*insert_history)(device_testing_context_type *device_testing_context, uint64_t card_id, sql_sample_type *samples, int num_samples);
+
+    // Appends end-of-round summaries to the round history.  Summaries that
+    // have already been recorded must be ignored.
+    int (*insert_rounds)(device_testing_context_type *device_testing_context, uint64_t card_id, round_summary_type *summaries, int num_summaries);
+
+    // Appends the results of a surface scan, one row per region.  Scans that
+    // have already been recorded must be ignored.
+    int (*insert_surface_scan)(device_testing_context_type *device_testing_context, uint64_t card_id, surface_scan_result_type *scan);
+
+    // Replaces the card's current status and consolidated sector map (which is
+    // CONSOLIDATED_SECTOR_MAP_BYTES long).
+    int (*update_sector_map)(device_testing_context_type *device_testing_context, uint64_t card_id, sql_sample_type *sample, uint8_t *map);
+} report_sink_type;
+
 typedef struct _sql_thread_params_type {
+    report_sink_type *sink;
     char *mysql_host;
     char *mysql_username;
     char *mysql_password;
     int mysql_port;
     char *mysql_db_name;
+    char *sqlite_file;
+    char *collector_socket;  // Where to find mfst-collector (NULL for the default)
     char *card_name;
     device_testing_context_type *device_testing_context;
     uint64_t card_id;
+    char *spool_file;    // Where to spool updates while the server is unreachable (NULL for the default)
     volatile int program_ended;
 } sql_thread_params_type;
 
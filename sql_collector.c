@@ -0,0 +1,282 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "collector.h"
+#include "device_testing_context.h"
+#include "messages.h"
+#include "mfst.h"
+#include "sql.h"
+#include "sql_collector.h"
+
+static int collector_fd = -1;
+
+// Path of the collector's socket, saved off by collector_thread_init()
+static char *collector_socket;
+
+static int collector_lost_connection(device_testing_context_type *device_testing_context, const char *funcname, int err) {
+    sql_thread_status = SQL_THREAD_DISCONNECTED;
+    log_log(device_testing_context, funcname, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_LOST_CONNECTION, strerror(err));
+    return 1;
+}
+
+/**
+ * Sends a message to the collector.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param funcname                The name of the calling function.
+ * @param type                    The type of message to send.
+ * @param card_id                 The card the message is about.
+ * @param payload                 The body of the message.
+ * @param length                  The length of the body, in bytes.
+ *
+ * @returns 0 if the message was sent, or 1 if the connection to the collector
+ *          was lost.
+ */
+static int collector_send(device_testing_context_type *device_testing_context, const char *funcname, uint32_t type, uint64_t card_id, void *payload, uint32_t length) {
+    collector_msg_header_type header;
+    struct iovec iov[2];
+    struct msghdr msg;
+    ssize_t ret;
+
+    header.type = type;
+    header.length = length;
+    header.card_id = card_id;
+
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = payload;
+    iov[1].iov_len = length;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+
+    // Messages are small and the collector is always reading, so a short
+    // send is rare -- but it can happen if the socket buffer is full
+    while(msg.msg_iovlen) {
+        if((ret = sendmsg(collector_fd, &msg, MSG_NOSIGNAL)) == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            return collector_lost_connection(device_testing_context, funcname, errno);
+        }
+
+        while(msg.msg_iovlen && ret >= msg.msg_iov[0].iov_len) {
+            ret -= msg.msg_iov[0].iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+
+        if(msg.msg_iovlen) {
+            msg.msg_iov[0].iov_base = (char *) msg.msg_iov[0].iov_base + ret;
+            msg.msg_iov[0].iov_len -= ret;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Sends one of the card registration messages to the collector and waits for
+ * its answer.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param funcname                The name of the calling function.
+ * @param type                    The type of message to send.
+ * @param card_id                 The card the message is about (0 if the card
+ *                                isn't known yet).
+ * @param name                    The name of the card, or NULL.
+ * @param id                      A pointer to a variable which will receive
+ *                                the card ID sent back by the collector, or
+ *                                NULL.
+ *
+ * @returns 0 if the request was successful, 1 if the connection to the
+ *          collector (or the collector's connection to the database) was lost,
+ *          or -1 if the collector was unable to complete the request.
+ */
+static int collector_request(device_testing_context_type *device_testing_context, const char *funcname, uint32_t type, uint64_t card_id, char *name, uint64_t *id) {
+    collector_card_info_type info;
+    collector_reply_type reply;
+    size_t received = 0;
+    ssize_t ret;
+
+    memset(&info, 0, sizeof(info));
+    uuid_copy(info.uuid, device_testing_context->device_info.device_uuid);
+    info.num_physical_sectors = device_testing_context->device_info.num_physical_sectors;
+    info.sector_size = device_testing_context->device_info.sector_size;
+    if(name) {
+        snprintf(info.name, sizeof(info.name), "%s", name);
+    }
+
+    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
+
+    if(ret = collector_send(device_testing_context, funcname, type, card_id, &info, sizeof(info))) {
+        return ret;
+    }
+
+    while(received < sizeof(reply)) {
+        if((ret = recv(collector_fd, (char *) &reply + received, sizeof(reply) - received, 0)) == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            return collector_lost_connection(device_testing_context, funcname, errno);
+        } else if(!ret) {
+            return collector_lost_connection(device_testing_context, funcname, ECONNRESET);
+        }
+
+        received += ret;
+    }
+
+    if(reply.result == 1) {
+        sql_thread_status = SQL_THREAD_DISCONNECTED;
+        return 1;
+    } else if(reply.result) {
+        sql_thread_status = SQL_THREAD_ERROR;
+        log_log(device_testing_context, funcname, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_REQUEST_FAILED);
+        return -1;
+    }
+
+    if(id) {
+        *id = reply.card_id;
+    }
+
+    sql_thread_status = SQL_THREAD_CONNECTED;
+    return 0;
+}
+
+static int collector_thread_init(sql_thread_params_type *params) {
+    collector_socket = params->collector_socket ? params->collector_socket : COLLECTOR_DEFAULT_SOCKET;
+    return 0;
+}
+
+static void collector_disconnect() {
+    if(collector_fd != -1) {
+        close(collector_fd);
+        collector_fd = -1;
+    }
+}
+
+static void collector_thread_end() {
+    collector_disconnect();
+}
+
+static int collector_connect(device_testing_context_type *device_testing_context) {
+    struct sockaddr_un addr;
+
+    if(strlen(collector_socket) >= sizeof(addr.sun_path)) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_CONNECT_ERROR, collector_socket, strerror(ENAMETOOLONG));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, collector_socket);
+
+    if((collector_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_CONNECT_ERROR, collector_socket, strerror(errno));
+        return -1;
+    }
+
+    if(connect(collector_fd, (struct sockaddr *) &addr, sizeof(addr)) == -1) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_COLLECTOR_CONNECT_ERROR, collector_socket, strerror(errno));
+        collector_disconnect();
+        return 1;
+    }
+
+    return 0;
+}
+
+static int collector_find_card(device_testing_context_type *device_testing_context, uint64_t *id) {
+    return collector_request(device_testing_context, __func__, COLLECTOR_MSG_FIND_CARD, 0, NULL, id);
+}
+
+static int collector_insert_card(device_testing_context_type *device_testing_context, char *name, uint64_t *id) {
+    int ret;
+
+    if(!(ret = collector_request(device_testing_context, __func__, COLLECTOR_MSG_INSERT_CARD, 0, name, id))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_CARD_REGISTERED, *id);
+    }
+
+    return ret;
+}
+
+static int collector_update_card(device_testing_context_type *device_testing_context, uint64_t id) {
+    return collector_request(device_testing_context, __func__, COLLECTOR_MSG_UPDATE_CARD, id, NULL, NULL);
+}
+
+// The collector batches everything up into its own transactions, so there's
+// nothing to do here
+static int collector_begin(device_testing_context_type *device_testing_context) {
+    return 0;
+}
+
+static int collector_commit(device_testing_context_type *device_testing_context) {
+    return 0;
+}
+
+static void collector_rollback(device_testing_context_type *device_testing_context) {
+}
+
+static int collector_insert_history(device_testing_context_type *device_testing_context, uint64_t card_id, sql_sample_type *samples, int num_samples) {
+    int offset, count, ret;
+
+    for(offset = 0; offset < num_samples; offset += count) {
+        count = num_samples - offset;
+        if(count > SQL_HISTORY_ROWS_PER_INSERT) {
+            count = SQL_HISTORY_ROWS_PER_INSERT;
+        }
+
+        if(ret = collector_send(device_testing_context, __func__, COLLECTOR_MSG_SAMPLES, card_id, samples + offset, count * sizeof(sql_sample_type))) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static int collector_insert_rounds(device_testing_context_type *device_testing_context, uint64_t card_id, round_summary_type *summaries, int num_summaries) {
+    return collector_send(device_testing_context, __func__, COLLECTOR_MSG_ROUNDS, card_id, summaries, num_summaries * sizeof(round_summary_type));
+}
+
+static int collector_insert_surface_scan(device_testing_context_type *device_testing_context, uint64_t card_id, surface_scan_result_type *scan) {
+    return collector_send(device_testing_context, __func__, COLLECTOR_MSG_SURFACE_SCAN, card_id, scan, sizeof(surface_scan_result_type));
+}
+
+static int collector_update_sector_map(device_testing_context_type *device_testing_context, uint64_t card_id, sql_sample_type *sample, uint8_t *map) {
+    static collector_sector_map_type update;
+    int ret;
+
+    memcpy(&update.sample, sample, sizeof(update.sample));
+    memcpy(update.map, map, sizeof(update.map));
+
+    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
+    if(ret = collector_send(device_testing_context, __func__, COLLECTOR_MSG_SECTOR_MAP, card_id, &update, sizeof(update))) {
+        return ret;
+    }
+
+    sql_thread_status = SQL_THREAD_CONNECTED;
+    return 0;
+}
+
+report_sink_type collector_report_sink = {
+    .thread_init = collector_thread_init,
+    .thread_end = collector_thread_end,
+    .connect = collector_connect,
+    .disconnect = collector_disconnect,
+    .find_card = collector_find_card,
+    .insert_card = collector_insert_card,
+    .update_card = collector_update_card,
+    .begin = collector_begin,
+    .commit = collector_commit,
+    .rollback = collector_rollback,
+    .insert_history = collector_insert_history,
+    .insert_rounds = collector_insert_rounds,
+    .insert_surface_scan = collector_insert_surface_scan,
+    .update_sector_map = collector_update_sector_map
+};
@@ -0,0 +1,14 @@
+#if !defined(SQL_COLLECTOR_H)
+#define SQL_COLLECTOR_H
+
+#include "sql.h"
+
+/**
+ * A reporting sink that hands progress updates to a local mfst-collector
+ * process over a Unix domain socket, using the socket path passed in the SQL
+ * thread's parameters.  The collector batches updates from many instances
+ * together before writing them to the database.
+ */
+extern report_sink_type collector_report_sink;
+
+#endif // !defined(SQL_COLLECTOR_H)
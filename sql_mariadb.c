@@ -0,0 +1,806 @@
+#include "config.h"
+#include "sql_mariadb.h"
+
+#if defined(HAVE_MARIADB)
+
+#include <errno.h>
+#include <mariadb/errmsg.h>
+#include <mariadb/mysql.h>
+#include <mariadb/mysqld_error.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "device_testing_context.h"
+#include "messages.h"
+#include "mfst.h"
+#include "sql.h"
+
+// Number of changed regions of the consolidated sector map that get patched by
+// a single execution of the partial update statement
+#define SQL_MAP_RANGES_PER_STATEMENT 8
+
+// Changed regions that are closer together than this are sent as one region,
+// since the unchanged bytes in between are cheaper than another set of params
+#define SQL_MAP_RANGE_MERGE_GAP 32
+
+// If more regions than this have changed (e.g., at the start of a new round),
+// it's cheaper to just send the whole map
+#define SQL_MAP_MAX_RANGES (SQL_MAP_RANGES_PER_STATEMENT * 4)
+
+static MYSQL *mysql;
+
+// Connection details, saved off by mariadb_thread_init()
+static sql_thread_params_type *mariadb_params;
+
+// Prepared statements are kept for as long as the connection stays up, so that
+// they don't have to be re-prepared every time the map is updated
+static MYSQL_STMT *full_update_stmt;
+static MYSQL_STMT *partial_update_stmt;
+
+// The copy of the consolidated sector map that the server has as of the last
+// successful update, and the card it belongs to (mfst-collector uses the same
+// connection for many cards)
+static uint8_t last_sent_sector_map[CONSOLIDATED_SECTOR_MAP_BYTES];
+static uint64_t last_sent_card_id;
+static int last_sent_sector_map_valid;
+
+static int mariadb_is_connection_error(int result) {
+    return
+        result == CR_SERVER_GONE_ERROR ||
+        result == CR_SERVER_LOST ||
+        result == ER_CONNECTION_KILLED ||
+        result == CR_CONN_HOST_ERROR ||
+        result == CR_CONNECTION_ERROR ||
+        // If the client library reconnected behind our back, our prepared
+        // statements are gone -- treat it as a disconnect so that they get
+        // prepared again
+        result == ER_UNKNOWN_STMT_HANDLER;
+}
+
+/**
+ * Logs an error returned by a prepared statement and updates the SQL thread
+ * status accordingly.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param stmt                    The statement that returned the error.
+ * @param funcname                The name of the function that got the error.
+ * @param msg                     The message to log if the error was not a
+ *                                connection error.
+ *
+ * @returns 1 if the error indicates that we lost our connection to the server,
+ *          or -1 otherwise.
+ */
+static int mariadb_stmt_error(device_testing_context_type *device_testing_context, MYSQL_STMT *stmt, const char *funcname, int msg) {
+    if(mariadb_is_connection_error(mysql_stmt_errno(stmt))) {
+        sql_thread_status = SQL_THREAD_DISCONNECTED;
+        log_log(device_testing_context, funcname, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
+        return 1;
+    }
+
+    sql_thread_status = SQL_THREAD_ERROR;
+    log_log(device_testing_context, funcname, SEVERITY_LEVEL_DEBUG, msg, mysql_stmt_error(stmt));
+    return -1;
+}
+
+/**
+ * Same as mariadb_stmt_error(), but for errors returned by the connection
+ * itself rather than by a prepared statement.
+ */
+static int mariadb_conn_error(device_testing_context_type *device_testing_context, const char *funcname, int msg) {
+    if(mariadb_is_connection_error(mysql_errno(mysql))) {
+        sql_thread_status = SQL_THREAD_DISCONNECTED;
+        log_log(device_testing_context, funcname, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
+        return 1;
+    }
+
+    sql_thread_status = SQL_THREAD_ERROR;
+    log_log(device_testing_context, funcname, SEVERITY_LEVEL_DEBUG, msg, mysql_error(mysql));
+    return -1;
+}
+
+/**
+ * Closes the prepared statements used to update the consolidated sector map.
+ * Must be called before the connection they were prepared on is closed.  The
+ * next update after the statements are prepared again will send the full map.
+ */
+static void mariadb_close_statements() {
+    if(full_update_stmt) {
+        mysql_stmt_close(full_update_stmt);
+        full_update_stmt = NULL;
+    }
+
+    if(partial_update_stmt) {
+        mysql_stmt_close(partial_update_stmt);
+        partial_update_stmt = NULL;
+    }
+
+    last_sent_sector_map_valid = 0;
+}
+
+/**
+ * Prepares the statements used to update the consolidated sector map.
+ *
+ * The partial update statement patches up to SQL_MAP_RANGES_PER_STATEMENT
+ * regions of the map in place using nested calls to INSERT().  Each region
+ * takes three parameters: its (1-based) position, its length, and the new data.
+ * Regions that aren't needed are given a position of 0, which causes INSERT()
+ * to leave the map alone.
+ *
+ * @param device_testing_context  The device being tested.
+ *
+ * @returns 0 if the statements were prepared successfully, 1 if the connection
+ *          to the server was lost, or -1 if any other error occurred.
+ */
+static int mariadb_prepare_statements(device_testing_context_type *device_testing_context) {
+    const char *full_update_query = "INSERT INTO consolidated_sector_maps (id, consolidated_sector_map, last_updated, cur_round_num, num_bad_sectors, status, rate) VALUES (?, ?, ?, ?, ?, ?, ?) ON DUPLICATE KEY UPDATE consolidated_sector_map=VALUES(consolidated_sector_map), last_updated=VALUES(last_updated), cur_round_num=VALUES(cur_round_num), num_bad_sectors=VALUES(num_bad_sectors), status=VALUES(status), rate=VALUES(rate)";
+    char partial_update_query[512];
+    int i, len, ret;
+
+    len = snprintf(partial_update_query, sizeof(partial_update_query), "UPDATE consolidated_sector_maps SET consolidated_sector_map=");
+    for(i = 0; i < SQL_MAP_RANGES_PER_STATEMENT; i++) {
+        len += snprintf(partial_update_query + len, sizeof(partial_update_query) - len, "INSERT(");
+    }
+
+    len += snprintf(partial_update_query + len, sizeof(partial_update_query) - len, "consolidated_sector_map");
+    for(i = 0; i < SQL_MAP_RANGES_PER_STATEMENT; i++) {
+        len += snprintf(partial_update_query + len, sizeof(partial_update_query) - len, ", ?, ?, ?)");
+    }
+
+    len += snprintf(partial_update_query + len, sizeof(partial_update_query) - len, ", last_updated=?, cur_round_num=?, num_bad_sectors=?, status=?, rate=? WHERE id=?");
+
+    if(!(full_update_stmt = mysql_stmt_init(mysql)) || !(partial_update_stmt = mysql_stmt_init(mysql))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_INIT_ERROR, mysql_error(mysql));
+        mariadb_close_statements();
+        return -1;
+    }
+
+    if(mysql_stmt_prepare(full_update_stmt, full_update_query, strlen(full_update_query))) {
+        ret = mariadb_stmt_error(device_testing_context, full_update_stmt, __func__, MSG_MYSQL_STMT_PREPARE_ERROR);
+        mariadb_close_statements();
+        return ret;
+    }
+
+    if(mysql_stmt_prepare(partial_update_stmt, partial_update_query, len)) {
+        ret = mariadb_stmt_error(device_testing_context, partial_update_stmt, __func__, MSG_MYSQL_STMT_PREPARE_ERROR);
+        mariadb_close_statements();
+        return ret;
+    }
+
+    sql_thread_status = SQL_THREAD_CONNECTED;
+    return 0;
+}
+
+/**
+ * Compares the consolidated sector map against the copy that was last sent to
+ * the server and builds a list of the regions that have changed.  Regions that
+ * are within SQL_MAP_RANGE_MERGE_GAP bytes of each other are merged.
+ *
+ * @param map      The new consolidated sector map.
+ * @param starts   An array of at least SQL_MAP_MAX_RANGES elements that will
+ *                 receive the starting offset of each changed region.
+ * @param lengths  An array of at least SQL_MAP_MAX_RANGES elements that will
+ *                 receive the length of each changed region.
+ *
+ * @returns The number of changed regions, or -1 if more than
+ *          SQL_MAP_MAX_RANGES regions have changed.
+ */
+static int mariadb_find_changed_ranges(uint8_t *map, uint64_t *starts, unsigned long *lengths) {
+    int num_ranges = 0;
+    uint64_t i;
+
+    for(i = 0; i < CONSOLIDATED_SECTOR_MAP_BYTES; i++) {
+        if(map[i] == last_sent_sector_map[i]) {
+            continue;
+        }
+
+        if(num_ranges && (i - (starts[num_ranges - 1] + lengths[num_ranges - 1])) <= SQL_MAP_RANGE_MERGE_GAP) {
+            lengths[num_ranges - 1] = i + 1 - starts[num_ranges - 1];
+        } else {
+            if(num_ranges == SQL_MAP_MAX_RANGES) {
+                return -1;
+            }
+
+            starts[num_ranges] = i;
+            lengths[num_ranges] = 1;
+            num_ranges++;
+        }
+    }
+
+    return num_ranges;
+}
+
+/**
+ * Updates the card's row in the consolidated_sector_maps table.  The first
+ * update on a connection sends the whole map.  After that, only the regions of
+ * the map that changed since the last update are sent, unless so much of the
+ * map has changed that it's cheaper to send the whole thing again.
+ */
+static int mariadb_update_sector_map(device_testing_context_type *device_testing_context, uint64_t card_id, sql_sample_type *sample, uint8_t *map) {
+    char indicator;
+
+    MYSQL_BIND bind_params[(SQL_MAP_RANGES_PER_STATEMENT * 3) + 6];
+    MYSQL_BIND *stats_params;
+    uint64_t range_starts[SQL_MAP_MAX_RANGES];
+    unsigned long range_lengths[SQL_MAP_MAX_RANGES];
+    uint64_t positions[SQL_MAP_RANGES_PER_STATEMENT];
+    uint64_t lengths[SQL_MAP_RANGES_PER_STATEMENT];
+    unsigned long blob_lengths[SQL_MAP_RANGES_PER_STATEMENT];
+    unsigned long full_map_length = CONSOLIDATED_SECTOR_MAP_BYTES;
+    int num_ranges = -1, first_range, k, in_transaction = 0;
+    int ret;
+
+    if(!full_update_stmt && (ret = mariadb_prepare_statements(device_testing_context))) {
+        return ret;
+    }
+
+    if(last_sent_sector_map_valid && last_sent_card_id == card_id) {
+        num_ranges = mariadb_find_changed_ranges(map, range_starts, range_lengths);
+    }
+
+    memset(bind_params, 0, sizeof(bind_params));
+    indicator = STMT_INDICATOR_NONE;
+
+    if(num_ranges == -1) {
+        // Either this is the first update on this connection, or so much of the
+        // map has changed that patching it isn't worth it -- send the whole
+        // thing
+        bind_params[0].buffer_type = MYSQL_TYPE_LONGLONG;
+        bind_params[0].buffer = &card_id;
+        bind_params[0].buffer_length = sizeof(card_id);
+        bind_params[0].u.indicator = &indicator;
+        bind_params[0].is_unsigned = 1;
+
+        bind_params[1].buffer_type = MYSQL_TYPE_BLOB;
+        bind_params[1].buffer = map;
+        bind_params[1].buffer_length = CONSOLIDATED_SECTOR_MAP_BYTES;
+        bind_params[1].length = &full_map_length;
+        bind_params[1].u.indicator = &indicator;
+
+        stats_params = &bind_params[2];
+    } else {
+        stats_params = &bind_params[SQL_MAP_RANGES_PER_STATEMENT * 3];
+    }
+
+    stats_params[0].buffer_type = MYSQL_TYPE_LONGLONG;
+    stats_params[0].buffer = &sample->sample_time;
+    stats_params[0].buffer_length = sizeof(sample->sample_time);
+    stats_params[0].is_unsigned = 1;
+
+    stats_params[1].buffer_type = MYSQL_TYPE_LONGLONG;
+    stats_params[1].buffer = &sample->cur_round_num;
+    stats_params[1].buffer_length = sizeof(sample->cur_round_num);
+
+    stats_params[2].buffer_type = MYSQL_TYPE_LONGLONG;
+    stats_params[2].buffer = &sample->num_bad_sectors;
+    stats_params[2].buffer_length = sizeof(sample->num_bad_sectors);
+    stats_params[2].is_unsigned = 1;
+
+    stats_params[3].buffer_type = MYSQL_TYPE_LONG;
+    stats_params[3].buffer = &sample->status;
+    stats_params[3].buffer_length = sizeof(sample->status);
+
+    stats_params[4].buffer_type = MYSQL_TYPE_DOUBLE;
+    stats_params[4].buffer = &sample->rate;
+    stats_params[4].buffer_length = sizeof(sample->rate);
+
+    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
+
+    if(num_ranges == -1) {
+        if(mysql_stmt_bind_param(full_update_stmt, bind_params)) {
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_PARAM_ERROR, mysql_stmt_error(full_update_stmt));
+            return -1;
+        }
+
+        if(mysql_stmt_execute(full_update_stmt)) {
+            return mariadb_stmt_error(device_testing_context, full_update_stmt, __func__, MSG_MYSQL_STMT_EXECUTE_ERROR);
+        }
+
+        memcpy(last_sent_sector_map, map, sizeof(last_sent_sector_map));
+        last_sent_card_id = card_id;
+        last_sent_sector_map_valid = 1;
+        sql_thread_status = SQL_THREAD_CONNECTED;
+        return 0;
+    }
+
+    stats_params[5].buffer_type = MYSQL_TYPE_LONGLONG;
+    stats_params[5].buffer = &card_id;
+    stats_params[5].buffer_length = sizeof(card_id);
+    stats_params[5].is_unsigned = 1;
+
+    // If it takes more than one statement to patch everything, do it all in
+    // one transaction so that nobody sees a half-updated map
+    if(num_ranges > SQL_MAP_RANGES_PER_STATEMENT) {
+        if(mysql_autocommit(mysql, 0)) {
+            return mariadb_conn_error(device_testing_context, __func__, MSG_MYSQL_TRANSACTION_ERROR);
+        }
+
+        in_transaction = 1;
+    }
+
+    // Even if nothing in the map changed, this still runs once to update the
+    // stats
+    first_range = 0;
+    do {
+        for(k = 0; k < SQL_MAP_RANGES_PER_STATEMENT; k++) {
+            if(first_range + k < num_ranges) {
+                positions[k] = range_starts[first_range + k] + 1;
+                lengths[k] = range_lengths[first_range + k];
+                blob_lengths[k] = range_lengths[first_range + k];
+            } else {
+                positions[k] = 0;
+                lengths[k] = 0;
+                blob_lengths[k] = 0;
+            }
+
+            bind_params[k * 3].buffer_type = MYSQL_TYPE_LONGLONG;
+            bind_params[k * 3].buffer = &positions[k];
+            bind_params[k * 3].buffer_length = sizeof(positions[k]);
+            bind_params[k * 3].is_unsigned = 1;
+
+            bind_params[(k * 3) + 1].buffer_type = MYSQL_TYPE_LONGLONG;
+            bind_params[(k * 3) + 1].buffer = &lengths[k];
+            bind_params[(k * 3) + 1].buffer_length = sizeof(lengths[k]);
+            bind_params[(k * 3) + 1].is_unsigned = 1;
+
+            bind_params[(k * 3) + 2].buffer_type = MYSQL_TYPE_BLOB;
+            bind_params[(k * 3) + 2].buffer = map + (positions[k] ? range_starts[first_range + k] : 0);
+            bind_params[(k * 3) + 2].buffer_length = blob_lengths[k];
+            bind_params[(k * 3) + 2].length = &blob_lengths[k];
+        }
+
+        if(mysql_stmt_bind_param(partial_update_stmt, bind_params)) {
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_PARAM_ERROR, mysql_stmt_error(partial_update_stmt));
+            ret = -1;
+            break;
+        }
+
+        if(mysql_stmt_execute(partial_update_stmt)) {
+            ret = mariadb_stmt_error(device_testing_context, partial_update_stmt, __func__, MSG_MYSQL_STMT_EXECUTE_ERROR);
+            break;
+        }
+
+        // If the row has disappeared out from under us, put it back on the
+        // next update
+        if(!mysql_stmt_affected_rows(partial_update_stmt)) {
+            last_sent_sector_map_valid = 0;
+        }
+
+        ret = 0;
+        first_range += SQL_MAP_RANGES_PER_STATEMENT;
+    } while(first_range < num_ranges);
+
+    if(in_transaction) {
+        if(ret) {
+            mysql_rollback(mysql);
+        } else if(mysql_commit(mysql)) {
+            ret = mariadb_conn_error(device_testing_context, __func__, MSG_MYSQL_TRANSACTION_ERROR);
+        }
+
+        mysql_autocommit(mysql, 1);
+    }
+
+    if(ret) {
+        return ret;
+    }
+
+    if(last_sent_sector_map_valid) {
+        memcpy(last_sent_sector_map, map, sizeof(last_sent_sector_map));
+    }
+
+    sql_thread_status = SQL_THREAD_CONNECTED;
+    return 0;
+}
+
+static int mariadb_insert_card(device_testing_context_type *device_testing_context, char *name, uint64_t *id) {
+    const char *insert_query = "INSERT INTO cards (name, uuid, size, sector_size) VALUES (?, ?, ?, ?)";
+    MYSQL_STMT *stmt;
+    MYSQL_BIND bind_params[4];
+    char indicator;
+    char uuid_str[37];
+    int result;
+
+    uuid_unparse(device_testing_context->device_info.device_uuid, uuid_str);
+
+    if(!(stmt = mysql_stmt_init(mysql))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_INIT_ERROR, mysql_error(mysql));
+        return -1;
+    }
+
+    if(mysql_stmt_prepare(stmt, insert_query, strlen(insert_query))) {
+        result = mysql_stmt_errno(stmt);
+        if(mariadb_is_connection_error(result)) {
+            sql_thread_status = SQL_THREAD_DISCONNECTED;
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
+            result = 1;
+        } else {
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_PREPARE_ERROR, mysql_stmt_error(stmt));
+            result = -1;
+        }
+
+        mysql_stmt_close(stmt);
+        return result;
+    }
+
+    memset(bind_params, 0, sizeof(bind_params));
+
+    bind_params[0].buffer_type = MYSQL_TYPE_STRING;
+    bind_params[0].buffer = name;
+    bind_params[0].buffer_length = strlen(name);
+    indicator = STMT_INDICATOR_NTS;
+    bind_params[0].u.indicator = &indicator;
+
+    bind_params[1].buffer_type = MYSQL_TYPE_STRING;
+    bind_params[1].buffer = uuid_str;
+    bind_params[1].buffer_length = strlen(uuid_str);
+    bind_params[1].u.indicator = &indicator;
+
+    bind_params[2].buffer_type = MYSQL_TYPE_LONGLONG;
+    bind_params[2].buffer = &device_testing_context->device_info.num_physical_sectors;
+    bind_params[2].buffer_length = sizeof(device_testing_context->device_info.num_physical_sectors);
+    bind_params[2].is_unsigned = 1;
+
+    bind_params[3].buffer_type = MYSQL_TYPE_LONG;
+    bind_params[3].buffer = &device_testing_context->device_info.sector_size;
+    bind_params[3].buffer_length = sizeof(device_testing_context->device_info.sector_size);
+    bind_params[3].is_unsigned = 0;
+
+    if(mysql_stmt_bind_param(stmt, bind_params)) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_PARAM_ERROR, mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return -1;
+    }
+
+    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
+
+    if(mysql_stmt_execute(stmt)) {
+        result = mysql_stmt_errno(stmt);
+        if(mariadb_is_connection_error(result)) {
+            sql_thread_status = SQL_THREAD_DISCONNECTED;
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
+            result = 1;
+        } else {
+            sql_thread_status = SQL_THREAD_ERROR;
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_EXECUTE_ERROR, mysql_stmt_error(stmt));
+            result = -1;
+        }
+
+        mysql_stmt_close(stmt);
+        return result;
+    }
+
+    *id = mysql_stmt_insert_id(stmt);
+    mysql_stmt_close(stmt);
+
+    sql_thread_status = SQL_THREAD_CONNECTED;
+
+    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_CARD_REGISTERED, *id);
+
+    return 0;
+}
+
+static int mariadb_find_card(device_testing_context_type *device_testing_context, uint64_t *id) {
+    MYSQL_STMT *stmt;
+    MYSQL_BIND bind_params[2];
+    char uuid_str[37];
+    char indicator;
+    my_bool is_error, is_null;
+    int result;
+
+    const char *find_card_query = "SELECT id FROM cards WHERE uuid=?";
+    
+    // Does the card already exist in the database?
+    uuid_unparse(device_testing_context->device_info.device_uuid, uuid_str);
+
+    if(!(stmt = mysql_stmt_init(mysql))) {
+        sql_thread_status = SQL_THREAD_ERROR;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_INIT_ERROR, mysql_error(mysql));
+        return -1;
+    }
+
+    if(mysql_stmt_prepare(stmt, find_card_query, strlen(find_card_query))) {
+        result = mysql_stmt_errno(stmt);
+        if(mariadb_is_connection_error(result)) {
+            sql_thread_status = SQL_THREAD_DISCONNECTED;
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
+            result = 1;
+        } else {
+            sql_thread_status = SQL_THREAD_ERROR;
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_PREPARE_ERROR, mysql_stmt_error(stmt));
+            result = -1;
+        }
+
+        mysql_stmt_close(stmt);
+        return result;
+    }
+
+    memset(bind_params, 0, sizeof(bind_params));
+
+    // Use bind_params[0] for the input bind and bind_params[1] for the output bind
+    bind_params[0].buffer_type = MYSQL_TYPE_STRING;
+    bind_params[0].buffer = uuid_str;
+    bind_params[0].buffer_length = strlen(uuid_str);
+    indicator = STMT_INDICATOR_NTS;
+    bind_params[0].u.indicator = &indicator;
+
+    bind_params[1].buffer_type = MYSQL_TYPE_LONGLONG;
+    bind_params[1].buffer = id;
+    bind_params[1].buffer_length = sizeof(*id);
+    bind_params[1].error = &is_error;
+    bind_params[1].is_null = &is_null;
+    bind_params[1].is_unsigned = 1;
+
+    if(mysql_stmt_bind_param(stmt, bind_params)) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_PARAM_ERROR, mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return -1;
+    }
+
+    if(mysql_stmt_bind_result(stmt, bind_params + 1)) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_RESULT_ERROR, mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return -1;
+    }
+
+    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
+    if(mysql_stmt_execute(stmt)) {
+        result = mysql_stmt_errno(stmt);
+        if(mariadb_is_connection_error(result)) {
+            sql_thread_status = SQL_THREAD_DISCONNECTED;
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
+            result = 1;
+        } else {
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_EXECUTE_ERROR, mysql_stmt_error(stmt));
+            result = -1;
+        }
+
+        mysql_stmt_close(stmt);
+        return result;
+    }
+
+    result = mysql_stmt_fetch(stmt);
+    mysql_stmt_free_result(stmt);
+    mysql_stmt_close(stmt);
+
+    sql_thread_status = SQL_THREAD_CONNECTED;
+
+    if(result == MYSQL_NO_DATA) {
+        *id = 0ULL;
+    }
+
+    return 0;
+}
+
+static int mariadb_update_card(device_testing_context_type *device_testing_context, uint64_t id) {
+    MYSQL_STMT *stmt;
+    MYSQL_BIND bind_params[3];
+    int result;
+
+    const char *update_query = "UPDATE cards SET size=?, sector_size=? WHERE id=?";
+
+    if(!(stmt = mysql_stmt_init(mysql))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_INIT_ERROR, mysql_error(mysql));
+        return -1;
+    }
+
+    if(mysql_stmt_prepare(stmt, update_query, strlen(update_query))) {
+        result = mysql_stmt_errno(stmt);
+        if(mariadb_is_connection_error(result)) {
+            sql_thread_status = SQL_THREAD_DISCONNECTED;
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
+            result = 1;
+        } else {
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_PREPARE_ERROR, mysql_stmt_error(stmt));
+            result = -1;
+        }
+
+        mysql_stmt_close(stmt);
+        return result;
+    }
+
+    memset(bind_params, 0, sizeof(bind_params));
+
+    bind_params[0].buffer_type = MYSQL_TYPE_LONGLONG;
+    bind_params[0].buffer = &device_testing_context->device_info.num_physical_sectors;
+    bind_params[0].buffer_length = sizeof(device_testing_context->device_info.num_physical_sectors);
+    bind_params[0].is_unsigned = 1;
+
+    bind_params[1].buffer_type = MYSQL_TYPE_LONG;
+    bind_params[1].buffer = &device_testing_context->device_info.sector_size;
+    bind_params[1].buffer_length = sizeof(device_testing_context->device_info.sector_size);
+    bind_params[1].is_unsigned = 0;
+
+    bind_params[2].buffer_type = MYSQL_TYPE_LONGLONG;
+    bind_params[2].buffer = &id;
+    bind_params[2].buffer_length = sizeof(id);
+    bind_params[2].is_unsigned = 1;
+
+    if(mysql_stmt_bind_param(stmt, bind_params)) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_BIND_PARAM_ERROR, mysql_stmt_error(stmt));
+        mysql_stmt_close(stmt);
+        return -1;
+    }
+
+    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
+    if(mysql_stmt_execute(stmt)) {
+        result = mysql_stmt_errno(stmt);
+        if(mariadb_is_connection_error(result)) {
+            sql_thread_status = SQL_THREAD_DISCONNECTED;
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_LOST_CONNECTION);
+            result = 1;
+        } else {
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_STMT_EXECUTE_ERROR, mysql_stmt_error(stmt));
+            result = -1;
+        }
+
+        mysql_stmt_close(stmt);
+        return result;
+    }
+
+    sql_thread_status = SQL_THREAD_CONNECTED;
+
+    return 0;
+}
+
+static int mariadb_insert_history(device_testing_context_type *device_testing_context, uint64_t card_id, sql_sample_type *samples, int num_samples) {
+    char *query;
+    size_t query_size = (num_samples * 256) + 512;
+    int i, len, ret = 0;
+
+    if(!(query = malloc(query_size))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MALLOC_ERROR, strerror(errno));
+        return -1;
+    }
+
+    len = snprintf(query, query_size, "INSERT IGNORE INTO status_history (id, sample_time, cur_round_num, num_bad_sectors, status, rate, total_bytes_read, total_bytes_written, read_rate, write_rate, avg_read_latency, avg_write_latency) VALUES ");
+    for(i = 0; i < num_samples; i++) {
+        len += snprintf(query + len, query_size - len, "%s(%lu, %ld, %ld, %lu, %d, %.17g, %lu, %lu, %.17g, %.17g, %.17g, %.17g)", i ? ", " : "", card_id, samples[i].sample_time, samples[i].cur_round_num, samples[i].num_bad_sectors, samples[i].status, samples[i].rate,
+                        samples[i].total_bytes_read, samples[i].total_bytes_written, samples[i].read_rate, samples[i].write_rate, samples[i].avg_read_latency, samples[i].avg_write_latency);
+    }
+
+    if(mysql_real_query(mysql, query, len)) {
+        ret = mariadb_conn_error(device_testing_context, __func__, MSG_MYSQL_QUERY_ERROR);
+    }
+
+    free(query);
+    return ret;
+}
+
+static int mariadb_insert_rounds(device_testing_context_type *device_testing_context, uint64_t card_id, round_summary_type *summaries, int num_summaries) {
+    char query[(ROUND_HISTORY_SIZE * 256) + 512];
+    int i, len;
+
+    len = snprintf(query, sizeof(query), "INSERT IGNORE INTO round_history (id, round_num, end_time, num_bad_sectors_this_round, num_new_bad_sectors_this_round, num_good_sectors_this_round, total_bad_sectors, total_bytes_read, total_bytes_written) VALUES ");
+    for(i = 0; i < num_summaries; i++) {
+        len += snprintf(query + len, sizeof(query) - len, "%s(%lu, %lu, %ld, %lu, %lu, %lu, %lu, %lu, %lu)", i ? ", " : "", card_id, summaries[i].round_num, summaries[i].end_time, summaries[i].num_bad_sectors_this_round,
+                        summaries[i].num_new_bad_sectors_this_round, summaries[i].num_good_sectors_this_round, summaries[i].total_bad_sectors, summaries[i].total_bytes_read, summaries[i].total_bytes_written);
+    }
+
+    if(mysql_real_query(mysql, query, len)) {
+        return mariadb_conn_error(device_testing_context, __func__, MSG_MYSQL_QUERY_ERROR);
+    }
+
+    return 0;
+}
+
+static int mariadb_insert_surface_scan(device_testing_context_type *device_testing_context, uint64_t card_id, surface_scan_result_type *scan) {
+    char *query;
+    size_t query_size = (scan->num_regions * 256) + 512;
+    int i, len, ret = 0;
+
+    if(!(query = malloc(query_size))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MALLOC_ERROR, strerror(errno));
+        return -1;
+    }
+
+    len = snprintf(query, query_size, "INSERT IGNORE INTO surface_scans (id, scan_num, region_num, round_num, end_time, region_offset, read_rate, avg_latency, max_latency, read_errors) VALUES ");
+    for(i = 0; i < scan->num_regions; i++) {
+        len += snprintf(query + len, query_size - len, "%s(%lu, %lu, %d, %lu, %ld, %lu, %.17g, %lu, %lu, %lu)", i ? ", " : "", card_id, scan->scan_num, i, scan->round_num, scan->end_time, i * scan->region_size,
+                        scan->regions[i].read_rate, scan->regions[i].avg_latency, scan->regions[i].max_latency, scan->regions[i].read_errors);
+    }
+
+    if(mysql_real_query(mysql, query, len)) {
+        ret = mariadb_conn_error(device_testing_context, __func__, MSG_MYSQL_QUERY_ERROR);
+    }
+
+    free(query);
+    return ret;
+}
+
+static int mariadb_thread_init(sql_thread_params_type *params) {
+    if(!params->mysql_host || !params->mysql_username || !params->mysql_password || !params->mysql_port || !params->mysql_db_name) {
+        log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SQL_THREAD_REQUIRED_PARAM_MISSING);
+        return -1;
+    }
+
+    if(!mysql_thread_safe()) {
+        log_log(params->device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_THREAD_SAFE_RETURNED_0);
+        log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_MARIADB_LIBRARIES_NOT_THREAD_SAFE);
+        return -1;
+    }
+
+    if(mysql_thread_init()) {
+        log_log(params->device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_THREAD_INIT_ERROR);
+        log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_MARIADB_LIBRARY_ERROR);
+        return -1;
+    }
+
+    mariadb_params = params;
+    return 0;
+}
+
+static void mariadb_disconnect() {
+    if(mysql) {
+        mariadb_close_statements();
+        mysql_close(mysql);
+        mysql = NULL;
+    }
+}
+
+static void mariadb_thread_end() {
+    mariadb_disconnect();
+    mysql_thread_end();
+}
+
+static int mariadb_connect(device_testing_context_type *device_testing_context) {
+    my_bool reconnect = 1;
+
+    if(!(mysql = mysql_init(NULL))) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_INIT_ERROR);
+        return -1;
+    }
+
+    mysql_optionsv(mysql, MYSQL_OPT_RECONNECT, (void *)&reconnect);
+
+    if(!mysql_real_connect(mysql, mariadb_params->mysql_host, mariadb_params->mysql_username, mariadb_params->mysql_password, mariadb_params->mysql_db_name, mariadb_params->mysql_port, NULL, 0)) {
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MYSQL_REAL_CONNECT_ERROR);
+        mysql_close(mysql);
+        mysql = NULL;
+        return 1;
+    }
+
+    return 0;
+}
+
+static int mariadb_begin(device_testing_context_type *device_testing_context) {
+    if(mysql_autocommit(mysql, 0)) {
+        return mariadb_conn_error(device_testing_context, __func__, MSG_MYSQL_TRANSACTION_ERROR);
+    }
+
+    return 0;
+}
+
+static int mariadb_commit(device_testing_context_type *device_testing_context) {
+    int ret = 0;
+
+    if(mysql_commit(mysql)) {
+        ret = mariadb_conn_error(device_testing_context, __func__, MSG_MYSQL_TRANSACTION_ERROR);
+    }
+
+    mysql_autocommit(mysql, 1);
+    return ret;
+}
+
+static void mariadb_rollback(device_testing_context_type *device_testing_context) {
+    mysql_rollback(mysql);
+    mysql_autocommit(mysql, 1);
+}
+
+report_sink_type mariadb_report_sink = {
+    .thread_init = mariadb_thread_init,
+    .thread_end = mariadb_thread_end,
+    .connect = mariadb_connect,
+    .disconnect = mariadb_disconnect,
+    .find_card = mariadb_find_card,
+    .insert_card = mariadb_insert_card,
+    .update_card = mariadb_update_card,
+    .begin = mariadb_begin,
+    .commit = mariadb_commit,
+    .rollback = mariadb_rollback,
+    .insert_history = mariadb_insert_history,
+    .insert_rounds = mariadb_insert_rounds,
+    .insert_surface_scan = mariadb_insert_surface_scan,
+    .update_sector_map = mariadb_update_sector_map
+};
+
+#endif // defined(HAVE_MARIADB)
@@ -0,0 +1,16 @@
+#if !defined(SQL_MARIADB_H)
+#define SQL_MARIADB_H
+
+#include "config.h"
+#include "sql.h"
+
+#  if defined(HAVE_MARIADB)
+
+/**
+ * A reporting sink that sends progress updates to a MySQL or MariaDB server,
+ * using the connection details passed in the SQL thread's parameters.
+ */
+extern report_sink_type mariadb_report_sink;
+
+#  endif // defined(HAVE_MARIADB)
+#endif // !defined(SQL_MARIADB_H)
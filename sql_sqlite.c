@@ -0,0 +1,436 @@
+#include "config.h"
+#include "sql_sqlite.h"
+
+#if defined(HAVE_SQLITE)
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <string.h>
+#include <uuid/uuid.h>
+
+#include "device_testing_context.h"
+#include "messages.h"
+#include "mfst.h"
+#include "sql.h"
+
+// How long to wait for another process (such as a script reading the database)
+// to release its lock before giving up and trying again later, in milliseconds
+#define SQL_SQLITE_BUSY_TIMEOUT 5000
+
+static sqlite3 *db;
+
+// Filename of the database, saved off by sqlite_thread_init()
+static char *sqlite_file;
+
+// Statements used on every update are kept for as long as the database is open
+static sqlite3_stmt *insert_history_stmt;
+static sqlite3_stmt *insert_round_stmt;
+static sqlite3_stmt *insert_scan_stmt;
+static sqlite3_stmt *update_map_stmt;
+
+// The same schema as mfst.sql, so that the same queries work against either
+// backend
+static const char *sqlite_schema =
+    "CREATE TABLE IF NOT EXISTS cards ("
+    "  id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    "  name VARCHAR(256) DEFAULT NULL,"
+    "  uuid CHAR(36) DEFAULT NULL UNIQUE,"
+    "  size BIGINT DEFAULT NULL,"
+    "  sector_size INT DEFAULT NULL"
+    ");"
+    "CREATE TABLE IF NOT EXISTS consolidated_sector_maps ("
+    "  id INTEGER NOT NULL PRIMARY KEY,"
+    "  is_active TINYINT NOT NULL DEFAULT 1,"
+    "  cur_round_num BIGINT DEFAULT NULL,"
+    "  round_num_offset BIGINT DEFAULT 0,"
+    "  num_bad_sectors BIGINT DEFAULT NULL,"
+    "  consolidated_sector_map BLOB DEFAULT NULL,"
+    "  status INT DEFAULT NULL,"
+    "  rate DOUBLE DEFAULT NULL,"
+    "  last_updated BIGINT DEFAULT NULL"
+    ");"
+    "CREATE TABLE IF NOT EXISTS status_history ("
+    "  id BIGINT NOT NULL,"
+    "  sample_time BIGINT NOT NULL,"
+    "  cur_round_num BIGINT DEFAULT NULL,"
+    "  num_bad_sectors BIGINT DEFAULT NULL,"
+    "  status INT DEFAULT NULL,"
+    "  rate DOUBLE DEFAULT NULL,"
+    "  total_bytes_read BIGINT DEFAULT NULL,"
+    "  total_bytes_written BIGINT DEFAULT NULL,"
+    "  read_rate DOUBLE DEFAULT NULL,"
+    "  write_rate DOUBLE DEFAULT NULL,"
+    "  avg_read_latency DOUBLE DEFAULT NULL,"
+    "  avg_write_latency DOUBLE DEFAULT NULL,"
+    "  PRIMARY KEY (id, sample_time)"
+    ");"
+    "CREATE INDEX IF NOT EXISTS status_history_sample_time ON status_history (sample_time);"
+    "CREATE TABLE IF NOT EXISTS round_history ("
+    "  id BIGINT NOT NULL,"
+    "  round_num BIGINT NOT NULL,"
+    "  end_time BIGINT DEFAULT NULL,"
+    "  num_bad_sectors_this_round BIGINT DEFAULT NULL,"
+    "  num_new_bad_sectors_this_round BIGINT DEFAULT NULL,"
+    "  num_good_sectors_this_round BIGINT DEFAULT NULL,"
+    "  total_bad_sectors BIGINT DEFAULT NULL,"
+    "  total_bytes_read BIGINT DEFAULT NULL,"
+    "  total_bytes_written BIGINT DEFAULT NULL,"
+    "  PRIMARY KEY (id, round_num)"
+    ");"
+    "CREATE INDEX IF NOT EXISTS round_history_round_num ON round_history (round_num);"
+    "CREATE TABLE IF NOT EXISTS surface_scans ("
+    "  id BIGINT NOT NULL,"
+    "  scan_num BIGINT NOT NULL,"
+    "  region_num INT NOT NULL,"
+    "  round_num BIGINT DEFAULT NULL,"
+    "  end_time BIGINT DEFAULT NULL,"
+    "  region_offset BIGINT DEFAULT NULL,"
+    "  read_rate DOUBLE DEFAULT NULL,"
+    "  avg_latency BIGINT DEFAULT NULL,"
+    "  max_latency BIGINT DEFAULT NULL,"
+    "  read_errors BIGINT DEFAULT NULL,"
+    "  PRIMARY KEY (id, scan_num, region_num)"
+    ");"
+    "CREATE INDEX IF NOT EXISTS surface_scans_round_num ON surface_scans (round_num);"
+    "CREATE VIEW IF NOT EXISTS endurance_test_data AS SELECT a.id AS id, a.name AS name, a.size AS size, a.sector_size AS sector_size, b.cur_round_num + b.round_num_offset AS cur_round_num, "
+    "b.num_bad_sectors AS num_bad_sectors, b.consolidated_sector_map AS consolidated_sector_map, b.status AS status, b.rate AS rate, b.last_updated AS last_updated "
+    "FROM cards a JOIN consolidated_sector_maps b ON a.id = b.id;";
+
+/**
+ * Logs an error returned by SQLite and updates the SQL thread status
+ * accordingly.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param funcname                The name of the function that got the error.
+ * @param result                  The result code returned by SQLite.
+ *
+ * @returns 1 if the database was locked by someone else (in which case it's
+ *          worth trying again later), or -1 otherwise.
+ */
+static int sqlite_error(device_testing_context_type *device_testing_context, const char *funcname, int result) {
+    if(result == SQLITE_BUSY || result == SQLITE_LOCKED) {
+        sql_thread_status = SQL_THREAD_DISCONNECTED;
+        log_log(device_testing_context, funcname, SEVERITY_LEVEL_DEBUG, MSG_SQLITE_DATABASE_BUSY);
+        return 1;
+    }
+
+    sql_thread_status = SQL_THREAD_ERROR;
+    log_log(device_testing_context, funcname, SEVERITY_LEVEL_DEBUG, MSG_SQLITE_ERROR, db ? sqlite3_errmsg(db) : sqlite3_errstr(result));
+    return -1;
+}
+
+/**
+ * Runs a statement that doesn't return any rows, then resets it so that it can
+ * be run again.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param funcname                The name of the calling function.
+ * @param stmt                    The statement to run.
+ *
+ * @returns 0 if the statement ran successfully, 1 if the database was locked,
+ *          or -1 if any other error occurred.
+ */
+static int sqlite_run_statement(device_testing_context_type *device_testing_context, const char *funcname, sqlite3_stmt *stmt) {
+    int result;
+
+    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
+    result = sqlite3_step(stmt);
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+
+    if(result != SQLITE_DONE) {
+        return sqlite_error(device_testing_context, funcname, result);
+    }
+
+    sql_thread_status = SQL_THREAD_CONNECTED;
+    return 0;
+}
+
+static int sqlite_exec(device_testing_context_type *device_testing_context, const char *funcname, const char *sql) {
+    int result;
+
+    if((result = sqlite3_exec(db, sql, NULL, NULL, NULL)) != SQLITE_OK) {
+        return sqlite_error(device_testing_context, funcname, result);
+    }
+
+    return 0;
+}
+
+static void sqlite_close_statements() {
+    // sqlite3_finalize() is a no-op when passed NULL
+    sqlite3_finalize(insert_history_stmt);
+    sqlite3_finalize(insert_round_stmt);
+    sqlite3_finalize(insert_scan_stmt);
+    sqlite3_finalize(update_map_stmt);
+
+    insert_history_stmt = NULL;
+    insert_round_stmt = NULL;
+    insert_scan_stmt = NULL;
+    update_map_stmt = NULL;
+}
+
+static int sqlite_prepare_statements(device_testing_context_type *device_testing_context) {
+    const char *insert_history_query = "INSERT OR IGNORE INTO status_history (id, sample_time, cur_round_num, num_bad_sectors, status, rate, total_bytes_read, total_bytes_written, read_rate, write_rate, avg_read_latency, avg_write_latency) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    const char *insert_round_query = "INSERT OR IGNORE INTO round_history (id, round_num, end_time, num_bad_sectors_this_round, num_new_bad_sectors_this_round, num_good_sectors_this_round, total_bad_sectors, total_bytes_read, total_bytes_written) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    const char *insert_scan_query = "INSERT OR IGNORE INTO surface_scans (id, scan_num, region_num, round_num, end_time, region_offset, read_rate, avg_latency, max_latency, read_errors) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+    const char *update_map_query = "INSERT INTO consolidated_sector_maps (id, consolidated_sector_map, last_updated, cur_round_num, num_bad_sectors, status, rate) VALUES (?, ?, ?, ?, ?, ?, ?) ON CONFLICT(id) DO UPDATE SET consolidated_sector_map=excluded.consolidated_sector_map, last_updated=excluded.last_updated, cur_round_num=excluded.cur_round_num, num_bad_sectors=excluded.num_bad_sectors, status=excluded.status, rate=excluded.rate";
+    int result;
+
+    if((result = sqlite3_prepare_v2(db, insert_history_query, -1, &insert_history_stmt, NULL)) != SQLITE_OK ||
+       (result = sqlite3_prepare_v2(db, insert_round_query, -1, &insert_round_stmt, NULL)) != SQLITE_OK ||
+       (result = sqlite3_prepare_v2(db, insert_scan_query, -1, &insert_scan_stmt, NULL)) != SQLITE_OK ||
+       (result = sqlite3_prepare_v2(db, update_map_query, -1, &update_map_stmt, NULL)) != SQLITE_OK) {
+        result = sqlite_error(device_testing_context, __func__, result);
+        sqlite_close_statements();
+        return result;
+    }
+
+    return 0;
+}
+
+static int sqlite_thread_init(sql_thread_params_type *params) {
+    if(!params->sqlite_file) {
+        log_log(params->device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SQL_THREAD_REQUIRED_PARAM_MISSING);
+        return -1;
+    }
+
+    sqlite_file = params->sqlite_file;
+    return 0;
+}
+
+static void sqlite_disconnect() {
+    if(db) {
+        sqlite_close_statements();
+        sqlite3_close(db);
+        db = NULL;
+    }
+}
+
+static void sqlite_thread_end() {
+    sqlite_disconnect();
+}
+
+static int sqlite_connect(device_testing_context_type *device_testing_context) {
+    int result;
+
+    // The database is only ever used from the SQL thread, so SQLite doesn't
+    // need to do any locking of its own
+    if((result = sqlite3_open_v2(sqlite_file, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL)) != SQLITE_OK) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SQLITE_OPEN_ERROR, sqlite_file, db ? sqlite3_errmsg(db) : sqlite3_errstr(result));
+        sqlite3_close(db);
+        db = NULL;
+        return -1;
+    }
+
+    sqlite3_busy_timeout(db, SQL_SQLITE_BUSY_TIMEOUT);
+
+    // WAL mode lets other programs read the database while we're writing to
+    // it, and synchronous=NORMAL means we only wait on the disk at
+    // checkpoints rather than on every commit
+    if((result = sqlite_exec(device_testing_context, __func__, "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL;")) ||
+       (result = sqlite_exec(device_testing_context, __func__, sqlite_schema)) ||
+       (result = sqlite_prepare_statements(device_testing_context))) {
+        sqlite_disconnect();
+        return result;
+    }
+
+    return 0;
+}
+
+static int sqlite_find_card(device_testing_context_type *device_testing_context, uint64_t *id) {
+    const char *find_card_query = "SELECT id FROM cards WHERE uuid=?";
+    sqlite3_stmt *stmt;
+    char uuid_str[37];
+    int result;
+
+    uuid_unparse(device_testing_context->device_info.device_uuid, uuid_str);
+
+    if((result = sqlite3_prepare_v2(db, find_card_query, -1, &stmt, NULL)) != SQLITE_OK) {
+        return sqlite_error(device_testing_context, __func__, result);
+    }
+
+    sqlite3_bind_text(stmt, 1, uuid_str, -1, SQLITE_TRANSIENT);
+
+    sql_thread_status = SQL_THREAD_QUERY_EXECUTING;
+    result = sqlite3_step(stmt);
+
+    if(result == SQLITE_ROW) {
+        *id = sqlite3_column_int64(stmt, 0);
+    } else if(result == SQLITE_DONE) {
+        *id = 0ULL;
+    } else {
+        result = sqlite_error(device_testing_context, __func__, result);
+        sqlite3_finalize(stmt);
+        return result;
+    }
+
+    sqlite3_finalize(stmt);
+    sql_thread_status = SQL_THREAD_CONNECTED;
+
+    return 0;
+}
+
+static int sqlite_insert_card(device_testing_context_type *device_testing_context, char *name, uint64_t *id) {
+    const char *insert_query = "INSERT INTO cards (name, uuid, size, sector_size) VALUES (?, ?, ?, ?)";
+    sqlite3_stmt *stmt;
+    char uuid_str[37];
+    int result;
+
+    uuid_unparse(device_testing_context->device_info.device_uuid, uuid_str);
+
+    if((result = sqlite3_prepare_v2(db, insert_query, -1, &stmt, NULL)) != SQLITE_OK) {
+        return sqlite_error(device_testing_context, __func__, result);
+    }
+
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, uuid_str, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 3, device_testing_context->device_info.num_physical_sectors);
+    sqlite3_bind_int(stmt, 4, device_testing_context->device_info.sector_size);
+
+    result = sqlite_run_statement(device_testing_context, __func__, stmt);
+    sqlite3_finalize(stmt);
+
+    if(result) {
+        return result;
+    }
+
+    *id = sqlite3_last_insert_rowid(db);
+    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_CARD_REGISTERED, *id);
+
+    return 0;
+}
+
+static int sqlite_update_card(device_testing_context_type *device_testing_context, uint64_t id) {
+    const char *update_query = "UPDATE cards SET size=?, sector_size=? WHERE id=?";
+    sqlite3_stmt *stmt;
+    int result;
+
+    if((result = sqlite3_prepare_v2(db, update_query, -1, &stmt, NULL)) != SQLITE_OK) {
+        return sqlite_error(device_testing_context, __func__, result);
+    }
+
+    sqlite3_bind_int64(stmt, 1, device_testing_context->device_info.num_physical_sectors);
+    sqlite3_bind_int(stmt, 2, device_testing_context->device_info.sector_size);
+    sqlite3_bind_int64(stmt, 3, id);
+
+    result = sqlite_run_statement(device_testing_context, __func__, stmt);
+    sqlite3_finalize(stmt);
+
+    return result;
+}
+
+static int sqlite_begin(device_testing_context_type *device_testing_context) {
+    return sqlite_exec(device_testing_context, __func__, "BEGIN");
+}
+
+static int sqlite_commit(device_testing_context_type *device_testing_context) {
+    return sqlite_exec(device_testing_context, __func__, "COMMIT");
+}
+
+static void sqlite_rollback(device_testing_context_type *device_testing_context) {
+    // Fails harmlessly if SQLite already rolled the transaction back on its own
+    sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+}
+
+static int sqlite_insert_history(device_testing_context_type *device_testing_context, uint64_t card_id, sql_sample_type *samples, int num_samples) {
+    int i, result;
+
+    for(i = 0; i < num_samples; i++) {
+        sqlite3_bind_int64(insert_history_stmt, 1, card_id);
+        sqlite3_bind_int64(insert_history_stmt, 2, samples[i].sample_time);
+        sqlite3_bind_int64(insert_history_stmt, 3, samples[i].cur_round_num);
+        sqlite3_bind_int64(insert_history_stmt, 4, samples[i].num_bad_sectors);
+        sqlite3_bind_int(insert_history_stmt, 5, samples[i].status);
+        sqlite3_bind_double(insert_history_stmt, 6, samples[i].rate);
+        sqlite3_bind_int64(insert_history_stmt, 7, samples[i].total_bytes_read);
+        sqlite3_bind_int64(insert_history_stmt, 8, samples[i].total_bytes_written);
+        sqlite3_bind_double(insert_history_stmt, 9, samples[i].read_rate);
+        sqlite3_bind_double(insert_history_stmt, 10, samples[i].write_rate);
+        sqlite3_bind_double(insert_history_stmt, 11, samples[i].avg_read_latency);
+        sqlite3_bind_double(insert_history_stmt, 12, samples[i].avg_write_latency);
+
+        if(result = sqlite_run_statement(device_testing_context, __func__, insert_history_stmt)) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int sqlite_insert_rounds(device_testing_context_type *device_testing_context, uint64_t card_id, round_summary_type *summaries, int num_summaries) {
+    int i, result;
+
+    for(i = 0; i < num_summaries; i++) {
+        sqlite3_bind_int64(insert_round_stmt, 1, card_id);
+        sqlite3_bind_int64(insert_round_stmt, 2, summaries[i].round_num);
+        sqlite3_bind_int64(insert_round_stmt, 3, summaries[i].end_time);
+        sqlite3_bind_int64(insert_round_stmt, 4, summaries[i].num_bad_sectors_this_round);
+        sqlite3_bind_int64(insert_round_stmt, 5, summaries[i].num_new_bad_sectors_this_round);
+        sqlite3_bind_int64(insert_round_stmt, 6, summaries[i].num_good_sectors_this_round);
+        sqlite3_bind_int64(insert_round_stmt, 7, summaries[i].total_bad_sectors);
+        sqlite3_bind_int64(insert_round_stmt, 8, summaries[i].total_bytes_read);
+        sqlite3_bind_int64(insert_round_stmt, 9, summaries[i].total_bytes_written);
+
+        if(result = sqlite_run_statement(device_testing_context, __func__, insert_round_stmt)) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int sqlite_insert_surface_scan(device_testing_context_type *device_testing_context, uint64_t card_id, surface_scan_result_type *scan) {
+    int i, result;
+
+    for(i = 0; i < scan->num_regions; i++) {
+        sqlite3_bind_int64(insert_scan_stmt, 1, card_id);
+        sqlite3_bind_int64(insert_scan_stmt, 2, scan->scan_num);
+        sqlite3_bind_int(insert_scan_stmt, 3, i);
+        sqlite3_bind_int64(insert_scan_stmt, 4, scan->round_num);
+        sqlite3_bind_int64(insert_scan_stmt, 5, scan->end_time);
+        sqlite3_bind_int64(insert_scan_stmt, 6, i * scan->region_size);
+        sqlite3_bind_double(insert_scan_stmt, 7, scan->regions[i].read_rate);
+        sqlite3_bind_int64(insert_scan_stmt, 8, scan->regions[i].avg_latency);
+        sqlite3_bind_int64(insert_scan_stmt, 9, scan->regions[i].max_latency);
+        sqlite3_bind_int64(insert_scan_stmt, 10, scan->regions[i].read_errors);
+
+        if(result = sqlite_run_statement(device_testing_context, __func__, insert_scan_stmt)) {
+            return result;
+        }
+    }
+
+    return 0;
+}
+
+static int sqlite_update_sector_map(device_testing_context_type *device_testing_context, uint64_t card_id, sql_sample_type *sample, uint8_t *map) {
+    // The blob is written straight into the database file, so there's no need
+    // to only send the parts of the map that changed like we do for MariaDB
+    sqlite3_bind_int64(update_map_stmt, 1, card_id);
+    sqlite3_bind_blob(update_map_stmt, 2, map, CONSOLIDATED_SECTOR_MAP_BYTES, SQLITE_STATIC);
+    sqlite3_bind_int64(update_map_stmt, 3, sample->sample_time);
+    sqlite3_bind_int64(update_map_stmt, 4, sample->cur_round_num);
+    sqlite3_bind_int64(update_map_stmt, 5, sample->num_bad_sectors);
+    sqlite3_bind_int(update_map_stmt, 6, sample->status);
+    sqlite3_bind_double(update_map_stmt, 7, sample->rate);
+
+    return sqlite_run_statement(device_testing_context, __func__, update_map_stmt);
+}
+
+report_sink_type sqlite_report_sink = {
+    .thread_init = sqlite_thread_init,
+    .thread_end = sqlite_thread_end,
+    .connect = sqlite_connect,
+    .disconnect = sqlite_disconnect,
+    .find_card = sqlite_find_card,
+    .insert_card = sqlite_insert_card,
+    .update_card = sqlite_update_card,
+    .begin = sqlite_begin,
+    .commit = sqlite_commit,
+    .rollback = sqlite_rollback,
+    .insert_history = sqlite_insert_history,
+    .insert_rounds = sqlite_insert_rounds,
+    .insert_surface_scan = sqlite_insert_surface_scan,
+    .update_sector_map = sqlite_update_sector_map
+};
+
+#endif // defined(HAVE_SQLITE)
@@ -0,0 +1,17 @@
+#if !defined(SQL_SQLITE_H)
+#define SQL_SQLITE_H
+
+#include "config.h"
+#include "sql.h"
+
+#  if defined(HAVE_SQLITE)
+
+/**
+ * A reporting sink that writes progress updates to a local SQLite database,
+ * using the filename passed in the SQL thread's parameters.  The database is
+ * created (along with the same tables as mfst.sql) if it doesn't exist.
+ */
+extern report_sink_type sqlite_report_sink;
+
+#  endif // defined(HAVE_SQLITE)
+#endif // !defined(SQL_SQLITE_H)
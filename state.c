@@ -32,8 +32,263 @@ int test_json_pointer(struct json_object *obj, const char *path) {
     return ret;
 }
 
+/**
+ * Builds a JSON array holding the results of the queue depth sweep.  Each
+ * element is an object holding the results for one queue depth.
+ *
+ * @param device_testing_context  The device whose results should be saved.
+ *
+ * @returns The new JSON array, or NULL if an error occurred.
+ */
+static struct json_object *save_queue_depth_sweep(device_testing_context_type *device_testing_context) {
+    struct json_object *array, *entry;
+    queue_depth_result_type *result;
+    int i;
+
+    array = json_object_new_array();
+
+    for(i = 0; i < device_testing_context->performance_test_info.queue_depth_sweep_steps; i++) {
+        result = &device_testing_context->performance_test_info.queue_depth_sweep[i];
+        entry = json_object_new_object();
+
+        if(json_object_object_add(entry, "queue_depth", json_object_new_int(result->queue_depth)) ||
+           json_object_object_add(entry, "read_iops", json_object_new_double(result->read_iops)) ||
+           json_object_object_add(entry, "write_iops", json_object_new_double(result->write_iops)) ||
+           json_object_object_add(entry, "read_latency_p50", json_object_new_uint64(result->read_latency_p50)) ||
+           json_object_object_add(entry, "read_latency_p99", json_object_new_uint64(result->read_latency_p99)) ||
+           json_object_object_add(entry, "read_latency_p999", json_object_new_uint64(result->read_latency_p999)) ||
+           json_object_object_add(entry, "write_latency_p50", json_object_new_uint64(result->write_latency_p50)) ||
+           json_object_object_add(entry, "write_latency_p99", json_object_new_uint64(result->write_latency_p99)) ||
+           json_object_object_add(entry, "write_latency_p999", json_object_new_uint64(result->write_latency_p999)) ||
+           json_object_array_add(array, entry)) {
+            json_object_put(entry);
+            json_object_put(array);
+            return NULL;
+        }
+    }
+
+    return array;
+}
+
+/**
+ * Loads the results of the queue depth sweep from the state file.  The sweep
+ * results are informational only, so an entry that's missing or malformed
+ * just ends the list rather than causing the state file to be rejected.
+ *
+ * @param device_testing_context  The device whose results should be loaded.
+ * @param array                   The "queue_depth_sweep" array from the state
+ *                                file.
+ */
+static void load_queue_depth_sweep(device_testing_context_type *device_testing_context, struct json_object *array) {
+    struct json_object *entry, *obj;
+    queue_depth_result_type *result;
+    size_t i;
+
+    device_testing_context->performance_test_info.queue_depth_sweep_steps = 0;
+
+    for(i = 0; i < json_object_array_length(array) && i < QUEUE_DEPTH_SWEEP_STEPS; i++) {
+        entry = json_object_array_get_idx(array, i);
+        result = &device_testing_context->performance_test_info.queue_depth_sweep[i];
+
+        if(!json_object_is_type(entry, json_type_object) || !json_object_object_get_ex(entry, "queue_depth", &obj) || !json_object_is_type(obj, json_type_int)) {
+            break;
+        }
+
+        result->queue_depth = json_object_get_int(obj);
+        result->read_iops = json_object_object_get_ex(entry, "read_iops", &obj) ? json_object_get_double(obj) : 0;
+        result->write_iops = json_object_object_get_ex(entry, "write_iops", &obj) ? json_object_get_double(obj) : 0;
+        result->read_latency_p50 = json_object_object_get_ex(entry, "read_latency_p50", &obj) ? json_object_get_uint64(obj) : 0;
+        result->read_latency_p99 = json_object_object_get_ex(entry, "read_latency_p99", &obj) ? json_object_get_uint64(obj) : 0;
+        result->read_latency_p999 = json_object_object_get_ex(entry, "read_latency_p999", &obj) ? json_object_get_uint64(obj) : 0;
+        result->write_latency_p50 = json_object_object_get_ex(entry, "write_latency_p50", &obj) ? json_object_get_uint64(obj) : 0;
+        result->write_latency_p99 = json_object_object_get_ex(entry, "write_latency_p99", &obj) ? json_object_get_uint64(obj) : 0;
+        result->write_latency_p999 = json_object_object_get_ex(entry, "write_latency_p999", &obj) ? json_object_get_uint64(obj) : 0;
+
+        device_testing_context->performance_test_info.queue_depth_sweep_steps = i + 1;
+    }
+}
+
+/**
+ * Builds a JSON object holding the results of the most recent surface scan.
+ * The per-region results are stored as parallel arrays, one entry per region.
+ *
+ * @param device_testing_context  The device whose results should be saved.
+ *
+ * @returns The new JSON object, or NULL if an error occurred.
+ */
+static struct json_object *save_surface_scan(device_testing_context_type *device_testing_context) {
+    struct json_object *scan, *read_rates, *avg_latencies, *max_latencies, *read_errors;
+    surface_scan_result_type *result = &device_testing_context->surface_scan_info.latest;
+    int i;
+
+    scan = json_object_new_object();
+    read_rates = json_object_new_array();
+    avg_latencies = json_object_new_array();
+    max_latencies = json_object_new_array();
+    read_errors = json_object_new_array();
+
+    for(i = 0; i < result->num_regions; i++) {
+        if(json_object_array_add(read_rates, json_object_new_double(result->regions[i].read_rate)) ||
+           json_object_array_add(avg_latencies, json_object_new_uint64(result->regions[i].avg_latency)) ||
+           json_object_array_add(max_latencies, json_object_new_uint64(result->regions[i].max_latency)) ||
+           json_object_array_add(read_errors, json_object_new_uint64(result->regions[i].read_errors))) {
+            json_object_put(read_rates);
+            json_object_put(avg_latencies);
+            json_object_put(max_latencies);
+            json_object_put(read_errors);
+            json_object_put(scan);
+            return NULL;
+        }
+    }
+
+    if(json_object_object_add(scan, "scans_performed", json_object_new_uint64(device_testing_context->surface_scan_info.scans_performed)) ||
+       json_object_object_add(scan, "scan_num", json_object_new_uint64(result->scan_num)) ||
+       json_object_object_add(scan, "round_num", json_object_new_uint64(result->round_num)) ||
+       json_object_object_add(scan, "end_time", json_object_new_int64(result->end_time)) ||
+       json_object_object_add(scan, "region_size", json_object_new_uint64(result->region_size)) ||
+       json_object_object_add(scan, "sample_percent", json_object_new_int(result->sample_percent)) ||
+       json_object_object_add(scan, "median_read_rate", json_object_new_double(result->median_read_rate))) {
+        json_object_put(read_rates);
+        json_object_put(avg_latencies);
+        json_object_put(max_latencies);
+        json_object_put(read_errors);
+        json_object_put(scan);
+        return NULL;
+    }
+
+    if(json_object_object_add(scan, "read_rates", read_rates)) {
+        json_object_put(read_rates);
+        json_object_put(avg_latencies);
+        json_object_put(max_latencies);
+        json_object_put(read_errors);
+        json_object_put(scan);
+        return NULL;
+    }
+
+    if(json_object_object_add(scan, "avg_latencies", avg_latencies)) {
+        json_object_put(avg_latencies);
+        json_object_put(max_latencies);
+        json_object_put(read_errors);
+        json_object_put(scan);
+        return NULL;
+    }
+
+    if(json_object_object_add(scan, "max_latencies", max_latencies)) {
+        json_object_put(max_latencies);
+        json_object_put(read_errors);
+        json_object_put(scan);
+        return NULL;
+    }
+
+    if(json_object_object_add(scan, "read_errors", read_errors)) {
+        json_object_put(read_errors);
+        json_object_put(scan);
+        return NULL;
+    }
+
+    return scan;
+}
+
+/**
+ * Loads the results of the most recent surface scan from the state file.  Like
+ * the queue depth sweep, the scan results are informational only, so if
+ * they're malformed they're simply ignored (and the scan will be run again).
+ *
+ * @param device_testing_context  The device whose results should be loaded.
+ * @param scan                    The "surface_scan" object from the state
+ *                                file.
+ */
+static void load_surface_scan(device_testing_context_type *device_testing_context, struct json_object *scan) {
+    struct json_object *obj, *read_rates, *avg_latencies, *max_latencies, *read_errors;
+    surface_scan_result_type *result = &device_testing_context->surface_scan_info.latest;
+    size_t num_regions, i;
+
+    if(!json_object_object_get_ex(scan, "scans_performed", &obj) || !json_object_is_type(obj, json_type_int) ||
+       !json_object_object_get_ex(scan, "read_rates", &read_rates) || !json_object_is_type(read_rates, json_type_array) ||
+       !json_object_object_get_ex(scan, "avg_latencies", &avg_latencies) || !json_object_is_type(avg_latencies, json_type_array) ||
+       !json_object_object_get_ex(scan, "max_latencies", &max_latencies) || !json_object_is_type(max_latencies, json_type_array) ||
+       !json_object_object_get_ex(scan, "read_errors", &read_errors) || !json_object_is_type(read_errors, json_type_array)) {
+        return;
+    }
+
+    num_regions = json_object_array_length(read_rates);
+    if(!num_regions || num_regions > SURFACE_SCAN_REGIONS || json_object_array_length(avg_latencies) != num_regions ||
+       json_object_array_length(max_latencies) != num_regions || json_object_array_length(read_errors) != num_regions) {
+        return;
+    }
+
+    memset(result, 0, sizeof(surface_scan_result_type));
+    device_testing_context->surface_scan_info.scans_performed = json_object_get_uint64(obj);
+
+    result->num_regions = num_regions;
+    result->scan_num = json_object_object_get_ex(scan, "scan_num", &obj) ? json_object_get_uint64(obj) : 0;
+    result->round_num = json_object_object_get_ex(scan, "round_num", &obj) ? json_object_get_uint64(obj) : 0;
+    result->end_time = json_object_object_get_ex(scan, "end_time", &obj) ? json_object_get_int64(obj) : 0;
+    result->region_size = json_object_object_get_ex(scan, "region_size", &obj) ? json_object_get_uint64(obj) : 0;
+    result->sample_percent = json_object_object_get_ex(scan, "sample_percent", &obj) ? json_object_get_int(obj) : 0;
+    result->median_read_rate = json_object_object_get_ex(scan, "median_read_rate", &obj) ? json_object_get_double(obj) : 0;
+
+    for(i = 0; i < num_regions; i++) {
+        result->regions[i].read_rate = json_object_get_double(json_object_array_get_idx(read_rates, i));
+        result->regions[i].avg_latency = json_object_get_uint64(json_object_array_get_idx(avg_latencies, i));
+        result->regions[i].max_latency = json_object_get_uint64(json_object_array_get_idx(max_latencies, i));
+        result->regions[i].read_errors = json_object_get_uint64(json_object_array_get_idx(read_errors, i));
+    }
+
+    // The heatmap works out which region each sector is in from the region
+    // size, so it had better be a whole number of sectors
+    if(!result->region_size || (result->region_size % device_testing_context->device_info.sector_size)) {
+        memset(result, 0, sizeof(surface_scan_result_type));
+        device_testing_context->surface_scan_info.scans_performed = 0;
+    }
+}
+
+/**
+ * Builds a JSON object holding the I/O timeout counters, so that the totals in
+ * the stats file carry on where they left off when the test is resumed.
+ *
+ * @param device_testing_context  The device whose counters should be saved.
+ *
+ * @returns The new JSON object, or NULL if an error occurred.
+ */
+static struct json_object *save_io_timeout_stats(device_testing_context_type *device_testing_context) {
+    struct json_object *stats;
+    io_timeout_stats_type *io_timeout_stats = &device_testing_context->io_timeout_stats;
+
+    if(!(stats = json_object_new_object())) {
+        return NULL;
+    }
+
+    if(json_object_object_add(stats, "num_timeouts", json_object_new_uint64(io_timeout_stats->num_timeouts)) ||
+       json_object_object_add(stats, "num_forced_resets", json_object_new_uint64(io_timeout_stats->num_forced_resets)) ||
+       json_object_object_add(stats, "total_timeout_time", json_object_new_uint64(io_timeout_stats->total_timeout_time)) ||
+       json_object_object_add(stats, "longest_timeout_time", json_object_new_uint64(io_timeout_stats->longest_timeout_time))) {
+        json_object_put(stats);
+        return NULL;
+    }
+
+    return stats;
+}
+
+/**
+ * Loads the I/O timeout counters saved by save_io_timeout_stats().  Missing
+ * counters are left at 0.
+ *
+ * @param device_testing_context  The device whose counters should be loaded.
+ * @param stats                   The "io_timeouts" object from the state file.
+ */
+static void load_io_timeout_stats(device_testing_context_type *device_testing_context, struct json_object *stats) {
+    struct json_object *obj;
+    io_timeout_stats_type *io_timeout_stats = &device_testing_context->io_timeout_stats;
+
+    io_timeout_stats->num_timeouts = json_object_object_get_ex(stats, "num_timeouts", &obj) ? json_object_get_uint64(obj) : 0;
+    io_timeout_stats->num_forced_resets = json_object_object_get_ex(stats, "num_forced_resets", &obj) ? json_object_get_uint64(obj) : 0;
+    io_timeout_stats->total_timeout_time = json_object_object_get_ex(stats, "total_timeout_time", &obj) ? json_object_get_uint64(obj) : 0;
+    io_timeout_stats->longest_timeout_time = json_object_object_get_ex(stats, "longest_timeout_time", &obj) ? json_object_get_uint64(obj) : 0;
+}
+
 int save_state(device_testing_context_type *device_testing_context) {
-    struct json_object *root, *parent, *obj;
+    struct json_object *root, *parent, *child, *obj;
     char *filename;
     char *sector_map, *b64str;
     char device_uuid[37];
@@ -112,6 +367,16 @@ int save_state(device_testing_context_type *device_testing_context) {
         return -1;
     }
 
+    if(device_testing_context->device_info.write_cache_size) {
+        obj = json_object_new_uint64(device_testing_context->device_info.write_cache_size);
+        if(json_object_object_add(parent, "write_cache_size", obj)) {
+            json_object_put(obj);
+            json_object_put(parent);
+            json_object_put(root);
+            return -1;
+        }
+    }
+
     obj = json_object_new_double(device_testing_context->performance_test_info.sequential_read_speed);
     if(json_object_object_add(parent, "sequential_read_speed", obj)) {
         json_object_put(obj);
@@ -144,6 +409,49 @@ int save_state(device_testing_context_type *device_testing_context) {
         return -1;
     }
 
+    if(device_testing_context->sustained_write_test_info.sustained_write_speed) {
+        obj = json_object_new_double(device_testing_context->sustained_write_test_info.sustained_write_speed);
+        if(json_object_object_add(parent, "sustained_write_speed", obj)) {
+            json_object_put(obj);
+            json_object_put(parent);
+            json_object_put(root);
+            return -1;
+        }
+    }
+
+    if(device_testing_context->au_speed_test_info.test_performed) {
+        obj = json_object_new_double(device_testing_context->au_speed_test_info.small_ru.min_write_speed);
+        if(json_object_object_add(parent, "au_small_ru_write_speed", obj)) {
+            json_object_put(obj);
+            json_object_put(parent);
+            json_object_put(root);
+            return -1;
+        }
+
+        obj = json_object_new_double(device_testing_context->au_speed_test_info.large_ru.min_write_speed);
+        if(json_object_object_add(parent, "au_large_ru_write_speed", obj)) {
+            json_object_put(obj);
+            json_object_put(parent);
+            json_object_put(root);
+            return -1;
+        }
+    }
+
+    if(device_testing_context->performance_test_info.queue_depth_sweep_steps) {
+        if(!(child = save_queue_depth_sweep(device_testing_context))) {
+            json_object_put(parent);
+            json_object_put(root);
+            return -1;
+        }
+
+        if(json_object_object_add(parent, "queue_depth_sweep", child)) {
+            json_object_put(child);
+            json_object_put(parent);
+            json_object_put(root);
+            return -1;
+        }
+    }
+
     if(json_object_object_add(root, "device_info", parent)) {
         json_object_put(parent);
         json_object_put(root);
@@ -331,6 +639,19 @@ int save_state(device_testing_context_type *device_testing_context) {
         return -1;
     }
 
+    if(!(child = save_io_timeout_stats(device_testing_context))) {
+        json_object_put(parent);
+        json_object_put(root);
+        return -1;
+    }
+
+    if(json_object_object_add(parent, "io_timeouts", child)) {
+        json_object_put(child);
+        json_object_put(parent);
+        json_object_put(root);
+        return -1;
+    }
+
     if(device_testing_context->endurance_test_info.rounds_to_first_error != -1ULL) {
         obj = json_object_new_int64(device_testing_context->endurance_test_info.rounds_to_first_error);
         if(json_object_object_add(parent, "first_failure_round", obj)) {
@@ -381,6 +702,21 @@ int save_state(device_testing_context_type *device_testing_context) {
         }
     }
 
+    if(device_testing_context->surface_scan_info.scans_performed) {
+        if(!(child = save_surface_scan(device_testing_context))) {
+            json_object_put(parent);
+            json_object_put(root);
+            return -1;
+        }
+
+        if(json_object_object_add(parent, "surface_scan", child)) {
+            json_object_put(child);
+            json_object_put(parent);
+            json_object_put(root);
+            return -1;
+        }
+    }
+
     if(json_object_object_add(root, "state", parent)) {
         json_object_put(parent);
         json_object_put(root);
@@ -436,6 +772,10 @@ int load_state(device_testing_context_type *device_testing_context) {
     const char *sequential_write_speed_ptr = "/device_info/sequential_write_speed";
     const char *random_read_iops_ptr = "/device_info/random_read_iops";
     const char *random_write_iops_ptr = "/device_info/random_write_iops";
+    const char *write_cache_size_ptr = "/device_info/write_cache_size";
+    const char *sustained_write_speed_ptr = "/device_info/sustained_write_speed";
+    const char *au_small_ru_write_speed_ptr = "/device_info/au_small_ru_write_speed";
+    const char *au_large_ru_write_speed_ptr = "/device_info/au_large_ru_write_speed";
     const char *disable_curses_ptr = "/program_options/disable_curses";
     const char *stats_file_ptr = "/program_options/stats_file";
     const char *log_file_ptr = "/program_options/log_file";
@@ -464,6 +804,10 @@ int load_state(device_testing_context_type *device_testing_context) {
         sequential_write_speed_ptr,
         random_read_iops_ptr,
         random_write_iops_ptr,
+        write_cache_size_ptr,
+        sustained_write_speed_ptr,
+        au_small_ru_write_speed_ptr,
+        au_large_ru_write_speed_ptr,
         disable_curses_ptr,
         stats_file_ptr,
         log_file_ptr,
@@ -494,6 +838,10 @@ int load_state(device_testing_context_type *device_testing_context) {
         json_type_double,  // sequential_write_speed_ptr
         json_type_double,  // random_read_iops_ptr
         json_type_double,  // random_write_iops_ptr
+        json_type_int,     // write_cache_size_ptr
+        json_type_double,  // sustained_write_speed_ptr
+        json_type_double,  // au_small_ru_write_speed_ptr
+        json_type_double,  // au_large_ru_write_speed_ptr
         json_type_boolean, // disable_curses_ptr
         json_type_string,  // stats_file_ptr
         json_type_string,  // log_file_ptr
@@ -523,6 +871,10 @@ int load_state(device_testing_context_type *device_testing_context) {
         1, // sequential_write_speed_ptr
         1, // random_read_iops_ptr
         1, // random_write_iops_ptr
+        0, // write_cache_size_ptr
+        0, // sustained_write_speed_ptr
+        0, // au_small_ru_write_speed_ptr
+        0, // au_large_ru_write_speed_ptr
         0, // disable_curses_ptr
         0, // stats_file_ptr
         0, // log_file_ptr
@@ -552,6 +904,10 @@ int load_state(device_testing_context_type *device_testing_context) {
         0, // sequential_write_speed_ptr
         0, // random_read_iops_ptr
         0, // random_write_iops_ptr
+        0, // write_cache_size_ptr
+        0, // sustained_write_speed_ptr
+        0, // au_small_ru_write_speed_ptr
+        0, // au_large_ru_write_speed_ptr
         0, // disable_curses_ptr
         0, // stats_file_ptr
         0, // log_file_ptr
@@ -581,6 +937,10 @@ int load_state(device_testing_context_type *device_testing_context) {
         NULL, // sequential_write_speed_ptr
         NULL, // random_read_iops_ptr
         NULL, // random_write_iops_ptr
+        NULL, // write_cache_size_ptr
+        NULL, // sustained_write_speed_ptr
+        NULL, // au_small_ru_write_speed_ptr
+        NULL, // au_large_ru_write_speed_ptr
         NULL, // disable_curses_ptr
         NULL, // stats_file_ptr
         NULL, // log_file_ptr
@@ -610,6 +970,10 @@ int load_state(device_testing_context_type *device_testing_context) {
         0, // sequential_write_speed_ptr
         0, // random_read_iops_ptr
         0, // random_write_iops_ptr
+        0, // write_cache_size_ptr
+        0, // sustained_write_speed_ptr
+        0, // au_small_ru_write_speed_ptr
+        0, // au_large_ru_write_speed_ptr
         0, // disable_curses_ptr
         0, // stats_file_ptr
         0, // log_file_ptr
@@ -639,6 +1003,10 @@ int load_state(device_testing_context_type *device_testing_context) {
         &device_testing_context->performance_test_info.sequential_write_speed,
         &device_testing_context->performance_test_info.random_read_iops,
         &device_testing_context->performance_test_info.random_write_iops,
+        &device_testing_context->device_info.write_cache_size,
+        &device_testing_context->sustained_write_test_info.sustained_write_speed,
+        &device_testing_context->au_speed_test_info.small_ru.min_write_speed,
+        &device_testing_context->au_speed_test_info.large_ru.min_write_speed,
         &program_options.no_curses,
         &program_options.stats_file,
         &program_options.log_file,
@@ -773,6 +1141,10 @@ int load_state(device_testing_context_type *device_testing_context) {
         -1,                  // sequential_write_speed_ptr
         -1,                  // random_read_iops_ptr
         -1,                  // random_write_iops_ptr
+        -1,                  // write_cache_size_ptr
+        -1,                  // sustained_write_speed_ptr
+        -1,                  // au_small_ru_write_speed_ptr
+        -1,                  // au_large_ru_write_speed_ptr
         -1,                  // disable_curses_ptr
         -1,                  // stats_file_ptr
         -1,                  // log_file_ptr
@@ -874,6 +1246,18 @@ int load_state(device_testing_context_type *device_testing_context) {
         free(uuid_str);
     }
 
+    if(!json_pointer_get(root, "/device_info/queue_depth_sweep", &obj) && json_object_is_type(obj, json_type_array)) {
+        load_queue_depth_sweep(device_testing_context, obj);
+    }
+
+    if(!json_pointer_get(root, "/state/surface_scan", &obj) && json_object_is_type(obj, json_type_object)) {
+        load_surface_scan(device_testing_context, obj);
+    }
+
+    if(!json_pointer_get(root, "/state/io_timeouts", &obj) && json_object_is_type(obj, json_type_object)) {
+        load_io_timeout_stats(device_testing_context, obj);
+    }
+
     device_testing_context->endurance_test_info.rounds_completed = tmp_num_rounds;
     device_testing_context->endurance_test_info.stats_file_counters.total_bytes_read = tmp_bytes_read;
     device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written = tmp_bytes_written;
@@ -0,0 +1,136 @@
+#include <sched.h>
+#include <string.h>
+
+#include "device_testing_context.h"
+#include "stats_block.h"
+
+/**
+ * Starts an update to data protected by a seqlock.
+ *
+ * @param sequence  The seqlock's sequence counter.
+ *
+ * @returns The value of the sequence counter before the update, to be passed
+ *          to seqlock_write_end().
+ */
+static unsigned int seqlock_write_begin(unsigned int *sequence) {
+    unsigned int start = *sequence;
+
+    // Make the sequence number odd so that readers know to try again, and make
+    // sure that readers see that before they see any of the new values
+    __atomic_store_n(sequence, start + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    return start;
+}
+
+/**
+ * Finishes an update started with seqlock_write_begin().
+ *
+ * @param sequence  The seqlock's sequence counter.
+ * @param start     The value returned by seqlock_write_begin().
+ */
+static void seqlock_write_end(unsigned int *sequence, unsigned int start) {
+    __atomic_store_n(sequence, start + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Waits for any update in progress to finish before reading data protected by
+ * a seqlock.
+ *
+ * @param sequence  The seqlock's sequence counter.
+ *
+ * @returns The value of the sequence counter, to be passed to
+ *          seqlock_read_retry().
+ */
+static unsigned int seqlock_read_begin(unsigned int *sequence) {
+    unsigned int start;
+
+    // If the main thread is in the middle of publishing, give it a chance to
+    // finish
+    while((start = __atomic_load_n(sequence, __ATOMIC_ACQUIRE)) & 1) {
+        sched_yield();
+    }
+
+    return start;
+}
+
+/**
+ * Checks whether data read after seqlock_read_begin() was changed while it was
+ * being read.
+ *
+ * @param sequence  The seqlock's sequence counter.
+ * @param start     The value returned by seqlock_read_begin().
+ *
+ * @returns Non-zero if the data needs to be read again, or 0 if it doesn't.
+ */
+static int seqlock_read_retry(unsigned int *sequence, unsigned int start) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(sequence, __ATOMIC_RELAXED) != start;
+}
+
+void stats_block_publish(device_testing_context_type *device_testing_context) {
+    stats_block_type *block = &device_testing_context->stats_block;
+    stats_snapshot_type *snapshot = &block->snapshot;
+    unsigned int sequence = seqlock_write_begin(&block->sequence);
+
+    snapshot->total_bytes_written = device_testing_context->endurance_test_info.stats_file_counters.total_bytes_written;
+    snapshot->total_bytes_read = device_testing_context->endurance_test_info.stats_file_counters.total_bytes_read;
+    snapshot->rounds_completed = device_testing_context->endurance_test_info.rounds_completed;
+    snapshot->total_bad_sectors = device_testing_context->endurance_test_info.total_bad_sectors;
+    snapshot->num_bad_sectors_this_round = device_testing_context->endurance_test_info.num_bad_sectors_this_round;
+    snapshot->rounds_to_first_error = device_testing_context->endurance_test_info.rounds_to_first_error;
+    snapshot->rounds_to_0_1_threshold = device_testing_context->endurance_test_info.rounds_to_0_1_threshold;
+    snapshot->rounds_to_1_threshold = device_testing_context->endurance_test_info.rounds_to_1_threshold;
+    snapshot->rounds_to_10_threshold = device_testing_context->endurance_test_info.rounds_to_10_threshold;
+    snapshot->rounds_to_25_threshold = device_testing_context->endurance_test_info.rounds_to_25_threshold;
+
+    snapshot->current_phase = device_testing_context->endurance_test_info.current_phase;
+    snapshot->phase_start_time = device_testing_context->endurance_test_info.phase_start_time;
+    snapshot->phase_start_bytes = device_testing_context->endurance_test_info.phase_start_bytes;
+    snapshot->last_write_phase_rate = device_testing_context->endurance_test_info.last_write_phase_rate;
+    snapshot->last_read_phase_rate = device_testing_context->endurance_test_info.last_read_phase_rate;
+
+    snapshot->optimal_block_size = device_testing_context->device_info.optimal_block_size;
+
+    // The I/O timeout stats are updated by the I/O watchdog thread rather than
+    // by us, so they can still be an update or two apart from each other
+    memcpy((void *) &snapshot->io_latency_stats, (void *) &device_testing_context->io_latency_stats, sizeof(io_latency_stats_type));
+    memcpy((void *) &snapshot->io_timeout_stats, (void *) &device_testing_context->io_timeout_stats, sizeof(io_timeout_stats_type));
+    memcpy((void *) &snapshot->device_event_stats, (void *) &device_testing_context->device_event_stats, sizeof(device_event_stats_type));
+
+    seqlock_write_end(&block->sequence, sequence);
+}
+
+void stats_block_read(device_testing_context_type *device_testing_context, stats_snapshot_type *snapshot) {
+    stats_block_type *block = &device_testing_context->stats_block;
+    unsigned int sequence;
+
+    do {
+        sequence = seqlock_read_begin(&block->sequence);
+        memcpy(snapshot, (void *) &block->snapshot, sizeof(stats_snapshot_type));
+    } while(seqlock_read_retry(&block->sequence, sequence));
+}
+
+void stats_block_publish_surface_scan(device_testing_context_type *device_testing_context, surface_scan_result_type *result) {
+    surface_scan_info_type *info = &device_testing_context->surface_scan_info;
+    unsigned int sequence = seqlock_write_begin(&info->sequence);
+
+    memcpy(&info->latest, result, sizeof(surface_scan_result_type));
+    info->scans_performed++;
+
+    seqlock_write_end(&info->sequence, sequence);
+}
+
+uint64_t stats_block_read_surface_scan(device_testing_context_type *device_testing_context, surface_scan_result_type *result) {
+    surface_scan_info_type *info = &device_testing_context->surface_scan_info;
+    unsigned int sequence;
+    uint64_t scans_performed;
+
+    do {
+        sequence = seqlock_read_begin(&info->sequence);
+        scans_performed = info->scans_performed;
+        memcpy(result, &info->latest, sizeof(surface_scan_result_type));
+    } while(seqlock_read_retry(&info->sequence, sequence));
+
+    return scans_performed;
+}
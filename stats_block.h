@@ -0,0 +1,53 @@
+#if !defined(STATS_BLOCK_H)
+#define STATS_BLOCK_H
+
+#include "device_testing_context.h"
+
+/**
+ * Publishes a new snapshot of the device's counters to its stats block, so
+ * that other threads can pick up a consistent copy with stats_block_read().
+ * The stats block is protected by a seqlock, so publishing never waits on a
+ * reader.  Must only be called from the main thread.
+ *
+ * @param device_testing_context  The device whose counters should be
+ *                                published.
+ */
+void stats_block_publish(device_testing_context_type *device_testing_context);
+
+/**
+ * Takes a copy of the most recently published snapshot of the device's
+ * counters.  Never takes any locks; if the main thread publishes a new
+ * snapshot while the copy is being made, the copy is simply made again.
+ *
+ * @param device_testing_context  The device whose counters should be read.
+ * @param snapshot                A pointer to a struct that will receive the
+ *                                snapshot.
+ */
+void stats_block_read(device_testing_context_type *device_testing_context, stats_snapshot_type *snapshot);
+
+/**
+ * Publishes the results of a surface scan that just finished: the results are
+ * copied to device_testing_context->surface_scan_info.latest and the number of
+ * scans performed goes up by one.  Uses the same kind of seqlock as the stats
+ * block, so that the SQL thread never picks up a half-copied scan.  Must only
+ * be called from the main thread.
+ *
+ * @param device_testing_context  The device that was scanned.
+ * @param result                  The results of the scan.
+ */
+void stats_block_publish_surface_scan(device_testing_context_type *device_testing_context, surface_scan_result_type *result);
+
+/**
+ * Takes a copy of the most recently published surface scan.  Like
+ * stats_block_read(), this never takes any locks.
+ *
+ * @param device_testing_context  The device whose scan should be read.
+ * @param result                  A pointer to a struct that will receive the
+ *                                results of the scan.
+ *
+ * @returns The number of scans performed as of the copied scan (0 if no scan
+ *          has been published yet).
+ */
+uint64_t stats_block_read_surface_scan(device_testing_context_type *device_testing_context, surface_scan_result_type *result);
+
+#endif // !defined(STATS_BLOCK_H)
@@ -0,0 +1,265 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer_pool.h"
+#include "io_watchdog.h"
+#include "lockfile.h"
+#include "messages.h"
+#include "mfst.h"
+#include "ncurses.h"
+#include "stats_block.h"
+#include "surface_scan.h"
+#include "util.h"
+
+/**
+ * Compares two read speeds.  Used to sort the regions' read speeds with
+ * qsort().
+ */
+static int compare_read_rates(const void *a, const void *b) {
+    double x = *((const double *) a), y = *((const double *) b);
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Works out the median read speed of the regions that have been scanned so
+ * far.  Regions that couldn't be read at all are left out.
+ *
+ * @param result  The scan results.
+ *
+ * @returns The median read speed, in bytes per second, or 0 if no regions have
+ *          been read successfully.
+ */
+static double get_median_read_rate(surface_scan_result_type *result) {
+    double rates[SURFACE_SCAN_REGIONS];
+    int i, num_rates;
+
+    for(i = 0, num_rates = 0; i < result->num_regions; i++) {
+        if(result->regions[i].read_rate) {
+            rates[num_rates++] = result->regions[i].read_rate;
+        }
+    }
+
+    if(!num_rates) {
+        return 0;
+    }
+
+    qsort(rates, num_rates, sizeof(double), compare_read_rates);
+
+    return (num_rates % 2) ? rates[num_rates / 2] : (rates[(num_rates / 2) - 1] + rates[num_rates / 2]) / 2;
+}
+
+int get_surface_scan_region(device_testing_context_type *device_testing_context, surface_scan_result_type *result, uint64_t sector_num) {
+    uint64_t region;
+
+    region = sector_num / (result->region_size / device_testing_context->device_info.sector_size);
+    return region < result->num_regions ? region : result->num_regions - 1;
+}
+
+/**
+ * Reads a single block from the device and measures how long it took.
+ *
+ * @param device_testing_context  The device being scanned.
+ * @param buf                     A buffer large enough to hold the block.
+ * @param position                The byte offset of the block.
+ * @param length                  The size of the block, in bytes.
+ * @param elapsed                 A pointer to a variable that receives the
+ *                                time it took to read the block, in
+ *                                microseconds.
+ *
+ * @returns 0 if the block was read successfully, or -1 if it was not.  On
+ *          error, errno is set to the underlying error.
+ */
+static int timed_surface_scan_read(device_testing_context_type *device_testing_context, char *buf, uint64_t position, uint64_t length, time_t *elapsed) {
+    struct timeval start_time, end_time;
+    uint64_t bytes_left;
+    int64_t ret;
+
+    assert(!gettimeofday(&start_time, NULL));
+
+    for(bytes_left = length; bytes_left; bytes_left -= ret) {
+        ret = io_watchdog_read(device_testing_context, buf + (length - bytes_left), bytes_left, position + (length - bytes_left));
+        if(ret == -1) {
+            return -1;
+        } else if(!ret) {
+            errno = EIO;
+            return -1;
+        }
+    }
+
+    assert(!gettimeofday(&end_time, NULL));
+    *elapsed = timediff(start_time, end_time);
+
+    return 0;
+}
+
+int run_surface_scan(device_testing_context_type *device_testing_context) {
+    char *buf;
+    char rate[15], slowest_rate[15];
+    uint64_t region_sectors, region_start, region_end, block, num_blocks, position, length, block_size, region_bytes, num_reads, total_errors;
+    time_t elapsed, region_time;
+    int i, slowest, num_slow, error_regions, local_errno, prev_show_heatmap;
+    surface_scan_info_type *info = &device_testing_context->surface_scan_info;
+    surface_scan_result_type *result = &info->current;
+    surface_scan_region_type *region;
+    const uint64_t sector_size = device_testing_context->device_info.sector_size;
+    const uint64_t num_sectors = device_testing_context->device_info.num_physical_sectors;
+    const unsigned int sample_percent = program_options.surface_scan_sample_percent;
+
+    // This can run in between rounds of the endurance test, when there may not
+    // be anyone around to dismiss a dialog -- so problems are only logged
+    if(lock_lockfile(device_testing_context)) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SURFACE_SCAN_ABORTING_LOCK_ERROR);
+        return -1;
+    }
+
+    memset(result, 0, sizeof(surface_scan_result_type));
+    result->scan_num = info->scans_performed + 1;
+    result->round_num = device_testing_context->endurance_test_info.rounds_completed;
+    result->num_regions = num_sectors < SURFACE_SCAN_REGIONS ? num_sectors : SURFACE_SCAN_REGIONS;
+    result->sample_percent = sample_percent;
+
+    region_sectors = num_sectors / result->num_regions;
+    result->region_size = region_sectors * sector_size;
+
+    block_size = (SURFACE_SCAN_BLOCK_SIZE / sector_size) * sector_size;
+    if(!block_size) {
+        block_size = sector_size;
+    } else if(block_size > result->region_size) {
+        block_size = result->region_size;
+    }
+
+    if(!(buf = buffer_pool_get(device_testing_context, block_size))) {
+        local_errno = errno;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, block_size, strerror(local_errno));
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SURFACE_SCAN_ABORTING_MEM_ALLOC_ERROR);
+        unlock_lockfile(device_testing_context);
+
+        errno = local_errno;
+        return -1;
+    }
+
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SURFACE_SCAN_STARTING, sample_percent, block_size, result->num_regions);
+
+    // Show the heatmap while the scan runs
+    info->scan_in_progress = 1;
+    prev_show_heatmap = sector_display.show_heatmap;
+    sector_display.show_heatmap = 1;
+    redraw_screen(device_testing_context);
+
+    for(i = 0; i < result->num_regions; i++) {
+        region = &result->regions[i];
+        region_start = i * region_sectors * sector_size;
+        region_end = (i == (result->num_regions - 1)) ? num_sectors * sector_size : region_start + result->region_size;
+        num_blocks = ((region_end - region_start) / block_size) + (((region_end - region_start) % block_size) ? 1 : 0);
+
+        region_bytes = 0;
+        region_time = 0;
+        num_reads = 0;
+
+        for(block = 0; block < num_blocks; block++) {
+            // Spread the sampled blocks evenly across the region.  The first
+            // block is always read, so every region gets at least one sample.
+            if(((block * sample_percent) % 100) >= sample_percent) {
+                continue;
+            }
+
+            position = region_start + (block * block_size);
+            length = (region_end - position) < block_size ? (region_end - position) : block_size;
+
+            if(timed_surface_scan_read(device_testing_context, buf, position, length, &elapsed)) {
+                local_errno = errno;
+                if(local_errno == EIO) {
+                    log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_SURFACE_SCAN_READ_ERROR, position, strerror(local_errno));
+                    region->read_errors++;
+                    continue;
+                }
+
+                buffer_pool_put(device_testing_context, buf);
+                unlock_lockfile(device_testing_context);
+
+                log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_READ_ERROR, strerror(local_errno));
+                log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SURFACE_SCAN_ABORTING_DEVICE_ERROR);
+
+                info->scan_in_progress = 0;
+                sector_display.show_heatmap = prev_show_heatmap;
+                redraw_screen(device_testing_context);
+
+                errno = local_errno;
+                return -1;
+            }
+
+            region_bytes += length;
+            region_time += elapsed;
+            num_reads++;
+
+            if(elapsed > region->max_latency) {
+                region->max_latency = elapsed;
+            }
+        }
+
+        if(num_reads) {
+            region->read_rate = ((double) region_bytes) / (((double) (region_time ? region_time : 1)) / 1000000.0);
+            region->avg_latency = region_time / num_reads;
+        }
+
+        // The colors on the heatmap are relative to the median, so a new
+        // median means the whole map needs to be redrawn
+        result->median_read_rate = get_median_read_rate(result);
+        draw_sectors(device_testing_context, 0, num_sectors);
+        handle_key_inputs(device_testing_context, NULL);
+    }
+
+    buffer_pool_put(device_testing_context, buf);
+    unlock_lockfile(device_testing_context);
+
+    result->end_time = time(NULL);
+
+    slowest = -1;
+    num_slow = 0;
+    error_regions = 0;
+    total_errors = 0;
+
+    for(i = 0; i < result->num_regions; i++) {
+        region = &result->regions[i];
+        if(region->read_errors) {
+            error_regions++;
+            total_errors += region->read_errors;
+        }
+
+        if(!region->read_rate) {
+            continue;
+        }
+
+        if(slowest == -1 || region->read_rate < result->regions[slowest].read_rate) {
+            slowest = i;
+        }
+
+        if(region->read_rate < (result->median_read_rate * SURFACE_SCAN_VERY_SLOW_THRESHOLD)) {
+            num_slow++;
+        }
+    }
+
+    stats_block_publish_surface_scan(device_testing_context, result);
+    info->scan_in_progress = 0;
+
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SURFACE_SCAN_RESULT, format_rate(result->median_read_rate, rate, sizeof(rate)),
+            slowest == -1 ? 0 : slowest * result->region_size, format_rate(slowest == -1 ? 0 : result->regions[slowest].read_rate, slowest_rate, sizeof(slowest_rate)),
+            num_slow, result->num_regions);
+
+    if(total_errors) {
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SURFACE_SCAN_READ_ERRORS, total_errors, error_regions);
+    }
+
+    sector_display.show_heatmap = prev_show_heatmap;
+    redraw_screen(device_testing_context);
+
+    return 0;
+}
@@ -0,0 +1,60 @@
+#if !defined(SURFACE_SCAN_H)
+#define SURFACE_SCAN_H
+
+#include <inttypes.h>
+
+#include "device_testing_context.h"
+
+// Size of the reads issued by the surface scan, in bytes.  Smaller regions are
+// read in a single request.
+#define SURFACE_SCAN_BLOCK_SIZE 1048576
+
+// Regions that read slower than these fractions of the median read speed are
+// flagged on the heatmap
+#define SURFACE_SCAN_SLOW_THRESHOLD      0.75
+#define SURFACE_SCAN_VERY_SLOW_THRESHOLD 0.50
+#define SURFACE_SCAN_CRAWL_THRESHOLD     0.25
+
+/**
+ * Reads the device from start to finish and records how quickly each part of
+ * it reads.  The device is divided into SURFACE_SCAN_REGIONS regions, and the
+ * read speed, average and maximum read latency, and number of failed reads are
+ * recorded for each one.  Flash that is wearing out tends to need more and
+ * more error correction (and read retries) before its sectors fail outright,
+ * so regions that read slower than the rest of the device are an early
+ * warning sign.
+ *
+ * Reads are SURFACE_SCAN_BLOCK_SIZE bytes long.  If --surface-scan-sample was
+ * given, only that percentage of each region is read, spread out evenly across
+ * the region.  Reads that fail with EIO are counted against their region and
+ * the scan carries on; any other error ends the scan.
+ *
+ * While the scan is running, its results so far are kept in
+ * device_testing_context->surface_scan_info.current and the sector map is
+ * replaced with a heatmap of them.  The data on the device isn't modified.
+ *
+ * The caller is expected to have waited for the lockfile to be free; the scan
+ * takes the lock itself.
+ *
+ * @param device_testing_context  The device to be scanned.
+ *
+ * @returns 0 if the scan completed, or -1 if it did not.  On success, the
+ *          results are copied to
+ *          device_testing_context->surface_scan_info.latest.  On error, errno
+ *          is set to the underlying error and the results of the previous scan
+ *          (if any) are left alone.
+ */
+int run_surface_scan(device_testing_context_type *device_testing_context);
+
+/**
+ * Works out which region of a surface scan a sector falls in.
+ *
+ * @param device_testing_context  The device that was scanned.
+ * @param result                  The results of the scan.
+ * @param sector_num              The sector to look up.
+ *
+ * @returns The index of the region in result->regions.
+ */
+int get_surface_scan_region(device_testing_context_type *device_testing_context, surface_scan_result_type *result, uint64_t sector_num);
+
+#endif // !defined(SURFACE_SCAN_H)
@@ -0,0 +1,221 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer_pool.h"
+#include "io_watchdog.h"
+#include "messages.h"
+#include "mfst.h"
+#include "ncurses.h"
+#include "rng.h"
+#include "sustained_write_test.h"
+#include "util.h"
+
+/**
+ * Displays a dialog to the user indicating that the sustained write test
+ * encountered an I/O error, and logs the error.  This function blocks until
+ * the user dismisses the dialog.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param errnum                  The error number of the error that occurred.
+ */
+static void io_error_during_sustained_write_test(device_testing_context_type *device_testing_context, int errnum) {
+    log_log(device_testing_context, "probe_sustained_write_speed", SEVERITY_LEVEL_DEBUG, MSG_WRITE_ERROR, strerror(errnum));
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SUSTAINED_WRITE_TEST_ABORTING_DEVICE_ERROR);
+
+    message_window(device_testing_context, stdscr, WARNING_TITLE,
+                   "We ran into an error during the sustained write test.  It "
+                   "could be that the device was removed, experienced an error "
+                   "and disconnected itself, or set itself to read-only.  The "
+                   "speed class results will be based on the 30-second "
+                   "sequential write test instead -- but if the device really "
+                   "has been removed or set to read-only, the remainder of the "
+                   "tests are going to fail pretty quickly.", 1);
+}
+
+int probe_sustained_write_speed(device_testing_context_type *device_testing_context) {
+    struct timeval start_time, sample_start_time, cur_time;
+    char *buf;
+    char rate[15], post_rate[15];
+    uint64_t max_bytes, bytes_written, bytes_left, sample_start_bytes, num_samples;
+    uint64_t window_start_bytes[SUSTAINED_WRITE_TEST_WINDOW_SAMPLES];
+    time_t window_start_times[SUSTAINED_WRITE_TEST_WINDOW_SAMPLES], elapsed, cliff_time;
+    double window_rates[SUSTAINED_WRITE_TEST_WINDOW_SAMPLES], pre_window_rate, window_rate, plateau_rate;
+    int64_t ret;
+    int i, oldest, cliff_sample, prev_percent, cur_percent, local_errno, plateau_windows;
+    const uint64_t block_size = device_testing_context->device_info.optimal_block_size;
+    sustained_write_test_info_type *info = &device_testing_context->sustained_write_test_info;
+    WINDOW *window;
+
+    max_bytes = (((device_testing_context->device_info.num_physical_sectors * device_testing_context->device_info.sector_size * program_options.sustained_write_percent) / 100) / block_size) * block_size;
+    if(!max_bytes) {
+        max_bytes = block_size;
+    }
+
+    if(!(buf = buffer_pool_get(device_testing_context, block_size))) {
+        local_errno = errno;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, block_size, strerror(local_errno));
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_SUSTAINED_WRITE_TEST_ABORTING_MEM_ALLOC_ERROR);
+
+        message_window(device_testing_context, stdscr, WARNING_TITLE,
+                       "We ran into an error while trying to allocate memory "
+                       "for the sustained write test.  This could mean your "
+                       "system is low on memory.  The speed class results will "
+                       "be based on the 30-second sequential write test "
+                       "instead.", 1);
+
+        errno = local_errno;
+        return -1;
+    }
+
+    memset(info, 0, sizeof(sustained_write_test_info_type));
+
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SUSTAINED_WRITE_TEST_STARTING, max_bytes);
+    window = message_window(device_testing_context, stdscr, "Measuring sustained write speed",
+        "\n                                        ", // Make room for the progress bar
+    0);
+
+    assert(!gettimeofday(&start_time, NULL));
+    sample_start_time = cur_time = start_time;
+    sample_start_bytes = 0;
+    num_samples = 0;
+    cliff_sample = -1;
+    cliff_time = 0;
+    prev_percent = 0;
+    plateau_rate = 0;
+    plateau_windows = 0;
+
+    for(bytes_written = 0; bytes_written < max_bytes;) {
+        handle_key_inputs(device_testing_context, window);
+
+        rng_fill_buffer(device_testing_context, buf, block_size);
+        for(bytes_left = block_size; bytes_left; bytes_left -= ret) {
+            ret = io_watchdog_write(device_testing_context, buf + (block_size - bytes_left), bytes_left, bytes_written + (block_size - bytes_left));
+            if(ret == -1 || !ret) {
+                local_errno = ret ? errno : EIO;
+                buffer_pool_put(device_testing_context, buf);
+                erase_and_delete_window(window);
+
+                io_error_during_sustained_write_test(device_testing_context, local_errno);
+
+                errno = local_errno;
+                return -1;
+            }
+        }
+
+        bytes_written += block_size;
+        assert(!gettimeofday(&cur_time, NULL));
+
+        cur_percent = (bytes_written * 40) / max_bytes;
+        if(cur_percent != prev_percent) {
+            // Advance the graph
+            if(!program_options.no_curses) {
+                wattron(window, COLOR_PAIR(BLACK_ON_GREEN));
+                mvwprintw(window, 2, 2, "%*s", cur_percent, "");
+                wattroff(window, COLOR_PAIR(BLACK_ON_GREEN));
+                touchwin(stdscr);
+                wrefresh(window);
+            }
+
+            prev_percent = cur_percent;
+        }
+
+        if(timediff(sample_start_time, cur_time) < SUSTAINED_WRITE_TEST_SAMPLE_INTERVAL) {
+            continue;
+        }
+
+        // Close out this sample.  The last few samples are kept in a ring,
+        // along with how far into the test each one started.
+        i = num_samples % SUSTAINED_WRITE_TEST_WINDOW_SAMPLES;
+        window_start_bytes[i] = sample_start_bytes;
+        window_start_times[i] = timediff(start_time, sample_start_time);
+        window_rates[i] = ((double) (bytes_written - sample_start_bytes)) / (((double) timediff(sample_start_time, cur_time)) / 1000000.0);
+
+        num_samples++;
+        sample_start_time = cur_time;
+        sample_start_bytes = bytes_written;
+        elapsed = timediff(start_time, cur_time);
+
+        if(cliff_sample == -1 && num_samples > SUSTAINED_WRITE_TEST_WINDOW_SAMPLES) {
+            // Compare the last few samples against everything that came before
+            // them.  Averaging over several samples keeps a single slow second
+            // (the device doing some housekeeping, say) from being mistaken
+            // for the cache filling up.
+            oldest = num_samples % SUSTAINED_WRITE_TEST_WINDOW_SAMPLES;
+            pre_window_rate = ((double) window_start_bytes[oldest]) / (((double) window_start_times[oldest]) / 1000000.0);
+            window_rate = ((double) (bytes_written - window_start_bytes[oldest])) / (((double) (elapsed - window_start_times[oldest])) / 1000000.0);
+
+            if((window_rate * SUSTAINED_WRITE_TEST_CLIFF_FACTOR) < pre_window_rate) {
+                // Pin the drop on the first slow sample in the window
+                for(i = 0; i < (SUSTAINED_WRITE_TEST_WINDOW_SAMPLES - 1); i++) {
+                    if((window_rates[(oldest + i) % SUSTAINED_WRITE_TEST_WINDOW_SAMPLES] * SUSTAINED_WRITE_TEST_CLIFF_FACTOR) < pre_window_rate) {
+                        break;
+                    }
+                }
+
+                cliff_sample = (oldest + i) % SUSTAINED_WRITE_TEST_WINDOW_SAMPLES;
+                cliff_time = window_start_times[cliff_sample];
+
+                info->cliff_detected = 1;
+                info->write_cache_size = window_start_bytes[cliff_sample];
+            }
+        }
+
+        if(cliff_sample != -1 && (elapsed - cliff_time) >= (SUSTAINED_WRITE_TEST_STEADY_STATE_SECONDS * 1000000ULL)) {
+            break;
+        }
+
+        // No drop yet -- check to see if the write speed has settled down.
+        // Each window that ends within the tolerance of the speed at the start
+        // of the current run extends the run; any other window starts a new
+        // one.
+        if(cliff_sample == -1 && !(num_samples % SUSTAINED_WRITE_TEST_WINDOW_SAMPLES)) {
+            oldest = num_samples % SUSTAINED_WRITE_TEST_WINDOW_SAMPLES;
+            window_rate = ((double) (bytes_written - window_start_bytes[oldest])) / (((double) (elapsed - window_start_times[oldest])) / 1000000.0);
+
+            if(plateau_windows && window_rate >= (plateau_rate * (1 - SUSTAINED_WRITE_TEST_PLATEAU_TOLERANCE)) &&
+               window_rate <= (plateau_rate * (1 + SUSTAINED_WRITE_TEST_PLATEAU_TOLERANCE))) {
+                plateau_windows++;
+            } else {
+                plateau_rate = window_rate;
+                plateau_windows = 1;
+            }
+
+            if(plateau_windows >= SUSTAINED_WRITE_TEST_PLATEAU_WINDOWS) {
+                info->plateau_detected = 1;
+                log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SUSTAINED_WRITE_TEST_PLATEAU, format_rate(plateau_rate, rate, sizeof(rate)),
+                        (SUSTAINED_WRITE_TEST_PLATEAU_WINDOWS * SUSTAINED_WRITE_TEST_WINDOW_SAMPLES * SUSTAINED_WRITE_TEST_SAMPLE_INTERVAL) / 1000000);
+                break;
+            }
+        }
+    }
+
+    buffer_pool_put(device_testing_context, buf);
+    erase_and_delete_window(window);
+
+    elapsed = timediff(start_time, cur_time);
+
+    info->test_performed = 1;
+    info->bytes_written = bytes_written;
+
+    if(info->cliff_detected) {
+        info->pre_cliff_write_speed = ((double) info->write_cache_size) / (((double) cliff_time) / 1000000.0);
+        info->post_cliff_write_speed = ((double) (bytes_written - info->write_cache_size)) / (((double) (elapsed - cliff_time)) / 1000000.0);
+        info->sustained_write_speed = info->post_cliff_write_speed;
+
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SUSTAINED_WRITE_TEST_CLIFF, format_rate(info->pre_cliff_write_speed, rate, sizeof(rate)),
+                format_rate(info->post_cliff_write_speed, post_rate, sizeof(post_rate)), info->write_cache_size);
+    } else {
+        info->sustained_write_speed = ((double) bytes_written) / (((double) (elapsed ? elapsed : 1)) / 1000000.0);
+
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SUSTAINED_WRITE_TEST_NO_CLIFF, bytes_written, format_rate(info->sustained_write_speed, rate, sizeof(rate)));
+    }
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#if !defined(SUSTAINED_WRITE_TEST_H)
+#define SUSTAINED_WRITE_TEST_H
+
+#include <inttypes.h>
+
+#include "device_testing_context.h"
+
+// Interval at which the write speed is sampled during the sustained write
+// test, in microseconds
+#define SUSTAINED_WRITE_TEST_SAMPLE_INTERVAL 1000000
+
+// Number of samples that are averaged together when looking for the drop in
+// write speed
+#define SUSTAINED_WRITE_TEST_WINDOW_SAMPLES 5
+
+// How many times slower the writes have to get before we decide that the
+// device's write cache has filled up
+#define SUSTAINED_WRITE_TEST_CLIFF_FACTOR 2
+
+// Number of seconds to keep writing after the drop in write speed, so that we
+// get a good measurement of the post-drop speed
+#define SUSTAINED_WRITE_TEST_STEADY_STATE_SECONDS 30
+
+// If the write speed hasn't dropped off, the test also stops once the average
+// speed over SUSTAINED_WRITE_TEST_PLATEAU_WINDOWS back-to-back windows of
+// SUSTAINED_WRITE_TEST_WINDOW_SAMPLES samples has stayed within this fraction
+// of the speed at the start of the run.  The run is long (three minutes) so
+// that a large write cache isn't mistaken for the device's steady state.
+#define SUSTAINED_WRITE_TEST_PLATEAU_TOLERANCE 0.10
+#define SUSTAINED_WRITE_TEST_PLATEAU_WINDOWS   36
+
+/**
+ * Measures the speed at which the device can write data over a long stretch of
+ * time.
+ *
+ * Many devices write into a fast cache (usually a chunk of flash run in SLC
+ * mode) until it fills up, and then slow down dramatically.  The 30-second
+ * sequential write test often ends before that happens.  This test writes
+ * random data sequentially from the start of the device, sampling the write
+ * speed once a second, until either the average speed over the last
+ * SUSTAINED_WRITE_TEST_WINDOW_SAMPLES samples drops below
+ * 1/SUSTAINED_WRITE_TEST_CLIFF_FACTOR of the average speed up to that point
+ * (and SUSTAINED_WRITE_TEST_STEADY_STATE_SECONDS more seconds have been spent
+ * measuring the slower speed), the write speed holds steady for
+ * SUSTAINED_WRITE_TEST_PLATEAU_WINDOWS windows in a row without dropping off,
+ * or the percentage of the device given by --sustained-write-test has been
+ * written.
+ *
+ * The caller is expected to hold the lockfile.
+ *
+ * @param device_testing_context  The device to be tested.
+ *
+ * @returns 0 if the test was successful, or -1 if the test failed.  On success,
+ *          the results are placed in
+ *          device_testing_context->sustained_write_test_info.
+ */
+int probe_sustained_write_speed(device_testing_context_type *device_testing_context);
+
+#endif // !defined(SUSTAINED_WRITE_TEST_H)
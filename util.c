@@ -1,6 +1,8 @@
+#include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/socket.h>
 
 #include "util.h"
 
@@ -52,3 +54,22 @@ void multifree(int num_args, ...) {
     va_end(list);
 }
 
+
+int send_all(int fd, const char *buf, size_t len) {
+    ssize_t ret;
+
+    while(len) {
+        if((ret = send(fd, buf, len, MSG_NOSIGNAL)) == -1) {
+            if(errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        buf += ret;
+        len -= ret;
+    }
+
+    return 0;
+}
@@ -1,6 +1,7 @@
 #if !defined(UTIL_H)
 #define UTIL_H
 
+#include <stddef.h>
 #include <sys/time.h>
 
 /**
@@ -40,4 +41,18 @@ time_t timediff(struct timeval start_time, struct timeval end_time);
 */
 void multifree(int num_args, ...);
 
+/**
+ * Sends the entire contents of a buffer over a socket, retrying until all of
+ * it has been sent.  SIGPIPE is suppressed, so a client that hangs up early
+ * just causes an error to be returned.
+ *
+ * @param fd   The socket to send the data on.
+ * @param buf  The data to be sent.
+ * @param len  The number of bytes to send.
+ *
+ * @returns 0 if all of the data was sent, or -1 if an error occurred.  On
+ *          error, errno is set to the underlying error.
+ */
+int send_all(int fd, const char *buf, size_t len);
+
 #endif // !defined(UTIL_H)
@@ -5,3 +5,4 @@ define( 'MYSQL_USER', '' );   // Set this to your MySQL/MariaDB username
 define( 'MYSQL_PASS', '' );   // Set this to your MySQL/MariaDB password
 define( 'MYSQL_DBNAME', '' ); // Set this to the name of your MySQL/MariaDB database
 define( 'MYSQL_PORT', 3306 ); // Set this to the port number that your MySQL/MariaDB host is running on (the default is 3306)
+define( 'COLLECTOR_STATUS_FILE', '' ); // Set this to the --status-file passed to mfst-collector (optional)
@@ -2,12 +2,115 @@
 
 require_once( 'config.php' ); // Set this to the path to your config.php
 
+// ?collector returns mfst-collector's summary of the instances reporting in
+// through it (totals across all of them, plus the latest status of each card).
+// This doesn't need the database.
+if( array_key_exists( 'collector', $_REQUEST ) ) {
+    $status = COLLECTOR_STATUS_FILE ? @file_get_contents( COLLECTOR_STATUS_FILE ) : false;
+    if( $status === false ) {
+        header( $_SERVER[ 'SERVER_PROTOCOL' ] . ' 404 Not Found' );
+        die( json_encode( [ 'error' => 'The collector status file is not available.' ] ) );
+    }
+
+    header( 'Content-Type: application/json' );
+    die( $status );
+}
+
 $db = new mysqli( MYSQL_HOST, MYSQL_USER, MYSQL_PASS, MYSQL_DBNAME, MYSQL_PORT );
 if( $db->connect_error ) {
     header( $_SERVER[ 'SERVER_PROTOCOL' ] . ' 500 Internal Server Error' );
     die( json_encode( [ 'error' => 'Unable to connect to the MySQL server.' ] ) );
 }
 
+// Downsampled time series for graphing.  ?history=<card id> returns the status
+// samples for a card; ?rounds=<card id> (or ?rounds=all for every card) returns
+// the end-of-round summaries.  Rows are averaged over evenly-sized buckets so
+// that at most `points` rows (default 500) come back per card.
+if( array_key_exists( 'history', $_REQUEST ) || array_key_exists( 'rounds', $_REQUEST ) ) {
+    $points = array_key_exists( 'points', $_REQUEST ) ? intval( $_REQUEST[ 'points' ] ) : 500;
+    $points = max( 1, min( $points, 5000 ) );
+    $output = [];
+
+    if( array_key_exists( 'history', $_REQUEST ) ) {
+        $id = intval( $_REQUEST[ 'history' ] );
+        $where = 'id = ' . $id;
+
+        if( array_key_exists( 'since', $_REQUEST ) ) {
+            $where .= ' AND sample_time >= ' . intval( $_REQUEST[ 'since' ] );
+        }
+
+        if( array_key_exists( 'until', $_REQUEST ) ) {
+            $where .= ' AND sample_time <= ' . intval( $_REQUEST[ 'until' ] );
+        }
+
+        $result = $db->query( 'SELECT MIN(sample_time) lo, MAX(sample_time) hi FROM status_history WHERE ' . $where );
+        $range = $result->fetch_object();
+        $result->free();
+
+        if( $range->lo !== null ) {
+            $bucket = max( 1, intval( ceil( ( $range->hi - $range->lo + 1 ) / $points ) ) );
+            $result = $db->query( 'SELECT MIN(sample_time) sample_time, MAX(cur_round_num) + IFNULL((SELECT round_num_offset FROM consolidated_sector_maps WHERE id = ' . $id . '), 0) cur_round_num, ' .
+                                  'MAX(num_bad_sectors) num_bad_sectors, AVG(rate) rate, AVG(read_rate) read_rate, AVG(write_rate) write_rate, ' .
+                                  'AVG(avg_read_latency) avg_read_latency, AVG(avg_write_latency) avg_write_latency, MAX(total_bytes_read) total_bytes_read, ' .
+                                  'MAX(total_bytes_written) total_bytes_written FROM status_history WHERE ' . $where . ' GROUP BY FLOOR((sample_time - ' . $range->lo . ') / ' . $bucket . ') ' .
+                                  'ORDER BY sample_time' );
+
+            while( $row = $result->fetch_object() ) {
+                $output[] = [
+                    'sample_time' => $row->sample_time,
+                    'cur_round_num' => $row->cur_round_num,
+                    'num_bad_sectors' => $row->num_bad_sectors,
+                    'rate' => $row->rate,
+                    'read_rate' => $row->read_rate,
+                    'write_rate' => $row->write_rate,
+                    'avg_read_latency' => $row->avg_read_latency,
+                    'avg_write_latency' => $row->avg_write_latency,
+                    'total_bytes_read' => $row->total_bytes_read,
+                    'total_bytes_written' => $row->total_bytes_written
+                ];
+            }
+
+            $result->free();
+        }
+    } else {
+        $where = $_REQUEST[ 'rounds' ] === 'all' ? '1' : 'a.id = ' . intval( $_REQUEST[ 'rounds' ] );
+
+        $result = $db->query( 'SELECT MAX(a.round_num) hi FROM round_history a WHERE ' . $where );
+        $range = $result->fetch_object();
+        $result->free();
+
+        if( $range->hi !== null ) {
+            $bucket = max( 1, intval( ceil( $range->hi / $points ) ) );
+            $result = $db->query( 'SELECT a.id id, MAX(a.round_num) + IFNULL(MAX(b.round_num_offset), 0) round_num, MAX(a.end_time) end_time, ' .
+                                  'SUM(a.num_bad_sectors_this_round) num_bad_sectors_this_round, SUM(a.num_new_bad_sectors_this_round) num_new_bad_sectors_this_round, ' .
+                                  'SUM(a.num_good_sectors_this_round) num_good_sectors_this_round, MAX(a.total_bad_sectors) total_bad_sectors, ' .
+                                  'MAX(a.total_bytes_read) total_bytes_read, MAX(a.total_bytes_written) total_bytes_written ' .
+                                  'FROM round_history a LEFT JOIN consolidated_sector_maps b ON a.id = b.id WHERE ' . $where . ' ' .
+                                  'GROUP BY a.id, FLOOR((a.round_num - 1) / ' . $bucket . ') ORDER BY a.id, round_num' );
+
+            while( $row = $result->fetch_object() ) {
+                $output[] = [
+                    'id' => $row->id,
+                    'round_num' => $row->round_num,
+                    'end_time' => $row->end_time,
+                    'num_bad_sectors_this_round' => $row->num_bad_sectors_this_round,
+                    'num_new_bad_sectors_this_round' => $row->num_new_bad_sectors_this_round,
+                    'num_good_sectors_this_round' => $row->num_good_sectors_this_round,
+                    'total_bad_sectors' => $row->total_bad_sectors,
+                    'total_bytes_read' => $row->total_bytes_read,
+                    'total_bytes_written' => $row->total_bytes_written
+                ];
+            }
+
+            $result->free();
+        }
+    }
+
+    $db->close();
+
+    die( json_encode( $output ) );
+}
+
 $query = 'SELECT a.id id, a.name name, a.size size, b.status, b.rate, (b.cur_round_num + b.round_num_offset) cur_round_num, b.num_bad_sectors num_bad_sectors, b.consolidated_sector_map data, b.last_updated last_updated FROM cards a, consolidated_sector_maps b WHERE a.id = b.id AND b.is_active = 1';
 
 if( array_key_exists( 'since', $_REQUEST ) ) {
@@ -0,0 +1,708 @@
+#include <assert.h>
+#include <errno.h>
+#include <json-c/json_object.h>
+#include <json-c/json_util.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer_pool.h"
+#include "device.h"
+#include "latency_histogram.h"
+#include "messages.h"
+#include "mfst.h"
+#include "ncurses.h"
+#include "rng.h"
+#include "util.h"
+#include "workload.h"
+
+// Largest request size a job file is allowed to ask for
+#define WORKLOAD_MAX_BLOCK_SIZE (16 * 1048576)
+
+// Longest a job file is allowed to make the workers sit idle between bursts,
+// in milliseconds
+#define WORKLOAD_MAX_BURST_IDLE 60000
+
+// Longest the workers nap at a time while they're sitting idle between bursts,
+// in milliseconds, so that they notice promptly when they're told to stop
+#define WORKLOAD_IDLE_SLICE 100
+
+typedef struct _workload_worker_type {
+    device_testing_context_type *device_testing_context;
+    workload_job_type *job;
+    char *buf;                          // Buffer for this worker's requests
+    unsigned int seed;                  // Seed for this worker's offsets,
+                                        // sizes, and read/write choices
+    int *stop;                          // Set to non-zero to stop all workers
+    uint64_t region_start;              // Start of the job's region, in bytes
+    uint64_t region_size;               // Size of the job's region, in bytes
+    uint64_t *next_offset;              // Next offset (relative to the start
+                                        // of the region) for sequential jobs;
+                                        // shared by all of the workers
+    uint64_t *bytes_issued;             // Bytes issued so far by all of the
+                                        // workers
+    uint64_t completed;                 // Number of requests completed
+    uint64_t bytes_completed;           // Number of bytes transferred
+    int error;                          // errno from a failed request, or 0
+    char error_was_write;               // Was the failed request a write?
+    latency_histogram_type read_histogram;
+    latency_histogram_type write_histogram;
+} workload_worker_type;
+
+/**
+ * Reads an optional non-negative integer out of a job.
+ *
+ * @param entry          The JSON object describing the job.
+ * @param key            The key to read.
+ * @param min            The smallest value allowed.
+ * @param max            The largest value allowed.
+ * @param default_value  The value to use if the key isn't present.
+ * @param value          A pointer to a variable that receives the value.
+ * @param job_num        The index of the job in the file, for error messages.
+ * @param error          A buffer that receives a description of the problem if
+ *                       the value is invalid.
+ * @param error_size     The size of `error`, in bytes.
+ *
+ * @returns 0 if the key was missing or held a valid value, or -1 if it held an
+ *          invalid value.
+ */
+static int get_workload_uint(struct json_object *entry, const char *key, uint64_t min, uint64_t max, uint64_t default_value, uint64_t *value, int job_num, char *error,
+                             size_t error_size) {
+    struct json_object *obj;
+    int64_t i;
+
+    if(!json_object_object_get_ex(entry, key, &obj)) {
+        *value = default_value;
+        return 0;
+    }
+
+    if(!json_object_is_type(obj, json_type_int) || (i = json_object_get_int64(obj)) < 0 || ((uint64_t) i) < min || ((uint64_t) i) > max) {
+        snprintf(error, error_size, "job %d: \"%s\" must be a whole number between %lu and %lu", job_num + 1, key, min, max);
+        return -1;
+    }
+
+    *value = i;
+    return 0;
+}
+
+/**
+ * Adds a block size to a job, after making sure it's sane.
+ *
+ * @param job         The job to add the block size to.
+ * @param size        The block size, in bytes.
+ * @param weight      How often the block size should be picked, relative to
+ *                    the job's other block sizes.
+ * @param job_num     The index of the job in the file, for error messages.
+ * @param error       A buffer that receives a description of the problem if
+ *                    the block size is invalid.
+ * @param error_size  The size of `error`, in bytes.
+ *
+ * @returns 0 if the block size was added, or -1 if it was invalid.
+ */
+static int add_workload_block_size(workload_job_type *job, uint64_t size, uint64_t weight, int job_num, char *error, size_t error_size) {
+    if(job->num_block_sizes == WORKLOAD_MAX_BLOCK_SIZES) {
+        snprintf(error, error_size, "job %d: no more than %d block sizes may be given", job_num + 1, WORKLOAD_MAX_BLOCK_SIZES);
+        return -1;
+    }
+
+    // Every device we're likely to see has 512-byte sectors at the least;
+    // we'll check against the real sector size when the job is run
+    if(size % 512) {
+        snprintf(error, error_size, "job %d: block size %lu isn't a multiple of 512", job_num + 1, size);
+        return -1;
+    }
+
+    job->block_sizes[job->num_block_sizes].size = size;
+    job->block_sizes[job->num_block_sizes].weight = weight;
+    job->num_block_sizes++;
+    job->total_weight += weight;
+
+    return 0;
+}
+
+/**
+ * Fills out a job from its description in the workload file.
+ *
+ * @param entry       The JSON object describing the job.
+ * @param job         The job to fill out.
+ * @param job_num     The index of the job in the file, for error messages.
+ * @param error       A buffer that receives a description of the problem if
+ *                    the job is invalid.
+ * @param error_size  The size of `error`, in bytes.
+ *
+ * @returns 0 if the job was filled out, or -1 if it was invalid.
+ */
+static int parse_workload_job(struct json_object *entry, workload_job_type *job, int job_num, char *error, size_t error_size) {
+    struct json_object *obj, *size_entry, *size_obj;
+    uint64_t value, weight;
+    const char *pattern;
+    int i;
+
+    if(!json_object_is_type(entry, json_type_object)) {
+        snprintf(error, error_size, "job %d isn't an object", job_num + 1);
+        return -1;
+    }
+
+    if(!json_object_object_get_ex(entry, "name", &obj) || !json_object_is_type(obj, json_type_string)) {
+        snprintf(error, error_size, "job %d doesn't have a name", job_num + 1);
+        return -1;
+    }
+
+    assert(job->name = strdup(json_object_get_string(obj)));
+
+    if(json_object_object_get_ex(entry, "block_size", &obj)) {
+        if(get_workload_uint(entry, "block_size", 512, WORKLOAD_MAX_BLOCK_SIZE, 0, &value, job_num, error, error_size) ||
+           add_workload_block_size(job, value, 1, job_num, error, error_size)) {
+            return -1;
+        }
+    }
+
+    if(json_object_object_get_ex(entry, "block_sizes", &obj)) {
+        if(!json_object_is_type(obj, json_type_array)) {
+            snprintf(error, error_size, "job %d: \"block_sizes\" must be an array", job_num + 1);
+            return -1;
+        }
+
+        for(i = 0; i < json_object_array_length(obj); i++) {
+            size_entry = json_object_array_get_idx(obj, i);
+            if(!json_object_is_type(size_entry, json_type_object) || !json_object_object_get_ex(size_entry, "size", &size_obj)) {
+                snprintf(error, error_size, "job %d: each entry in \"block_sizes\" must be an object with a \"size\"", job_num + 1);
+                return -1;
+            }
+
+            if(get_workload_uint(size_entry, "size", 512, WORKLOAD_MAX_BLOCK_SIZE, 0, &value, job_num, error, error_size) ||
+               get_workload_uint(size_entry, "weight", 1, 1000000, 1, &weight, job_num, error, error_size) ||
+               add_workload_block_size(job, value, weight, job_num, error, error_size)) {
+                return -1;
+            }
+        }
+    }
+
+    if(!job->num_block_sizes) {
+        snprintf(error, error_size, "job %d doesn't have a \"block_size\" or \"block_sizes\"", job_num + 1);
+        return -1;
+    }
+
+    job->pattern = WORKLOAD_PATTERN_RANDOM;
+    if(json_object_object_get_ex(entry, "pattern", &obj)) {
+        pattern = json_object_is_type(obj, json_type_string) ? json_object_get_string(obj) : "";
+        if(!strcmp(pattern, "sequential")) {
+            job->pattern = WORKLOAD_PATTERN_SEQUENTIAL;
+        } else if(strcmp(pattern, "random")) {
+            snprintf(error, error_size, "job %d: \"pattern\" must be \"random\" or \"sequential\"", job_num + 1);
+            return -1;
+        }
+    }
+
+    if(get_workload_uint(entry, "read_percent", 0, 100, 100, &value, job_num, error, error_size)) {
+        return -1;
+    }
+
+    job->read_percent = value;
+
+    if(get_workload_uint(entry, "queue_depth", 1, WORKLOAD_MAX_QUEUE_DEPTH, 1, &value, job_num, error, error_size)) {
+        return -1;
+    }
+
+    job->queue_depth = value;
+
+    if(get_workload_uint(entry, "region_start", 0, 99, 0, &value, job_num, error, error_size)) {
+        return -1;
+    }
+
+    job->region_start = value;
+
+    if(get_workload_uint(entry, "region_end", job->region_start + 1, 100, 100, &value, job_num, error, error_size)) {
+        return -1;
+    }
+
+    job->region_end = value;
+
+    if(get_workload_uint(entry, "duration", 1, 86400, 0, &job->duration, job_num, error, error_size) ||
+       get_workload_uint(entry, "bytes", 1, UINT64_MAX >> 1, 0, &job->byte_limit, job_num, error, error_size)) {
+        return -1;
+    }
+
+    if(!job->duration && !job->byte_limit) {
+        job->duration = WORKLOAD_DEFAULT_DURATION;
+    }
+
+    if(get_workload_uint(entry, "burst_requests", 0, 1000000, 0, &value, job_num, error, error_size)) {
+        return -1;
+    }
+
+    job->burst_requests = value;
+
+    if(get_workload_uint(entry, "burst_idle", 0, WORKLOAD_MAX_BURST_IDLE, 0, &value, job_num, error, error_size)) {
+        return -1;
+    }
+
+    job->burst_idle = value;
+
+    return 0;
+}
+
+int load_workload_file(const char *filename, workload_job_type **jobs, int *num_jobs, char *error, size_t error_size) {
+    struct json_object *root, *array;
+    workload_job_type *list;
+    int i, count;
+
+    if(!(root = json_object_from_file(filename))) {
+        snprintf(error, error_size, "%s", json_util_get_last_err());
+
+        // json-c ends its error messages with a newline
+        if(strlen(error) && error[strlen(error) - 1] == '\n') {
+            error[strlen(error) - 1] = 0;
+        }
+
+        return -1;
+    }
+
+    if(!json_object_is_type(root, json_type_object) || !json_object_object_get_ex(root, "jobs", &array) || !json_object_is_type(array, json_type_array) ||
+       !(count = json_object_array_length(array))) {
+        snprintf(error, error_size, "the file must contain an object with a non-empty \"jobs\" array");
+        json_object_put(root);
+        return -1;
+    }
+
+    if(!(list = calloc(count, sizeof(workload_job_type)))) {
+        snprintf(error, error_size, "%s", strerror(errno));
+        json_object_put(root);
+        return -1;
+    }
+
+    for(i = 0; i < count; i++) {
+        if(parse_workload_job(json_object_array_get_idx(array, i), &list[i], i, error, error_size)) {
+            free_workload_jobs(list, count);
+            json_object_put(root);
+            return -1;
+        }
+    }
+
+    json_object_put(root);
+
+    *jobs = list;
+    *num_jobs = count;
+
+    return 0;
+}
+
+void free_workload_jobs(workload_job_type *jobs, int num_jobs) {
+    int i;
+
+    for(i = 0; i < num_jobs; i++) {
+        if(jobs[i].name) {
+            free(jobs[i].name);
+        }
+    }
+
+    free(jobs);
+}
+
+/**
+ * Displays a dialog to the user indicating that a workload job encountered an
+ * I/O error, and logs the error.  This function blocks until the user
+ * dismisses the dialog.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param write                   Non-zero if the failed request was a write.
+ * @param errnum                  The error number of the error that occurred.
+ */
+static void io_error_during_workload_job(device_testing_context_type *device_testing_context, char write, int errnum) {
+    log_log(device_testing_context, "run_workload_jobs", SEVERITY_LEVEL_DEBUG, write ? MSG_WRITE_ERROR : MSG_READ_ERROR, strerror(errnum));
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_ABORTING_WORKLOAD_JOBS_DEVICE_ERROR);
+
+    message_window(device_testing_context, stdscr, WARNING_TITLE,
+                   "We ran into an error while running the workload jobs.  It "
+                   "could be that the device was removed, experienced an error "
+                   "and disconnected itself, or set itself to read-only.  If "
+                   "the device really has been removed or set to read-only, "
+                   "the remainder of the tests are going to fail pretty "
+                   "quickly.", 1);
+}
+
+/**
+ * Issues requests for a workload job, one at a time, until told to stop (or
+ * until the job's byte limit is reached).  Running several of these at once
+ * keeps that many requests in flight.
+ *
+ * The workers call pread()/pwrite() directly instead of going through the I/O
+ * watchdog, since the watchdog only keeps track of one request at a time.
+ * execute_workload_job() keeps an eye on them instead.
+ *
+ * @param arg  A pointer to the worker's workload_worker_type.
+ */
+static void *workload_worker_main(void *arg) {
+    workload_worker_type *worker = arg;
+    workload_job_type *job = worker->job;
+    struct timespec start_time, end_time;
+    uint64_t size, offset;
+    unsigned int pick, burst, idle;
+    ssize_t ret;
+    char write;
+    int i;
+
+    for(burst = 0; !__atomic_load_n(worker->stop, __ATOMIC_RELAXED);) {
+        // Pick a request size in proportion to the weights
+        pick = rand_r(&worker->seed) % job->total_weight;
+        for(i = 0; pick >= job->block_sizes[i].weight; i++) {
+            pick -= job->block_sizes[i].weight;
+        }
+
+        size = job->block_sizes[i].size;
+        write = (rand_r(&worker->seed) % 100) >= job->read_percent;
+
+        if(job->byte_limit && __atomic_fetch_add(worker->bytes_issued, size, __ATOMIC_RELAXED) >= job->byte_limit) {
+            __atomic_store_n(worker->stop, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        if(job->pattern == WORKLOAD_PATTERN_SEQUENTIAL) {
+            // Wrap back around to the start of the region when we run off the
+            // end of it
+            offset = __atomic_fetch_add(worker->next_offset, size, __ATOMIC_RELAXED) % worker->region_size;
+            if((offset + size) > worker->region_size) {
+                offset = 0;
+            }
+        } else {
+            offset = (((((uint64_t) rand_r(&worker->seed)) << 31) | rand_r(&worker->seed)) % (worker->region_size / size)) * size;
+        }
+
+        offset += worker->region_start;
+
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+        if(write) {
+            ret = pwrite(worker->device_testing_context->device_info.fd, worker->buf, size, offset);
+        } else {
+            ret = pread(worker->device_testing_context->device_info.fd, worker->buf, size, offset);
+        }
+
+        if(ret != size) {
+            worker->error = ret == -1 ? errno : EIO;
+            worker->error_was_write = write;
+            __atomic_store_n(worker->stop, 1, __ATOMIC_RELAXED);
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &end_time);
+        latency_histogram_add(write ? &worker->write_histogram : &worker->read_histogram,
+                              ((end_time.tv_sec - start_time.tv_sec) * 1000000) + ((end_time.tv_nsec - start_time.tv_nsec) / 1000));
+        __atomic_add_fetch(&worker->bytes_completed, size, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&worker->completed, 1, __ATOMIC_RELAXED);
+
+        if(job->burst_requests && ++burst == job->burst_requests) {
+            // Sit idle in short naps, so that we don't hold things up for
+            // long if we're told to stop in the meantime
+            burst = 0;
+            for(idle = 0; idle < job->burst_idle && !__atomic_load_n(worker->stop, __ATOMIC_RELAXED); idle += WORKLOAD_IDLE_SLICE) {
+                usleep(((job->burst_idle - idle) < WORKLOAD_IDLE_SLICE ? (job->burst_idle - idle) : WORKLOAD_IDLE_SLICE) * 1000);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+int execute_workload_job(device_testing_context_type *device_testing_context, workload_job_type *job, uint64_t region_start, uint64_t region_size,
+                         uint64_t max_block_size, WINDOW *window, char show_progress, workload_result_type *result) {
+    workload_worker_type *workers;
+    pthread_t threads[WORKLOAD_MAX_QUEUE_DEPTH];
+    struct timespec start_time, last_progress_time, second_start_time, now;
+    char *bufs;
+    uint64_t next_offset, bytes_issued, completed, prev_completed, bytes, second_start_bytes, elapsed, second_elapsed;
+    double second_rate;
+    int i, num_started, stop, ret, local_errno, prev_percent, cur_percent;
+
+    memset(result, 0, sizeof(workload_result_type));
+    latency_histogram_reset(&result->read_histogram);
+    latency_histogram_reset(&result->write_histogram);
+
+    if(!(workers = calloc(job->queue_depth, sizeof(workload_worker_type)))) {
+        local_errno = errno;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_MALLOC_ERROR, strerror(local_errno));
+        result->failure = WORKLOAD_FAILURE_MEMORY;
+
+        errno = local_errno;
+        return -1;
+    }
+
+    if(!(bufs = buffer_pool_get(device_testing_context, max_block_size * job->queue_depth))) {
+        local_errno = errno;
+        log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_BUFFER_POOL_GET_ERROR, max_block_size * job->queue_depth, strerror(local_errno));
+        free(workers);
+        result->failure = WORKLOAD_FAILURE_MEMORY;
+
+        errno = local_errno;
+        return -1;
+    }
+
+    rng_fill_buffer(device_testing_context, bufs, max_block_size * job->queue_depth);
+
+    stop = 0;
+    next_offset = 0;
+    bytes_issued = 0;
+
+    for(i = 0; i < job->queue_depth; i++) {
+        workers[i].device_testing_context = device_testing_context;
+        workers[i].job = job;
+        workers[i].buf = bufs + (i * max_block_size);
+        workers[i].seed = rng_get_random_number(device_testing_context);
+        workers[i].stop = &stop;
+        workers[i].region_start = region_start;
+        workers[i].region_size = region_size;
+        workers[i].next_offset = &next_offset;
+        workers[i].bytes_issued = &bytes_issued;
+        latency_histogram_reset(&workers[i].read_histogram);
+        latency_histogram_reset(&workers[i].write_histogram);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    last_progress_time = second_start_time = start_time;
+    prev_completed = second_start_bytes = 0;
+    result->slowest_second = -1;
+    prev_percent = 0;
+    local_errno = 0;
+
+    for(num_started = 0; num_started < job->queue_depth; num_started++) {
+        if(ret = pthread_create(&threads[num_started], NULL, &workload_worker_main, &workers[num_started])) {
+            local_errno = ret;
+            result->failure = WORKLOAD_FAILURE_THREAD;
+            __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    while(!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+        usleep(100000);
+        handle_key_inputs(device_testing_context, window);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        for(i = 0, completed = 0, bytes = 0; i < job->queue_depth; i++) {
+            completed += __atomic_load_n(&workers[i].completed, __ATOMIC_RELAXED);
+            bytes += __atomic_load_n(&workers[i].bytes_completed, __ATOMIC_RELAXED);
+        }
+
+        elapsed = ((now.tv_sec - start_time.tv_sec) * 1000000) + ((now.tv_nsec - start_time.tv_nsec) / 1000);
+
+        // Keep track of the slowest one-second stretch, the same way the
+        // speed tests do
+        second_elapsed = ((now.tv_sec - second_start_time.tv_sec) * 1000000) + ((now.tv_nsec - second_start_time.tv_nsec) / 1000);
+        if(second_elapsed >= 1000000) {
+            second_rate = ((double) (bytes - second_start_bytes)) / (((double) second_elapsed) / 1000000.0);
+            if(result->slowest_second < 0 || second_rate < result->slowest_second) {
+                result->slowest_second = second_rate;
+            }
+
+            second_start_time = now;
+            second_start_bytes = bytes;
+        }
+
+        if(completed != prev_completed) {
+            prev_completed = completed;
+            last_progress_time = now;
+        } else if(program_options.io_timeout > 0 && (now.tv_sec - last_progress_time.tv_sec) >= (program_options.io_timeout + (job->burst_idle / 1000))) {
+            // Nothing's moving -- reset the device so that the kernel fails
+            // whatever's stuck, and give up
+            local_errno = ETIMEDOUT;
+            result->failure = WORKLOAD_FAILURE_STALLED;
+            __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+            kick_device(device_testing_context->device_info.device_num);
+            break;
+        }
+
+        if(job->duration && elapsed >= (job->duration * 1000000)) {
+            __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+        }
+
+        if(!show_progress) {
+            continue;
+        }
+
+        // Show whichever limit we're closer to
+        cur_percent = job->duration ? (elapsed * 40) / (job->duration * 1000000) : 0;
+        if(job->byte_limit && ((bytes * 40) / job->byte_limit) > cur_percent) {
+            cur_percent = (bytes * 40) / job->byte_limit;
+        }
+
+        if(cur_percent > 40) {
+            cur_percent = 40;
+        }
+
+        if(cur_percent != prev_percent) {
+            // Advance the graph
+            if(!program_options.no_curses) {
+                wattron(window, COLOR_PAIR(BLACK_ON_GREEN));
+                mvwprintw(window, 2, 2, "%*s", cur_percent, "");
+                wattroff(window, COLOR_PAIR(BLACK_ON_GREEN));
+                touchwin(stdscr);
+                wrefresh(window);
+            }
+
+            prev_percent = cur_percent;
+        }
+    }
+
+    for(i = 0; i < num_started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for(i = 0; i < job->queue_depth; i++) {
+        if(workers[i].error && !local_errno) {
+            local_errno = workers[i].error;
+            result->failure = WORKLOAD_FAILURE_IO;
+            result->error_was_write = workers[i].error_was_write;
+        }
+
+        latency_histogram_merge(&result->read_histogram, &workers[i].read_histogram);
+        latency_histogram_merge(&result->write_histogram, &workers[i].write_histogram);
+        result->bytes += workers[i].bytes_completed;
+    }
+
+    buffer_pool_put(device_testing_context, bufs);
+    free(workers);
+
+    result->secs = ((double) (((now.tv_sec - start_time.tv_sec) * 1000000) + ((now.tv_nsec - start_time.tv_nsec) / 1000))) / 1000000.0;
+
+    // Jobs that finish in under a second don't have a slowest second
+    if(result->slowest_second < 0) {
+        result->slowest_second = ((double) result->bytes) / result->secs;
+    }
+
+    if(local_errno) {
+        errno = local_errno;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Runs a single workload job and logs the results.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param job                     The job to run.
+ * @param region_start            The start of the job's region, in bytes.
+ * @param region_size             The size of the job's region, in bytes.
+ * @param max_block_size          The largest of the job's block sizes.
+ *
+ * @returns 0 if the job completed successfully, or -1 if an error occurred.
+ *          On error, the error has already been logged and reported to the
+ *          user, and errno is set to the underlying error.
+ */
+static int run_workload_job(device_testing_context_type *device_testing_context, workload_job_type *job, uint64_t region_start, uint64_t region_size,
+                            uint64_t max_block_size) {
+    workload_result_type result;
+    char rate[15], slowest_rate[15], label[128];
+    int local_errno;
+    WINDOW *window;
+
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_WORKLOAD_JOB_STARTING, job->name, job->read_percent,
+            job->pattern == WORKLOAD_PATTERN_SEQUENTIAL ? "sequential" : "random", job->queue_depth);
+    window = message_window(device_testing_context, stdscr, "Running workload job",
+        "\n                                        ", // Make room for the progress bar
+    0);
+
+    local_errno = execute_workload_job(device_testing_context, job, region_start, region_size, max_block_size, window, 1, &result) ? errno : 0;
+    erase_and_delete_window(window);
+
+    switch(result.failure) {
+        case WORKLOAD_FAILURE_NONE:
+            break;
+
+        case WORKLOAD_FAILURE_MEMORY:
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_ABORTING_WORKLOAD_JOBS_MEM_ALLOC_ERROR);
+
+            message_window(device_testing_context, stdscr, WARNING_TITLE,
+                           "We ran into an error while trying to allocate memory "
+                           "for the workload jobs.  This could mean your system is "
+                           "low on memory.", 1);
+            break;
+
+        case WORKLOAD_FAILURE_THREAD:
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WORKLOAD_JOB_THREAD_ERROR, job->name, strerror(local_errno));
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_ABORTING_WORKLOAD_JOBS_DEVICE_ERROR);
+            break;
+
+        case WORKLOAD_FAILURE_STALLED:
+            log_log(device_testing_context, __func__, SEVERITY_LEVEL_DEBUG, MSG_WORKLOAD_JOB_STALLED, program_options.io_timeout, job->name);
+            io_error_during_workload_job(device_testing_context, result.error_was_write, local_errno);
+            break;
+
+        case WORKLOAD_FAILURE_IO:
+            io_error_during_workload_job(device_testing_context, result.error_was_write, local_errno);
+            break;
+    }
+
+    if(local_errno) {
+        errno = local_errno;
+        return -1;
+    }
+
+    log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_WORKLOAD_JOB_RESULT, job->name, format_rate(((double) result.bytes) / result.secs, rate, sizeof(rate)),
+            ((double) (result.read_histogram.num_samples + result.write_histogram.num_samples)) / result.secs, result.secs,
+            format_rate(result.slowest_second, slowest_rate, sizeof(slowest_rate)));
+
+    if(result.read_histogram.num_samples) {
+        snprintf(label, sizeof(label), "%s (reads)", job->name);
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_LATENCY_RESULTS, label, latency_histogram_percentile(&result.read_histogram, 50),
+                latency_histogram_percentile(&result.read_histogram, 99), latency_histogram_percentile(&result.read_histogram, 99.9));
+    }
+
+    if(result.write_histogram.num_samples) {
+        snprintf(label, sizeof(label), "%s (writes)", job->name);
+        log_log(device_testing_context, NULL, SEVERITY_LEVEL_INFO, MSG_SPEED_TEST_LATENCY_RESULTS, label, latency_histogram_percentile(&result.write_histogram, 50),
+                latency_histogram_percentile(&result.write_histogram, 99), latency_histogram_percentile(&result.write_histogram, 99.9));
+    }
+
+    return 0;
+}
+
+int run_workload_jobs(device_testing_context_type *device_testing_context, workload_job_type *jobs, int num_jobs) {
+    struct timeval cur_time;
+    uint64_t device_size, region_start, region_end, max_block_size;
+    int i, j;
+
+    device_size = device_testing_context->device_info.num_physical_sectors * device_testing_context->device_info.sector_size;
+
+    assert(!gettimeofday(&cur_time, NULL));
+    rng_init(device_testing_context, cur_time.tv_sec + cur_time.tv_usec);
+
+    for(i = 0; i < num_jobs; i++) {
+        for(j = 0, max_block_size = 0; j < jobs[i].num_block_sizes; j++) {
+            if(jobs[i].block_sizes[j].size % device_testing_context->device_info.sector_size) {
+                break;
+            }
+
+            if(jobs[i].block_sizes[j].size > max_block_size) {
+                max_block_size = jobs[i].block_sizes[j].size;
+            }
+        }
+
+        if(j < jobs[i].num_block_sizes) {
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_WORKLOAD_JOB_BAD_BLOCK_SIZE, jobs[i].name, jobs[i].block_sizes[j].size);
+            continue;
+        }
+
+        // Keep the region on sector boundaries
+        region_start = (((device_size * jobs[i].region_start) / 100) / device_testing_context->device_info.sector_size) * device_testing_context->device_info.sector_size;
+        region_end = (((device_size * jobs[i].region_end) / 100) / device_testing_context->device_info.sector_size) * device_testing_context->device_info.sector_size;
+
+        if((region_end - region_start) < max_block_size) {
+            log_log(device_testing_context, NULL, SEVERITY_LEVEL_WARNING, MSG_WORKLOAD_JOB_REGION_TOO_SMALL, jobs[i].name);
+            continue;
+        }
+
+        if(run_workload_job(device_testing_context, &jobs[i], region_start, region_end - region_start, max_block_size)) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+#if !defined(WORKLOAD_H)
+#define WORKLOAD_H
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#include "device_testing_context.h"
+#include "latency_histogram.h"
+#include "ncurses.h"
+
+// Maximum number of different block sizes a single job can mix together
+#define WORKLOAD_MAX_BLOCK_SIZES 8
+
+// Maximum number of requests a job can keep in flight at once
+#define WORKLOAD_MAX_QUEUE_DEPTH 64
+
+// How long a job runs for if the job file gives neither a duration nor a byte
+// limit, in seconds
+#define WORKLOAD_DEFAULT_DURATION 30
+
+typedef enum {
+    WORKLOAD_PATTERN_RANDOM,
+    WORKLOAD_PATTERN_SEQUENTIAL
+} workload_pattern_type;
+
+typedef struct _workload_block_size_type {
+    uint64_t size;                      // Size of the request, in bytes
+    unsigned int weight;                // How often this size is picked,
+                                        // relative to the other sizes
+} workload_block_size_type;
+
+typedef struct _workload_job_type {
+    char *name;
+    workload_pattern_type pattern;
+    unsigned int read_percent;          // Percentage of requests that are
+                                        // reads; the rest are writes
+    workload_block_size_type block_sizes[WORKLOAD_MAX_BLOCK_SIZES];
+    int num_block_sizes;
+    unsigned int total_weight;          // Sum of the block sizes' weights
+    int queue_depth;
+    unsigned int region_start;          // Start of the region to test, as a
+                                        // percentage of the device
+    unsigned int region_end;            // End of the region to test, as a
+                                        // percentage of the device
+    uint64_t duration;                  // Maximum run time, in seconds, or 0
+                                        // for no limit
+    uint64_t byte_limit;                // Maximum number of bytes to transfer,
+                                        // or 0 for no limit
+    unsigned int burst_requests;        // Number of requests each worker
+                                        // issues before going idle, or 0 to
+                                        // never go idle
+    unsigned int burst_idle;            // How long each worker stays idle
+                                        // between bursts, in milliseconds
+} workload_job_type;
+
+typedef enum {
+    WORKLOAD_FAILURE_NONE,
+    WORKLOAD_FAILURE_MEMORY,            // Couldn't allocate the workers or
+                                        // their buffers
+    WORKLOAD_FAILURE_THREAD,            // Couldn't start one of the workers
+    WORKLOAD_FAILURE_STALLED,           // No requests completed for
+                                        // --io-timeout seconds
+    WORKLOAD_FAILURE_IO                 // A request failed
+} workload_failure_type;
+
+typedef struct _workload_result_type {
+    latency_histogram_type read_histogram;
+    latency_histogram_type write_histogram;
+    uint64_t bytes;                     // Bytes transferred
+    double secs;                        // How long the job ran for, in seconds
+    double slowest_second;              // Slowest one-second stretch, in bytes
+                                        // per second
+    char error_was_write;               // Was the failed request a write?
+    workload_failure_type failure;      // Why the job stopped early, if it did
+} workload_result_type;
+
+/**
+ * Loads a list of jobs from a workload file.  The file is a JSON object with a
+ * "jobs" array; each job is an object that can contain the following keys:
+ *
+ * - "name": A name for the job, used when logging the results.  Required.
+ * - "block_size": The size of every request, in bytes.
+ * - "block_sizes": An array of {"size": bytes, "weight": n} objects, for jobs
+ *   that mix several request sizes.  Each request picks a size at random, in
+ *   proportion to the weights.  Either "block_size" or "block_sizes" is
+ *   required.
+ * - "read_percent": The percentage of requests that are reads (default: 100).
+ * - "queue_depth": The number of requests kept in flight (default: 1).
+ * - "pattern": "random" or "sequential" (default: "random").
+ * - "region_start" and "region_end": The part of the device to test, as
+ *   percentages of the device's size (default: 0 and 100).
+ * - "duration": The maximum number of seconds to run the job for.
+ * - "bytes": The maximum number of bytes to transfer.
+ * - "burst_requests" and "burst_idle": If given, each in-flight request slot
+ *   issues "burst_requests" requests and then sits idle for "burst_idle"
+ *   milliseconds, to mimic bursty workloads like logging.
+ *
+ * A job stops when it reaches its duration or byte limit, whichever comes
+ * first.  If neither is given, the job runs for WORKLOAD_DEFAULT_DURATION
+ * seconds.
+ *
+ * @param filename    The name of the file to load.
+ * @param jobs        A pointer to a variable that receives the list of jobs.
+ *                    The list should be freed with free_workload_jobs().
+ * @param num_jobs    A pointer to a variable that receives the number of jobs
+ *                    in the list.
+ * @param error       A buffer that receives a description of the problem if
+ *                    the file can't be loaded.
+ * @param error_size  The size of `error`, in bytes.
+ *
+ * @returns 0 if the file was loaded successfully, or -1 if it could not be
+ *          loaded.
+ */
+int load_workload_file(const char *filename, workload_job_type **jobs, int *num_jobs, char *error, size_t error_size);
+
+/**
+ * Frees a list of jobs loaded by load_workload_file().
+ *
+ * @param jobs      The list of jobs to free.
+ * @param num_jobs  The number of jobs in the list.
+ */
+void free_workload_jobs(workload_job_type *jobs, int num_jobs);
+
+/**
+ * Runs a single job against the given region of the device, without logging
+ * the results or reporting errors to the user -- that's left to the caller.
+ * Each in-flight request gets a thread of its own; this thread keeps an eye on
+ * them, keeps the display responsive, and stops the job once it reaches its
+ * duration or byte limit.  If no requests complete for --io-timeout seconds,
+ * the device is reset to knock the stuck requests loose and the job is
+ * abandoned.
+ *
+ * The job's region_start and region_end are ignored in favor of
+ * `region_start` and `region_size`.
+ *
+ * @param device_testing_context  The device being tested.
+ * @param job                     The job to run.
+ * @param region_start            The start of the region to test, in bytes.
+ * @param region_size             The size of the region to test, in bytes.
+ * @param max_block_size          The largest of the job's block sizes.
+ * @param window                  The window being displayed to the user.
+ * @param show_progress           Non-zero to draw a progress bar on the third
+ *                                line of `window`.
+ * @param result                  A pointer to a structure that receives the
+ *                                results of the job.  If the job fails,
+ *                                `result->failure` says why.
+ *
+ * @returns 0 if the job completed successfully, or -1 if an error occurred.
+ *          On error, errno is set to the underlying error.
+ */
+int execute_workload_job(device_testing_context_type *device_testing_context, workload_job_type *job, uint64_t region_start, uint64_t region_size,
+                         uint64_t max_block_size, WINDOW *window, char show_progress, workload_result_type *result);
+
+/**
+ * Runs each of the given jobs against the device, one after another, and logs
+ * the throughput and request latency of each.  Jobs that don't fit the device
+ * (for example, jobs with block sizes that aren't a multiple of the device's
+ * sector size) are skipped.
+ *
+ * Each in-flight request gets a thread of its own, the same way the queue
+ * depth sweep works.  If no requests complete for --io-timeout seconds, the
+ * device is reset to knock the stuck requests loose and the remaining jobs are
+ * abandoned.
+ *
+ * The caller is expected to hold the lockfile.
+ *
+ * @param device_testing_context  The device to be tested.
+ * @param jobs                    The jobs to run.
+ * @param num_jobs                The number of jobs in `jobs`.
+ *
+ * @returns 0 if all of the jobs ran (or were skipped), or -1 if an error
+ *          occurred.  On error, errno is set to the underlying error.
+ */
+int run_workload_jobs(device_testing_context_type *device_testing_context, workload_job_type *jobs, int num_jobs);
+
+#endif // !defined(WORKLOAD_H)